@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+struct arena_block {
+    arena_block_t* next;
+    size_t used;
+    size_t cap;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+void arena_init(arena_t* arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+}
+
+static arena_block_t* new_block(size_t cap) {
+    if (cap > SIZE_MAX - sizeof(arena_block_t)) return NULL;
+    arena_block_t* block = (arena_block_t*)malloc(sizeof(arena_block_t) + cap);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->used = 0;
+    block->cap = cap;
+    return block;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    if (size > SIZE_MAX - ARENA_ALIGN) return NULL;
+    size = align_up(size ? size : 1);
+    arena_block_t* block = arena->head;
+    if (!block || block->cap - block->used < size) {
+        block = new_block(size > arena->block_size ? size : arena->block_size);
+        if (!block) return NULL;
+        // Oversized one-off blocks go behind the current head so the
+        // head's remaining space is still used by later small requests.
+        if (arena->head && size > arena->block_size) {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        } else {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+char* arena_strndup(arena_t* arena, const char* src, size_t len) {
+    char* dst = (char*)arena_alloc(arena, len + 1);
+    if (!dst) return NULL;
+    if (len) memcpy(dst, src, len);
+    dst[len] = '\0';
+    return dst;
+}
+
+void arena_free(arena_t* arena) {
+    arena_block_t* block = arena->head;
+    while (block) {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+void arena_reset(arena_t* arena) {
+    arena_block_t* head = arena->head;
+    if (!head) return;
+    if (!head->next) {
+        head->used = 0;
+        return;
+    }
+    size_t cap = 0;
+    for (arena_block_t* block = head; block; block = block->next) {
+        cap = cap > SIZE_MAX - block->cap ? SIZE_MAX : cap + block->cap;
+    }
+    arena_free(arena);
+    // On failure the arena is just empty; the next alloc starts over.
+    arena->head = new_block(cap);
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump-pointer allocator. Everything allocated from an arena is released
+// together by arena_free or arena_reset; there is no per-allocation free.
+
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+
+typedef struct arena_block arena_block_t;
+
+typedef struct {
+    arena_block_t* head;
+    size_t block_size;
+} arena_t;
+
+void arena_init(arena_t* arena, size_t block_size);
+
+// Returns max_align_t-aligned storage, or NULL when out of memory.
+void* arena_alloc(arena_t* arena, size_t size);
+
+// Copies len bytes into the arena and NUL-terminates them.
+char* arena_strndup(arena_t* arena, const char* src, size_t len);
+
+void arena_free(arena_t* arena);
+
+// Releases everything allocated but keeps the memory for reuse. An arena
+// that spilled into several blocks is merged into one as big as all of
+// them, so that work of the same size fits in a single block next time
+// and resetting after it is O(1).
+void arena_reset(arena_t* arena);
+
+#endif
@@ -0,0 +1,943 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "batch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_HAVE_X86 1
+#endif
+
+#define BATCH_NAMES_BLOCK 4096
+#define LOOKUP_EMPTY UINT32_MAX
+
+// Lane arrays are NULL when the operand is a scalar broadcast (xk / yk).
+// Comparison kernels write one bit per lane; OP_TRUTH tests x != 0 and
+// not NaN, matching value_truthy.
+typedef void (*cmp_kernel_fn)(opcode_t op, const double* x, double xk,
+                              const double* y, double yk, size_t n, uint64_t* out);
+typedef void (*arith_kernel_fn)(opcode_t op, const double* x, double xk,
+                                const double* y, double yk, size_t n, double* out);
+
+struct batch_kernels {
+    const char* name;
+    cmp_kernel_fn cmp;
+    arith_kernel_fn arith;
+};
+
+// One VM register across every lane of the batch.
+typedef enum {
+    VR_CONST,                   // the same value in every lane
+    VR_NUM,                     // a number in every lane
+    VR_MASK,                    // a bool in every lane, one bit each
+    VR_VALUES                   // anything else
+} vreg_kind_t;
+
+typedef struct {
+    vreg_kind_t kind;
+    value_t k;
+    const double* num;
+    const uint64_t* mask;
+    const value_t* vals;
+} vreg_t;
+
+static inline size_t words_for(size_t n) {
+    return (n + 63) / 64;
+}
+
+// ---------------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------------
+
+#define LANE(p, k, i) ((p) ? (p)[i] : (k))
+
+#define SCALAR_CMP_LOOP(from, test)                                       \
+    for (size_t i = (from); i < n; i++) {                                 \
+        double a = LANE(x, xk, i);                                        \
+        double b = LANE(y, yk, i);                                        \
+        if (test) out[i >> 6] |= (uint64_t)1 << (i & 63);                 \
+    }
+
+#define SCALAR_ARITH_LOOP(from, expr)                                     \
+    for (size_t i = (from); i < n; i++) {                                 \
+        double a = LANE(x, xk, i);                                        \
+        double b = LANE(y, yk, i);                                        \
+        out[i] = (expr);                                                  \
+    }
+
+static void cmp_tail(opcode_t op, const double* x, double xk, const double* y, double yk,
+                     size_t from, size_t n, uint64_t* out) {
+    switch (op) {
+        case OP_LT: SCALAR_CMP_LOOP(from, a < b) break;
+        case OP_LE: SCALAR_CMP_LOOP(from, a <= b) break;
+        case OP_GT: SCALAR_CMP_LOOP(from, a > b) break;
+        case OP_GE: SCALAR_CMP_LOOP(from, a >= b) break;
+        case OP_EQ: SCALAR_CMP_LOOP(from, a == b) break;
+        case OP_NE: SCALAR_CMP_LOOP(from, a != b) break;
+        case OP_TRUTH: SCALAR_CMP_LOOP(from, a != b && a == a) break;
+        default: break;
+    }
+}
+
+static void arith_tail(opcode_t op, const double* x, double xk, const double* y, double yk,
+                       size_t from, size_t n, double* out) {
+    switch (op) {
+        case OP_ADD: SCALAR_ARITH_LOOP(from, a + b) break;
+        case OP_SUB: SCALAR_ARITH_LOOP(from, a - b) break;
+        case OP_MUL: SCALAR_ARITH_LOOP(from, a * b) break;
+        case OP_DIV: SCALAR_ARITH_LOOP(from, a / b) break;
+        case OP_MOD: SCALAR_ARITH_LOOP(from, fmod(a, b)) break;
+        default: break;
+    }
+}
+
+static void cmp_scalar(opcode_t op, const double* x, double xk, const double* y, double yk,
+                       size_t n, uint64_t* out) {
+    memset(out, 0, words_for(n) * sizeof(uint64_t));
+    cmp_tail(op, x, xk, y, yk, 0, n, out);
+}
+
+static void arith_scalar(opcode_t op, const double* x, double xk, const double* y, double yk,
+                         size_t n, double* out) {
+    arith_tail(op, x, xk, y, yk, 0, n, out);
+}
+
+static const batch_kernels_t kernels_scalar = { "scalar", cmp_scalar, arith_scalar };
+
+#ifdef BATCH_HAVE_X86
+#define AVX2_LOAD(p, v, i) ((p) ? _mm256_loadu_pd((p) + (i)) : (v))
+
+#define AVX2_CMP_LOOP(pred)                                               \
+    for (; i + 4 <= n; i += 4) {                                          \
+        __m256d c = _mm256_cmp_pd(AVX2_LOAD(x, vx, i), AVX2_LOAD(y, vy, i), pred); \
+        out[i >> 6] |= (uint64_t)(unsigned)_mm256_movemask_pd(c) << (i & 63); \
+    }
+
+#define AVX2_ARITH_LOOP(intrinsic)                                        \
+    for (; i + 4 <= n; i += 4) {                                          \
+        _mm256_storeu_pd(out + i, intrinsic(AVX2_LOAD(x, vx, i), AVX2_LOAD(y, vy, i))); \
+    }
+
+__attribute__((target("avx2")))
+static void cmp_avx2(opcode_t op, const double* x, double xk, const double* y, double yk,
+                     size_t n, uint64_t* out) {
+    const __m256d vx = _mm256_set1_pd(xk);
+    const __m256d vy = _mm256_set1_pd(yk);
+    size_t i = 0;
+    memset(out, 0, words_for(n) * sizeof(uint64_t));
+    switch (op) {
+        case OP_LT: AVX2_CMP_LOOP(_CMP_LT_OQ) break;
+        case OP_LE: AVX2_CMP_LOOP(_CMP_LE_OQ) break;
+        case OP_GT: AVX2_CMP_LOOP(_CMP_GT_OQ) break;
+        case OP_GE: AVX2_CMP_LOOP(_CMP_GE_OQ) break;
+        case OP_EQ: AVX2_CMP_LOOP(_CMP_EQ_OQ) break;
+        case OP_NE: AVX2_CMP_LOOP(_CMP_NEQ_UQ) break;
+        case OP_TRUTH: AVX2_CMP_LOOP(_CMP_NEQ_OQ) break;
+        default: break;
+    }
+    cmp_tail(op, x, xk, y, yk, i, n, out);
+}
+
+__attribute__((target("avx2")))
+static void arith_avx2(opcode_t op, const double* x, double xk, const double* y, double yk,
+                       size_t n, double* out) {
+    const __m256d vx = _mm256_set1_pd(xk);
+    const __m256d vy = _mm256_set1_pd(yk);
+    size_t i = 0;
+    switch (op) {
+        case OP_ADD: AVX2_ARITH_LOOP(_mm256_add_pd) break;
+        case OP_SUB: AVX2_ARITH_LOOP(_mm256_sub_pd) break;
+        case OP_MUL: AVX2_ARITH_LOOP(_mm256_mul_pd) break;
+        case OP_DIV: AVX2_ARITH_LOOP(_mm256_div_pd) break;
+        default: break;
+    }
+    arith_tail(op, x, xk, y, yk, i, n, out);
+}
+
+static const batch_kernels_t kernels_avx2 = { "avx2", cmp_avx2, arith_avx2 };
+#endif
+
+static const batch_kernels_t* select_kernels(void) {
+#ifdef BATCH_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) return &kernels_avx2;
+#endif
+    return &kernels_scalar;
+}
+
+const char* batch_kernel_name(void) {
+    return select_kernels()->name;
+}
+
+// ---------------------------------------------------------------------------
+// Columns
+// ---------------------------------------------------------------------------
+
+static uint32_t name_hash(str_t s) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.len; i++) {
+        h ^= (uint8_t)s.ptr[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t* find_slot(const batch_engine_t* b, str_t name) {
+    size_t i = name_hash(name) & b->lookup_mask;
+    for (;;) {
+        uint32_t* slot = &b->lookup[i];
+        if (*slot == LOOKUP_EMPTY || str_eq(b->columns[*slot].name, name)) return slot;
+        i = (i + 1) & b->lookup_mask;
+    }
+}
+
+static error_t grow_lookup(batch_engine_t* b) {
+    size_t slots = (b->lookup_mask + 1) * 2;
+    uint32_t* lookup = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    if (!lookup) return ERR_MALLOC_FAILED;
+    memset(lookup, 0xFF, slots * sizeof(uint32_t));
+    free(b->lookup);
+    b->lookup = lookup;
+    b->lookup_mask = slots - 1;
+    for (size_t c = 0; c < b->ncolumns; c++) *find_slot(b, b->columns[c].name) = (uint32_t)c;
+    return ERR_OK;
+}
+
+static error_t add_column(batch_engine_t* b, str_t name, uint32_t* out) {
+    if (b->ncolumns == b->columns_cap) {
+        size_t cap = b->columns_cap ? b->columns_cap * 2 : 16;
+        batch_column_t* columns = (batch_column_t*)realloc(b->columns, cap * sizeof(batch_column_t));
+        if (!columns) return ERR_MALLOC_FAILED;
+        b->columns = columns;
+        field_t* fields = (field_t*)realloc(b->lane_fields, cap * sizeof(field_t));
+        if (!fields) return ERR_MALLOC_FAILED;
+        b->lane_fields = fields;
+        b->columns_cap = cap;
+    }
+    if ((b->ncolumns + 1) * 2 > b->lookup_mask + 1) {
+        error_t err = grow_lookup(b);
+        if (err != ERR_OK) return err;
+    }
+
+    batch_column_t* col = &b->columns[b->ncolumns];
+    char* copy = arena_strndup(&b->names, name.ptr, name.len);
+    col->tag = (uint8_t*)malloc(BATCH_LANES);
+    col->num = (double*)malloc(BATCH_LANES * sizeof(double));
+    col->str = (str_t*)malloc(BATCH_LANES * sizeof(str_t));
+    if (!copy || !col->tag || !col->num || !col->str) {
+        free(col->tag);
+        free(col->num);
+        free(col->str);
+        return ERR_MALLOC_FAILED;
+    }
+    col->name = (str_t){ copy, name.len };
+    memset(col->tag, BATCH_ABSENT, BATCH_LANES);
+
+    *find_slot(b, col->name) = (uint32_t)b->ncolumns;
+    *out = (uint32_t)b->ncolumns++;
+    return ERR_OK;
+}
+
+static error_t column_for(batch_engine_t* b, str_t name, uint32_t* out) {
+    uint32_t* slot = find_slot(b, name);
+    if (*slot != LOOKUP_EMPTY) {
+        *out = *slot;
+        return ERR_OK;
+    }
+    return add_column(b, name, out);
+}
+
+static inline void set_lane(batch_column_t* col, size_t i, value_t v) {
+    col->tag[i] = (uint8_t)v.type;
+    switch (v.type) {
+        case VAL_NULL: break;
+        case VAL_BOOL: col->num[i] = v.as.b ? 1.0 : 0.0; break;
+        case VAL_NUM: col->num[i] = v.as.num; break;
+        case VAL_STR:
+        case VAL_RAW: col->str[i] = v.as.str; break;
+    }
+}
+
+static inline value_t column_value(const batch_column_t* col, size_t i) {
+    value_t v = value_null();
+    switch (col->tag[i]) {
+        case VAL_BOOL: v = value_bool(col->num[i] != 0.0); break;
+        case VAL_NUM: v = value_num(col->num[i]); break;
+        case VAL_STR:
+        case VAL_RAW:
+            v.type = (value_type_t)col->tag[i];
+            v.as.str = col->str[i];
+            break;
+        default: break;
+    }
+    return v;
+}
+
+// Collects the fields present in one lane, for serialization.
+static size_t lane_fields(batch_engine_t* b, size_t lane) {
+    size_t n = 0;
+    for (size_t c = 0; c < b->ncolumns; c++) {
+        const batch_column_t* col = &b->columns[c];
+        if (col->tag[lane] == BATCH_ABSENT) continue;
+        b->lane_fields[n].name = col->name;
+        b->lane_fields[n].value = column_value(col, lane);
+        n++;
+    }
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+// Vector VM
+// ---------------------------------------------------------------------------
+
+static inline value_t lane_value(const vreg_t* r, size_t i) {
+    switch (r->kind) {
+        case VR_CONST: return r->k;
+        case VR_NUM: return value_num(r->num[i]);
+        case VR_MASK: return value_bool((r->mask[i >> 6] >> (i & 63)) & 1);
+        case VR_VALUES: return r->vals[i];
+    }
+    return value_null();
+}
+
+static inline bool is_num(const vreg_t* r) {
+    return r->kind == VR_NUM || (r->kind == VR_CONST && r->k.type == VAL_NUM);
+}
+
+static void load_field(batch_engine_t* b, unsigned d, int32_t c, size_t n, vreg_t* out) {
+    if (c < 0) {
+        *out = (vreg_t){ .kind = VR_CONST, .k = value_null() };
+        return;
+    }
+    const batch_column_t* col = &b->columns[c];
+    size_t i = 0;
+    while (i < n && col->tag[i] == VAL_NUM) i++;
+    if (i == n) {
+        // Zero-copy: the register reads the column directly.
+        *out = (vreg_t){ .kind = VR_NUM, .num = col->num };
+        return;
+    }
+    value_t* vals = b->reg_vals + (size_t)d * BATCH_LANES;
+    for (i = 0; i < n; i++) vals[i] = column_value(col, i);
+    *out = (vreg_t){ .kind = VR_VALUES, .vals = vals };
+}
+
+static void truth_mask(batch_engine_t* b, const vreg_t* r, size_t n, uint64_t* out) {
+    size_t words = words_for(n);
+    switch (r->kind) {
+        case VR_CONST:
+            memset(out, value_truthy(&r->k) ? 0xFF : 0, words * sizeof(uint64_t));
+            break;
+        case VR_NUM:
+            b->kernels->cmp(OP_TRUTH, r->num, 0.0, NULL, 0.0, n, out);
+            break;
+        case VR_MASK:
+            memmove(out, r->mask, words * sizeof(uint64_t));
+            break;
+        case VR_VALUES:
+            memset(out, 0, words * sizeof(uint64_t));
+            for (size_t i = 0; i < n; i++) {
+                if (value_truthy(&r->vals[i])) out[i >> 6] |= (uint64_t)1 << (i & 63);
+            }
+            break;
+    }
+}
+
+static bool is_comparison(opcode_t op) {
+    return op >= OP_LT && op <= OP_NE;
+}
+
+static bool has_zero(const vreg_t* r, size_t n) {
+    if (r->kind == VR_CONST) return r->k.as.num == 0.0;
+    for (size_t i = 0; i < n; i++) {
+        if (r->num[i] == 0.0) return true;
+    }
+    return false;
+}
+
+static void eval_unary(batch_engine_t* b, opcode_t op, unsigned d, const vreg_t* x, size_t n, vreg_t* out) {
+    if (x->kind == VR_CONST) {
+        value_t k = value_null();
+        if (op == OP_NOT) k = value_bool(!value_truthy(&x->k));
+        else if (op == OP_TRUTH) k = value_bool(value_truthy(&x->k));
+        else if (x->k.type == VAL_NUM) k = value_num(-x->k.as.num);
+        *out = (vreg_t){ .kind = VR_CONST, .k = k };
+        return;
+    }
+    if (op == OP_NOT || op == OP_TRUTH) {
+        uint64_t* mask = b->reg_mask + (size_t)d * BATCH_WORDS;
+        truth_mask(b, x, n, mask);
+        if (op == OP_NOT) {
+            for (size_t w = 0; w < words_for(n); w++) mask[w] = ~mask[w];
+        }
+        *out = (vreg_t){ .kind = VR_MASK, .mask = mask };
+        return;
+    }
+    if (x->kind == VR_NUM) {
+        double* num = b->reg_num + (size_t)d * BATCH_LANES;
+        for (size_t i = 0; i < n; i++) num[i] = -x->num[i];
+        *out = (vreg_t){ .kind = VR_NUM, .num = num };
+        return;
+    }
+    value_t* vals = b->reg_vals + (size_t)d * BATCH_LANES;
+    for (size_t i = 0; i < n; i++) {
+        value_t v = lane_value(x, i);
+        vals[i] = v.type == VAL_NUM ? value_num(-v.as.num) : value_null();
+    }
+    *out = (vreg_t){ .kind = VR_VALUES, .vals = vals };
+}
+
+static void eval_binary(batch_engine_t* b, opcode_t op, unsigned d,
+                        const vreg_t* x, const vreg_t* y, size_t n, vreg_t* out) {
+    uint64_t* mask = b->reg_mask + (size_t)d * BATCH_WORDS;
+    double* num = b->reg_num + (size_t)d * BATCH_LANES;
+    value_t* vals = b->reg_vals + (size_t)d * BATCH_LANES;
+
+    if (x->kind == VR_CONST && y->kind == VR_CONST) {
+        *out = (vreg_t){ .kind = VR_CONST, .k = expr_binary(op, &x->k, &y->k) };
+        return;
+    }
+
+    if (op == OP_AND || op == OP_OR) {
+        truth_mask(b, x, n, b->tmp_mask[0]);
+        truth_mask(b, y, n, b->tmp_mask[1]);
+        for (size_t w = 0; w < words_for(n); w++) {
+            mask[w] = op == OP_AND ? b->tmp_mask[0][w] & b->tmp_mask[1][w]
+                                   : b->tmp_mask[0][w] | b->tmp_mask[1][w];
+        }
+        *out = (vreg_t){ .kind = VR_MASK, .mask = mask };
+        return;
+    }
+
+    if (is_num(x) && is_num(y)) {
+        const double* xp = x->kind == VR_NUM ? x->num : NULL;
+        const double* yp = y->kind == VR_NUM ? y->num : NULL;
+        double xk = xp ? 0.0 : x->k.as.num;
+        double yk = yp ? 0.0 : y->k.as.num;
+        if (is_comparison(op)) {
+            b->kernels->cmp(op, xp, xk, yp, yk, n, mask);
+            *out = (vreg_t){ .kind = VR_MASK, .mask = mask };
+            return;
+        }
+        // Division by zero is null, so those batches take the generic path.
+        if (op == OP_ADD || op == OP_SUB || op == OP_MUL ||
+            ((op == OP_DIV || op == OP_MOD) && !has_zero(y, n))) {
+            if (op == OP_MOD) arith_tail(op, xp, xk, yp, yk, 0, n, num);
+            else b->kernels->arith(op, xp, xk, yp, yk, n, num);
+            *out = (vreg_t){ .kind = VR_NUM, .num = num };
+            return;
+        }
+    }
+
+    if (is_comparison(op)) {
+        // Bits are stored a word at a time, so x or y may alias mask.
+        uint64_t word = 0;
+        for (size_t i = 0; i < n; i++) {
+            value_t a = lane_value(x, i);
+            value_t c = lane_value(y, i);
+            if (expr_binary(op, &a, &c).as.b) word |= (uint64_t)1 << (i & 63);
+            if ((i & 63) == 63 || i + 1 == n) {
+                mask[i >> 6] = word;
+                word = 0;
+            }
+        }
+        *out = (vreg_t){ .kind = VR_MASK, .mask = mask };
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        value_t a = lane_value(x, i);
+        value_t c = lane_value(y, i);
+        vals[i] = expr_binary(op, &a, &c);
+    }
+    *out = (vreg_t){ .kind = VR_VALUES, .vals = vals };
+}
+
+// Evaluates an expression over lanes [0, n). Both sides of && and || are
+// evaluated; the jumps only matter to the scalar evaluator.
+static vreg_t eval_expr(batch_engine_t* b, const expr_t* expr, size_t n) {
+    const program_t* prog = &b->rules->program;
+    vreg_t regs[EXPR_MAX_REGS] = { { .kind = VR_CONST } };
+
+    const insn_t* pc = prog->code + expr->start;
+    const insn_t* end = pc + expr->len;
+    while (pc < end) {
+        insn_t insn = *pc++;
+        opcode_t op = INSN_OP(insn);
+        unsigned d = INSN_D(insn);
+
+        switch (op) {
+            case OP_LOADK:
+                regs[d] = (vreg_t){ .kind = VR_CONST, .k = prog->consts[insn_operand(insn, &pc)] };
+                break;
+            case OP_LOADF:
+                load_field(b, d, b->field_column[insn_operand(insn, &pc)], n, &regs[d]);
+                break;
+            case OP_NOT:
+            case OP_NEG:
+            case OP_TRUTH: {
+                vreg_t x = regs[INSN_A(insn)];
+                eval_unary(b, op, d, &x, n, &regs[d]);
+                break;
+            }
+            case OP_JF:
+            case OP_JT:
+            case OP_COUNT:
+                break;
+            default: {
+                vreg_t x = regs[INSN_A(insn)];
+                vreg_t y = regs[INSN_B(insn)];
+                eval_binary(b, op, d, &x, &y, n, &regs[d]);
+                break;
+            }
+        }
+    }
+    return regs[0];
+}
+
+static void materialize(const vreg_t* r, size_t n, batch_column_t* dst) {
+    switch (r->kind) {
+        case VR_CONST:
+            for (size_t i = 0; i < n; i++) set_lane(dst, i, r->k);
+            break;
+        case VR_NUM:
+            memset(dst->tag, VAL_NUM, n);
+            memcpy(dst->num, r->num, n * sizeof(double));
+            break;
+        case VR_MASK:
+            memset(dst->tag, VAL_BOOL, n);
+            for (size_t i = 0; i < n; i++) dst->num[i] = (double)((r->mask[i >> 6] >> (i & 63)) & 1);
+            break;
+        case VR_VALUES:
+            for (size_t i = 0; i < n; i++) set_lane(dst, i, r->vals[i]);
+            break;
+    }
+}
+
+// dst[i] = src[i] for every lane selected by mask.
+static void masked_write(batch_column_t* dst, const batch_column_t* src, const uint64_t* mask, size_t n) {
+    for (size_t w = 0; w < words_for(n); w++) {
+        uint64_t m = mask[w];
+        size_t base = w * 64;
+        if (m == ~(uint64_t)0) {
+            memcpy(dst->tag + base, src->tag + base, 64);
+            memcpy(dst->num + base, src->num + base, 64 * sizeof(double));
+            memcpy(dst->str + base, src->str + base, 64 * sizeof(str_t));
+            continue;
+        }
+        while (m) {
+            size_t i = base + (size_t)__builtin_ctzll(m);
+            dst->tag[i] = src->tag[i];
+            dst->num[i] = src->num[i];
+            dst->str[i] = src->str[i];
+            m &= m - 1;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Engine
+// ---------------------------------------------------------------------------
+
+error_t batch_init(batch_engine_t* batch, const ruleset_t* rules, const hash_t rules_hash) {
+    if (!batch || !rules || !rules_hash) return ERR_NULL_PTR;
+    memset(batch, 0, sizeof(*batch));
+    batch->rules = rules;
+    batch->kernels = select_kernels();
+    arena_init(&batch->names, BATCH_NAMES_BLOCK);
+    arena_init(&batch->strings, ARENA_DEFAULT_BLOCK);
+    buffer_init(&batch->inputs);
+    buffer_init(&batch->outputs);
+    buffer_init(&batch->seals);
+    buffer_init(&batch->changes);
+
+    error_t err = engine_init(&batch->engine, rules, rules_hash);
+    if (err != ERR_OK) return err;
+
+    size_t nthen = 0;
+    batch->max_then = 1;
+    for (size_t r = 0; r < rules->nrules; r++) {
+        nthen += rules->rules[r].nthen;
+        if (rules->rules[r].nthen > batch->max_then) batch->max_then = rules->rules[r].nthen;
+    }
+    size_t nrules = rules->nrules ? rules->nrules : 1;
+    size_t nfields = rules->program.nfields ? rules->program.nfields : 1;
+
+    batch->lookup = (uint32_t*)malloc(64 * sizeof(uint32_t));
+    batch->then_column = (uint32_t*)calloc(nthen ? nthen : 1, sizeof(uint32_t));
+    batch->field_column = (int32_t*)calloc(nfields, sizeof(int32_t));
+    batch->input_end = (size_t*)calloc(BATCH_LANES, sizeof(size_t));
+    batch->input_hash = (hash_t*)calloc(BATCH_LANES, sizeof(hash_t));
+    batch->applied = (uint64_t*)calloc(nrules * BATCH_WORDS, sizeof(uint64_t));
+    batch->lane_applied = (uint32_t*)calloc(HASH_MAX_LANES * nrules, sizeof(uint32_t));
+    batch->lane_start = (size_t*)calloc(BATCH_LANES + 1, sizeof(size_t));
+    batch->changes_end = (size_t*)calloc(nrules, sizeof(size_t));
+    batch->reg_num = (double*)malloc((size_t)EXPR_MAX_REGS * BATCH_LANES * sizeof(double));
+    batch->reg_mask = (uint64_t*)malloc((size_t)EXPR_MAX_REGS * BATCH_WORDS * sizeof(uint64_t));
+    batch->reg_vals = (value_t*)malloc((size_t)EXPR_MAX_REGS * BATCH_LANES * sizeof(value_t));
+    batch->pending = (batch_column_t*)calloc(batch->max_then, sizeof(batch_column_t));
+    if (!batch->lookup || !batch->then_column || !batch->field_column || !batch->input_end || !batch->input_hash ||
+        !batch->applied || !batch->lane_applied || !batch->lane_start || !batch->changes_end || !batch->reg_num || !batch->reg_mask ||
+        !batch->reg_vals || !batch->pending) {
+        batch_free(batch);
+        return ERR_MALLOC_FAILED;
+    }
+    memset(batch->lookup, 0xFF, 64 * sizeof(uint32_t));
+    batch->lookup_mask = 63;
+
+    for (size_t j = 0; j < batch->max_then; j++) {
+        batch_column_t* p = &batch->pending[j];
+        p->tag = (uint8_t*)malloc(BATCH_LANES);
+        p->num = (double*)malloc(BATCH_LANES * sizeof(double));
+        p->str = (str_t*)malloc(BATCH_LANES * sizeof(str_t));
+        if (!p->tag || !p->num || !p->str) {
+            batch_free(batch);
+            return ERR_MALLOC_FAILED;
+        }
+    }
+
+    // Every assigned field gets a column up front; assignments never
+    // allocate during a flush.
+    size_t k = 0;
+    for (size_t r = 0; r < rules->nrules; r++) {
+        const rule_t* rule = &rules->rules[r];
+        for (size_t j = 0; j < rule->nthen; j++) {
+            err = column_for(batch, rule->then[j].field, &batch->then_column[k++]);
+            if (err != ERR_OK) {
+                batch_free(batch);
+                return err;
+            }
+        }
+    }
+    return ERR_OK;
+}
+
+void batch_free(batch_engine_t* batch) {
+    if (!batch) return;
+    for (size_t c = 0; c < batch->ncolumns; c++) {
+        free(batch->columns[c].tag);
+        free(batch->columns[c].num);
+        free(batch->columns[c].str);
+    }
+    if (batch->pending) {
+        for (size_t j = 0; j < batch->max_then; j++) {
+            free(batch->pending[j].tag);
+            free(batch->pending[j].num);
+            free(batch->pending[j].str);
+        }
+    }
+    free(batch->columns);
+    free(batch->lookup);
+    free(batch->hint);
+    free(batch->then_column);
+    free(batch->field_column);
+    free(batch->related);
+    free(batch->related_start);
+    free(batch->input_end);
+    free(batch->input_hash);
+    buffer_free(&batch->inputs);
+    buffer_free(&batch->outputs);
+    buffer_free(&batch->seals);
+    free(batch->applied);
+    free(batch->lane_applied);
+    free(batch->lane_fields);
+    free(batch->log);
+    free(batch->by_lane);
+    free(batch->lane_start);
+    buffer_free(&batch->changes);
+    free(batch->changes_end);
+    free(batch->reg_num);
+    free(batch->reg_mask);
+    free(batch->reg_vals);
+    free(batch->pending);
+    arena_free(&batch->names);
+    arena_free(&batch->strings);
+    engine_free(&batch->engine);
+    memset(batch, 0, sizeof(*batch));
+}
+
+error_t batch_append(batch_engine_t* batch, const field_t* fields, size_t nfields) {
+    if (!batch || (!fields && nfields)) return ERR_NULL_PTR;
+    if (batch_full(batch)) return ERR_BUFFER_OVERFLOW;
+
+    if (nfields > batch->hint_cap) {
+        uint32_t* hint = (uint32_t*)realloc(batch->hint, nfields * sizeof(uint32_t));
+        if (!hint) return ERR_MALLOC_FAILED;
+        for (size_t i = batch->hint_cap; i < nfields; i++) hint[i] = LOOKUP_EMPTY;
+        batch->hint = hint;
+        batch->hint_cap = nfields;
+    }
+
+    size_t lane = batch->nlanes;
+    for (size_t i = 0; i < nfields; i++) {
+        // Records from one file usually repeat the previous key order.
+        uint32_t c = batch->hint[i];
+        if (c >= batch->ncolumns || !str_eq(batch->columns[c].name, fields[i].name)) {
+            error_t err = column_for(batch, fields[i].name, &c);
+            if (err != ERR_OK) return err;
+            batch->hint[i] = c;
+        }
+        value_t v = fields[i].value;
+        if (v.type == VAL_STR || v.type == VAL_RAW) {
+            char* copy = arena_strndup(&batch->strings, v.as.str.ptr, v.as.str.len);
+            if (!copy) return ERR_MALLOC_FAILED;
+            v.as.str.ptr = copy;
+        }
+        set_lane(&batch->columns[c], lane, v);
+    }
+    batch->nlanes++;
+
+    // Hashed with the rest of the batch at flush time.
+    size_t n = lane_fields(batch, lane);
+    error_t err = engine_write_json(&batch->engine, batch->lane_fields, n, &batch->inputs);
+    batch->input_end[lane] = batch->inputs.len;
+    return err;
+}
+
+// Hashes the n back-to-back spans of buf that end at end[0..n).
+static void hash_spans(const buffer_t* buf, const size_t* end, size_t n, hash_t* out) {
+    const char* data[HASH_MAX_LANES];
+    size_t len[HASH_MAX_LANES];
+    size_t start = 0;
+    for (size_t base = 0; base < n; base += HASH_MAX_LANES) {
+        size_t m = n - base < HASH_MAX_LANES ? n - base : HASH_MAX_LANES;
+        for (size_t i = 0; i < m; i++) {
+            data[i] = buf->data + start;
+            len[i] = end[base + i] - start;
+            start = end[base + i];
+        }
+        hash_many(data, len, m, out + base);
+    }
+}
+
+// Logs the old and new value of every lane selected for one `then`
+// value, before it is written.
+static error_t log_changes(batch_engine_t* b, uint32_t rule, uint32_t then, const batch_column_t* column,
+                           const batch_column_t* value, const uint64_t* selected, size_t n) {
+    size_t count = 0;
+    for (size_t w = 0; w < words_for(n); w++) count += (size_t)__builtin_popcountll(selected[w]);
+    if (b->nlog + count > b->log_cap) {
+        size_t cap = b->log_cap ? b->log_cap : BATCH_LANES;
+        while (cap < b->nlog + count) cap *= 2;
+        batch_change_t* log = (batch_change_t*)realloc(b->log, cap * sizeof(batch_change_t));
+        if (!log) return ERR_MALLOC_FAILED;
+        b->log = log;
+        batch_change_t* by_lane = (batch_change_t*)realloc(b->by_lane, cap * sizeof(batch_change_t));
+        if (!by_lane) return ERR_MALLOC_FAILED;
+        b->by_lane = by_lane;
+        b->log_cap = cap;
+    }
+    for (size_t w = 0; w < words_for(n); w++) {
+        for (uint64_t m = selected[w]; m; m &= m - 1) {
+            size_t i = w * 64 + (size_t)__builtin_ctzll(m);
+            batch_change_t* c = &b->log[b->nlog++];
+            c->lane = (uint32_t)i;
+            c->rule = rule;
+            c->then = then;
+            c->had_old = column->tag[i] != BATCH_ABSENT;
+            c->old = column_value(column, i);
+            c->value = column_value(value, i);
+        }
+    }
+    return ERR_OK;
+}
+
+// Counting sort of the log by lane; within a lane it stays in rule order.
+static void sort_log(batch_engine_t* b, size_t n) {
+    memset(b->lane_start, 0, (n + 1) * sizeof(size_t));
+    for (size_t i = 0; i < b->nlog; i++) b->lane_start[b->log[i].lane + 1]++;
+    for (size_t lane = 0; lane < n; lane++) b->lane_start[lane + 1] += b->lane_start[lane];
+    for (size_t i = 0; i < b->nlog; i++) b->by_lane[b->lane_start[b->log[i].lane]++] = b->log[i];
+    // Each start was advanced to the next lane's; shift them back.
+    for (size_t lane = n; lane > 0; lane--) b->lane_start[lane] = b->lane_start[lane - 1];
+    b->lane_start[0] = 0;
+}
+
+// Writes one lane's changes arrays, one per applied rule.
+static error_t write_changes(batch_engine_t* b, size_t lane, const uint32_t* applied, size_t napplied) {
+    buffer_t* out = &b->changes;
+    buffer_clear(out);
+    size_t i = b->lane_start[lane];
+    size_t end = b->lane_start[lane + 1];
+    error_t err = ERR_OK;
+    for (size_t a = 0; a < napplied && err == ERR_OK; a++) {
+        err = buffer_append_char(out, '[');
+        for (bool first = true; i < end && b->by_lane[i].rule == applied[a] && err == ERR_OK; i++, first = false) {
+            const batch_change_t* c = &b->by_lane[i];
+            if (!first) err = buffer_append_char(out, ',');
+            if (err == ERR_OK) err = engine_write_change(out, b->rules->rules[c->rule].then[c->then].field,
+                                                         c->had_old ? &c->old : NULL, &c->value);
+        }
+        if (err == ERR_OK) err = buffer_append_char(out, ']');
+        b->changes_end[a] = out->len;
+    }
+    return err;
+}
+
+// Lists, for every column, the columns at an ancestor or descendant
+// path, pairing each dotted name with its prefixes. Rebuilt only when
+// columns were added; without dotted names it stays empty.
+static error_t link_related(batch_engine_t* b) {
+    size_t n = b->ncolumns;
+    if (b->related_columns == n && b->related_start) return ERR_OK;
+    size_t* start = (size_t*)realloc(b->related_start, (n + 1) * sizeof(size_t));
+    if (!start) return ERR_MALLOC_FAILED;
+    b->related_start = start;
+    memset(start, 0, (n + 1) * sizeof(size_t));
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t d = 0; d < n; d++) {
+            str_t name = b->columns[d].name;
+            for (size_t i = 0; i < name.len; i++) {
+                if (name.ptr[i] != '.') continue;
+                uint32_t a = *find_slot(b, (str_t){ name.ptr, i });
+                if (a == LOOKUP_EMPTY) continue;
+                if (pass == 0) {
+                    start[a + 1]++;
+                    start[d + 1]++;
+                } else {
+                    b->related[start[a]++] = (uint32_t)d;
+                    b->related[start[d]++] = a;
+                }
+            }
+        }
+        if (pass == 1) break;
+        for (size_t c = 0; c < n; c++) start[c + 1] += start[c];
+        if (start[n] > b->related_cap) {
+            uint32_t* related = (uint32_t*)realloc(b->related, start[n] * sizeof(uint32_t));
+            if (!related) return ERR_MALLOC_FAILED;
+            b->related = related;
+            b->related_cap = start[n];
+        }
+    }
+    // Each start was advanced to the next column's; shift them back.
+    for (size_t c = n; c > 0; c--) start[c] = start[c - 1];
+    start[0] = 0;
+    b->related_columns = n;
+    return ERR_OK;
+}
+
+static void clear_lanes(batch_column_t* col, const uint64_t* mask, size_t n) {
+    for (size_t w = 0; w < words_for(n); w++) {
+        for (uint64_t m = mask[w]; m; m &= m - 1) col->tag[w * 64 + (size_t)__builtin_ctzll(m)] = BATCH_ABSENT;
+    }
+}
+
+static error_t run_rules(batch_engine_t* b, size_t n) {
+    const ruleset_t* rules = b->rules;
+    const program_t* prog = &rules->program;
+    size_t words = words_for(n);
+    error_t err = link_related(b);
+    if (err != ERR_OK) return err;
+
+    for (size_t f = 0; f < prog->nfields; f++) {
+        uint32_t slot = *find_slot(b, prog->fields[f]);
+        b->field_column[f] = slot == LOOKUP_EMPTY ? -1 : (int32_t)slot;
+    }
+
+    uint64_t valid[BATCH_WORDS];
+    memset(valid, 0xFF, sizeof(valid));
+    if (n & 63) valid[words - 1] = ((uint64_t)1 << (n & 63)) - 1;
+
+    size_t k = 0;
+    for (size_t r = 0; r < rules->nrules; r++) {
+        const rule_t* rule = &rules->rules[r];
+        uint64_t* selected = b->applied + r * BATCH_WORDS;
+        vreg_t cond = eval_expr(b, &rule->cond, n);
+        truth_mask(b, &cond, n, selected);
+
+        uint64_t any = 0;
+        for (size_t w = 0; w < words; w++) {
+            selected[w] &= valid[w];
+            any |= selected[w];
+        }
+        if (any) {
+            // All values first, against the state before this rule.
+            for (size_t j = 0; j < rule->nthen; j++) {
+                vreg_t v = eval_expr(b, &rule->then[j].expr, n);
+                materialize(&v, n, &b->pending[j]);
+            }
+            for (size_t j = 0; j < rule->nthen; j++) {
+                uint32_t c = b->then_column[k + j];
+                batch_column_t* column = &b->columns[c];
+                err = log_changes(b, (uint32_t)r, (uint32_t)j, column, &b->pending[j], selected, n);
+                if (err != ERR_OK) return err;
+                masked_write(column, &b->pending[j], selected, n);
+                for (size_t x = b->related_start[c]; x < b->related_start[c + 1]; x++) {
+                    clear_lanes(&b->columns[b->related[x]], selected, n);
+                }
+            }
+        }
+        k += rule->nthen;
+    }
+    return ERR_OK;
+}
+
+error_t batch_flush(batch_engine_t* batch, execution_fn fn, void* ctx) {
+    if (!batch || !fn) return ERR_NULL_PTR;
+    size_t n = batch->nlanes;
+    if (n == 0) return ERR_OK;
+
+    batch->nlog = 0;
+    error_t err = run_rules(batch, n);
+    if (err == ERR_OK) sort_log(batch, n);
+    hash_spans(&batch->inputs, batch->input_end, n, batch->input_hash);
+
+    const size_t nrules = batch->rules->nrules;
+    for (size_t base = 0; base < n && err == ERR_OK; base += HASH_MAX_LANES) {
+        size_t m = n - base < HASH_MAX_LANES ? n - base : HASH_MAX_LANES;
+        size_t output_end[HASH_MAX_LANES], seal_end[HASH_MAX_LANES], napplied[HASH_MAX_LANES];
+        hash_t output_hash[HASH_MAX_LANES], execution_hash[HASH_MAX_LANES];
+
+        buffer_clear(&batch->outputs);
+        for (size_t i = 0; i < m && err == ERR_OK; i++) {
+            size_t nfields = lane_fields(batch, base + i);
+            err = engine_write_json(&batch->engine, batch->lane_fields, nfields, &batch->outputs);
+            output_end[i] = batch->outputs.len;
+        }
+        if (err != ERR_OK) break;
+        hash_spans(&batch->outputs, output_end, m, output_hash);
+
+        buffer_clear(&batch->seals);
+        for (size_t i = 0; i < m && err == ERR_OK; i++) {
+            size_t lane = base + i;
+            uint32_t* applied = batch->lane_applied + i * nrules;
+            napplied[i] = 0;
+            for (size_t r = 0; r < nrules; r++) {
+                if ((batch->applied[r * BATCH_WORDS + (lane >> 6)] >> (lane & 63)) & 1) {
+                    applied[napplied[i]++] = (uint32_t)r;
+                }
+            }
+            err = engine_write_seal(&batch->engine, applied, napplied[i], batch->input_hash[lane],
+                                    output_hash[i], &batch->seals);
+            seal_end[i] = batch->seals.len;
+        }
+        if (err != ERR_OK) break;
+        hash_spans(&batch->seals, seal_end, m, execution_hash);
+
+        for (size_t i = 0; i < m && err == ERR_OK; i++) {
+            size_t lane = base + i;
+            err = write_changes(batch, lane, batch->lane_applied + i * nrules, napplied[i]);
+            if (err != ERR_OK) break;
+            execution_t out;
+            memcpy(out.input_hash, batch->input_hash[base + i], sizeof(hash_t));
+            memcpy(out.output_hash, output_hash[i], sizeof(hash_t));
+            memcpy(out.execution_hash, execution_hash[i], sizeof(hash_t));
+            size_t start = i ? output_end[i - 1] : 0;
+            out.applied = batch->lane_applied + i * nrules;
+            out.napplied = napplied[i];
+            out.state = batch->lane_fields;
+            out.nstate = lane_fields(batch, base + i);
+            out.output_json = (str_t){ batch->outputs.data + start, output_end[i] - start };
+            size_t input_start = lane ? batch->input_end[lane - 1] : 0;
+            out.input_json = (str_t){ batch->inputs.data + input_start, batch->input_end[lane] - input_start };
+            out.changes = (str_t){ batch->changes.data, batch->changes.len };
+            out.changes_end = batch->changes_end;
+            err = fn(ctx, &out);
+        }
+    }
+
+    for (size_t c = 0; c < batch->ncolumns; c++) memset(batch->columns[c].tag, BATCH_ABSENT, n);
+    arena_free(&batch->strings);
+    buffer_clear(&batch->inputs);
+    batch->nlanes = 0;
+    return err;
+}
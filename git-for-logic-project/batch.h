@@ -0,0 +1,122 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "git_for_logic.h"
+#include "value.h"
+#include "arena.h"
+#include "rules.h"
+#include "execute.h"
+
+// Columnar batch executor. Records are appended into struct-of-arrays
+// columns (a type tag, a double and a string slice per lane) and every
+// compiled expression is evaluated once per batch over whole columns:
+// numeric comparisons and arithmetic run as SIMD kernels (AVX2 or scalar,
+// picked at runtime), `when` results become selection bitmasks, and
+// `then` values are applied as masked column writes. Mixed-type columns
+// fall back to per-lane expr_binary, so results, output JSON and hashes
+// are identical to engine_run. Digests are computed HASH_MAX_LANES records
+// at a time with hash_many.
+//
+// Masked writes log each selected lane's old and new value as they go;
+// the log is sorted by lane at flush time and written out as the same
+// per-rule changes arrays engine_run records. A write also marks the
+// selected lanes absent in the columns at an ancestor or descendant path
+// (`a` for `a.b`, `a.b` for `a`), as engine_run clears those slots.
+
+#define BATCH_LANES 1024
+#define BATCH_WORDS (BATCH_LANES / 64)
+#define BATCH_ABSENT 0xFF
+
+typedef struct {
+    str_t name;
+    uint8_t* tag;               // value_type_t per lane, or BATCH_ABSENT
+    double* num;                // VAL_NUM lanes; VAL_BOOL lanes as 0 / 1
+    str_t* str;                 // VAL_STR and VAL_RAW lanes
+} batch_column_t;
+
+typedef error_t (*execution_fn)(void* ctx, const execution_t* result);
+
+// One lane's assignment of one `then` value.
+typedef struct {
+    uint32_t lane;
+    uint32_t rule;
+    uint32_t then;              // index into the rule's then
+    bool had_old;
+    value_t old;
+    value_t value;
+} batch_change_t;
+
+typedef struct batch_kernels batch_kernels_t;
+
+typedef struct {
+    const ruleset_t* rules;
+    const batch_kernels_t* kernels;
+    engine_t engine;            // serialization and hashing
+
+    batch_column_t* columns;
+    size_t ncolumns;
+    size_t columns_cap;
+    uint32_t* lookup;           // open-addressed index into columns, by name
+    size_t lookup_mask;
+    uint32_t* hint;             // column of the i-th field of the last record
+    size_t hint_cap;
+    uint32_t* then_column;      // column of every `then` field, rule by rule
+    int32_t* field_column;      // column of every program field, or -1
+    uint32_t* related;          // columns at an ancestor or descendant path,
+    size_t* related_start;      // column by column, and one past: start in related
+    size_t related_cap;
+    size_t related_columns;     // ncolumns when related was built
+    arena_t names;              // column names, for the life of the engine
+    arena_t strings;            // string lanes, per batch
+
+    size_t nlanes;
+    buffer_t inputs;            // input JSON of every lane, back to back
+    size_t* input_end;          // per lane: where its JSON ends in inputs
+    hash_t* input_hash;         // per lane
+    uint64_t* applied;          // selection mask of each rule
+    uint32_t* lane_applied;     // HASH_MAX_LANES lists of up to nrules
+    field_t* lane_fields;
+
+    // Audit trail: every assignment of the batch in rule order, then the
+    // same sorted by lane.
+    batch_change_t* log;
+    batch_change_t* by_lane;
+    size_t nlog;
+    size_t log_cap;
+    size_t* lane_start;         // per lane, and one past: start in by_lane
+    buffer_t changes;           // the reported lane's changes arrays
+    size_t* changes_end;
+
+    // One hash group: output and seal JSON of up to HASH_MAX_LANES lanes.
+    buffer_t outputs;
+    buffer_t seals;
+
+    // Vector VM scratch: per-register lanes, pending `then` values.
+    double* reg_num;
+    uint64_t* reg_mask;
+    value_t* reg_vals;
+    uint64_t tmp_mask[2][BATCH_WORDS];
+    batch_column_t* pending;
+    size_t max_then;
+} batch_engine_t;
+
+error_t batch_init(batch_engine_t* batch, const ruleset_t* rules, const hash_t rules_hash);
+void batch_free(batch_engine_t* batch);
+
+// Adds one record as the next lane. Names and strings are copied, so the
+// fields only need to live for the call. Duplicate names keep the last
+// value.
+error_t batch_append(batch_engine_t* batch, const field_t* fields, size_t nfields);
+
+static inline bool batch_full(const batch_engine_t* batch) {
+    return batch->nlanes == BATCH_LANES;
+}
+
+// Runs every rule over the pending lanes and reports each record's result
+// to fn, in append order, then empties the batch.
+error_t batch_flush(batch_engine_t* batch, execution_fn fn, void* ctx);
+
+// Name of the kernel set this CPU will use ("avx2", "scalar").
+const char* batch_kernel_name(void);
+
+#endif
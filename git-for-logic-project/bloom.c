@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bloom.h"
+#include "odb.h"
+
+#define BLOOM_MAGIC "LGBF"
+#define BLOOM_VERSION 1
+#define BLOOM_BOM 0x01020304u
+#define BLOOM_HEADER 64
+#define BLOOM_BLOCK 64
+#define BLOOM_WORDS (BLOOM_BLOCK / 8)
+#define BLOOM_MAX_LOG2 40
+#define BLOOM_COUNT_OFFSET 24
+
+struct bloom {
+    uint8_t* map;
+    size_t len;
+    uint64_t* blocks;
+    uint64_t* count;            // in the mapping
+    uint64_t mask;              // blocks - 1
+    uint64_t capacity;
+    char tmp[ODB_PATH_MAX];     // until published
+};
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static error_t map_fd(bloom_t* b, int fd, size_t len) {
+    void* map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return ERR_IO;
+    b->map = (uint8_t*)map;
+    b->len = len;
+    b->blocks = (uint64_t*)(b->map + BLOOM_HEADER);
+    b->count = (uint64_t*)(b->map + BLOOM_COUNT_OFFSET);
+    // Probes land anywhere; don't read ahead around them.
+    posix_madvise(map, len, POSIX_MADV_RANDOM);
+    return ERR_OK;
+}
+
+error_t bloom_open(bloom_t** out, const char* path) {
+    if (!out || !path) return ERR_NULL_PTR;
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return ERR_FILE_NOT_FOUND;
+    uint8_t head[BLOOM_HEADER];
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && pread(fd, head, sizeof(head), 0) == (ssize_t)sizeof(head);
+    uint32_t bom = BLOOM_BOM;
+    uint32_t log2 = ok ? get_u32(head + 12) : 0;
+    ok = ok && memcmp(head, BLOOM_MAGIC, 4) == 0 && get_u32(head + 4) == BLOOM_VERSION &&
+         memcmp(head + 8, &bom, 4) == 0 && log2 <= BLOOM_MAX_LOG2 &&
+         (uint64_t)st.st_size == BLOOM_HEADER + ((uint64_t)BLOOM_BLOCK << log2);
+    bloom_t* b = ok ? (bloom_t*)calloc(1, sizeof(bloom_t)) : NULL;
+    error_t err = !ok ? ERR_IO : !b ? ERR_MALLOC_FAILED : map_fd(b, fd, (size_t)st.st_size);
+    close(fd);
+    if (err != ERR_OK) {
+        free(b);
+        return err;
+    }
+    b->mask = ((uint64_t)1 << log2) - 1;
+    b->capacity = get_u64(head + 16);
+    *out = b;
+    return ERR_OK;
+}
+
+error_t bloom_create(bloom_t** out, const char* dir, size_t capacity) {
+    if (!out || !dir) return ERR_NULL_PTR;
+    uint32_t log2 = 0;
+    while (log2 < BLOOM_MAX_LOG2 && ((uint64_t)BLOOM_BLOCK * 8 << log2) < (uint64_t)capacity * BLOOM_BITS_PER_OBJECT) {
+        log2++;
+    }
+    bloom_t* b = (bloom_t*)calloc(1, sizeof(bloom_t));
+    if (!b) return ERR_MALLOC_FAILED;
+    int written = snprintf(b->tmp, sizeof(b->tmp), "%s/tmp_bloom_XXXXXX", dir);
+    if (written < 0 || (size_t)written >= sizeof(b->tmp)) {
+        free(b);
+        return ERR_BUFFER_OVERFLOW;
+    }
+    int fd = mkstemp(b->tmp);
+    if (fd < 0) {
+        free(b);
+        return ERR_IO;
+    }
+    // Sparse: the blocks read as zeroes until they are set.
+    size_t len = BLOOM_HEADER + ((size_t)BLOOM_BLOCK << log2);
+    error_t err = fchmod(fd, 0644) == 0 && ftruncate(fd, (off_t)len) == 0 ? map_fd(b, fd, len) : ERR_IO;
+    close(fd);
+    if (err != ERR_OK) {
+        remove(b->tmp);
+        free(b);
+        return err;
+    }
+    uint32_t bom = BLOOM_BOM;
+    memcpy(b->map, BLOOM_MAGIC, 4);
+    put_u32(b->map + 4, BLOOM_VERSION);
+    memcpy(b->map + 8, &bom, 4);
+    put_u32(b->map + 12, log2);
+    put_u64(b->map + 16, capacity);
+    b->mask = ((uint64_t)1 << log2) - 1;
+    b->capacity = capacity;
+    *out = b;
+    return ERR_OK;
+}
+
+error_t bloom_publish(bloom_t* b, const char* path) {
+    if (!b || !path) return ERR_NULL_PTR;
+    if (!b->tmp[0]) return ERR_OK;
+    if (rename(b->tmp, path) != 0) return ERR_IO;
+    b->tmp[0] = '\0';
+    return ERR_OK;
+}
+
+void bloom_close(bloom_t* b) {
+    if (!b) return;
+    munmap(b->map, b->len);
+    if (b->tmp[0]) remove(b->tmp);
+    free(b);
+}
+
+static uint64_t* block_of(const bloom_t* b, const hash_t id) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)id[i] << (8 * i);
+    return b->blocks + (v & b->mask) * BLOOM_WORDS;
+}
+
+void bloom_add(bloom_t* b, const hash_t id) {
+    if (!b || !id) return;
+    uint64_t* block = block_of(b, id);
+    for (int i = 0; i < BLOOM_WORDS; i++) {
+        __atomic_fetch_or(&block[i], (uint64_t)1 << (id[8 + i] & 63), __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(b->count, 1, __ATOMIC_RELAXED);
+}
+
+bool bloom_may_contain(const bloom_t* b, const hash_t id) {
+    if (!b || !id) return true;
+    const uint64_t* block = block_of(b, id);
+    for (int i = 0; i < BLOOM_WORDS; i++) {
+        uint64_t word = __atomic_load_n(&block[i], __ATOMIC_RELAXED);
+        if (!(word & (uint64_t)1 << (id[8 + i] & 63))) return false;
+    }
+    return true;
+}
+
+bool bloom_full(const bloom_t* b) {
+    return b && __atomic_load_n(b->count, __ATOMIC_RELAXED) > b->capacity;
+}
@@ -0,0 +1,53 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "git_for_logic.h"
+#include "hash.h"
+
+// Persistent blocked Bloom filter over object ids, mmap'd shared so that
+// every process adding objects to a repository sets bits in the same
+// file. Each id maps to one 64-byte block, one cache line, and sets one
+// bit in each of its eight 64-bit words (a split block filter, as in
+// Impala and Parquet). Ids are SHA-1s, so their bytes are used directly
+// as the hash: bytes 0-7 pick the block, bytes 8-15 the bits.
+//
+// At BLOOM_BITS_PER_OBJECT bits per object about one probe in a thousand
+// for an absent id is a false positive. Past its capacity the filter
+// still works, with more false positives, until it is rebuilt larger.
+//
+// Layout: "LGBF", u32 version, u32 byte order mark, u32 log2 of the block
+// count, u64 capacity (little-endian), the native u64 count of ids added,
+// zeroes up to 64 bytes, then the blocks as native u64 words. A filter
+// written with the other byte order fails to open.
+
+#define BLOOM_FILE "bloom"
+#define BLOOM_BITS_PER_OBJECT 16
+#define BLOOM_MIN_OBJECTS (64 * 1024)
+
+typedef struct bloom bloom_t;
+
+// Maps an existing filter. Returns ERR_FILE_NOT_FOUND if there is none
+// and ERR_IO if it is malformed.
+error_t bloom_open(bloom_t** out, const char* path);
+
+// Creates an empty filter for capacity ids in a temporary file in dir.
+// It is usable at once; bloom_publish moves it to its path.
+error_t bloom_create(bloom_t** out, const char* dir, size_t capacity);
+error_t bloom_publish(bloom_t* bloom, const char* path);
+
+// Unmaps the filter; an unpublished one is removed.
+void bloom_close(bloom_t* bloom);
+
+// Safe to call from any number of threads and processes.
+void bloom_add(bloom_t* bloom, const hash_t id);
+
+// False only if id was never added.
+bool bloom_may_contain(const bloom_t* bloom, const hash_t id);
+
+// More ids added than it was sized for.
+bool bloom_full(const bloom_t* bloom);
+
+#endif
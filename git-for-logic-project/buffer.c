@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "buffer.h"
+
+#define BUFFER_MIN_CAP 256
+
+void buffer_init(buffer_t* buf) {
+    buf->data = NULL;
+    buf->len = 0;
+    buf->cap = 0;
+}
+
+void buffer_free(buffer_t* buf) {
+    free(buf->data);
+    buffer_init(buf);
+}
+
+void buffer_clear(buffer_t* buf) {
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+error_t buffer_reserve(buffer_t* buf, size_t extra) {
+    if (extra > SIZE_MAX - buf->len - 1) return ERR_BUFFER_OVERFLOW;
+    size_t need = buf->len + extra + 1;
+    if (need <= buf->cap) return ERR_OK;
+    size_t cap = buf->cap ? buf->cap : BUFFER_MIN_CAP;
+    while (cap < need) {
+        if (cap > SIZE_MAX / 2) {
+            cap = need;
+            break;
+        }
+        cap *= 2;
+    }
+    char* data = (char*)realloc(buf->data, cap);
+    if (!data) return ERR_MALLOC_FAILED;
+    buf->data = data;
+    buf->cap = cap;
+    return ERR_OK;
+}
+
+error_t buffer_append(buffer_t* buf, const void* data, size_t len) {
+    error_t err = buffer_reserve(buf, len);
+    if (err != ERR_OK) return err;
+    if (len) memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return ERR_OK;
+}
+
+error_t buffer_append_char(buffer_t* buf, char c) {
+    return buffer_append(buf, &c, 1);
+}
+
+error_t buffer_append_str(buffer_t* buf, const char* s) {
+    return buffer_append(buf, s, strlen(s));
+}
@@ -0,0 +1,22 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include "git_for_logic.h"
+
+// Growable byte buffer. Always NUL-terminated after a successful append.
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} buffer_t;
+
+void buffer_init(buffer_t* buf);
+void buffer_free(buffer_t* buf);
+void buffer_clear(buffer_t* buf);
+error_t buffer_reserve(buffer_t* buf, size_t extra);
+error_t buffer_append(buffer_t* buf, const void* data, size_t len);
+error_t buffer_append_char(buffer_t* buf, char c);
+error_t buffer_append_str(buffer_t* buf, const char* s);
+
+#endif
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cache.h"
+
+#define CACHE_MIN_BUCKETS 64
+#define CACHE_LINE 64
+
+typedef struct entry {
+    struct entry* chain;        // next in the bucket
+    struct entry* newer;        // LRU list
+    struct entry* older;
+    hash_t id;
+    char type[ODB_TYPE_MAX];
+    size_t len;
+    char data[];
+} entry_t;
+
+// Each shard on its own cache lines, so locking one does not slow
+// threads working in another.
+typedef struct {
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    entry_t** buckets;
+    size_t mask;                // buckets - 1
+    size_t count;
+    size_t bytes;
+    entry_t* newest;
+    entry_t* oldest;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} shard_t;
+
+struct object_cache {
+    size_t shard_budget;
+    shard_t shards[CACHE_SHARDS];
+};
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// Ids are SHA-1s: their bytes are hash enough. The shard and the bucket
+// come from different bytes.
+static shard_t* shard_of(object_cache_t* c, const hash_t id) {
+    return &c->shards[id[HASH_LEN - 1] % CACHE_SHARDS];
+}
+
+static size_t bucket_of(const shard_t* s, const hash_t id) {
+    return (size_t)(get_u64(id) & s->mask);
+}
+
+static size_t cost(size_t len) {
+    return sizeof(entry_t) + len;
+}
+
+error_t cache_create(object_cache_t** out, size_t budget) {
+    if (!out) return ERR_NULL_PTR;
+    size_t size = (sizeof(object_cache_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    object_cache_t* c = (object_cache_t*)aligned_alloc(CACHE_LINE, size);
+    if (!c) return ERR_MALLOC_FAILED;
+    memset(c, 0, sizeof(*c));
+    c->shard_budget = budget / CACHE_SHARDS;
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        shard_t* s = &c->shards[i];
+        s->buckets = (entry_t**)calloc(CACHE_MIN_BUCKETS, sizeof(entry_t*));
+        if (!s->buckets) {
+            cache_destroy(c);
+            return ERR_MALLOC_FAILED;
+        }
+        s->mask = CACHE_MIN_BUCKETS - 1;
+        pthread_mutex_init(&s->lock, NULL);
+    }
+    *out = c;
+    return ERR_OK;
+}
+
+void cache_destroy(object_cache_t* c) {
+    if (!c) return;
+    for (size_t i = 0; i < CACHE_SHARDS; i++) {
+        shard_t* s = &c->shards[i];
+        if (!s->buckets) break;
+        for (entry_t* e = s->newest; e;) {
+            entry_t* next = e->older;
+            free(e);
+            e = next;
+        }
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(c);
+}
+
+static entry_t* find(const shard_t* s, const hash_t id) {
+    for (entry_t* e = s->buckets[bucket_of(s, id)]; e; e = e->chain) {
+        if (hash_eq(e->id, id)) return e;
+    }
+    return NULL;
+}
+
+static void lru_unlink(shard_t* s, entry_t* e) {
+    if (e->newer) e->newer->older = e->older;
+    else s->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else s->oldest = e->newer;
+}
+
+static void lru_push(shard_t* s, entry_t* e) {
+    e->newer = NULL;
+    e->older = s->newest;
+    if (s->newest) s->newest->newer = e;
+    else s->oldest = e;
+    s->newest = e;
+}
+
+static void touch(shard_t* s, entry_t* e) {
+    if (s->newest == e) return;
+    lru_unlink(s, e);
+    lru_push(s, e);
+}
+
+static void evict(shard_t* s, entry_t* e) {
+    entry_t** link = &s->buckets[bucket_of(s, e->id)];
+    while (*link != e) link = &(*link)->chain;
+    *link = e->chain;
+    lru_unlink(s, e);
+    s->count--;
+    s->bytes -= cost(e->len);
+    s->evictions++;
+    free(e);
+}
+
+// Doubles the table once it holds as many entries as buckets. On
+// allocation failure the chains just get longer.
+static void grow(shard_t* s) {
+    size_t n = (s->mask + 1) * 2;
+    entry_t** buckets = (entry_t**)calloc(n, sizeof(entry_t*));
+    if (!buckets) return;
+    entry_t** old = s->buckets;
+    size_t old_n = s->mask + 1;
+    s->buckets = buckets;
+    s->mask = n - 1;
+    for (size_t b = 0; b < old_n; b++) {
+        for (entry_t* e = old[b]; e;) {
+            entry_t* next = e->chain;
+            size_t i = bucket_of(s, e->id);
+            e->chain = buckets[i];
+            buckets[i] = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+bool cache_get(object_cache_t* c, const hash_t id, char type[ODB_TYPE_MAX], buffer_t* out) {
+    if (!c || !id || !type || !out) return false;
+    shard_t* s = shard_of(c, id);
+    pthread_mutex_lock(&s->lock);
+    entry_t* e = find(s, id);
+    bool hit = e && buffer_append(out, e->data, e->len) == ERR_OK;
+    if (hit) {
+        memcpy(type, e->type, ODB_TYPE_MAX);
+        touch(s, e);
+        s->hits++;
+    } else {
+        s->misses++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return hit;
+}
+
+error_t cache_put(object_cache_t* c, const hash_t id, const char* type, const char* data, size_t len) {
+    if (!c || !id || !type || (!data && len)) return ERR_NULL_PTR;
+    size_t type_len = strlen(type);
+    if (type_len >= ODB_TYPE_MAX) return ERR_BUFFER_OVERFLOW;
+    if (cost(len) > c->shard_budget) return ERR_OK;
+
+    // Copy outside the lock.
+    entry_t* e = (entry_t*)malloc(cost(len));
+    if (!e) return ERR_MALLOC_FAILED;
+    memcpy(e->id, id, sizeof(hash_t));
+    memset(e->type, 0, sizeof(e->type));
+    memcpy(e->type, type, type_len);
+    e->len = len;
+    if (len) memcpy(e->data, data, len);
+
+    shard_t* s = shard_of(c, id);
+    pthread_mutex_lock(&s->lock);
+    entry_t* existing = find(s, id);
+    if (existing) {
+        touch(s, existing);
+        pthread_mutex_unlock(&s->lock);
+        free(e);
+        return ERR_OK;
+    }
+    if (s->count > s->mask) grow(s);
+    size_t b = bucket_of(s, id);
+    e->chain = s->buckets[b];
+    s->buckets[b] = e;
+    lru_push(s, e);
+    s->count++;
+    s->bytes += cost(len);
+    while (s->bytes > c->shard_budget) evict(s, s->oldest);
+    pthread_mutex_unlock(&s->lock);
+    return ERR_OK;
+}
+
+void cache_stats(object_cache_t* c, cache_stats_t* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; c && i < CACHE_SHARDS; i++) {
+        shard_t* s = &c->shards[i];
+        pthread_mutex_lock(&s->lock);
+        out->hits += s->hits;
+        out->misses += s->misses;
+        out->evictions += s->evictions;
+        out->objects += s->count;
+        out->bytes += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "buffer.h"
+#include "odb.h"
+
+// In-memory cache of decoded objects (content after delta resolution and
+// decompression), keyed by id. It is split into CACHE_SHARDS shards, each
+// with its own lock, hash table and LRU list, so threads reading
+// different objects rarely contend. Each shard holds at most its share of
+// the byte budget and evicts least recently used objects past it; an
+// object bigger than a shard's share is not cached.
+
+#define CACHE_SHARDS 16
+
+typedef struct object_cache object_cache_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t objects;             // cached now
+    size_t bytes;               // cached now, with per-entry overhead
+} cache_stats_t;
+
+error_t cache_create(object_cache_t** out, size_t budget);
+void cache_destroy(object_cache_t* cache);
+
+// On a hit, appends the content to out, copies the type and returns true.
+bool cache_get(object_cache_t* cache, const hash_t id, char type[ODB_TYPE_MAX], buffer_t* out);
+
+// Adds an object, or refreshes it if it is already cached.
+error_t cache_put(object_cache_t* cache, const hash_t id, const char* type, const char* data, size_t len);
+
+void cache_stats(object_cache_t* cache, cache_stats_t* out);
+
+#endif
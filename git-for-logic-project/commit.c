@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include "commit.h"
+#include "json.h"
+
+// Reads the first line of path into line. Returns its length, or -1 if
+// the file cannot be read.
+static long read_line(const char* path, char* line, size_t cap) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    long len = -1;
+    if (fgets(line, (int)cap, f)) {
+        len = (long)strcspn(line, "\r\n");
+        line[len] = '\0';
+    }
+    fclose(f);
+    return len;
+}
+
+error_t committer_open(committer_t* committer, const char* repo_path, const char* message) {
+    if (!committer || !repo_path) return ERR_NULL_PTR;
+    memset(committer, 0, sizeof(*committer));
+    committer->message = message ? message : "";
+
+    char logicgit[ODB_PATH_MAX];
+    int written = snprintf(logicgit, sizeof(logicgit), "%s/.logicgit", repo_path);
+    if (written < 0 || (size_t)written >= sizeof(logicgit)) return ERR_BUFFER_OVERFLOW;
+    error_t err = odb_open(&committer->odb, logicgit);
+    if (err != ERR_OK) return err;
+    buffer_init(&committer->content);
+
+    // HEAD is either "ref: refs/heads/<branch>" or a detached commit id.
+    char head[ODB_PATH_MAX];
+    written = snprintf(committer->head_path, sizeof(committer->head_path), "%s/HEAD", logicgit);
+    if (written < 0 || (size_t)written >= sizeof(committer->head_path)) return ERR_BUFFER_OVERFLOW;
+    long len = read_line(committer->head_path, head, sizeof(head));
+    if (len < 0) return ERR_OK;     // no HEAD yet: detached, no parent
+
+    if (strncmp(head, "ref: ", 5) == 0) {
+        written = snprintf(committer->head_path, sizeof(committer->head_path), "%s/%s", logicgit, head + 5);
+        if (written < 0 || (size_t)written >= sizeof(committer->head_path)) return ERR_BUFFER_OVERFLOW;
+        len = read_line(committer->head_path, head, sizeof(head));
+    }
+    if (len >= 0 && hash_from_hex(head, (size_t)len, committer->parent)) committer->has_parent = true;
+    return ERR_OK;
+}
+
+void committer_close(committer_t* committer) {
+    if (!committer) return;
+    odb_close(&committer->odb);
+    buffer_free(&committer->content);
+}
+
+// Serializes the next commit object into committer->content.
+static error_t write_content(committer_t* committer, const execution_t* result) {
+    buffer_t* b = &committer->content;
+    buffer_clear(b);
+
+    error_t err = buffer_append_str(b, "{\"author\":\"logic-git\",\"execution\":");
+    if (err == ERR_OK) err = json_write_hash(b, result->execution_hash);
+    if (err == ERR_OK) err = buffer_append_str(b, ",\"message\":");
+    if (err == ERR_OK) {
+        str_t message = { committer->message, strlen(committer->message) };
+        err = json_write_string(b, message);
+    }
+    if (err == ERR_OK) err = buffer_append_str(b, ",\"parent\":");
+    if (err == ERR_OK) {
+        err = committer->has_parent ? json_write_hash(b, committer->parent) : buffer_append_str(b, "null");
+    }
+    if (err == ERR_OK) err = buffer_append_char(b, '}');
+    return err;
+}
+
+static void advance(committer_t* committer, const hash_t id) {
+    memcpy(committer->parent, id, sizeof(hash_t));
+    committer->has_parent = true;
+    committer->ncommits++;
+}
+
+error_t committer_commit(committer_t* committer, const execution_t* result, hash_t out) {
+    if (!committer || !result) return ERR_NULL_PTR;
+    error_t err = write_content(committer, result);
+    if (err == ERR_OK) err = odb_write(&committer->odb, "commit", committer->content.data, committer->content.len, out);
+    if (err != ERR_OK) return err;
+    advance(committer, out);
+    return ERR_OK;
+}
+
+error_t committer_prepare(committer_t* committer, const execution_t* result, hash_t out) {
+    if (!committer || !result) return ERR_NULL_PTR;
+    error_t err = write_content(committer, result);
+    if (err == ERR_OK) err = odb_hash("commit", committer->content.data, committer->content.len, out);
+    if (err != ERR_OK) return err;
+    advance(committer, out);
+    return ERR_OK;
+}
+
+error_t committer_finish(committer_t* committer) {
+    if (!committer) return ERR_NULL_PTR;
+    if (committer->ncommits == 0) return ERR_OK;
+    FILE* f = fopen(committer->head_path, "w");
+    if (!f) return ERR_IO;
+    hash_hex_t hex;
+    int ok = fprintf(f, "%s\n", hash_hex(committer->parent, hex)) > 0;
+    if (fclose(f) != 0 || !ok) return ERR_IO;
+    return ERR_OK;
+}
@@ -0,0 +1,38 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include "git_for_logic.h"
+#include "odb.h"
+#include "execute.h"
+
+// Chains one commit object per execution onto the current branch, as
+// legacy commit() does: {"author","execution","message","parent"} in
+// canonical JSON, stored in the object store as type "commit". Commits
+// carry no timestamp, so the same run over the same inputs always yields
+// the same commit ids no matter how many threads evaluated it. The branch
+// ref is written once, by committer_finish.
+
+typedef struct {
+    odb_t odb;
+    char head_path[ODB_PATH_MAX];   // file HEAD resolves to (ref or HEAD)
+    hash_t parent;
+    bool has_parent;
+    const char* message;
+    buffer_t content;
+    size_t ncommits;
+} committer_t;
+
+error_t committer_open(committer_t* committer, const char* repo_path, const char* message);
+void committer_close(committer_t* committer);
+
+// Commits one execution on top of the previous commit.
+error_t committer_commit(committer_t* committer, const execution_t* result, hash_t out);
+
+// Chains the next commit without storing it: its object is left in
+// committer->content, for a writer thread to store.
+error_t committer_prepare(committer_t* committer, const execution_t* result, hash_t out);
+
+// Points the branch (or a detached HEAD) at the last commit.
+error_t committer_finish(committer_t* committer);
+
+#endif
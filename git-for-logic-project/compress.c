@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#define ZLIB_CONST
+#include <zlib.h>
+#include "compress.h"
+#include "hash.h"
+#include "odb.h"
+
+#define DICT_NGRAM 8
+#define DICT_SEGMENT 64
+#define DICT_SAMPLE_BYTES (1 << 20)     // bytes of samples a dictionary is trained on
+#define DICT_CURRENT "CURRENT"
+// A 16 KiB window holds the largest dictionary; a small hash table keeps
+// the per-object state copy cheap. Objects are a few hundred bytes.
+#define DEFLATE_WINDOW_BITS 14
+#define DEFLATE_MEM_LEVEL 4
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+typedef struct {
+    size_t start;
+    uint64_t score;
+} segment_t;
+
+static int compare_segments(const void* a, const void* b) {
+    const segment_t* x = (const segment_t*)a;
+    const segment_t* y = (const segment_t*)b;
+    if (x->score != y->score) return x->score < y->score ? -1 : 1;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+// After zstd's COVER trainer, simplified: every 8-byte n-gram of the
+// samples is counted (in a hashed table, so rare collisions merge), the
+// samples are cut into one epoch per dictionary segment, and each epoch
+// contributes its highest-scoring DICT_SEGMENT-byte window. A chosen
+// window's n-grams stop counting, so later epochs pick other content.
+error_t dict_train(const str_t* samples, size_t n, buffer_t* out) {
+    if ((!samples && n) || !out) return ERR_NULL_PTR;
+    if (n < DICT_MIN_SAMPLES) return ERR_FILE_NOT_FOUND;
+    buffer_t all;
+    buffer_init(&all);
+    error_t err = ERR_OK;
+    for (size_t i = 0; err == ERR_OK && i < n && all.len < DICT_SAMPLE_BYTES; i++) {
+        size_t take = samples[i].len;
+        if (take > DICT_SAMPLE_BYTES - all.len) take = DICT_SAMPLE_BYTES - all.len;
+        err = buffer_append(&all, samples[i].ptr, take);
+    }
+    if (err == ERR_OK && all.len < 2 * DICT_SEGMENT) err = ERR_FILE_NOT_FOUND;
+    if (err != ERR_OK) {
+        buffer_free(&all);
+        return err;
+    }
+
+    size_t ngrams = all.len - DICT_NGRAM + 1;
+    size_t size = 1024;
+    while (size < 2 * ngrams) size *= 2;
+    uint32_t* counts = (uint32_t*)calloc(size, sizeof(uint32_t));
+    uint32_t* bucket = (uint32_t*)malloc(ngrams * sizeof(uint32_t));
+    size_t nsegments = DICT_MAX / DICT_SEGMENT;
+    if (nsegments > all.len / DICT_SEGMENT) nsegments = all.len / DICT_SEGMENT;
+    segment_t* chosen = (segment_t*)malloc(nsegments * sizeof(segment_t));
+    if (!counts || !bucket || !chosen) {
+        free(counts);
+        free(bucket);
+        free(chosen);
+        buffer_free(&all);
+        return ERR_MALLOC_FAILED;
+    }
+    for (size_t i = 0; i < ngrams; i++) {
+        uint64_t v;
+        memcpy(&v, all.data + i, DICT_NGRAM);
+        bucket[i] = (uint32_t)(mix64(v) & (size - 1));
+        counts[bucket[i]]++;
+    }
+
+    const size_t window = DICT_SEGMENT - DICT_NGRAM + 1;  // n-grams per segment
+    size_t epoch = ngrams / nsegments;
+    size_t nchosen = 0;
+    for (size_t e = 0; e < nsegments; e++) {
+        size_t begin = e * epoch;
+        size_t end = e + 1 < nsegments ? begin + epoch : ngrams;
+        if (end - begin < window) continue;
+        uint64_t score = 0, best = 0;
+        size_t best_start = begin;
+        for (size_t j = begin; j < begin + window; j++) score += counts[bucket[j]];
+        best = score;
+        for (size_t s = begin + 1; s + window <= end; s++) {
+            score += counts[bucket[s + window - 1]];
+            score -= counts[bucket[s - 1]];
+            if (score > best) {
+                best = score;
+                best_start = s;
+            }
+        }
+        // A window of n-grams seen once each is not worth its bytes.
+        if (best < 2 * window) continue;
+        for (size_t j = best_start; j < best_start + window; j++) counts[bucket[j]] = 0;
+        chosen[nchosen].start = best_start;
+        chosen[nchosen].score = best;
+        nchosen++;
+    }
+
+    qsort(chosen, nchosen, sizeof(segment_t), compare_segments);
+    buffer_clear(out);
+    for (size_t i = 0; err == ERR_OK && i < nchosen; i++) {
+        err = buffer_append(out, all.data + chosen[i].start, DICT_SEGMENT);
+    }
+    if (err == ERR_OK && out->len == 0) err = ERR_FILE_NOT_FOUND;
+    free(counts);
+    free(bucket);
+    free(chosen);
+    buffer_free(&all);
+    return err;
+}
+
+static uint32_t dict_id(const char* data, size_t len) {
+    hash_t sum;
+    compute_sha1(data, len, sum);
+    uint32_t id = (uint32_t)sum[0] | (uint32_t)sum[1] << 8 | (uint32_t)sum[2] << 16 | (uint32_t)sum[3] << 24;
+    return id ? id : 1;         // 0 means "no dictionary"
+}
+
+// Writes path through path.lock and a rename.
+static error_t write_file(const char* path, const char* data, size_t len) {
+    char tmp[ODB_PATH_MAX + 8];
+    int written = snprintf(tmp, sizeof(tmp), "%s.lock", path);
+    if (written < 0 || (size_t)written >= sizeof(tmp)) return ERR_BUFFER_OVERFLOW;
+    FILE* f = fopen(tmp, "wbx");
+    if (!f) return ERR_IO;
+    size_t put = len ? fwrite(data, 1, len, f) : 0;
+    if (fclose(f) != 0 || put != len || rename(tmp, path) != 0) {
+        remove(tmp);
+        return ERR_IO;
+    }
+    return ERR_OK;
+}
+
+error_t dict_save(const char* logicgit_dir, const char* data, size_t len, uint32_t* id) {
+    if (!logicgit_dir || !data || !id) return ERR_NULL_PTR;
+    if (len == 0 || len > DICT_MAX) return ERR_BUFFER_OVERFLOW;
+    char dir[ODB_PATH_MAX], path[ODB_PATH_MAX];
+    int written = snprintf(dir, sizeof(dir), "%s/%s", logicgit_dir, DICT_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(dir)) return ERR_BUFFER_OVERFLOW;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return ERR_IO;
+
+    *id = dict_id(data, len);
+    written = snprintf(path, sizeof(path), "%s/%08x.dict", dir, (unsigned)*id);
+    if (written < 0 || (size_t)written >= sizeof(path)) return ERR_BUFFER_OVERFLOW;
+    error_t err = write_file(path, data, len);
+    if (err != ERR_OK) return err;
+
+    char line[16];
+    written = snprintf(line, sizeof(line), "%08x\n", (unsigned)*id);
+    written = snprintf(path, sizeof(path), "%s/%s", dir, DICT_CURRENT);
+    if (written < 0 || (size_t)written >= sizeof(path)) return ERR_BUFFER_OVERFLOW;
+    return write_file(path, line, strlen(line));
+}
+
+static bool parse_id(const char* s, uint32_t* id) {
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++) {
+        char c = s[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (d < 0) return false;
+        v = v << 4 | (uint32_t)d;
+    }
+    *id = v;
+    return true;
+}
+
+// Reads a dictionary file; one whose content does not match its name is
+// skipped.
+static error_t load_dict(dict_set_t* set, const char* path, uint32_t id, size_t* cap) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return ERR_OK;
+    char* data = (char*)malloc(DICT_MAX + 1);
+    size_t len = data ? fread(data, 1, DICT_MAX + 1, f) : 0;
+    fclose(f);
+    if (!data) return ERR_MALLOC_FAILED;
+    if (len == 0 || len > DICT_MAX || dict_id(data, len) != id) {
+        free(data);
+        return ERR_OK;
+    }
+    if (set->count == *cap) {
+        *cap = *cap ? *cap * 2 : 4;
+        dict_t* dicts = (dict_t*)realloc(set->dicts, *cap * sizeof(dict_t));
+        if (!dicts) {
+            free(data);
+            return ERR_MALLOC_FAILED;
+        }
+        set->dicts = dicts;
+    }
+    set->dicts[set->count].id = id;
+    set->dicts[set->count].data = data;
+    set->dicts[set->count].len = len;
+    set->count++;
+    return ERR_OK;
+}
+
+error_t dict_set_load(dict_set_t* set, const char* logicgit_dir) {
+    if (!set || !logicgit_dir) return ERR_NULL_PTR;
+    memset(set, 0, sizeof(*set));
+    char dir_path[ODB_PATH_MAX], path[ODB_PATH_MAX];
+    int written = snprintf(dir_path, sizeof(dir_path), "%s/%s", logicgit_dir, DICT_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(dir_path)) return ERR_BUFFER_OVERFLOW;
+    DIR* dir = opendir(dir_path);
+    if (!dir) return ERR_OK;
+
+    error_t err = ERR_OK;
+    size_t cap = 0;
+    struct dirent* entry;
+    while (err == ERR_OK && (entry = readdir(dir)) != NULL) {
+        uint32_t id;
+        if (strlen(entry->d_name) != 13 || strcmp(entry->d_name + 8, ".dict") != 0 ||
+            !parse_id(entry->d_name, &id)) {
+            continue;
+        }
+        written = snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path)) continue;
+        err = load_dict(set, path, id, &cap);
+    }
+    closedir(dir);
+    if (err != ERR_OK) {
+        dict_set_free(set);
+        return err;
+    }
+
+    written = snprintf(path, sizeof(path), "%s/%s", dir_path, DICT_CURRENT);
+    FILE* f = written > 0 && (size_t)written < sizeof(path) ? fopen(path, "r") : NULL;
+    if (f) {
+        char line[16];
+        uint32_t id;
+        if (fgets(line, sizeof(line), f) && parse_id(line, &id)) set->current = dict_set_find(set, id);
+        fclose(f);
+    }
+    return ERR_OK;
+}
+
+void dict_set_free(dict_set_t* set) {
+    if (!set) return;
+    for (size_t i = 0; i < set->count; i++) free(set->dicts[i].data);
+    free(set->dicts);
+    memset(set, 0, sizeof(*set));
+}
+
+const dict_t* dict_set_find(const dict_set_t* set, uint32_t id) {
+    for (size_t i = 0; set && i < set->count; i++) {
+        if (set->dicts[i].id == id) return &set->dicts[i];
+    }
+    return NULL;
+}
+
+// Priming a stream with a dictionary costs a hash insert per dictionary
+// byte, far more than compressing a small object; it is done once, into
+// primed, which each object then starts from as a copy.
+struct compressor {
+    z_stream z;
+    z_stream primed;            // with the dictionary loaded, if there is one
+    const dict_t* dict;
+};
+
+static int deflate_init(z_stream* z) {
+    // Raw deflate: no zlib header or checksum; objects carry their own ids.
+    return deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -DEFLATE_WINDOW_BITS, DEFLATE_MEM_LEVEL,
+                        Z_DEFAULT_STRATEGY);
+}
+
+error_t compressor_open(compressor_t** out, const dict_t* dict) {
+    if (!out) return ERR_NULL_PTR;
+    compressor_t* c = (compressor_t*)calloc(1, sizeof(compressor_t));
+    if (!c) return ERR_MALLOC_FAILED;
+    if (deflate_init(&c->z) != Z_OK) {
+        free(c);
+        return ERR_MALLOC_FAILED;
+    }
+    if (dict) {
+        if (deflate_init(&c->primed) != Z_OK) {
+            deflateEnd(&c->z);
+            free(c);
+            return ERR_MALLOC_FAILED;
+        }
+        c->dict = dict;
+        if (deflateSetDictionary(&c->primed, (const Bytef*)dict->data, (uInt)dict->len) != Z_OK) {
+            compressor_close(c);
+            return ERR_IO;
+        }
+    }
+    *out = c;
+    return ERR_OK;
+}
+
+void compressor_close(compressor_t* c) {
+    if (!c) return;
+    deflateEnd(&c->z);
+    if (c->dict) deflateEnd(&c->primed);
+    free(c);
+}
+
+uint32_t compressor_dict_id(const compressor_t* c) {
+    return c && c->dict ? c->dict->id : 0;
+}
+
+error_t compressor_run(compressor_t* c, const char* data, size_t len, buffer_t* out) {
+    if (!c || (!data && len) || !out) return ERR_NULL_PTR;
+    if (len > UINT_MAX / 2) return ERR_BUFFER_OVERFLOW;
+    if (c->dict) {
+        deflateEnd(&c->z);
+        if (deflateCopy(&c->z, &c->primed) != Z_OK) {
+            // Leave z valid for the next object and compressor_close.
+            if (deflate_init(&c->z) != Z_OK) memset(&c->z, 0, sizeof(c->z));
+            return ERR_MALLOC_FAILED;
+        }
+    } else if (deflateReset(&c->z) != Z_OK) {
+        return ERR_IO;
+    }
+    uLong bound = deflateBound(&c->z, (uLong)len);
+    error_t err = buffer_reserve(out, bound);
+    if (err != ERR_OK) return err;
+    c->z.next_in = (const Bytef*)data;
+    c->z.avail_in = (uInt)len;
+    c->z.next_out = (Bytef*)out->data + out->len;
+    c->z.avail_out = (uInt)bound;
+    if (deflate(&c->z, Z_FINISH) != Z_STREAM_END) return ERR_IO;
+    size_t produced = (size_t)c->z.total_out;
+    if (produced >= len - len / 8) return ERR_BUFFER_OVERFLOW;
+    out->len += produced;
+    out->data[out->len] = '\0';
+    return ERR_OK;
+}
+
+error_t decompress(const dict_t* dict, const char* data, size_t n, size_t len, buffer_t* out) {
+    if (!data || !out) return ERR_NULL_PTR;
+    if (n > UINT_MAX / 2 || len > UINT_MAX / 2) return ERR_IO;
+    error_t err = buffer_reserve(out, len);
+    if (err != ERR_OK) return err;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit2(&z, -15) != Z_OK) return ERR_MALLOC_FAILED;
+    bool ok = !dict || inflateSetDictionary(&z, (const Bytef*)dict->data, (uInt)dict->len) == Z_OK;
+    z.next_in = (const Bytef*)data;
+    z.avail_in = (uInt)n;
+    z.next_out = (Bytef*)out->data + out->len;
+    z.avail_out = (uInt)len;
+    ok = ok && inflate(&z, Z_FINISH) == Z_STREAM_END && z.total_out == len;
+    inflateEnd(&z);
+    if (!ok) {
+        out->data[out->len] = '\0';
+        return ERR_IO;
+    }
+    out->len += len;
+    out->data[out->len] = '\0';
+    return ERR_OK;
+}
@@ -0,0 +1,67 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "git_for_logic.h"
+#include "value.h"
+#include "buffer.h"
+
+// Per-object compression with a preset dictionary. Stored objects are
+// small JSON documents that repeat the same keys and values; compressed
+// one by one they barely shrink, but against a dictionary of the repo's
+// own common substrings they do, and each one still decompresses on its
+// own. Objects are raw deflate streams (zlib) primed with the dictionary.
+//
+// Dictionaries live in .logicgit/dict as <id>.dict, id being eight hex
+// digits: the first four bytes of the dictionary's SHA-1, little-endian.
+// dict/CURRENT names the one new objects are written with. Whatever was
+// compressed records its dictionary's id, so old dictionaries are kept.
+
+#define DICT_SUBDIR "dict"
+#define DICT_MAX (16 * 1024)
+#define DICT_MIN_SAMPLES 64
+
+typedef struct {
+    uint32_t id;
+    char* data;
+    size_t len;
+} dict_t;
+
+// Builds a dictionary of at most DICT_MAX bytes from samples: segments
+// covering the most frequent 8-byte substrings, the most valuable last,
+// where deflate reaches them with the shortest distances. Returns
+// ERR_FILE_NOT_FOUND if there are fewer than DICT_MIN_SAMPLES samples.
+error_t dict_train(const str_t* samples, size_t n, buffer_t* out);
+
+// Writes a dictionary under logicgit_dir and makes it CURRENT.
+error_t dict_save(const char* logicgit_dir, const char* data, size_t len, uint32_t* id);
+
+// Every dictionary of a repository, loaded at once so readers on any
+// thread can use them.
+typedef struct {
+    dict_t* dicts;
+    size_t count;
+    const dict_t* current;      // NULL if there is no CURRENT
+} dict_set_t;
+
+error_t dict_set_load(dict_set_t* set, const char* logicgit_dir);
+void dict_set_free(dict_set_t* set);
+const dict_t* dict_set_find(const dict_set_t* set, uint32_t id);
+
+// A deflate stream kept open across objects. Not thread-safe.
+typedef struct compressor compressor_t;
+
+error_t compressor_open(compressor_t** out, const dict_t* dict);
+void compressor_close(compressor_t* compressor);
+uint32_t compressor_dict_id(const compressor_t* compressor);
+
+// Appends data, compressed, to out. Returns ERR_BUFFER_OVERFLOW, leaving
+// out as it was, if that does not save at least an eighth of len.
+error_t compressor_run(compressor_t* compressor, const char* data, size_t len, buffer_t* out);
+
+// Appends the len bytes that data (compressed against dict) holds to out.
+// Returns ERR_IO if data is corrupt or does not hold exactly len bytes.
+error_t decompress(const dict_t* dict, const char* data, size_t n, size_t len, buffer_t* out);
+
+#endif
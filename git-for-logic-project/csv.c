@@ -0,0 +1,663 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "csv.h"
+#include "arena.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSV_HAVE_X86 1
+#endif
+
+#define CSV_BLOCK 64
+#define CSV_WINDOW (32 * 1024)
+#define CSV_NUM_MAX 127
+#define CSV_INT_MAX_DIGITS 18
+#define CSV_FAST_DIGITS 15
+#define CSV_SCRATCH_BLOCK 4096
+// Columns are CSV_STRIDE cells apart. The pad keeps them off the same
+// cache sets, which a power-of-two stride would alias onto.
+#define CSV_STRIDE (CSV_BATCH_ROWS + 8)
+
+// Per-block classification produced by a stage-1 kernel. Bit i describes
+// byte i of the block.
+typedef struct {
+    uint64_t quote;
+    uint64_t comma;
+    uint64_t newline;
+} block_masks_t;
+
+typedef void (*classify_fn)(const uint8_t* block, block_masks_t* out);
+
+struct csv_reader {
+    const char* buf;
+    size_t len;
+
+    // Stage 1
+    classify_fn classify;
+    size_t next_block;
+    uint64_t prev_in_quote;     // all ones if the next block starts quoted
+    size_t window_base;
+    uint32_t index[CSV_WINDOW];
+    size_t nindex;
+
+    // Stage 2
+    size_t field_start;
+    size_t col;
+    str_t* header;
+    size_t nheader;
+    size_t header_cap;
+    bool have_header;
+    bool header_detached;       // names copied out of the input
+    size_t ncols;
+
+    str_t* cells;               // column-major, CSV_STRIDE per column
+    uint8_t* empty;             // column-major
+    uint8_t* kinds;             // column-major, for COL_MIXED columns
+    void* values;               // column-major, 8 bytes per cell
+    csv_column_t* columns;
+    column_type_t* inferred;
+    bool have_types;
+    size_t nrows;
+    arena_t scratch;            // unquoted cells containing "", per batch
+    arena_t scratch_names;      // unquoted header names, per walk
+
+    batch_fn fn;
+    void* ctx;
+};
+
+typedef struct csv_reader csv_parser_t;
+
+// ---------------------------------------------------------------------------
+// Stage 1 kernels
+// ---------------------------------------------------------------------------
+
+static void classify_scalar(const uint8_t* in, block_masks_t* m) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < CSV_BLOCK; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (in[i]) {
+            case '"': m->quote |= bit; break;
+            case ',': m->comma |= bit; break;
+            case '\n': m->newline |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#ifdef CSV_HAVE_X86
+#ifdef __SSE2__
+static void classify_sse2(const uint8_t* in, block_masks_t* m) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(in + 16 * i));
+        int shift = 16 * i;
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        m->comma |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)) << shift;
+        m->newline |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << shift;
+    }
+}
+#endif
+
+__attribute__((target("avx2")))
+static void classify_avx2(const uint8_t* in, block_masks_t* m) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(in + 32 * i));
+        int shift = 32 * i;
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        m->comma |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)) << shift;
+        m->newline |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline)) << shift;
+    }
+}
+#endif
+
+static classify_fn select_kernel(const char** name) {
+#ifdef CSV_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        if (name) *name = "avx2";
+        return classify_avx2;
+    }
+#ifdef __SSE2__
+    if (name) *name = "sse2";
+    return classify_sse2;
+#endif
+#endif
+    if (name) *name = "scalar";
+    return classify_scalar;
+}
+
+const char* csv_kernel_name(void) {
+    const char* name = NULL;
+    select_kernel(&name);
+    return name;
+}
+
+// Bit i of the result is the XOR of bits 0..i of x.
+static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static void index_block(csv_parser_t* p, const uint8_t* block, uint32_t rel) {
+    block_masks_t m;
+    p->classify(block, &m);
+
+    uint64_t in_quote = prefix_xor(m.quote) ^ p->prev_in_quote;
+    p->prev_in_quote = (uint64_t)((int64_t)in_quote >> 63);
+
+    uint64_t separators = (m.comma | m.newline) & ~in_quote;
+    while (separators) {
+        p->index[p->nindex++] = rel + (uint32_t)__builtin_ctzll(separators);
+        separators &= separators - 1;
+    }
+}
+
+// Indexes the next window. Returns false at end of input.
+static bool refill(csv_parser_t* p) {
+    p->nindex = 0;
+    while (p->nindex == 0) {
+        if (p->next_block >= p->len) return false;
+        p->window_base = p->next_block;
+        size_t end = p->len - p->window_base > CSV_WINDOW ? p->window_base + CSV_WINDOW : p->len;
+        size_t pos = p->window_base;
+        for (; pos + CSV_BLOCK <= end; pos += CSV_BLOCK) {
+            index_block(p, (const uint8_t*)p->buf + pos, (uint32_t)(pos - p->window_base));
+        }
+        if (pos < end) {
+            // Tail shorter than a block: pad with spaces.
+            uint8_t tail[CSV_BLOCK];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p->buf + pos, end - pos);
+            index_block(p, tail, (uint32_t)(pos - p->window_base));
+            pos = end;
+        }
+        p->next_block = pos;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Cell values
+// ---------------------------------------------------------------------------
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool parse_bool(str_t s, uint8_t* out) {
+    static const char* const truthy[] = { "true", "True", "TRUE" };
+    static const char* const falsy[] = { "false", "False", "FALSE" };
+    for (size_t i = 0; i < 3; i++) {
+        if (s.len == 4 && memcmp(s.ptr, truthy[i], 4) == 0) {
+            *out = 1;
+            return true;
+        }
+        if (s.len == 5 && memcmp(s.ptr, falsy[i], 5) == 0) {
+            *out = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_int(str_t s, int64_t* out) {
+    size_t i = 0;
+    bool neg = false;
+    if (i < s.len && (s.ptr[i] == '-' || s.ptr[i] == '+')) neg = s.ptr[i++] == '-';
+    if (i == s.len) return false;
+    // Leading zeros do not count: "00042" is 42, as Number() reads it.
+    while (i + 1 < s.len && s.ptr[i] == '0') i++;
+    if (s.len - i > CSV_INT_MAX_DIGITS) return false;
+    uint64_t v = 0;
+    for (; i < s.len; i++) {
+        if (!is_digit(s.ptr[i])) return false;
+        v = v * 10 + (uint64_t)(s.ptr[i] - '0');
+    }
+    *out = neg ? -(int64_t)v : (int64_t)v;
+    return true;
+}
+
+static bool parse_double(str_t s, double* out) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* c = s.ptr;
+    size_t n = s.len;
+    size_t i = 0;
+    bool neg = false;
+    if (i < n && (c[i] == '-' || c[i] == '+')) neg = c[i++] == '-';
+
+    uint64_t mantissa = 0;
+    size_t digits = 0;
+    size_t frac = 0;
+    for (; i < n && is_digit(c[i]); i++, digits++) mantissa = mantissa * 10 + (uint64_t)(c[i] - '0');
+    if (i < n && c[i] == '.') {
+        for (i++; i < n && is_digit(c[i]); i++, digits++, frac++) {
+            mantissa = mantissa * 10 + (uint64_t)(c[i] - '0');
+        }
+    }
+    if (digits == 0) return false;
+    bool exponent = i < n && (c[i] == 'e' || c[i] == 'E');
+    if (exponent) {
+        i++;
+        if (i < n && (c[i] == '+' || c[i] == '-')) i++;
+        size_t exp_start = i;
+        while (i < n && is_digit(c[i])) i++;
+        if (i == exp_start) return false;
+    }
+    if (i != n) return false;
+
+    if (!exponent && digits <= CSV_FAST_DIGITS) {
+        // Exact mantissa and power of ten: one correctly rounded division.
+        double v = (double)mantissa / pow10[frac];
+        *out = neg ? -v : v;
+        return true;
+    }
+    if (n > CSV_NUM_MAX) return false;
+    char tmp[CSV_NUM_MAX + 1];
+    memcpy(tmp, s.ptr, n);
+    tmp[n] = '\0';
+    *out = strtod(tmp, NULL);
+    return true;
+}
+
+static column_type_t cell_type(str_t s) {
+    uint8_t b;
+    int64_t i;
+    double d;
+    if (parse_bool(s, &b)) return COL_BOOL;
+    if (parse_int(s, &i)) return COL_INT;
+    if (parse_double(s, &d)) return COL_DOUBLE;
+    return COL_STRING;
+}
+
+static column_type_t merge_types(column_type_t a, column_type_t b) {
+    if (a == b) return a;
+    if ((a == COL_INT || a == COL_DOUBLE) && (b == COL_INT || b == COL_DOUBLE)) return COL_DOUBLE;
+    return COL_MIXED;
+}
+
+const char* column_type_name(column_type_t type) {
+    switch (type) {
+        case COL_BOOL: return "bool";
+        case COL_INT: return "int";
+        case COL_DOUBLE: return "double";
+        case COL_STRING: return "string";
+        case COL_MIXED: return "mixed";
+    }
+    return "unknown";
+}
+
+static inline bool is_edge(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '"';
+}
+
+// Trims whitespace, strips the enclosing quotes and collapses "" escapes.
+static error_t cell_text(csv_parser_t* p, str_t raw, str_t* out) {
+    const char* s = raw.ptr;
+    size_t n = raw.len;
+    if (n == 0 || (!is_edge(s[0]) && !is_edge(s[n - 1]))) {
+        // Common case: nothing to trim or unquote.
+        *out = raw;
+        return ERR_OK;
+    }
+    while (n && (*s == ' ' || *s == '\t' || *s == '\r')) {
+        s++;
+        n--;
+    }
+    while (n && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r')) n--;
+    if (n && *s == '"') {
+        s++;
+        n--;
+        if (n && s[n - 1] == '"') n--;
+        if (memchr(s, '"', n)) {
+            char* buf = (char*)arena_alloc(&p->scratch, n + 1);
+            if (!buf) return ERR_MALLOC_FAILED;
+            size_t k = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (s[i] != '"') {
+                    buf[k++] = s[i];
+                } else if (i + 1 < n && s[i + 1] == '"') {
+                    buf[k++] = '"';
+                    i++;
+                }
+            }
+            buf[k] = '\0';
+            s = buf;
+            n = k;
+        }
+    }
+    *out = (str_t){ s, n };
+    return ERR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Stage 2
+// ---------------------------------------------------------------------------
+
+// Parses column `c` of the batch as `type`. Returns false if a cell does
+// not fit, leaving the caller to retry with a wider type; a string column
+// fits only if none of its cells reads as a number or a bool.
+static bool fill_column(csv_parser_t* p, size_t c, column_type_t type) {
+    csv_column_t* col = &p->columns[c];
+    const str_t* cells = p->cells + c * CSV_STRIDE;
+    const uint8_t* empty = p->empty + c * CSV_STRIDE;
+    void* values = (char*)p->values + c * CSV_STRIDE * sizeof(uint64_t);
+
+    col->type = type;
+    col->empty = empty;
+    switch (type) {
+        case COL_BOOL: {
+            uint8_t* out = (uint8_t*)values;
+            for (size_t r = 0; r < p->nrows; r++) {
+                if (!empty[r] && !parse_bool(cells[r], &out[r])) return false;
+            }
+            col->v.b = out;
+            return true;
+        }
+        case COL_INT: {
+            int64_t* out = (int64_t*)values;
+            for (size_t r = 0; r < p->nrows; r++) {
+                if (!empty[r] && !parse_int(cells[r], &out[r])) return false;
+            }
+            col->v.i64 = out;
+            return true;
+        }
+        case COL_DOUBLE: {
+            double* out = (double*)values;
+            for (size_t r = 0; r < p->nrows; r++) {
+                if (!empty[r] && !parse_double(cells[r], &out[r])) return false;
+            }
+            col->v.f64 = out;
+            return true;
+        }
+        case COL_STRING:
+            for (size_t r = 0; r < p->nrows; r++) {
+                if (!empty[r] && cell_type(cells[r]) != COL_STRING) return false;
+            }
+            col->v.s = cells;
+            return true;
+        case COL_MIXED: {
+            csv_cell_t* out = (csv_cell_t*)values;
+            uint8_t* kinds = p->kinds + c * CSV_STRIDE;
+            for (size_t r = 0; r < p->nrows; r++) {
+                // Empty cells keep COL_STRING; readers check `empty` first.
+                column_type_t t = COL_STRING;
+                if (!empty[r]) {
+                    if (parse_bool(cells[r], &out[r].b)) t = COL_BOOL;
+                    else if (parse_int(cells[r], &out[r].i64)) t = COL_INT;
+                    else if (parse_double(cells[r], &out[r].f64)) t = COL_DOUBLE;
+                }
+                kinds[r] = (uint8_t)t;
+            }
+            col->kinds = kinds;
+            col->text = cells;
+            col->v.mixed = out;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void infer_types(csv_parser_t* p) {
+    for (size_t c = 0; c < p->ncols; c++) {
+        const str_t* cells = p->cells + c * CSV_STRIDE;
+        const uint8_t* empty = p->empty + c * CSV_STRIDE;
+        column_type_t type = COL_STRING;
+        bool seen = false;
+        for (size_t r = 0; r < p->nrows; r++) {
+            if (empty[r]) continue;
+            column_type_t t = cell_type(cells[r]);
+            type = seen ? merge_types(type, t) : t;
+            seen = true;
+            if (type == COL_MIXED) break;
+        }
+        p->inferred[c] = type;
+    }
+    p->have_types = true;
+}
+
+static error_t flush_batch(csv_parser_t* p) {
+    if (p->nrows == 0) return ERR_OK;
+
+    for (size_t c = 0; c < p->ncols; c++) {
+        str_t* cells = p->cells + c * CSV_STRIDE;
+        uint8_t* empty = p->empty + c * CSV_STRIDE;
+        for (size_t r = 0; r < p->nrows; r++) {
+            error_t err = cell_text(p, cells[r], &cells[r]);
+            if (err != ERR_OK) return err;
+            empty[r] = cells[r].len == 0;
+        }
+    }
+    if (!p->have_types) infer_types(p);
+
+    for (size_t c = 0; c < p->ncols; c++) {
+        column_type_t type = p->inferred[c];
+        while (!fill_column(p, c, type)) type = type == COL_INT ? COL_DOUBLE : COL_MIXED;
+    }
+
+    csv_batch_t batch = { p->header, p->columns, p->ncols, p->nrows };
+    error_t err = p->fn(p->ctx, &batch);
+    arena_reset(&p->scratch);
+    p->nrows = 0;
+    return err;
+}
+
+static error_t start_table(csv_parser_t* p) {
+    p->ncols = p->nheader;
+    for (size_t c = 0; c < p->ncols; c++) {
+        error_t err = cell_text(p, p->header[c], &p->header[c]);
+        if (err != ERR_OK) return err;
+    }
+    // Header names live for the whole walk; keep their scratch copies.
+    arena_t names = p->scratch;
+    arena_init(&p->scratch, CSV_SCRATCH_BLOCK);
+    p->scratch_names = names;
+
+    size_t cells = p->ncols * CSV_STRIDE;
+    p->cells = (str_t*)malloc(cells * sizeof(str_t));
+    p->empty = (uint8_t*)malloc(cells);
+    p->kinds = (uint8_t*)malloc(cells);
+    p->values = malloc(cells * sizeof(uint64_t));
+    p->columns = (csv_column_t*)calloc(p->ncols, sizeof(csv_column_t));
+    p->inferred = (column_type_t*)calloc(p->ncols, sizeof(column_type_t));
+    if (!p->cells || !p->empty || !p->kinds || !p->values || !p->columns || !p->inferred) return ERR_MALLOC_FAILED;
+    p->have_header = true;
+    return ERR_OK;
+}
+
+static bool is_blank(str_t s) {
+    for (size_t i = 0; i < s.len; i++) {
+        if (s.ptr[i] != ' ' && s.ptr[i] != '\t' && s.ptr[i] != '\r') return false;
+    }
+    return true;
+}
+
+static inline error_t end_cell(csv_parser_t* p, size_t end) {
+    str_t cell = { p->buf + p->field_start, end - p->field_start };
+    p->field_start = end + 1;
+    if (__builtin_expect(!p->have_header, 0)) {
+        if (p->nheader == p->header_cap) {
+            size_t cap = p->header_cap ? p->header_cap * 2 : 16;
+            str_t* grown = (str_t*)realloc(p->header, cap * sizeof(str_t));
+            if (!grown) return ERR_MALLOC_FAILED;
+            p->header = grown;
+            p->header_cap = cap;
+        }
+        p->header[p->nheader++] = cell;
+    } else if (p->col < p->ncols) {
+        p->cells[p->col * CSV_STRIDE + p->nrows] = cell;
+    }
+    p->col++;
+    return ERR_OK;
+}
+
+static error_t end_row(csv_parser_t* p) {
+    size_t ncells = p->col;
+    p->col = 0;
+    if (!p->have_header) {
+        if (p->nheader == 1 && is_blank(p->header[0])) {
+            p->nheader = 0;
+            return ERR_OK;
+        }
+        return start_table(p);
+    }
+    if (ncells == 1 && is_blank(p->cells[p->nrows])) return ERR_OK;
+    for (size_t c = ncells; c < p->ncols; c++) {
+        p->cells[c * CSV_STRIDE + p->nrows] = (str_t){ p->buf + p->field_start, 0 };
+    }
+    if (++p->nrows == CSV_BATCH_ROWS) return flush_batch(p);
+    return ERR_OK;
+}
+
+// Walks one buffer of whole rows; the table state carries over to the
+// next buffer.
+static error_t parse_rows(csv_parser_t* p, const char* buf, size_t len) {
+    p->buf = buf;
+    p->len = len;
+    p->next_block = 0;
+    p->window_base = 0;
+    p->nindex = 0;
+    p->field_start = 0;
+    p->prev_in_quote = 0;
+    while (refill(p)) {
+        for (size_t i = 0; i < p->nindex; i++) {
+            size_t pos = p->window_base + p->index[i];
+            error_t err = end_cell(p, pos);
+            if (err == ERR_OK && p->buf[pos] == '\n') err = end_row(p);
+            if (err != ERR_OK) return err;
+        }
+    }
+    if (p->field_start < p->len || p->col > 0) {
+        error_t err = end_cell(p, p->len);
+        if (err == ERR_OK) err = end_row(p);
+        if (err != ERR_OK) return err;
+    }
+    return ERR_OK;
+}
+
+// Copies what still points into the current buffer (header names and the
+// rows of the pending batch) into the parser's arenas, so the caller may
+// reuse the buffer.
+static error_t detach(csv_parser_t* p) {
+    if (p->have_header && !p->header_detached) {
+        for (size_t c = 0; c < p->ncols; c++) {
+            str_t* name = &p->header[c];
+            char* copy = (char*)arena_alloc(&p->scratch_names, name->len + 1);
+            if (!copy) return ERR_MALLOC_FAILED;
+            memcpy(copy, name->ptr, name->len);
+            copy[name->len] = '\0';
+            name->ptr = copy;
+        }
+        p->header_detached = true;
+    }
+    for (size_t c = 0; c < p->ncols; c++) {
+        str_t* cells = p->cells + c * CSV_STRIDE;
+        for (size_t r = 0; r < p->nrows; r++) {
+            if (cells[r].len == 0) {
+                cells[r].ptr = "";
+                continue;
+            }
+            char* copy = (char*)arena_alloc(&p->scratch, cells[r].len);
+            if (!copy) return ERR_MALLOC_FAILED;
+            memcpy(copy, cells[r].ptr, cells[r].len);
+            cells[r].ptr = copy;
+        }
+    }
+    return ERR_OK;
+}
+
+error_t csv_reader_open(csv_reader_t** out, batch_fn fn, void* ctx) {
+    if (!out || !fn) return ERR_NULL_PTR;
+    csv_parser_t* p = (csv_parser_t*)calloc(1, sizeof(csv_parser_t));
+    if (!p) return ERR_MALLOC_FAILED;
+    p->classify = select_kernel(NULL);
+    p->fn = fn;
+    p->ctx = ctx;
+    arena_init(&p->scratch, CSV_SCRATCH_BLOCK);
+    arena_init(&p->scratch_names, CSV_SCRATCH_BLOCK);
+    *out = p;
+    return ERR_OK;
+}
+
+error_t csv_reader_feed(csv_reader_t* p, const char* buf, size_t len) {
+    if (!p || !buf) return ERR_NULL_PTR;
+    error_t err = parse_rows(p, buf, len);
+    if (err == ERR_OK) err = detach(p);
+    return err;
+}
+
+error_t csv_reader_finish(csv_reader_t* p) {
+    if (!p) return ERR_NULL_PTR;
+    if (!p->have_header) return ERR_INVALID_JSON;
+    return flush_batch(p);
+}
+
+void csv_reader_free(csv_reader_t* p) {
+    if (!p) return;
+    arena_free(&p->scratch);
+    arena_free(&p->scratch_names);
+    free(p->header);
+    free(p->cells);
+    free(p->empty);
+    free(p->kinds);
+    free(p->values);
+    free(p->columns);
+    free(p->inferred);
+    free(p);
+}
+
+error_t csv_for_each_batch(const char* buf, size_t len, batch_fn fn, void* ctx) {
+    if (!buf || !fn) return ERR_NULL_PTR;
+    csv_parser_t* p = NULL;
+    error_t err = csv_reader_open(&p, fn, ctx);
+    if (err != ERR_OK) return err;
+    // The whole file is one buffer, so nothing needs detaching.
+    err = parse_rows(p, buf, len);
+    if (err == ERR_OK) err = csv_reader_finish(p);
+    csv_reader_free(p);
+    return err;
+}
+
+void csv_batch_row(const csv_batch_t* batch, size_t row, field_t* out) {
+    for (size_t c = 0; c < batch->ncolumns; c++) {
+        const csv_column_t* col = &batch->columns[c];
+        out[c].name = batch->names[c];
+        if (col->empty[row]) {
+            out[c].value = value_str((str_t){ "", 0 });
+            continue;
+        }
+        switch (col->type) {
+            case COL_BOOL: out[c].value = value_bool(col->v.b[row] != 0); break;
+            case COL_INT: out[c].value = value_num((double)col->v.i64[row]); break;
+            case COL_DOUBLE: out[c].value = value_num(col->v.f64[row]); break;
+            case COL_STRING: out[c].value = value_str(col->v.s[row]); break;
+            case COL_MIXED: {
+                const csv_cell_t* cell = &col->v.mixed[row];
+                switch ((column_type_t)col->kinds[row]) {
+                    case COL_BOOL: out[c].value = value_bool(cell->b != 0); break;
+                    case COL_INT: out[c].value = value_num((double)cell->i64); break;
+                    case COL_DOUBLE: out[c].value = value_num(cell->f64); break;
+                    default: out[c].value = value_str(col->text[row]); break;
+                }
+                break;
+            }
+        }
+    }
+}
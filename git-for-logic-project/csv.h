@@ -0,0 +1,102 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stdint.h>
+#include "git_for_logic.h"
+#include "value.h"
+
+// Vectorized CSV reader for data files.
+//
+// Stage 1 classifies 64-byte blocks with SIMD (AVX2, SSE2 or scalar,
+// picked at runtime) into quote / comma / newline bitmasks, turns the
+// quote mask into an in-quotes mask with a prefix XOR (a doubled "" flips
+// it twice, so escaped quotes need no special case), and indexes the
+// unquoted separators one window at a time.
+//
+// Stage 2 cuts cells from that index into column-major batches of up to
+// CSV_BATCH_ROWS rows. The first row is the header. Column types are
+// inferred from a sample, the first batch, and pick each column's storage:
+// a plain int64, double, bool or string array, or a mixed one that tags
+// every cell. A later batch whose cells do not all fit widens that column
+// for the batch (int -> double -> mixed, bool or string -> mixed).
+//
+// The inferred type never changes a value. The legacy parseCsv types
+// every cell by its own text, so a column sampled as strings still reads
+// a later "12" as the number 12, and a value does not depend on which
+// batch it lands in. Cells follow parseCsv otherwise too: surrounding
+// whitespace is trimmed, numeric text becomes a number even when quoted,
+// leading zeros are dropped as Number() drops them ("00042" is 42),
+// missing trailing cells are empty and extra cells are ignored. Unlike
+// parseCsv, true and false become bools. Quoted cells may contain commas,
+// newlines and "" escapes. Blank lines are skipped and an unterminated
+// quote runs to the end of the file.
+
+#define CSV_BATCH_ROWS 4096
+
+typedef enum {
+    COL_BOOL = 0,
+    COL_INT,
+    COL_DOUBLE,
+    COL_STRING,
+    COL_MIXED
+} column_type_t;
+
+// One typed cell of a COL_MIXED column.
+typedef union {
+    uint8_t b;
+    int64_t i64;
+    double f64;
+} csv_cell_t;
+
+typedef struct {
+    column_type_t type;
+    const uint8_t* empty;       // per row: 1 if the cell was empty
+    const uint8_t* kinds;       // COL_MIXED: per row, the cell's column_type_t
+    const str_t* text;          // COL_MIXED: the text of string cells
+    union {
+        const uint8_t* b;
+        const int64_t* i64;
+        const double* f64;
+        const str_t* s;
+        const csv_cell_t* mixed;
+    } v;
+} csv_column_t;
+
+// One batch of rows. Everything it points to is valid only during the
+// callback; string cells are slices of the input where possible.
+typedef struct {
+    const str_t* names;
+    const csv_column_t* columns;
+    size_t ncolumns;
+    size_t nrows;
+} csv_batch_t;
+
+typedef error_t (*batch_fn)(void* ctx, const csv_batch_t* batch);
+
+// Returns ERR_INVALID_JSON if the file has no header, or whatever the
+// callback returned if it stopped the walk.
+error_t csv_for_each_batch(const char* buf, size_t len, batch_fn fn, void* ctx);
+
+// Incremental form of csv_for_each_batch for input that arrives in pieces.
+// Every piece passed to csv_reader_feed must end on a row boundary (after
+// an unquoted newline, or at end of file); the header, inferred types and
+// the pending batch carry over, so batches and results match a single
+// csv_for_each_batch over the concatenation. The piece may be reused once
+// feed returns. csv_reader_finish flushes the last batch.
+typedef struct csv_reader csv_reader_t;
+
+error_t csv_reader_open(csv_reader_t** out, batch_fn fn, void* ctx);
+error_t csv_reader_feed(csv_reader_t* reader, const char* buf, size_t len);
+error_t csv_reader_finish(csv_reader_t* reader);
+void csv_reader_free(csv_reader_t* reader);
+
+// Fills out[0..ncolumns) with the cells of one row. Empty cells are "",
+// as in the legacy reader.
+void csv_batch_row(const csv_batch_t* batch, size_t row, field_t* out);
+
+const char* column_type_name(column_type_t type);
+
+// Name of the stage-1 kernel this CPU will use ("avx2", "sse2", "scalar").
+const char* csv_kernel_name(void);
+
+#endif
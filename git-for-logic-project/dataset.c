@@ -0,0 +1,465 @@
+#define _DEFAULT_SOURCE           // For syscall
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "dataset.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(STATX_BASIC_STATS)
+#define DATASET_HAVE_URING 1
+#endif
+#endif
+
+#define NAMES_INITIAL 64
+
+// Completion tags, in the low bits of user_data; the slot is above them.
+enum { OP_STAT, OP_OPEN, OP_READ, OP_CLOSE, OP_BITS = 2 };
+
+typedef struct {
+    size_t file;
+    int fd;
+    int err;                    // errno of the first failed step, or 0
+    unsigned pending;           // stat / open completions still due
+    bool ready;
+    struct stat st;
+    char* buf;
+    size_t cap;
+    size_t len;
+#ifdef DATASET_HAVE_URING
+    struct statx stx;
+#endif
+} slot_t;
+
+#ifdef DATASET_HAVE_URING
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_len;
+    void* cq_map;
+    size_t cq_map_len;
+    size_t sqes_len;
+    unsigned queued;            // SQEs written but not yet submitted
+    size_t inflight;            // submitted, completion not yet reaped
+} uring_t;
+#endif
+
+struct dataset {
+    DIR* dir;
+    char** names;
+    size_t count;
+    slot_t slots[DATASET_DEPTH];
+#ifdef DATASET_HAVE_URING
+    uring_t ring;
+    bool uring;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// Synchronous path
+// ---------------------------------------------------------------------------
+
+static bool reserve(slot_t* slot, size_t len) {
+    if (len <= slot->cap) return true;
+    char* buf = (char*)realloc(slot->buf, len);
+    if (!buf) return false;
+    slot->buf = buf;
+    slot->cap = len;
+    return true;
+}
+
+static error_t errno_error(int err) {
+    return err == ENOENT ? ERR_FILE_NOT_FOUND : ERR_IO;
+}
+
+static error_t read_sync(dataset_t* set, slot_t* slot) {
+    int fd = openat(dirfd(set->dir), set->names[slot->file], O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno_error(errno);
+    error_t err = fstat(fd, &slot->st) == 0 ? ERR_OK : ERR_IO;
+    size_t want = err == ERR_OK ? (size_t)slot->st.st_size : 0;
+    if (err == ERR_OK && !reserve(slot, want)) err = ERR_MALLOC_FAILED;
+    slot->len = 0;
+    while (err == ERR_OK && slot->len < want) {
+        ssize_t got = pread(fd, slot->buf + slot->len, want - slot->len, (off_t)slot->len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) err = ERR_IO;
+        if (got <= 0) break;
+        slot->len += (size_t)got;
+    }
+    close(fd);
+    return err;
+}
+
+// ---------------------------------------------------------------------------
+// io_uring path
+// ---------------------------------------------------------------------------
+
+#ifdef DATASET_HAVE_URING
+static error_t uring_open(uring_t* ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) return ERR_IO;
+    ring->entries = p.sq_entries;
+
+    ring->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_len > ring->sq_map_len) ring->sq_map_len = ring->cq_map_len;
+    }
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        close(ring->fd);
+        return ERR_IO;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            munmap(ring->sq_map, ring->sq_map_len);
+            close(ring->fd);
+            return ERR_IO;
+        }
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_len);
+        munmap(ring->sq_map, ring->sq_map_len);
+        close(ring->fd);
+        return ERR_IO;
+    }
+
+    char* sq = (char*)ring->sq_map;
+    char* cq = (char*)ring->cq_map;
+    ring->sq_head = (unsigned*)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return ERR_OK;
+}
+
+static void uring_close(uring_t* ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_map != ring->sq_map) munmap(ring->cq_map, ring->cq_map_len);
+    munmap(ring->sq_map, ring->sq_map_len);
+    close(ring->fd);
+}
+
+// Submits what is queued and, with wait set, blocks for one completion.
+static error_t uring_enter(uring_t* ring, bool wait) {
+    for (;;) {
+        long done = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait ? 1 : 0,
+                            wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (done < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            if (errno == EINTR) continue;
+            // Completion queue is full: let the caller reap first.
+            return ERR_OK;
+        }
+        if (done < 0) return ERR_IO;
+        ring->queued -= (unsigned)done;
+        ring->inflight += (size_t)done;
+        return ERR_OK;
+    }
+}
+
+static struct io_uring_sqe* uring_sqe(uring_t* ring) {
+    unsigned tail = *ring->sq_tail;
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head == ring->entries) {
+        if (uring_enter(ring, false) != ERR_OK) return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head == ring->entries) return NULL;
+    }
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+static void uring_push(uring_t* ring) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+}
+
+static bool submit(dataset_t* set, uint8_t op, int fd, const void* addr, uint32_t len, uint64_t off,
+                   size_t slot) {
+    struct io_uring_sqe* sqe = uring_sqe(&set->ring);
+    if (!sqe) return false;
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = off;
+    sqe->user_data = (uint64_t)slot << OP_BITS;
+    switch (op) {
+        case IORING_OP_STATX: sqe->user_data |= OP_STAT; break;
+        case IORING_OP_OPENAT:
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data |= OP_OPEN;
+            break;
+        case IORING_OP_READ: sqe->user_data |= OP_READ; break;
+        default: sqe->user_data |= OP_CLOSE; break;
+    }
+    uring_push(&set->ring);
+    return true;
+}
+
+static void finish_slot(dataset_t* set, slot_t* slot) {
+    if (slot->fd >= 0 && !submit(set, IORING_OP_CLOSE, slot->fd, NULL, 0, 0, 0)) close(slot->fd);
+    slot->fd = -1;
+    slot->ready = true;
+}
+
+static void read_next(dataset_t* set, slot_t* slot, size_t index) {
+    size_t want = (size_t)slot->st.st_size;
+    if (slot->len == want) {
+        finish_slot(set, slot);
+        return;
+    }
+    size_t chunk = want - slot->len;
+    if (chunk > UINT32_MAX) chunk = UINT32_MAX;
+    if (!submit(set, IORING_OP_READ, slot->fd, slot->buf + slot->len, (uint32_t)chunk, slot->len, index)) {
+        slot->err = EIO;
+        finish_slot(set, slot);
+    }
+}
+
+static void stat_from_statx(struct stat* st, const struct statx* stx) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = (ino_t)stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_size = (off_t)stx->stx_size;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+static void complete(dataset_t* set, uint64_t user_data, int res) {
+    slot_t* slot = &set->slots[user_data >> OP_BITS];
+    size_t index = (size_t)(user_data >> OP_BITS);
+    switch ((int)(user_data & ((1u << OP_BITS) - 1))) {
+        case OP_STAT:
+            if (res < 0 && !slot->err) slot->err = -res;
+            if (res >= 0) stat_from_statx(&slot->st, &slot->stx);
+            break;
+        case OP_OPEN:
+            if (res < 0 && !slot->err) slot->err = -res;
+            if (res >= 0) slot->fd = res;
+            break;
+        case OP_READ:
+            if (res == -EINTR || res == -EAGAIN) {
+                read_next(set, slot, index);
+            } else if (res <= 0) {
+                // Error, or the file shrank since it was stat'ed.
+                if (res < 0) slot->err = -res;
+                finish_slot(set, slot);
+            } else {
+                slot->len += (size_t)res;
+                read_next(set, slot, index);
+            }
+            return;
+        default:
+            return;
+    }
+    if (--slot->pending) return;
+    if (!slot->err && !reserve(slot, (size_t)slot->st.st_size)) slot->err = ENOMEM;
+    if (slot->err) {
+        finish_slot(set, slot);
+        return;
+    }
+    read_next(set, slot, index);
+}
+
+static void reap(dataset_t* set) {
+    uring_t* ring = &set->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        uint64_t user_data = cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+        ring->inflight--;
+        complete(set, user_data, res);
+    }
+}
+
+// Queues the stat and open of a file; its read follows once both are in.
+static void start_slot(dataset_t* set, size_t file) {
+    size_t index = file % DATASET_DEPTH;
+    slot_t* slot = &set->slots[index];
+    slot->file = file;
+    slot->fd = -1;
+    slot->err = 0;
+    slot->len = 0;
+    slot->ready = false;
+    slot->pending = 2;
+    const char* name = set->names[file];
+    int dir = dirfd(set->dir);
+    if (!submit(set, IORING_OP_STATX, dir, name, STATX_BASIC_STATS, (uint64_t)(uintptr_t)&slot->stx, index)) {
+        slot->err = EIO;
+        slot->pending--;
+    }
+    if (!submit(set, IORING_OP_OPENAT, dir, name, 0, 0, index)) {
+        slot->err = EIO;
+        slot->pending--;
+    }
+    if (slot->pending == 0) finish_slot(set, slot);
+}
+
+static error_t wait_ready(dataset_t* set, slot_t* slot) {
+    while (!slot->ready) {
+        error_t err = uring_enter(&set->ring, true);
+        if (err != ERR_OK) return err;
+        reap(set);
+    }
+    return ERR_OK;
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Public API
+// ---------------------------------------------------------------------------
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+error_t dataset_open(dataset_t** out, const char* path, name_filter_fn accept) {
+    if (!out || !path || !accept) return ERR_NULL_PTR;
+    dataset_t* set = (dataset_t*)calloc(1, sizeof(dataset_t));
+    if (!set) return ERR_MALLOC_FAILED;
+    set->dir = opendir(path);
+    if (!set->dir) {
+        free(set);
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    error_t err = ERR_OK;
+    size_t cap = 0;
+    for (struct dirent* entry; err == ERR_OK && (entry = readdir(set->dir));) {
+        if (entry->d_name[0] == '.' || !accept(entry->d_name)) continue;
+        if (set->count == cap) {
+            cap = cap ? cap * 2 : NAMES_INITIAL;
+            char** grown = (char**)realloc(set->names, cap * sizeof(char*));
+            if (!grown) {
+                err = ERR_MALLOC_FAILED;
+                break;
+            }
+            set->names = grown;
+        }
+        size_t len = strlen(entry->d_name);
+        char* name = (char*)malloc(len + 1);
+        if (!name) {
+            err = ERR_MALLOC_FAILED;
+            break;
+        }
+        memcpy(name, entry->d_name, len + 1);
+        set->names[set->count++] = name;
+    }
+    if (err != ERR_OK) {
+        dataset_close(set);
+        return err;
+    }
+    if (set->count) qsort(set->names, set->count, sizeof(char*), compare_names);
+
+#ifdef DATASET_HAVE_URING
+    // Up to three operations per slot can be outstanding at once.
+    set->uring = uring_open(&set->ring, 4 * DATASET_DEPTH) == ERR_OK;
+#endif
+    *out = set;
+    return ERR_OK;
+}
+
+void dataset_close(dataset_t* set) {
+    if (!set) return;
+#ifdef DATASET_HAVE_URING
+    if (set->uring) {
+        // Reads still in flight target the slot buffers.
+        while (set->ring.inflight || set->ring.queued) {
+            if (uring_enter(&set->ring, set->ring.inflight > 0) != ERR_OK) break;
+            reap(set);
+        }
+        uring_close(&set->ring);
+    }
+#endif
+    for (size_t i = 0; i < DATASET_DEPTH; i++) free(set->slots[i].buf);
+    for (size_t i = 0; i < set->count; i++) free(set->names[i]);
+    free(set->names);
+    if (set->dir) closedir(set->dir);
+    free(set);
+}
+
+size_t dataset_count(const dataset_t* set) {
+    return set->count;
+}
+
+const char* dataset_backend(const dataset_t* set) {
+#ifdef DATASET_HAVE_URING
+    if (set->uring) return "io_uring";
+#endif
+    (void)set;
+    return "pread";
+}
+
+error_t dataset_for_each(dataset_t* set, data_file_fn fn, void* ctx) {
+    if (!set || !fn) return ERR_NULL_PTR;
+#ifdef DATASET_HAVE_URING
+    size_t started = 0;
+#endif
+    for (size_t file = 0; file < set->count; file++) {
+        slot_t* slot = &set->slots[file % DATASET_DEPTH];
+        error_t err = ERR_OK;
+#ifdef DATASET_HAVE_URING
+        if (set->uring) {
+            // Keep the window full, then wait for the oldest file.
+            for (; started < set->count && started < file + DATASET_DEPTH; started++) start_slot(set, started);
+            err = uring_enter(&set->ring, false);
+            if (err == ERR_OK) err = wait_ready(set, slot);
+            if (err == ERR_OK && slot->err) {
+                // Kernels without these opcodes answer EINVAL.
+                err = slot->err == EINVAL || slot->err == EOPNOTSUPP ? read_sync(set, slot)
+                                                                     : errno_error(slot->err);
+            }
+        } else
+#endif
+        {
+            slot->file = file;
+            err = read_sync(set, slot);
+        }
+        if (err != ERR_OK) return err;
+
+        data_file_t view = { set->names[file], slot->buf ? slot->buf : "", slot->len, &slot->st };
+        err = fn(ctx, &view);
+        if (err != ERR_OK) return err;
+    }
+    return ERR_OK;
+}
@@ -0,0 +1,48 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "git_for_logic.h"
+
+// Reader for a directory of small data files, e.g. one file per customer.
+// The accepted names are listed once and visited in name order. On Linux
+// every file's statx, openat, read and close are submitted through an
+// io_uring (raw syscalls, no liburing), DATASET_DEPTH files ahead of the
+// one being visited, so evaluating a file overlaps with reading the next
+// ones and a whole window costs a handful of io_uring_enter calls instead
+// of four syscalls per file. Where io_uring is unavailable each file is
+// opened, stat'ed and pread() synchronously instead.
+
+#define DATASET_DEPTH 32
+
+typedef struct {
+    const char* name;           // relative to the directory
+    const char* data;
+    size_t len;
+    const struct stat* st;      // dev, ino, mode, size and mtime only
+} data_file_t;
+
+// Called once per file, in name order. data is valid only during the call.
+typedef error_t (*data_file_fn)(void* ctx, const data_file_t* file);
+
+typedef bool (*name_filter_fn)(const char* name);
+
+typedef struct dataset dataset_t;
+
+// Lists the entries of dir that accept() takes; hidden names are skipped.
+// Returns ERR_FILE_NOT_FOUND if dir cannot be opened.
+error_t dataset_open(dataset_t** out, const char* dir, name_filter_fn accept);
+void dataset_close(dataset_t* set);
+
+size_t dataset_count(const dataset_t* set);
+
+// "io_uring" or "pread".
+const char* dataset_backend(const dataset_t* set);
+
+// Returns ERR_FILE_NOT_FOUND or ERR_IO for a file that cannot be read, or
+// whatever fn returned if it stopped the walk.
+error_t dataset_for_each(dataset_t* set, data_file_fn fn, void* ctx);
+
+#endif
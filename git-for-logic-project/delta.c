@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "delta.h"
+
+#define DELTA_MAX_INSERT 127
+
+size_t delta_put_varint(uint8_t* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+size_t delta_get_varint(const uint8_t* p, size_t len, uint64_t* v) {
+    uint64_t r = 0;
+    for (size_t i = 0; i < len && i < 10; i++) {
+        r |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *v = r;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static error_t append_varint(buffer_t* out, uint64_t v) {
+    uint8_t tmp[10];
+    return buffer_append(out, tmp, delta_put_varint(tmp, v));
+}
+
+static uint32_t block_hash(const char* p) {
+    uint64_t a, b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    uint64_t h = (a ^ (b * 0x9E3779B97F4A7C15ULL)) * 0xFF51AFD7ED558CCDULL;
+    return (uint32_t)(h >> 32);
+}
+
+static error_t insert(buffer_t* out, const char* p, size_t n) {
+    error_t err = ERR_OK;
+    while (err == ERR_OK && n) {
+        size_t chunk = n < DELTA_MAX_INSERT ? n : DELTA_MAX_INSERT;
+        err = buffer_append_char(out, (char)chunk);
+        if (err == ERR_OK) err = buffer_append(out, p, chunk);
+        p += chunk;
+        n -= chunk;
+    }
+    return err;
+}
+
+static error_t copy(buffer_t* out, size_t offset, size_t size) {
+    error_t err = buffer_append_char(out, (char)DELTA_COPY);
+    if (err == ERR_OK) err = append_varint(out, offset);
+    if (err == ERR_OK) err = append_varint(out, size);
+    return err;
+}
+
+error_t delta_create(const char* base, size_t base_len, const char* target, size_t target_len,
+                     size_t limit, buffer_t* out) {
+    if ((!base && base_len) || (!target && target_len) || !out) return ERR_NULL_PTR;
+    if (base_len > UINT32_MAX - 1) return ERR_BUFFER_OVERFLOW;
+    size_t start = out->len;
+
+    // Every aligned block of the base, by hash; a later block with the same
+    // hash replaces an earlier one.
+    size_t nblocks = base_len / DELTA_BLOCK;
+    size_t size = 16;
+    while (size < nblocks * 2) size *= 2;
+    uint32_t* table = (uint32_t*)calloc(size, sizeof(uint32_t));
+    if (!table) return ERR_MALLOC_FAILED;
+    for (size_t b = 0; b < nblocks; b++) {
+        table[block_hash(base + b * DELTA_BLOCK) & (size - 1)] = (uint32_t)(b * DELTA_BLOCK + 1);
+    }
+
+    error_t err = append_varint(out, base_len);
+    if (err == ERR_OK) err = append_varint(out, target_len);
+    size_t literal = 0, i = 0;
+    while (err == ERR_OK && i + DELTA_BLOCK <= target_len && out->len - start < limit) {
+        uint32_t slot = table[block_hash(target + i) & (size - 1)];
+        size_t offset = slot ? slot - 1 : 0;
+        if (!slot || memcmp(base + offset, target + i, DELTA_BLOCK) != 0) {
+            i++;
+            continue;
+        }
+        size_t n = DELTA_BLOCK;
+        while (offset + n < base_len && i + n < target_len && base[offset + n] == target[i + n]) n++;
+        while (i > literal && offset > 0 && base[offset - 1] == target[i - 1]) {
+            i--;
+            offset--;
+            n++;
+        }
+        err = insert(out, target + literal, i - literal);
+        if (err == ERR_OK) err = copy(out, offset, n);
+        i += n;
+        literal = i;
+    }
+    if (err == ERR_OK) err = insert(out, target + literal, target_len - literal);
+    free(table);
+
+    if (err == ERR_OK && out->len - start >= limit) err = ERR_BUFFER_OVERFLOW;
+    if (err != ERR_OK) {
+        out->len = start;
+        if (out->data) out->data[start] = '\0';
+    }
+    return err;
+}
+
+error_t delta_apply(const char* base, size_t base_len, const char* delta, size_t delta_len, buffer_t* out) {
+    if ((!base && base_len) || !delta || !out) return ERR_NULL_PTR;
+    const uint8_t* d = (const uint8_t*)delta;
+    uint64_t want_base, result_len;
+    size_t pos = delta_get_varint(d, delta_len, &want_base);
+    size_t n = pos ? delta_get_varint(d + pos, delta_len - pos, &result_len) : 0;
+    if (!n || want_base != base_len) return ERR_IO;
+    pos += n;
+    if (result_len > SIZE_MAX / 2) return ERR_IO;
+    error_t err = buffer_reserve(out, (size_t)result_len);
+    if (err != ERR_OK) return err;
+
+    size_t begin = out->len;
+    while (err == ERR_OK && pos < delta_len) {
+        uint8_t op = d[pos++];
+        if (op == DELTA_COPY) {
+            uint64_t offset, size;
+            size_t a = delta_get_varint(d + pos, delta_len - pos, &offset);
+            size_t b = a ? delta_get_varint(d + pos + a, delta_len - pos - a, &size) : 0;
+            if (!b || offset > base_len || size > base_len - offset) {
+                err = ERR_IO;
+                break;
+            }
+            pos += a + b;
+            err = buffer_append(out, base + offset, (size_t)size);
+        } else if (op >= 1 && op <= DELTA_MAX_INSERT && op <= delta_len - pos) {
+            err = buffer_append(out, delta + pos, op);
+            pos += op;
+        } else {
+            err = ERR_IO;
+        }
+    }
+    if (err == ERR_OK && out->len - begin != result_len) err = ERR_IO;
+    if (err != ERR_OK) {
+        out->len = begin;
+        if (out->data) out->data[begin] = '\0';
+    }
+    return err;
+}
@@ -0,0 +1,38 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "git_for_logic.h"
+#include "buffer.h"
+
+// Binary deltas between two objects, in the spirit of git's pack deltas.
+// A delta is the varint length of the base, the varint length of the
+// result, then instructions: DELTA_COPY followed by a varint offset and a
+// varint size copies that range of the base; a byte n in 1..127 inserts
+// the n literal bytes that follow it. Varints are LEB128.
+//
+// delta_create indexes the base in DELTA_BLOCK-byte blocks and slides
+// over the target looking each position up, so similar objects (commits
+// differing in a couple of hashes, snapshots differing in a few fields)
+// cost little more than their differences.
+
+#define DELTA_BLOCK 16
+#define DELTA_COPY 0x80
+
+// Appends a delta turning base into target to out. Returns
+// ERR_BUFFER_OVERFLOW, leaving out as it was, if the delta would not be
+// smaller than limit bytes.
+error_t delta_create(const char* base, size_t base_len, const char* target, size_t target_len,
+                     size_t limit, buffer_t* out);
+
+// Appends base with the delta applied to out. Returns ERR_IO for a delta
+// that does not fit base.
+error_t delta_apply(const char* base, size_t base_len, const char* delta, size_t delta_len, buffer_t* out);
+
+// LEB128 helpers shared with pack.c. delta_get_varint returns the bytes
+// read, or 0 if p runs out first or the value overflows.
+size_t delta_put_varint(uint8_t* p, uint64_t v);
+size_t delta_get_varint(const uint8_t* p, size_t len, uint64_t* v);
+
+#endif
@@ -0,0 +1,710 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include "execute.h"
+#include "json.h"
+
+#define LOOKUP_EMPTY EXPR_NO_FIELD
+#define NO_SPAN SIZE_MAX
+#define JSON_MAX_NEST 64
+#define NUM_FORMAT_MAX 32
+#define MAX_SAFE_INTEGER 9007199254740991.0
+#define SORT_RUN 16
+
+static uint32_t name_hash(str_t s) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.len; i++) {
+        h ^= (uint8_t)s.ptr[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t next_pow2(size_t n) {
+    size_t p = 16;
+    while (p < n) p *= 2;
+    return p;
+}
+
+error_t engine_init(engine_t* engine, const ruleset_t* rules, const hash_t rules_hash) {
+    if (!engine || !rules || !rules_hash) return ERR_NULL_PTR;
+    memset(engine, 0, sizeof(*engine));
+    engine->rules = rules;
+    memcpy(engine->rules_hash, rules_hash, sizeof(hash_t));
+    buffer_init(&engine->input_json);
+    buffer_init(&engine->output_json);
+    buffer_init(&engine->exec_json);
+    buffer_init(&engine->changes);
+    buffer_init(&engine->shape);
+    arena_init(&engine->replay, ARENA_DEFAULT_BLOCK);
+
+    size_t max_then = 1;
+    for (size_t i = 0; i < rules->nrules; i++) {
+        if (rules->rules[i].nthen > max_then) max_then = rules->rules[i].nthen;
+        engine->max_added += rules->rules[i].nthen;
+    }
+    size_t nrules = rules->nrules ? rules->nrules : 1;
+    engine->nsymbols = rules->program.nfields;
+    size_t nsymbols = engine->nsymbols ? engine->nsymbols : 1;
+    engine->symbols = (uint32_t*)calloc(nsymbols, sizeof(uint32_t));
+    engine->base_symbols = (uint32_t*)calloc(nsymbols, sizeof(uint32_t));
+    engine->nested = (uint8_t*)calloc(nsymbols, 1);
+    engine->pending = (value_t*)calloc(max_then, sizeof(value_t));
+    engine->applied = (uint32_t*)calloc(nrules, sizeof(uint32_t));
+    // The upper half is sort_rule_names' scratch.
+    engine->applied_names = (str_t*)calloc(2 * nrules, sizeof(str_t));
+    engine->changes_end = (size_t*)calloc(nrules, sizeof(size_t));
+    if (!engine->symbols || !engine->base_symbols || !engine->nested || !engine->pending || !engine->applied ||
+        !engine->applied_names || !engine->changes_end) {
+        engine_free(engine);
+        return ERR_MALLOC_FAILED;
+    }
+    // A symbol whose path can clash with another symbol's: it has a dot,
+    // or another symbol is under it.
+    const program_t* prog = &rules->program;
+    for (size_t k = 0; k < engine->nsymbols; k++) {
+        str_t name = prog->fields[k];
+        for (size_t i = 0; i < name.len; i++) {
+            uint32_t parent;
+            if (name.ptr[i] != '.') continue;
+            engine->nested[k] = 1;
+            if (program_find_field(prog, (str_t){ name.ptr, i }, &parent)) engine->nested[parent] = 1;
+        }
+    }
+    return ERR_OK;
+}
+
+void engine_free(engine_t* engine) {
+    if (!engine) return;
+    free(engine->state);
+    free(engine->lookup);
+    free(engine->dirty);
+    free(engine->cleared);
+    free(engine->shape_ends);
+    free(engine->shape_slot);
+    free(engine->sorted);
+    free(engine->spans);
+    buffer_free(&engine->shape);
+    free(engine->base_symbols);
+    free(engine->symbols);
+    free(engine->nested);
+    free(engine->pending);
+    free(engine->applied);
+    free(engine->applied_names);
+    free((void*)engine->order);
+    buffer_free(&engine->input_json);
+    buffer_free(&engine->output_json);
+    buffer_free(&engine->exec_json);
+    buffer_free(&engine->changes);
+    free(engine->changes_end);
+    arena_free(&engine->replay);
+    memset(engine, 0, sizeof(*engine));
+}
+
+// ---------------------------------------------------------------------------
+// Record state
+// ---------------------------------------------------------------------------
+
+static error_t reserve_order(engine_t* engine, size_t need) {
+    if (need <= engine->order_cap) return ERR_OK;
+    size_t cap = next_pow2(need);
+    // The upper half is sort_paths' scratch.
+    const field_t** order = (const field_t**)realloc((void*)engine->order, 2 * cap * sizeof(*order));
+    if (!order) return ERR_MALLOC_FAILED;
+    engine->order = order;
+    engine->order_cap = cap;
+    return ERR_OK;
+}
+
+// Sizes the state and everything kept per slot for need slots.
+static error_t reserve_state(engine_t* engine, size_t need) {
+    if (need > engine->state_cap) {
+        size_t cap = next_pow2(need);
+        field_t* grown = (field_t*)realloc(engine->state, cap * sizeof(field_t));
+        if (!grown) return ERR_MALLOC_FAILED;
+        engine->state = grown;
+        uint64_t* dirty = (uint64_t*)realloc(engine->dirty, (cap + 63) / 64 * sizeof(uint64_t));
+        if (!dirty) return ERR_MALLOC_FAILED;
+        engine->dirty = dirty;
+        uint64_t* cleared = (uint64_t*)realloc(engine->cleared, (cap + 63) / 64 * sizeof(uint64_t));
+        if (!cleared) return ERR_MALLOC_FAILED;
+        engine->cleared = cleared;
+        size_t* ends = (size_t*)realloc(engine->shape_ends, cap * sizeof(size_t));
+        if (!ends) return ERR_MALLOC_FAILED;
+        engine->shape_ends = ends;
+        uint32_t* slots = (uint32_t*)realloc(engine->shape_slot, cap * sizeof(uint32_t));
+        if (!slots) return ERR_MALLOC_FAILED;
+        engine->shape_slot = slots;
+        uint32_t* sorted = (uint32_t*)realloc(engine->sorted, cap * sizeof(uint32_t));
+        if (!sorted) return ERR_MALLOC_FAILED;
+        engine->sorted = sorted;
+        size_t* spans = (size_t*)realloc(engine->spans, 2 * cap * sizeof(size_t));
+        if (!spans) return ERR_MALLOC_FAILED;
+        engine->spans = spans;
+        engine->state_cap = cap;
+    }
+    error_t err = reserve_order(engine, need);
+    if (err != ERR_OK) return err;
+    // Keep the index at most half full.
+    size_t slots = next_pow2(need * 2);
+    if (slots > engine->lookup_mask + 1 || !engine->lookup) {
+        uint32_t* lookup = (uint32_t*)realloc(engine->lookup, slots * sizeof(uint32_t));
+        if (!lookup) return ERR_MALLOC_FAILED;
+        engine->lookup = lookup;
+        engine->lookup_mask = slots - 1;
+        engine->shaped = false;
+    }
+    return ERR_OK;
+}
+
+static uint32_t* find_slot(const engine_t* engine, str_t name) {
+    size_t i = name_hash(name) & engine->lookup_mask;
+    for (;;) {
+        uint32_t* slot = &engine->lookup[i];
+        if (*slot == LOOKUP_EMPTY || str_eq(engine->state[*slot].name, name)) return slot;
+        i = (i + 1) & engine->lookup_mask;
+    }
+}
+
+// Sets the field slot indexes, adding it if the slot is empty.
+static error_t put_field(engine_t* engine, uint32_t* slot, str_t name, value_t value) {
+    if (*slot != LOOKUP_EMPTY) {
+        engine->state[*slot].value = value;
+        return ERR_OK;
+    }
+    if (engine->nstate >= engine->state_cap) return ERR_BUFFER_OVERFLOW;
+    *slot = (uint32_t)engine->nstate;
+    engine->state[engine->nstate].name = name;
+    engine->state[engine->nstate].value = value;
+    engine->nstate++;
+    return ERR_OK;
+}
+
+static bool is_dirty(const engine_t* engine, size_t slot) {
+    return (engine->dirty[slot / 64] >> (slot % 64)) & 1;
+}
+
+static bool is_cleared(const engine_t* engine, size_t slot) {
+    return (engine->cleared[slot / 64] >> (slot % 64)) & 1;
+}
+
+// A cleared slot reads as missing until it is written again.
+static void clear_slot(engine_t* engine, uint32_t slot) {
+    if (slot == LOOKUP_EMPTY) return;
+    engine->cleared[slot / 64] |= (uint64_t)1 << (slot % 64);
+    engine->state[slot].value = value_null();
+    engine->any_cleared = true;
+}
+
+// ---------------------------------------------------------------------------
+// Canonical JSON
+// ---------------------------------------------------------------------------
+
+// Orders dotted paths segment by segment, so every `a.*` key sorts
+// directly after `a` and before `a-b` or `aa`.
+static int path_cmp(str_t a, str_t b) {
+    size_t n = a.len < b.len ? a.len : b.len;
+    for (size_t i = 0; i < n; i++) {
+        int ca = a.ptr[i] == '.' ? 0 : (int)(uint8_t)a.ptr[i] + 1;
+        int cb = b.ptr[i] == '.' ? 0 : (int)(uint8_t)b.ptr[i] + 1;
+        if (ca != cb) return ca - cb;
+    }
+    return (a.len > b.len) - (a.len < b.len);
+}
+
+static int compare_paths(const void* pa, const void* pb) {
+    return path_cmp((*(const field_t* const*)pa)->name, (*(const field_t* const*)pb)->name);
+}
+
+// Stable merge sort by path, with tmp (n entries) as scratch: unlike
+// qsort it never allocates, however wide the record. Runs of SORT_RUN
+// are insertion sorted first.
+static void sort_paths(const field_t** order, const field_t** tmp, size_t n) {
+    for (size_t lo = 0; lo < n; lo += SORT_RUN) {
+        size_t hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            const field_t* f = order[i];
+            size_t j = i;
+            for (; j > lo && compare_paths(&order[j - 1], &f) > 0; j--) order[j] = order[j - 1];
+            order[j] = f;
+        }
+    }
+    const field_t** src = order;
+    const field_t** dst = tmp;
+    for (size_t width = SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) dst[k++] = compare_paths(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        const field_t** swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != order) memcpy((void*)order, (const void*)src, n * sizeof(*order));
+}
+
+static bool is_path_prefix(str_t prefix, str_t path) {
+    return path.len > prefix.len && path.ptr[prefix.len] == '.' &&
+           memcmp(prefix.ptr, path.ptr, prefix.len) == 0;
+}
+
+static size_t format_number(double x, char* buf) {
+    if (!isfinite(x)) return (size_t)snprintf(buf, NUM_FORMAT_MAX, "null");
+    if (x == 0.0) return (size_t)snprintf(buf, NUM_FORMAT_MAX, "0");
+    if (fabs(x) <= MAX_SAFE_INTEGER && x == trunc(x)) {
+        return (size_t)snprintf(buf, NUM_FORMAT_MAX, "%" PRId64, (int64_t)x);
+    }
+    // Shortest of 15..17 significant digits that reads back exactly.
+    int n = 0;
+    for (int prec = 15; prec <= 17; prec++) {
+        n = snprintf(buf, NUM_FORMAT_MAX, "%.*g", prec, x);
+        if (strtod(buf, NULL) == x) break;
+    }
+    return (size_t)n;
+}
+
+static error_t write_value(buffer_t* out, const value_t* v) {
+    char num[NUM_FORMAT_MAX];
+    switch (v->type) {
+        case VAL_NULL: return buffer_append(out, "null", 4);
+        case VAL_BOOL: return v->as.b ? buffer_append(out, "true", 4) : buffer_append(out, "false", 5);
+        case VAL_NUM: return buffer_append(out, num, format_number(v->as.num, num));
+        case VAL_STR: return json_write_string(out, v->as.str);
+        case VAL_RAW: return buffer_append(out, v->as.str.ptr, v->as.str.len);
+    }
+    return ERR_OK;
+}
+
+static size_t split_path(str_t name, str_t* segs) {
+    size_t n = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= name.len && n < JSON_MAX_NEST; i++) {
+        if (i == name.len || name.ptr[i] == '.') {
+            segs[n++] = (str_t){ name.ptr + start, i - start };
+            start = i + 1;
+        }
+    }
+    if (start <= name.len) segs[n - 1].len = (size_t)(name.ptr + name.len - segs[n - 1].ptr);
+    return n;
+}
+
+// Writes fields already in path order. If spans is not NULL, records
+// where each field's value starts and ends in out, two entries per
+// field, or NO_SPAN for fields that are not written.
+static error_t write_ordered(const field_t* const* order, size_t nfields, buffer_t* out, size_t* spans) {
+    str_t open[JSON_MAX_NEST];
+    bool first[JSON_MAX_NEST + 1];
+    size_t depth = 0;
+    first[0] = true;
+
+    error_t err = buffer_append_char(out, '{');
+    for (size_t i = 0; i < nfields && err == ERR_OK; i++) {
+        const field_t* f = order[i];
+        if (spans) spans[2 * i] = NO_SPAN;
+        // An object at `a.*` replaces a scalar at `a`, like setNestedValue.
+        if (i + 1 < nfields && is_path_prefix(f->name, order[i + 1]->name)) continue;
+        if (i > 0 && str_eq(f->name, order[i - 1]->name)) continue;
+
+        str_t segs[JSON_MAX_NEST];
+        size_t nsegs = split_path(f->name, segs);
+
+        size_t common = 0;
+        while (common < depth && common + 1 < nsegs && str_eq(open[common], segs[common])) common++;
+        for (; depth > common; depth--) err = buffer_append_char(out, '}');
+
+        for (size_t s = depth; s + 1 < nsegs && err == ERR_OK; s++) {
+            if (!first[depth]) err = buffer_append_char(out, ',');
+            first[depth] = false;
+            if (err == ERR_OK) err = json_write_string(out, segs[s]);
+            if (err == ERR_OK) err = buffer_append(out, ":{", 2);
+            open[depth++] = segs[s];
+            first[depth] = true;
+        }
+        if (err != ERR_OK) break;
+
+        if (!first[depth]) err = buffer_append_char(out, ',');
+        first[depth] = false;
+        if (err == ERR_OK) err = json_write_string(out, segs[nsegs - 1]);
+        if (err == ERR_OK) err = buffer_append_char(out, ':');
+        if (spans) spans[2 * i] = out->len;
+        if (err == ERR_OK) err = write_value(out, &f->value);
+        if (spans) spans[2 * i + 1] = out->len;
+    }
+    for (; depth > 0 && err == ERR_OK; depth--) err = buffer_append_char(out, '}');
+    if (err == ERR_OK) err = buffer_append_char(out, '}');
+    return err;
+}
+
+error_t engine_write_json(engine_t* engine, const field_t* fields, size_t nfields, buffer_t* out) {
+    error_t err = reserve_order(engine, nfields);
+    if (err != ERR_OK) return err;
+    for (size_t i = 0; i < nfields; i++) engine->order[i] = &fields[i];
+    sort_paths(engine->order, engine->order + engine->order_cap, nfields);
+    return write_ordered(engine->order, nfields, out, NULL);
+}
+
+// ---------------------------------------------------------------------------
+// Execution
+// ---------------------------------------------------------------------------
+
+error_t engine_hash_fields(engine_t* engine, const field_t* fields, size_t nfields,
+                           buffer_t* json, hash_t out) {
+    buffer_clear(json);
+    error_t err = engine_write_json(engine, fields, nfields, json);
+    if (err != ERR_OK) return err;
+    return compute_sha1(json->data, json->len, out);
+}
+
+error_t engine_write_seal(engine_t* engine, const uint32_t* applied, size_t napplied,
+                          const hash_t input_hash, const hash_t output_hash, buffer_t* b) {
+    const ruleset_t* rules = engine->rules;
+    for (size_t i = 0; i < napplied; i++) {
+        engine->applied_names[i] = rules->rules[applied[i]].name;
+    }
+    sort_rule_names(engine->applied_names, engine->applied_names + rules->nrules, napplied);
+
+    error_t err = buffer_append_str(b, "{\"appliedRules\":[");
+    for (size_t i = 0; i < napplied && err == ERR_OK; i++) {
+        if (i) err = buffer_append_char(b, ',');
+        if (err == ERR_OK) err = json_write_string(b, engine->applied_names[i]);
+    }
+    if (err == ERR_OK) err = buffer_append_str(b, "],\"input\":");
+    if (err == ERR_OK) err = json_write_hash(b, input_hash);
+    if (err == ERR_OK) err = buffer_append_str(b, ",\"output\":");
+    if (err == ERR_OK) err = json_write_hash(b, output_hash);
+    if (err == ERR_OK) err = buffer_append_str(b, ",\"rules\":");
+    if (err == ERR_OK) err = json_write_hash(b, engine->rules_hash);
+    if (err == ERR_OK) err = buffer_append_char(b, '}');
+    return err;
+}
+
+error_t engine_seal(engine_t* engine, const uint32_t* applied, size_t napplied, execution_t* out) {
+    buffer_t* b = &engine->exec_json;
+    buffer_clear(b);
+    error_t err = engine_write_seal(engine, applied, napplied, out->input_hash, out->output_hash, b);
+    if (err != ERR_OK) return err;
+    return compute_sha1(b->data, b->len, out->execution_hash);
+}
+
+static bool same_shape(const engine_t* engine, const field_t* input, size_t ninput) {
+    if (!engine->shaped || ninput != engine->nshape) return false;
+    size_t start = 0;
+    for (size_t i = 0; i < ninput; i++) {
+        str_t name = input[i].name;
+        size_t end = engine->shape_ends[i];
+        if (name.len != end - start || memcmp(engine->shape.data + start, name.ptr, name.len) != 0) return false;
+        start = end;
+    }
+    return true;
+}
+
+// Indexes the input from scratch and keeps its shape, with the slot of
+// each symbol.
+static error_t load_shape(engine_t* engine, const field_t* input, size_t ninput) {
+    engine->shaped = false;
+    engine->shape_nested = false;
+    memset(engine->lookup, 0xFF, (engine->lookup_mask + 1) * sizeof(uint32_t));
+    engine->nstate = 0;
+    buffer_clear(&engine->shape);
+    for (size_t i = 0; i < ninput; i++) {
+        if (memchr(input[i].name.ptr, '.', input[i].name.len)) engine->shape_nested = true;
+        uint32_t* slot = find_slot(engine, input[i].name);
+        error_t err = put_field(engine, slot, input[i].name, input[i].value);
+        if (err == ERR_OK) err = buffer_append(&engine->shape, input[i].name.ptr, input[i].name.len);
+        if (err != ERR_OK) return err;
+        engine->shape_slot[i] = *slot;
+        engine->shape_ends[i] = engine->shape.len;
+    }
+    engine->nshape = ninput;
+    engine->nbase = engine->nstate;
+    for (size_t s = 0; s < engine->nbase; s++) engine->order[s] = &engine->state[s];
+    sort_paths(engine->order, engine->order + engine->order_cap, engine->nbase);
+    for (size_t i = 0; i < engine->nbase; i++) engine->sorted[i] = (uint32_t)(engine->order[i] - engine->state);
+    const program_t* prog = &engine->rules->program;
+    for (size_t k = 0; k < engine->nsymbols; k++) engine->base_symbols[k] = *find_slot(engine, prog->fields[k]);
+    engine->shaped = true;
+    return ERR_OK;
+}
+
+// Fills the input slots and resets the symbols to them. Duplicate keys
+// keep the last value. Fields the rules add are never indexed by name,
+// so the lookup stays as load_shape left it.
+static error_t load_input(engine_t* engine, const field_t* input, size_t ninput) {
+    if (!same_shape(engine, input, ninput)) {
+        error_t err = load_shape(engine, input, ninput);
+        if (err != ERR_OK) return err;
+    } else {
+        for (size_t i = 0; i < ninput; i++) engine->state[engine->shape_slot[i]] = input[i];
+        engine->nstate = engine->nbase;
+    }
+    memcpy(engine->symbols, engine->base_symbols, engine->nsymbols * sizeof(uint32_t));
+    return ERR_OK;
+}
+
+// Writes the state after the rules. Fields added by the rules are merged
+// into the input's order and everything but the cleared slots is written
+// again; otherwise the input JSON is copied with the values the rules
+// wrote patched in. *changed is false if the output is the input.
+static error_t write_output(engine_t* engine, bool* changed) {
+    buffer_t* out = &engine->output_json;
+    buffer_clear(out);
+    size_t nbase = engine->nbase;
+    const field_t** order = engine->order;
+    if (engine->nstate > nbase || engine->any_cleared) {
+        *changed = true;
+        size_t nkept = 0;
+        for (size_t i = 0; i < nbase; i++) {
+            uint32_t s = engine->sorted[i];
+            if (!is_cleared(engine, s)) order[nkept++] = &engine->state[s];
+        }
+        size_t n = nkept;
+        for (size_t s = nbase; s < engine->nstate; s++) {
+            if (!is_cleared(engine, s)) order[n++] = &engine->state[s];
+        }
+        const field_t** merged = order + engine->order_cap;
+        sort_paths(order + nkept, merged, n - nkept);
+        size_t i = 0, j = nkept, k = 0;
+        while (i < nkept && j < n) {
+            merged[k++] = compare_paths(&order[j], &order[i]) < 0 ? order[j++] : order[i++];
+        }
+        while (i < nkept) merged[k++] = order[i++];
+        while (j < n) merged[k++] = order[j++];
+        return write_ordered(merged, n, out, NULL);
+    }
+
+    *changed = false;
+    const char* in = engine->input_json.data;
+    size_t copied = 0;
+    error_t err = ERR_OK;
+    for (size_t i = 0; i < nbase && err == ERR_OK; i++) {
+        uint32_t s = engine->sorted[i];
+        if (!is_dirty(engine, s) || engine->spans[2 * i] == NO_SPAN) continue;
+        *changed = true;
+        err = buffer_append(out, in + copied, engine->spans[2 * i] - copied);
+        if (err == ERR_OK) err = write_value(out, &engine->state[s].value);
+        copied = engine->spans[2 * i + 1];
+    }
+    if (err == ERR_OK) err = buffer_append(out, in + copied, engine->input_json.len - copied);
+    return err;
+}
+
+// Clears what a write to slot replaced, as setNestedValue does: the
+// fields at an ancestor or a descendant path of its name.
+static void replace_related(engine_t* engine, uint32_t slot) {
+    str_t name = engine->state[slot].name;
+    // Input ancestors by name; the lookup holds only input fields.
+    for (size_t i = 0; i < name.len; i++) {
+        if (name.ptr[i] == '.') clear_slot(engine, *find_slot(engine, (str_t){ name.ptr, i }));
+    }
+    // Input descendants follow the name in path order.
+    size_t lo = 0, hi = engine->nbase;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (path_cmp(engine->state[engine->sorted[mid]].name, name) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    for (; lo < engine->nbase && is_path_prefix(name, engine->state[engine->sorted[lo]].name); lo++) {
+        clear_slot(engine, engine->sorted[lo]);
+    }
+    for (size_t s = engine->nbase; s < engine->nstate; s++) {
+        str_t other = engine->state[s].name;
+        if (is_path_prefix(name, other) || is_path_prefix(other, name)) clear_slot(engine, (uint32_t)s);
+    }
+}
+
+error_t engine_run(engine_t* engine, const field_t* input, size_t ninput, execution_t* out) {
+    if (!engine || !out || (!input && ninput)) return ERR_NULL_PTR;
+    const ruleset_t* rules = engine->rules;
+    const program_t* prog = &rules->program;
+
+    size_t max_fields = ninput + engine->max_added;
+    error_t err = reserve_state(engine, max_fields);
+    if (err != ERR_OK) return err;
+    memset(engine->dirty, 0, (max_fields + 63) / 64 * sizeof(uint64_t));
+    memset(engine->cleared, 0, (max_fields + 63) / 64 * sizeof(uint64_t));
+    engine->any_cleared = false;
+    engine->napplied = 0;
+    buffer_clear(&engine->changes);
+
+    err = load_input(engine, input, ninput);
+    if (err != ERR_OK) return err;
+
+    buffer_clear(&engine->input_json);
+    for (size_t i = 0; i < engine->nbase; i++) engine->order[i] = &engine->state[engine->sorted[i]];
+    err = write_ordered(engine->order, engine->nbase, &engine->input_json, engine->spans);
+    if (err == ERR_OK) err = compute_sha1(engine->input_json.data, engine->input_json.len, out->input_hash);
+    if (err != ERR_OK) return err;
+
+    record_view_t view = { engine->state, engine->symbols };
+    for (size_t r = 0; r < rules->nrules; r++) {
+        const rule_t* rule = &rules->rules[r];
+        value_t cond = expr_eval(prog, &rule->cond, &view);
+        if (!value_truthy(&cond)) continue;
+
+        for (size_t j = 0; j < rule->nthen; j++) {
+            engine->pending[j] = expr_eval(prog, &rule->then[j].expr, &view);
+        }
+        err = buffer_append_char(&engine->changes, '[');
+        for (size_t j = 0; j < rule->nthen && err == ERR_OK; j++) {
+            const assignment_t* a = &rule->then[j];
+            uint32_t* slot = &engine->symbols[a->symbol];
+            bool missing = *slot == LOOKUP_EMPTY || is_cleared(engine, *slot);
+            const value_t* old = missing ? NULL : &engine->state[*slot].value;
+            if (j) err = buffer_append_char(&engine->changes, ',');
+            if (err == ERR_OK) err = engine_write_change(&engine->changes, a->field, old, &engine->pending[j]);
+            if (err == ERR_OK) err = put_field(engine, slot, a->field, engine->pending[j]);
+            if (err != ERR_OK) break;
+            engine->dirty[*slot / 64] |= (uint64_t)1 << (*slot % 64);
+            engine->cleared[*slot / 64] &= ~((uint64_t)1 << (*slot % 64));
+            if (engine->shape_nested || engine->nested[a->symbol]) replace_related(engine, *slot);
+        }
+        if (err == ERR_OK) err = buffer_append_char(&engine->changes, ']');
+        if (err != ERR_OK) return err;
+        engine->changes_end[engine->napplied] = engine->changes.len;
+        engine->applied[engine->napplied++] = (uint32_t)r;
+    }
+
+    bool changed;
+    err = write_output(engine, &changed);
+    if (err != ERR_OK) return err;
+    if (changed) err = compute_sha1(engine->output_json.data, engine->output_json.len, out->output_hash);
+    else memcpy(out->output_hash, out->input_hash, sizeof(hash_t));
+    if (err != ERR_OK) return err;
+    err = engine_seal(engine, engine->applied, engine->napplied, out);
+    if (err != ERR_OK) return err;
+
+    out->applied = engine->applied;
+    out->napplied = engine->napplied;
+    out->state = engine->state;
+    out->nstate = engine->nstate;
+    out->output_json = (str_t){ engine->output_json.data, engine->output_json.len };
+    out->input_json = (str_t){ engine->input_json.data, engine->input_json.len };
+    out->changes = (str_t){ engine->changes.data, engine->changes.len };
+    out->changes_end = engine->changes_end;
+    return ERR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Audit trail
+// ---------------------------------------------------------------------------
+
+error_t engine_write_change(buffer_t* out, str_t field, const value_t* old, const value_t* value) {
+    error_t err = buffer_append_str(out, "{\"field\":");
+    if (err == ERR_OK) err = json_write_string(out, field);
+    if (err == ERR_OK && old) err = buffer_append_str(out, ",\"old\":");
+    if (err == ERR_OK && old) err = write_value(out, old);
+    if (err == ERR_OK) err = buffer_append_str(out, ",\"new\":");
+    if (err == ERR_OK) err = write_value(out, value);
+    if (err == ERR_OK) err = buffer_append_char(out, '}');
+    return err;
+}
+
+// Assignments to replay, input fields first, copied out of the JSON
+// reader's scratch.
+typedef struct {
+    engine_t* engine;
+    field_t* ops;
+    size_t nops;
+    size_t cap;
+} replay_t;
+
+static error_t push_op(replay_t* r, str_t name, value_t value) {
+    if (r->nops == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 64;
+        field_t* ops = (field_t*)realloc(r->ops, cap * sizeof(field_t));
+        if (!ops) return ERR_MALLOC_FAILED;
+        r->ops = ops;
+        r->cap = cap;
+    }
+    arena_t* arena = &r->engine->replay;
+    char* copy = arena_strndup(arena, name.ptr, name.len);
+    if (!copy) return ERR_MALLOC_FAILED;
+    name.ptr = copy;
+    if (value.type == VAL_STR || value.type == VAL_RAW) {
+        copy = arena_strndup(arena, value.as.str.ptr, value.as.str.len);
+        if (!copy) return ERR_MALLOC_FAILED;
+        value.as.str.ptr = copy;
+    }
+    r->ops[r->nops++] = (field_t){ name, value };
+    return ERR_OK;
+}
+
+static error_t collect_input(void* ctx, const field_t* fields, size_t nfields) {
+    error_t err = ERR_OK;
+    for (size_t i = 0; i < nfields && err == ERR_OK; i++) {
+        err = push_op((replay_t*)ctx, fields[i].name, fields[i].value);
+    }
+    return err;
+}
+
+static error_t collect_change(void* ctx, const field_t* fields, size_t nfields) {
+    const value_t* field = NULL;
+    const value_t* value = NULL;
+    for (size_t i = 0; i < nfields; i++) {
+        if (str_eq(fields[i].name, STR_LIT("field"))) field = &fields[i].value;
+        if (str_eq(fields[i].name, STR_LIT("new"))) value = &fields[i].value;
+    }
+    if (!field || field->type != VAL_STR || !value) return ERR_INVALID_JSON;
+    return push_op((replay_t*)ctx, field->as.str, *value);
+}
+
+// replace_related for a replayed state, whose lookup holds every field.
+static void replay_related(engine_t* engine, uint32_t slot) {
+    str_t name = engine->state[slot].name;
+    engine->cleared[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    for (size_t s = 0; s < engine->nstate; s++) {
+        str_t other = engine->state[s].name;
+        if (is_path_prefix(name, other) || is_path_prefix(other, name)) clear_slot(engine, (uint32_t)s);
+    }
+}
+
+// Writes the replayed state without its cleared slots.
+static error_t write_state(engine_t* engine, buffer_t* out) {
+    size_t n = 0;
+    for (size_t s = 0; s < engine->nstate; s++) {
+        if (!is_cleared(engine, s)) engine->order[n++] = &engine->state[s];
+    }
+    sort_paths(engine->order, engine->order + engine->order_cap, n);
+    return write_ordered(engine->order, n, out, NULL);
+}
+
+error_t engine_replay(engine_t* engine, str_t input_json, const str_t* changes, size_t nchanges,
+                      replay_fn fn, void* ctx) {
+    if (!engine || (!changes && nchanges) || !fn) return ERR_NULL_PTR;
+    arena_reset(&engine->replay);
+    size_t* ends = (size_t*)arena_alloc(&engine->replay, (nchanges + 1) * sizeof(size_t));
+    if (!ends) return ERR_MALLOC_FAILED;
+    replay_t r = { engine, NULL, 0, 0 };
+    error_t err = json_for_each_record(input_json.ptr, input_json.len, collect_input, &r);
+    ends[0] = r.nops;
+    for (size_t i = 0; i < nchanges && err == ERR_OK; i++) {
+        err = json_for_each_record(changes[i].ptr, changes[i].len, collect_change, &r);
+        ends[i + 1] = r.nops;
+    }
+    if (err == ERR_OK) err = reserve_state(engine, r.nops);
+    if (err == ERR_OK) {
+        memset(engine->lookup, 0xFF, (engine->lookup_mask + 1) * sizeof(uint32_t));
+        memset(engine->cleared, 0, (r.nops + 63) / 64 * sizeof(uint64_t));
+        engine->nstate = 0;
+        engine->shaped = false;
+    }
+    size_t op = 0;
+    for (size_t step = 0; step <= nchanges && err == ERR_OK; step++) {
+        for (; op < ends[step] && err == ERR_OK; op++) {
+            uint32_t* slot = find_slot(engine, r.ops[op].name);
+            err = put_field(engine, slot, r.ops[op].name, r.ops[op].value);
+            if (err == ERR_OK && step > 0) replay_related(engine, *slot);
+        }
+        buffer_clear(&engine->output_json);
+        if (err == ERR_OK) err = write_state(engine, &engine->output_json);
+        if (err == ERR_OK) err = fn(ctx, step, (str_t){ engine->output_json.data, engine->output_json.len });
+    }
+    free(r.ops);
+    return err;
+}
@@ -0,0 +1,145 @@
+#ifndef EXECUTE_H
+#define EXECUTE_H
+
+#include "git_for_logic.h"
+#include "value.h"
+#include "hash.h"
+#include "buffer.h"
+#include "rules.h"
+#include "arena.h"
+
+// Deterministic rule executor, the ALBEO layer of the CALYX architecture in
+// README.md: pure logic with no I/O. Mirrors legacy executeRules: rules
+// run in priority order against a copy of the input record; each rule
+// whose condition holds evaluates all of its `then` values against the
+// state as it was before the rule, then assigns them in order.
+//
+// Instead of copying the whole state before and after every rule, the
+// engine records what each applied rule changed: a JSON array of
+// {"field":<dotted name>,"old":<value>,"new":<value>} objects, "old"
+// left out when the field did not exist yet. engine_replay rebuilds the
+// state after any rule from the input and those changes.
+//
+// The record state is a slot array: the input's fields fill the first
+// slots, fields the rules add take the next ones, and a dirty bitmap
+// marks the slots the rules wrote. A record whose field names match the
+// previous record's reuses its name index and path order, so loading it
+// is one copy per field. The output JSON is the input JSON with the
+// dirty values patched in, unless the rules added fields; only then is
+// it written out again, and only if nothing was written does it keep the
+// input's hash.
+//
+// As legacy setNestedValue does, writing a path replaces whatever sits at
+// its ancestors and descendants: after `a.b`, a scalar at `a` is gone, and
+// after `a`, so is every `a.*`. Those slots are cleared: they read as
+// missing and are left out of the output. Only rulesets or inputs with
+// dotted names pay for the check.
+//
+// Rules never look fields up by name. Every field a ruleset reads or
+// writes is interned as a symbol when it is compiled, and the engine
+// keeps the slot of each symbol for the current record: worked out once
+// per input shape, copied per record, extended as rules add fields.
+
+// Outcome of running a ruleset against one record. Pointers reference
+// engine-owned storage and stay valid until the next engine_run.
+struct execution_t {
+    hash_t input_hash;
+    hash_t output_hash;
+    hash_t execution_hash;
+    const uint32_t* applied;    // indices into rules->rules, in order applied
+    size_t napplied;
+    const field_t* state;       // final state, cleared slots included
+    size_t nstate;
+    str_t output_json;          // canonical JSON of the final state
+    str_t input_json;           // canonical JSON of the input record
+    str_t changes;              // per applied rule, its changes array
+    const size_t* changes_end;  // per applied rule: where its array ends
+};
+
+typedef struct {
+    const ruleset_t* rules;
+    hash_t rules_hash;
+
+    field_t* state;             // input fields, then fields rules added
+    size_t nstate;
+    size_t state_cap;
+    uint32_t* lookup;           // open-addressed index into state, by name
+    size_t lookup_mask;
+    uint64_t* dirty;            // slots the rules wrote
+    uint64_t* cleared;          // slots a write to a related path replaced
+    bool any_cleared;
+    size_t max_added;           // slots the rules can add to one record
+
+    // Shape of the last input: its field names, the slot each went to,
+    // and the input slots in path order, with where each one's value is
+    // in input_json.
+    buffer_t shape;
+    size_t* shape_ends;
+    uint32_t* shape_slot;
+    uint32_t* sorted;
+    size_t* spans;              // start and end, by position in sorted
+    size_t nshape;
+    size_t nbase;               // slots the input filled
+    uint32_t* base_symbols;     // slot of each symbol in the input
+    bool shaped;                // shape and lookup match
+    bool shape_nested;          // the input has dotted names
+
+    uint32_t* symbols;          // slot of each symbol, EXPR_NO_FIELD if unset
+    size_t nsymbols;
+    uint8_t* nested;            // per symbol: dotted, or the prefix of another
+
+    value_t* pending;           // `then` values of the rule being applied
+    uint32_t* applied;
+    size_t napplied;
+    buffer_t changes;
+    size_t* changes_end;
+
+    const field_t** order;      // sorted view used for serialization,
+    size_t order_cap;           // then as much sort scratch
+    str_t* applied_names;       // nrules entries, then as much sort scratch
+    buffer_t input_json;
+    buffer_t output_json;
+    buffer_t exec_json;
+    arena_t replay;             // names and strings of a replayed state
+} engine_t;
+
+error_t engine_init(engine_t* engine, const ruleset_t* rules, const hash_t rules_hash);
+void engine_free(engine_t* engine);
+
+// Runs every rule against one input record. Duplicate input keys keep
+// the last value, as JSON.parse does.
+error_t engine_run(engine_t* engine, const field_t* input, size_t ninput, execution_t* out);
+
+// Appends one entry of a changes array. old is NULL if the field was not
+// set before.
+error_t engine_write_change(buffer_t* out, str_t field, const value_t* old, const value_t* value);
+
+// Called by engine_replay with the state after the input (step 0) and
+// after each applied rule (step i + 1), as canonical JSON.
+typedef error_t (*replay_fn)(void* ctx, size_t step, str_t state_json);
+
+// Loads the state from input_json, then applies the changes arrays of
+// the applied rules in order. Returns ERR_INVALID_JSON if an array is
+// malformed.
+error_t engine_replay(engine_t* engine, str_t input_json, const str_t* changes, size_t nchanges,
+                      replay_fn fn, void* ctx);
+
+// Appends fields to out as canonical JSON: keys sorted, dotted paths
+// re-nested into objects, numbers in shortest round-trip form.
+error_t engine_write_json(engine_t* engine, const field_t* fields, size_t nfields, buffer_t* out);
+
+// Serializes fields into json and hashes the result.
+error_t engine_hash_fields(engine_t* engine, const field_t* fields, size_t nfields,
+                           buffer_t* json, hash_t out);
+
+// Appends the JSON whose digest is the execution hash of a record: the
+// applied rule names, sorted, and the input, output and rules digests.
+error_t engine_write_seal(engine_t* engine, const uint32_t* applied, size_t napplied,
+                          const hash_t input_hash, const hash_t output_hash, buffer_t* out);
+
+// Computes out->execution_hash from out->input_hash, out->output_hash and
+// the applied rules. Lets other evaluators (batch.c) hash their results
+// exactly as engine_run does.
+error_t engine_seal(engine_t* engine, const uint32_t* applied, size_t napplied, execution_t* out);
+
+#endif
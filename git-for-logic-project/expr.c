@@ -0,0 +1,953 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "expr.h"
+
+#define NUM_TOKEN_MAX 63
+#define INDEX_MIN_SLOTS 64
+#define FNV_BASIS 2166136261u
+
+typedef enum {
+    TOK_END = 0,
+    TOK_NUM,
+    TOK_STR,
+    TOK_IDENT,
+    TOK_TRUE,
+    TOK_FALSE,
+    TOK_NULL,
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_NOT,
+    TOK_BINOP,
+    TOK_ERROR,
+} token_kind_t;
+
+typedef struct {
+    token_kind_t kind;
+    opcode_t op;        // TOK_BINOP
+    int prec;           // TOK_BINOP
+    double num;         // TOK_NUM
+    str_t text;         // TOK_STR / TOK_IDENT
+    bool escaped;       // TOK_STR contains backslash escapes
+} token_t;
+
+typedef struct {
+    program_t* prog;
+    str_t src;
+    size_t pos;
+    token_t tok;
+    size_t start;       // where the expression's code starts
+    uint8_t max_reg;
+    unsigned depth;     // unary operators and parentheses open
+    bool known_only;    // fields must be in prog->fields already
+    const char* err;
+} parser_t;
+
+// Result of compiling a subexpression: whether it reduced to a single
+// LOADK, and if so which constant, so binary operators can fold.
+typedef struct {
+    bool is_const;
+    value_t k;
+} operand_t;
+
+enum {
+    PREC_OR = 1,
+    PREC_AND = 2,
+    PREC_EQUALITY = 3,
+    PREC_RELATIONAL = 4,
+    PREC_ADDITIVE = 5,
+    PREC_MULTIPLICATIVE = 6,
+};
+
+void program_init(program_t* prog) {
+    memset(prog, 0, sizeof(*prog));
+}
+
+void program_free(program_t* prog) {
+    if (!prog) return;
+    for (size_t i = 0; i < prog->nowned; i++) {
+        free(prog->owned[i]);
+    }
+    free(prog->owned);
+    free(prog->code);
+    free(prog->consts);
+    free(prog->const_index);
+    free(prog->field_index);
+    free(prog->fields);
+    memset(prog, 0, sizeof(*prog));
+}
+
+static error_t grow(void** items, size_t* cap, size_t need, size_t item_size) {
+    if (need <= *cap) return ERR_OK;
+    size_t new_cap = *cap ? *cap * 2 : 16;
+    while (new_cap < need) new_cap *= 2;
+    void* grown = realloc(*items, new_cap * item_size);
+    if (!grown) return ERR_MALLOC_FAILED;
+    *items = grown;
+    *cap = new_cap;
+    return ERR_OK;
+}
+
+static bool value_identical(const value_t* a, const value_t* b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case VAL_NULL: return true;
+        case VAL_BOOL: return a->as.b == b->as.b;
+        case VAL_NUM: return memcmp(&a->as.num, &b->as.num, sizeof(double)) == 0;
+        case VAL_STR:
+        case VAL_RAW: return str_eq(a->as.str, b->as.str);
+    }
+    return false;
+}
+
+static uint32_t fnv(uint32_t h, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t const_hash(const value_t* v) {
+    uint8_t type = (uint8_t)v->type;
+    uint32_t h = fnv(FNV_BASIS, &type, 1);
+    switch (v->type) {
+        case VAL_NULL: return h;
+        case VAL_BOOL: return fnv(h, &v->as.b, sizeof(v->as.b));
+        case VAL_NUM: return fnv(h, &v->as.num, sizeof(v->as.num));
+        case VAL_STR:
+        case VAL_RAW: return fnv(h, v->as.str.ptr, v->as.str.len);
+    }
+    return h;
+}
+
+static uint32_t field_hash(str_t name) {
+    return fnv(FNV_BASIS, name.ptr, name.len);
+}
+
+// The constant and field pools are deduplicated through open-addressed
+// tables of entry index + 1. Entries are only ever removed newest first
+// (unindex), which linear probing allows without tombstones.
+typedef uint32_t (*entry_hash_fn)(const program_t* prog, size_t i);
+typedef bool (*entry_eq_fn)(const program_t* prog, size_t i, const void* key);
+
+static uint32_t const_hash_at(const program_t* prog, size_t i) {
+    return const_hash(&prog->consts[i]);
+}
+
+static bool const_eq(const program_t* prog, size_t i, const void* key) {
+    return value_identical(&prog->consts[i], (const value_t*)key);
+}
+
+static uint32_t field_hash_at(const program_t* prog, size_t i) {
+    return field_hash(prog->fields[i]);
+}
+
+static bool field_eq(const program_t* prog, size_t i, const void* key) {
+    return str_eq(prog->fields[i], *(const str_t*)key);
+}
+
+// The key's slot, or the empty slot where it would go.
+static uint32_t* index_slot(const program_t* prog, uint32_t* table, size_t mask, uint32_t hash,
+                            entry_eq_fn eq, const void* key) {
+    size_t i = hash & mask;
+    while (table[i] && !eq(prog, table[i] - 1, key)) i = (i + 1) & mask;
+    return &table[i];
+}
+
+// Makes room for one more entry, keeping the table at most half full.
+static error_t reserve_index(const program_t* prog, uint32_t** table, size_t* mask, size_t n, entry_hash_fn hash) {
+    if (n >= UINT32_MAX - 1) return ERR_BUFFER_OVERFLOW;
+    if (*table && (n + 1) * 2 <= *mask + 1) return ERR_OK;
+    size_t slots = *table ? (*mask + 1) * 2 : INDEX_MIN_SLOTS;
+    while ((n + 1) * 2 > slots) slots *= 2;
+    uint32_t* grown = (uint32_t*)calloc(slots, sizeof(uint32_t));
+    if (!grown) return ERR_MALLOC_FAILED;
+    free(*table);
+    *table = grown;
+    *mask = slots - 1;
+    for (size_t i = 0; i < n; i++) {
+        size_t s = hash(prog, i) & *mask;
+        while (grown[s]) s = (s + 1) & *mask;
+        grown[s] = (uint32_t)(i + 1);
+    }
+    return ERR_OK;
+}
+
+static error_t add_const(program_t* prog, value_t v, uint32_t* out_index) {
+    error_t err = reserve_index(prog, &prog->const_index, &prog->const_mask, prog->nconsts, const_hash_at);
+    if (err != ERR_OK) return err;
+    uint32_t* slot = index_slot(prog, prog->const_index, prog->const_mask, const_hash(&v), const_eq, &v);
+    if (*slot) {
+        *out_index = *slot - 1;
+        return ERR_OK;
+    }
+    err = grow((void**)&prog->consts, &prog->consts_cap, prog->nconsts + 1, sizeof(value_t));
+    if (err != ERR_OK) return err;
+    prog->consts[prog->nconsts] = v;
+    *out_index = (uint32_t)prog->nconsts++;
+    *slot = *out_index + 1;
+    return ERR_OK;
+}
+
+error_t program_intern_field(program_t* prog, str_t name, uint32_t* out_index) {
+    if (!prog || !out_index) return ERR_NULL_PTR;
+    error_t err = reserve_index(prog, &prog->field_index, &prog->field_mask, prog->nfields, field_hash_at);
+    if (err != ERR_OK) return err;
+    uint32_t* slot = index_slot(prog, prog->field_index, prog->field_mask, field_hash(name), field_eq, &name);
+    if (*slot) {
+        *out_index = *slot - 1;
+        return ERR_OK;
+    }
+    err = grow((void**)&prog->fields, &prog->fields_cap, prog->nfields + 1, sizeof(str_t));
+    if (err != ERR_OK) return err;
+    prog->fields[prog->nfields] = name;
+    *out_index = (uint32_t)prog->nfields++;
+    *slot = *out_index + 1;
+    return ERR_OK;
+}
+
+bool program_find_field(const program_t* prog, str_t name, uint32_t* out_index) {
+    if (!prog || !out_index || !prog->field_index) return false;
+    uint32_t entry = *index_slot(prog, prog->field_index, prog->field_mask, field_hash(name), field_eq, &name);
+    if (!entry) return false;
+    *out_index = entry - 1;
+    return true;
+}
+
+// Drops the constants and fields added since the marks.
+static void unindex(program_t* prog, size_t consts_mark, size_t fields_mark) {
+    for (size_t i = prog->nconsts; i-- > consts_mark;) {
+        *index_slot(prog, prog->const_index, prog->const_mask, const_hash(&prog->consts[i]), const_eq,
+                    &prog->consts[i]) = 0;
+    }
+    for (size_t i = prog->nfields; i-- > fields_mark;) {
+        *index_slot(prog, prog->field_index, prog->field_mask, field_hash(prog->fields[i]), field_eq,
+                    &prog->fields[i]) = 0;
+    }
+    prog->nconsts = consts_mark;
+    prog->nfields = fields_mark;
+}
+
+static error_t add_owned(program_t* prog, char* text) {
+    error_t err = grow((void**)&prog->owned, &prog->owned_cap, prog->nowned + 1, sizeof(char*));
+    if (err != ERR_OK) return err;
+    prog->owned[prog->nowned++] = text;
+    return ERR_OK;
+}
+
+static error_t emit(parser_t* p, insn_t insn) {
+    program_t* prog = p->prog;
+    if (prog->code_len - p->start >= EXPR_MAX_LEN || prog->code_len >= UINT32_MAX) return ERR_BUFFER_OVERFLOW;
+    error_t err = grow((void**)&prog->code, &prog->code_cap, prog->code_len + 1, sizeof(insn_t));
+    if (err != ERR_OK) return err;
+    prog->code[prog->code_len++] = insn;
+    return ERR_OK;
+}
+
+static error_t use_reg(parser_t* p, unsigned reg) {
+    if (reg >= EXPR_MAX_REGS) {
+        p->err = "expression nested too deeply";
+        return ERR_BUFFER_OVERFLOW;
+    }
+    if (reg > p->max_reg) p->max_reg = (uint8_t)reg;
+    return ERR_OK;
+}
+
+// LOADK or LOADF k, with k in a word of its own if it needs one.
+static error_t emit_load(parser_t* p, opcode_t op, unsigned dst, uint32_t k) {
+    if (k < EXPR_WIDE) return emit(p, INSN_AX(op, dst, k));
+    error_t err = emit(p, INSN_AX(op, dst, EXPR_WIDE));
+    if (err == ERR_OK) err = emit(p, (insn_t)k);
+    return err;
+}
+
+static error_t emit_const(parser_t* p, unsigned dst, value_t k) {
+    uint32_t index;
+    error_t err = add_const(p->prog, k, &index);
+    if (err != ERR_OK) return err;
+    return emit_load(p, OP_LOADK, dst, index);
+}
+
+// ---------------------------------------------------------------------------
+// Lexer
+// ---------------------------------------------------------------------------
+
+static bool is_ident_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$';
+}
+
+static bool is_ident_char(char c) {
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static void lex_number(parser_t* p) {
+    const char* s = p->src.ptr;
+    size_t start = p->pos;
+    size_t i = start;
+    while (i < p->src.len && is_digit(s[i])) i++;
+    if (i < p->src.len && s[i] == '.') {
+        i++;
+        while (i < p->src.len && is_digit(s[i])) i++;
+    }
+    if (i < p->src.len && (s[i] == 'e' || s[i] == 'E')) {
+        size_t j = i + 1;
+        if (j < p->src.len && (s[j] == '+' || s[j] == '-')) j++;
+        if (j < p->src.len && is_digit(s[j])) {
+            i = j;
+            while (i < p->src.len && is_digit(s[i])) i++;
+        }
+    }
+
+    char buf[NUM_TOKEN_MAX + 1];
+    size_t n = i - start;
+    if (n > NUM_TOKEN_MAX || (i < p->src.len && is_ident_start(s[i]))) {
+        p->tok.kind = TOK_ERROR;
+        p->err = "malformed number";
+        return;
+    }
+    memcpy(buf, s + start, n);
+    buf[n] = '\0';
+    p->tok.kind = TOK_NUM;
+    p->tok.num = strtod(buf, NULL);
+    p->pos = i;
+}
+
+static void lex_string(parser_t* p) {
+    const char* s = p->src.ptr;
+    char quote = s[p->pos];
+    size_t i = p->pos + 1;
+    bool escaped = false;
+    while (i < p->src.len && s[i] != quote) {
+        if (s[i] == '\\') {
+            escaped = true;
+            i++;
+        }
+        i++;
+    }
+    if (i >= p->src.len) {
+        p->tok.kind = TOK_ERROR;
+        p->err = "unterminated string";
+        return;
+    }
+    p->tok.kind = TOK_STR;
+    p->tok.text = (str_t){ s + p->pos + 1, i - p->pos - 1 };
+    p->tok.escaped = escaped;
+    p->pos = i + 1;
+}
+
+static void lex_ident(parser_t* p) {
+    const char* s = p->src.ptr;
+    size_t start = p->pos;
+    size_t i = start;
+    for (;;) {
+        while (i < p->src.len && is_ident_char(s[i])) i++;
+        // Dotted paths (`applicant.income`) are a single field name.
+        if (i + 1 < p->src.len && s[i] == '.' && is_ident_start(s[i + 1])) {
+            i++;
+            continue;
+        }
+        break;
+    }
+    str_t word = { s + start, i - start };
+    p->pos = i;
+    if (str_eq(word, STR_LIT("true"))) p->tok.kind = TOK_TRUE;
+    else if (str_eq(word, STR_LIT("false"))) p->tok.kind = TOK_FALSE;
+    else if (str_eq(word, STR_LIT("null"))) p->tok.kind = TOK_NULL;
+    else {
+        p->tok.kind = TOK_IDENT;
+        p->tok.text = word;
+    }
+}
+
+static void set_binop(parser_t* p, opcode_t op, int prec, size_t width) {
+    p->tok.kind = TOK_BINOP;
+    p->tok.op = op;
+    p->tok.prec = prec;
+    p->pos += width;
+}
+
+static void next_token(parser_t* p) {
+    const char* s = p->src.ptr;
+    while (p->pos < p->src.len &&
+           (s[p->pos] == ' ' || s[p->pos] == '\t' || s[p->pos] == '\n' || s[p->pos] == '\r')) {
+        p->pos++;
+    }
+    if (p->pos >= p->src.len) {
+        p->tok.kind = TOK_END;
+        return;
+    }
+
+    char c = s[p->pos];
+    char c1 = p->pos + 1 < p->src.len ? s[p->pos + 1] : '\0';
+    char c2 = p->pos + 2 < p->src.len ? s[p->pos + 2] : '\0';
+
+    if (is_digit(c) || (c == '.' && is_digit(c1))) {
+        lex_number(p);
+        return;
+    }
+    if (is_ident_start(c)) {
+        lex_ident(p);
+        return;
+    }
+
+    switch (c) {
+        case '"':
+        case '\'':
+            lex_string(p);
+            return;
+        case '(':
+            p->tok.kind = TOK_LPAREN;
+            p->pos++;
+            return;
+        case ')':
+            p->tok.kind = TOK_RPAREN;
+            p->pos++;
+            return;
+        case '+': set_binop(p, OP_ADD, PREC_ADDITIVE, 1); return;
+        case '-': set_binop(p, OP_SUB, PREC_ADDITIVE, 1); return;
+        case '*': set_binop(p, OP_MUL, PREC_MULTIPLICATIVE, 1); return;
+        case '/': set_binop(p, OP_DIV, PREC_MULTIPLICATIVE, 1); return;
+        case '%': set_binop(p, OP_MOD, PREC_MULTIPLICATIVE, 1); return;
+        case '<':
+            if (c1 == '=') set_binop(p, OP_LE, PREC_RELATIONAL, 2);
+            else set_binop(p, OP_LT, PREC_RELATIONAL, 1);
+            return;
+        case '>':
+            if (c1 == '=') set_binop(p, OP_GE, PREC_RELATIONAL, 2);
+            else set_binop(p, OP_GT, PREC_RELATIONAL, 1);
+            return;
+        case '=':
+            // `==` and `===` are both strict equality.
+            if (c1 == '=') {
+                set_binop(p, OP_EQ, PREC_EQUALITY, c2 == '=' ? 3 : 2);
+                return;
+            }
+            break;
+        case '!':
+            if (c1 == '=') {
+                set_binop(p, OP_NE, PREC_EQUALITY, c2 == '=' ? 3 : 2);
+            } else {
+                p->tok.kind = TOK_NOT;
+                p->pos++;
+            }
+            return;
+        case '&':
+            if (c1 == '&') {
+                set_binop(p, OP_AND, PREC_AND, 2);
+                return;
+            }
+            break;
+        case '|':
+            if (c1 == '|') {
+                set_binop(p, OP_OR, PREC_OR, 2);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+    p->tok.kind = TOK_ERROR;
+    p->err = "unexpected character";
+}
+
+// ---------------------------------------------------------------------------
+// Parser / code generator
+// ---------------------------------------------------------------------------
+
+static error_t parse_expr(parser_t* p, int min_prec, unsigned dst, operand_t* out);
+
+static error_t string_constant(parser_t* p, value_t* out) {
+    str_t text = p->tok.text;
+    if (!p->tok.escaped) {
+        *out = value_str(text);
+        return ERR_OK;
+    }
+
+    char* buf = (char*)malloc(text.len + 1);
+    if (!buf) return ERR_MALLOC_FAILED;
+    size_t n = 0;
+    for (size_t i = 0; i < text.len; i++) {
+        char c = text.ptr[i];
+        if (c == '\\' && i + 1 < text.len) {
+            c = text.ptr[++i];
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+            else if (c == 'r') c = '\r';
+        }
+        buf[n++] = c;
+    }
+    buf[n] = '\0';
+
+    error_t err = add_owned(p->prog, buf);
+    if (err != ERR_OK) {
+        free(buf);
+        return err;
+    }
+    *out = value_str((str_t){ buf, n });
+    return ERR_OK;
+}
+
+static error_t parse_unary(parser_t* p, unsigned dst, operand_t* out);
+
+static error_t parse_operand(parser_t* p, unsigned dst, operand_t* out) {
+    error_t err = use_reg(p, dst);
+    if (err != ERR_OK) return err;
+
+    out->is_const = false;
+    switch (p->tok.kind) {
+        case TOK_NUM:
+            out->is_const = true;
+            out->k = value_num(p->tok.num);
+            next_token(p);
+            return emit_const(p, dst, out->k);
+        case TOK_STR:
+            err = string_constant(p, &out->k);
+            if (err != ERR_OK) return err;
+            out->is_const = true;
+            next_token(p);
+            return emit_const(p, dst, out->k);
+        case TOK_TRUE:
+        case TOK_FALSE:
+            out->is_const = true;
+            out->k = value_bool(p->tok.kind == TOK_TRUE);
+            next_token(p);
+            return emit_const(p, dst, out->k);
+        case TOK_NULL:
+            out->is_const = true;
+            out->k = value_null();
+            next_token(p);
+            return emit_const(p, dst, out->k);
+        case TOK_IDENT: {
+            uint32_t index;
+            size_t known = p->prog->nfields;
+            err = program_intern_field(p->prog, p->tok.text, &index);
+            if (err != ERR_OK) return err;
+            if (p->known_only && index >= known) {
+                p->err = "unknown field";
+                return ERR_INVALID_YAML;
+            }
+            next_token(p);
+            return emit_load(p, OP_LOADF, dst, index);
+        }
+        case TOK_LPAREN:
+            next_token(p);
+            err = parse_expr(p, PREC_OR, dst, out);
+            if (err != ERR_OK) return err;
+            if (p->tok.kind != TOK_RPAREN) {
+                p->err = "expected ')'";
+                return ERR_INVALID_YAML;
+            }
+            next_token(p);
+            return ERR_OK;
+        case TOK_NOT:
+        case TOK_BINOP: {
+            if (p->tok.kind == TOK_BINOP && p->tok.op != OP_SUB) break;
+            opcode_t op = p->tok.kind == TOK_NOT ? OP_NOT : OP_NEG;
+
+            next_token(p);
+            size_t start = p->prog->code_len;
+            operand_t inner;
+            err = parse_unary(p, dst, &inner);
+            if (err != ERR_OK) return err;
+            if (inner.is_const) {
+                p->prog->code_len = start;
+                if (op == OP_NOT) out->k = value_bool(!value_truthy(&inner.k));
+                else out->k = inner.k.type == VAL_NUM ? value_num(-inner.k.as.num) : value_null();
+                out->is_const = true;
+                return emit_const(p, dst, out->k);
+            }
+            return emit(p, INSN(op, dst, dst, 0));
+        }
+        default:
+            break;
+    }
+    if (!p->err) p->err = p->tok.kind == TOK_END ? "unexpected end of expression" : "unexpected token";
+    return ERR_INVALID_YAML;
+}
+
+// `!` and `-` chains and parentheses recurse, so their nesting is capped
+// at EXPR_MAX_DEPTH rather than left to the stack.
+static error_t parse_unary(parser_t* p, unsigned dst, operand_t* out) {
+    if (p->depth >= EXPR_MAX_DEPTH) {
+        p->err = "expression nested too deeply";
+        return ERR_BUFFER_OVERFLOW;
+    }
+    p->depth++;
+    error_t err = parse_operand(p, dst, out);
+    p->depth--;
+    return err;
+}
+
+static error_t parse_expr(parser_t* p, int min_prec, unsigned dst, operand_t* out) {
+    size_t start = p->prog->code_len;
+    error_t err = parse_unary(p, dst, out);
+    if (err != ERR_OK) return err;
+
+    while (p->tok.kind == TOK_BINOP && p->tok.prec >= min_prec) {
+        opcode_t op = p->tok.op;
+        int prec = p->tok.prec;
+        next_token(p);
+
+        err = use_reg(p, dst + 1);
+        if (err != ERR_OK) return err;
+
+        if (op == OP_AND || op == OP_OR) {
+            // Short-circuit: skip the right operand when the left one
+            // already decides the result. Evaluators that run both sides
+            // (the batch engine) ignore the jump and rely on AND/OR.
+            size_t jump_at = p->prog->code_len;
+            err = emit(p, INSN_AX(op == OP_AND ? OP_JF : OP_JT, dst, 0));
+            if (err != ERR_OK) return err;
+
+            operand_t rhs;
+            err = parse_expr(p, prec + 1, dst + 1, &rhs);
+            if (err != ERR_OK) return err;
+            err = emit(p, INSN(op, dst, dst, dst + 1));
+            if (err != ERR_OK) return err;
+
+            size_t offset = p->prog->code_len - (jump_at + 1);
+            p->prog->code[jump_at] = INSN_AX(op == OP_AND ? OP_JF : OP_JT, dst, offset);
+            out->is_const = false;
+            continue;
+        }
+
+        operand_t rhs;
+        err = parse_expr(p, prec + 1, dst + 1, &rhs);
+        if (err != ERR_OK) return err;
+
+        if (out->is_const && rhs.is_const) {
+            out->k = expr_binary(op, &out->k, &rhs.k);
+            p->prog->code_len = start;
+            err = emit_const(p, dst, out->k);
+            if (err != ERR_OK) return err;
+            continue;
+        }
+        err = emit(p, INSN(op, dst, dst, dst + 1));
+        if (err != ERR_OK) return err;
+        out->is_const = false;
+    }
+    return ERR_OK;
+}
+
+static error_t compile(program_t* prog, str_t src, expr_t* out, bool quiet, bool known_only) {
+    if (!prog || !out || (!src.ptr && src.len)) return ERR_NULL_PTR;
+
+    size_t code_mark = prog->code_len;
+    size_t consts_mark = prog->nconsts;
+    size_t fields_mark = prog->nfields;
+    size_t owned_mark = prog->nowned;
+
+    parser_t p = { .prog = prog, .src = src, .start = code_mark, .known_only = known_only };
+    next_token(&p);
+
+    operand_t result;
+    error_t err = parse_expr(&p, PREC_OR, 0, &result);
+    if (err == ERR_OK && p.tok.kind != TOK_END) {
+        p.err = p.tok.kind == TOK_ERROR ? p.err : "unexpected trailing input";
+        err = ERR_INVALID_YAML;
+    }
+
+    if (err != ERR_OK) {
+        if (!quiet) {
+            fprintf(stderr, "⚠️  Invalid expression \"%.*s\": %s at column %zu\n",
+                    (int)src.len, src.ptr, p.err ? p.err : error_string(err), p.pos + 1);
+        }
+        for (size_t i = owned_mark; i < prog->nowned; i++) free(prog->owned[i]);
+        prog->nowned = owned_mark;
+        prog->code_len = code_mark;
+        unindex(prog, consts_mark, fields_mark);
+        return err;
+    }
+
+    out->start = (uint32_t)code_mark;
+    out->len = (uint16_t)(prog->code_len - code_mark);
+    out->nregs = (uint8_t)(p.max_reg + 1);
+    return ERR_OK;
+}
+
+error_t expr_compile(program_t* prog, str_t src, expr_t* out) {
+    return compile(prog, src, out, false, false);
+}
+
+error_t expr_compile_value(program_t* prog, str_t src, expr_t* out) {
+    if (!prog || !out || (!src.ptr && src.len)) return ERR_NULL_PTR;
+
+    // A lone identifier reads as a word (`status: approved`), not a
+    // reference to a field called `approved`.
+    parser_t probe = { .prog = prog, .src = src };
+    next_token(&probe);
+    bool bare_word = probe.tok.kind == TOK_IDENT;
+    if (bare_word) {
+        next_token(&probe);
+        bare_word = probe.tok.kind == TOK_END;
+    }
+
+    if (!bare_word) {
+        error_t err = compile(prog, src, out, true, true);
+        if (err != ERR_INVALID_YAML) return err;
+    }
+
+    // Literal text: trim surrounding whitespace, keep everything else.
+    while (src.len && (src.ptr[0] == ' ' || src.ptr[0] == '\t')) {
+        src.ptr++;
+        src.len--;
+    }
+    while (src.len && (src.ptr[src.len - 1] == ' ' || src.ptr[src.len - 1] == '\t')) {
+        src.len--;
+    }
+    return expr_compile_literal(prog, src, out);
+}
+
+error_t expr_compile_literal(program_t* prog, str_t src, expr_t* out) {
+    if (!prog || !out || (!src.ptr && src.len)) return ERR_NULL_PTR;
+    size_t code_mark = prog->code_len;
+    parser_t p = { .prog = prog, .src = src, .start = code_mark };
+    error_t err = emit_const(&p, 0, value_str(src));
+    if (err != ERR_OK) return err;
+    out->start = (uint32_t)code_mark;
+    out->len = (uint16_t)(prog->code_len - code_mark);
+    out->nregs = 1;
+    return ERR_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Evaluator
+// ---------------------------------------------------------------------------
+
+bool value_truthy(const value_t* v) {
+    switch (v->type) {
+        case VAL_NULL: return false;
+        case VAL_BOOL: return v->as.b;
+        case VAL_NUM: return v->as.num != 0.0 && !isnan(v->as.num);
+        case VAL_STR: return v->as.str.len > 0;
+        case VAL_RAW: return true;
+    }
+    return false;
+}
+
+static int str_compare(str_t a, str_t b) {
+    size_t n = a.len < b.len ? a.len : b.len;
+    int c = n ? memcmp(a.ptr, b.ptr, n) : 0;
+    if (c != 0) return c;
+    return (a.len > b.len) - (a.len < b.len);
+}
+
+static bool is_js_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 99;
+}
+
+// JS ToNumber of a string: surrounding whitespace is ignored, empty text
+// is 0, and 0x, 0o and 0b integers and Infinity are numbers too. Anything
+// else that is not a whole decimal literal, or is longer than
+// NUM_TOKEN_MAX, is NaN.
+static double string_number(str_t s) {
+    while (s.len && is_js_space(s.ptr[0])) {
+        s.ptr++;
+        s.len--;
+    }
+    while (s.len && is_js_space(s.ptr[s.len - 1])) s.len--;
+    if (s.len == 0) return 0.0;
+
+    if (s.len > 2 && s.ptr[0] == '0') {
+        char c = s.ptr[1];
+        int base = c == 'x' || c == 'X' ? 16 : c == 'o' || c == 'O' ? 8 : c == 'b' || c == 'B' ? 2 : 0;
+        if (base) {
+            double v = 0.0;
+            for (size_t i = 2; i < s.len; i++) {
+                int d = digit_value(s.ptr[i]);
+                if (d >= base) return NAN;
+                v = v * base + d;
+            }
+            return v;
+        }
+    }
+
+    size_t i = s.ptr[0] == '+' || s.ptr[0] == '-' ? 1 : 0;
+    if (s.len - i == 8 && memcmp(s.ptr + i, "Infinity", 8) == 0) {
+        return s.ptr[0] == '-' ? -INFINITY : INFINITY;
+    }
+    size_t digits = 0;
+    for (; i < s.len && is_digit(s.ptr[i]); i++) digits++;
+    if (i < s.len && s.ptr[i] == '.') {
+        for (i++; i < s.len && is_digit(s.ptr[i]); i++) digits++;
+    }
+    if (digits == 0) return NAN;
+    if (i < s.len && (s.ptr[i] == 'e' || s.ptr[i] == 'E')) {
+        i++;
+        if (i < s.len && (s.ptr[i] == '+' || s.ptr[i] == '-')) i++;
+        size_t exp = 0;
+        for (; i < s.len && is_digit(s.ptr[i]); i++) exp++;
+        if (exp == 0) return NAN;
+    }
+    if (i != s.len || s.len > NUM_TOKEN_MAX) return NAN;
+
+    char buf[NUM_TOKEN_MAX + 1];
+    memcpy(buf, s.ptr, s.len);
+    buf[s.len] = '\0';
+    return strtod(buf, NULL);
+}
+
+// A number, bool or string as JS ToNumber converts it.
+static double primitive_number(const value_t* v) {
+    if (v->type == VAL_NUM) return v->as.num;
+    if (v->type == VAL_BOOL) return v->as.b ? 1.0 : 0.0;
+    return string_number(v->as.str);
+}
+
+// JS loose equality (==). null stands for both null and undefined, so it
+// equals only itself. Numbers, bools and strings of different types
+// compare as numbers: 1 == "1", true == 1, "" == 0. Objects and arrays
+// compare by their JSON text and never equal a primitive.
+static bool values_equal(const value_t* a, const value_t* b) {
+    if (a->type == b->type) {
+        switch (a->type) {
+            case VAL_NULL: return true;
+            case VAL_BOOL: return a->as.b == b->as.b;
+            case VAL_NUM: return a->as.num == b->as.num;
+            case VAL_STR:
+            case VAL_RAW: return str_eq(a->as.str, b->as.str);
+        }
+        return false;
+    }
+    if (a->type == VAL_NULL || b->type == VAL_NULL || a->type == VAL_RAW || b->type == VAL_RAW) return false;
+    return primitive_number(a) == primitive_number(b);
+}
+
+// JS relational comparison: two strings compare bytewise, other
+// primitives as numbers, so "10" > 9 holds. null orders like undefined, a
+// missing field, and objects and arrays like NaN: every comparison with
+// them is false. Returns -1, 0 or 1, or 2 when the operands are unordered.
+static int values_order(const value_t* a, const value_t* b) {
+    if (a->type == VAL_STR && b->type == VAL_STR) {
+        int c = str_compare(a->as.str, b->as.str);
+        return (c > 0) - (c < 0);
+    }
+    if (a->type == VAL_NULL || b->type == VAL_NULL || a->type == VAL_RAW || b->type == VAL_RAW) return 2;
+    double x = primitive_number(a);
+    double y = primitive_number(b);
+    if (isnan(x) || isnan(y)) return 2;
+    return (x > y) - (x < y);
+}
+
+value_t expr_binary(opcode_t op, const value_t* a, const value_t* b) {
+    bool nums = a->type == VAL_NUM && b->type == VAL_NUM;
+    double x = a->as.num;
+    double y = b->as.num;
+
+    switch (op) {
+        case OP_ADD: return nums ? value_num(x + y) : value_null();
+        case OP_SUB: return nums ? value_num(x - y) : value_null();
+        case OP_MUL: return nums ? value_num(x * y) : value_null();
+        case OP_DIV: return nums && y != 0.0 ? value_num(x / y) : value_null();
+        case OP_MOD: return nums && y != 0.0 ? value_num(fmod(x, y)) : value_null();
+        case OP_LT:
+            if (nums) return value_bool(x < y);
+            return value_bool(values_order(a, b) == -1);
+        case OP_LE: {
+            if (nums) return value_bool(x <= y);
+            int c = values_order(a, b);
+            return value_bool(c == -1 || c == 0);
+        }
+        case OP_GT:
+            if (nums) return value_bool(x > y);
+            return value_bool(values_order(a, b) == 1);
+        case OP_GE: {
+            if (nums) return value_bool(x >= y);
+            int c = values_order(a, b);
+            return value_bool(c == 1 || c == 0);
+        }
+        case OP_EQ: return value_bool(values_equal(a, b));
+        case OP_NE: return value_bool(!values_equal(a, b));
+        case OP_AND: return value_bool(value_truthy(a) && value_truthy(b));
+        case OP_OR: return value_bool(value_truthy(a) || value_truthy(b));
+        default: return value_null();
+    }
+}
+
+#define NUMERIC_FAST_PATH(result)                                          \
+    if (regs[a].type == VAL_NUM && regs[b].type == VAL_NUM) {              \
+        double x = regs[a].as.num;                                         \
+        double y = regs[b].as.num;                                         \
+        regs[d] = (result);                                                \
+    } else {                                                               \
+        regs[d] = expr_binary(op, &regs[a], &regs[b]);                     \
+    }
+
+value_t expr_eval(const program_t* prog, const expr_t* expr, const record_view_t* rec) {
+    value_t regs[EXPR_MAX_REGS];
+    regs[0] = value_null();
+
+    const insn_t* pc = prog->code + expr->start;
+    const insn_t* end = pc + expr->len;
+    while (pc < end) {
+        insn_t insn = *pc++;
+        opcode_t op = INSN_OP(insn);
+        unsigned d = INSN_D(insn);
+        unsigned a = INSN_A(insn);
+        unsigned b = INSN_B(insn);
+
+        switch (op) {
+            case OP_LOADK:
+                regs[d] = prog->consts[insn_operand(insn, &pc)];
+                break;
+            case OP_LOADF: {
+                uint32_t slot = rec->slots[insn_operand(insn, &pc)];
+                regs[d] = slot == EXPR_NO_FIELD ? value_null() : rec->fields[slot].value;
+                break;
+            }
+            case OP_NOT:
+                regs[d] = value_bool(!value_truthy(&regs[a]));
+                break;
+            case OP_NEG:
+                regs[d] = regs[a].type == VAL_NUM ? value_num(-regs[a].as.num) : value_null();
+                break;
+            case OP_TRUTH:
+                regs[d] = value_bool(value_truthy(&regs[a]));
+                break;
+            case OP_ADD: NUMERIC_FAST_PATH(value_num(x + y)) break;
+            case OP_SUB: NUMERIC_FAST_PATH(value_num(x - y)) break;
+            case OP_MUL: NUMERIC_FAST_PATH(value_num(x * y)) break;
+            case OP_LT: NUMERIC_FAST_PATH(value_bool(x < y)) break;
+            case OP_LE: NUMERIC_FAST_PATH(value_bool(x <= y)) break;
+            case OP_GT: NUMERIC_FAST_PATH(value_bool(x > y)) break;
+            case OP_GE: NUMERIC_FAST_PATH(value_bool(x >= y)) break;
+            case OP_DIV:
+            case OP_MOD:
+            case OP_EQ:
+            case OP_NE:
+            case OP_AND:
+            case OP_OR:
+                regs[d] = expr_binary(op, &regs[a], &regs[b]);
+                break;
+            case OP_JF:
+                if (!value_truthy(&regs[d])) {
+                    regs[d] = value_bool(false);
+                    pc += INSN_AX_OF(insn);
+                }
+                break;
+            case OP_JT:
+                if (value_truthy(&regs[d])) {
+                    regs[d] = value_bool(true);
+                    pc += INSN_AX_OF(insn);
+                }
+                break;
+            case OP_COUNT:
+                break;
+        }
+    }
+    return regs[0];
+}
@@ -0,0 +1,154 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "git_for_logic.h"
+#include "value.h"
+
+// Rule expressions (`when` conditions and `then` values) are compiled once
+// per ruleset into register bytecode and evaluated with a switch loop that
+// never parses or allocates.
+//
+// Instruction word layout: op:8 | d:8 | a:8 | b:8. LOADK, LOADF and the
+// jumps use a 16-bit operand stored in a:b. A LOADK or LOADF operand of
+// EXPR_WIDE or more is stored whole in the next code word instead, with
+// EXPR_WIDE in a:b, so a ruleset may have any number of constants and
+// fields. Only one expression's code is limited, to EXPR_MAX_LEN words.
+
+#define EXPR_MAX_REGS 32
+#define EXPR_MAX_DEPTH 256
+#define EXPR_MAX_LEN 65535
+#define EXPR_WIDE 0xFFFF
+
+typedef uint32_t insn_t;
+
+typedef enum {
+    OP_LOADK = 0,  // d = consts[k]
+    OP_LOADF,      // d = record field fields[k] (null when absent)
+    OP_NOT,        // d = !truthy(a)
+    OP_NEG,        // d = -a
+    OP_TRUTH,      // d = truthy(a)
+    OP_ADD,        // d = a + b
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_LT,         // d = a < b
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_EQ,
+    OP_NE,
+    OP_AND,        // d = truthy(a) && truthy(b)
+    OP_OR,
+    OP_JF,         // if !truthy(d): d = false, pc += ax
+    OP_JT,         // if truthy(d): d = true, pc += ax
+    OP_COUNT
+} opcode_t;
+
+#define INSN(op, d, a, b) \
+    ((insn_t)(op) | ((insn_t)(d) << 8) | ((insn_t)(a) << 16) | ((insn_t)(b) << 24))
+#define INSN_AX(op, d, ax) \
+    ((insn_t)(op) | ((insn_t)(d) << 8) | ((insn_t)(ax) << 16))
+#define INSN_OP(i) ((opcode_t)((i) & 0xFF))
+#define INSN_D(i)  (((i) >> 8) & 0xFF)
+#define INSN_A(i)  (((i) >> 16) & 0xFF)
+#define INSN_B(i)  (((i) >> 24) & 0xFF)
+#define INSN_AX_OF(i) (((i) >> 16) & 0xFFFF)
+
+// The operand k of a LOADK or LOADF; advances *pc past a wide one.
+static inline uint32_t insn_operand(insn_t insn, const insn_t** pc) {
+    uint32_t ax = INSN_AX_OF(insn);
+    return ax == EXPR_WIDE ? *(*pc)++ : ax;
+}
+
+// One compiled expression: a contiguous run of program code whose
+// result is left in register 0.
+typedef struct {
+    uint32_t start;
+    uint16_t len;
+    uint8_t nregs;
+} expr_t;
+
+// Shared code, constant and field-name pools for every expression of a
+// ruleset. Field names and unescaped string constants point into the
+// source text, which must outlive the program. Each distinct field name
+// is interned once; its index in fields is the field's symbol.
+typedef struct {
+    insn_t* code;
+    size_t code_len;
+    size_t code_cap;
+
+    value_t* consts;
+    size_t nconsts;
+    size_t consts_cap;
+    uint32_t* const_index;      // open-addressed, index + 1, 0 for empty
+    size_t const_mask;
+
+    str_t* fields;
+    size_t nfields;
+    size_t fields_cap;
+    uint32_t* field_index;      // the same, for fields
+    size_t field_mask;
+
+    char** owned;      // unescaped string constants
+    size_t nowned;
+    size_t owned_cap;
+} program_t;
+
+#define EXPR_NO_FIELD UINT32_MAX
+
+// Field access for the evaluator, by symbol: slots[i] is the index in
+// fields of the record's value for prog->fields[i], or EXPR_NO_FIELD
+// when the record has no such field.
+typedef struct {
+    const field_t* fields;
+    const uint32_t* slots;
+} record_view_t;
+
+void program_init(program_t* prog);
+void program_free(program_t* prog);
+
+// Returns the symbol of a field name, adding it to prog->fields if it is
+// new.
+error_t program_intern_field(program_t* prog, str_t name, uint32_t* out_index);
+
+// Looks up the symbol of a field name without adding it.
+bool program_find_field(const program_t* prog, str_t name, uint32_t* out_index);
+
+// Compiles a boolean `when` condition.
+// Returns ERR_INVALID_YAML on syntax errors, ERR_BUFFER_OVERFLOW when the
+// expression needs more than EXPR_MAX_REGS registers or EXPR_MAX_LEN
+// code words, or nests unary operators and parentheses deeper than
+// EXPR_MAX_DEPTH.
+error_t expr_compile(program_t* prog, str_t src, expr_t* out);
+
+// Compiles a plain (unquoted) `then` value. It is compiled as an
+// expression (`income * 5`, `0.025`, `true`) only if it parses as one and
+// every field it names is in prog->fields already, i.e. is read by a
+// condition or assigned by a rule. Anything else (`pre-approved`, `N/A`,
+// or a bare identifier such as `approved`) becomes a string literal, as
+// legacy stores it.
+error_t expr_compile_value(program_t* prog, str_t src, expr_t* out);
+
+// Compiles text as a string constant, verbatim: quoted and block `then`
+// values.
+error_t expr_compile_literal(program_t* prog, str_t src, expr_t* out);
+
+value_t expr_eval(const program_t* prog, const expr_t* expr, const record_view_t* rec);
+
+bool value_truthy(const value_t* v);
+
+// Scalar semantics of the binary opcodes, shared with constant folding.
+// Comparisons follow the JS operators of the legacy evaluator: == and !=
+// are loose (1 == "1", true == 1), and <, <=, >, >= compare two strings
+// bytewise and anything else as numbers ("10" > 9). null stands for
+// both null and undefined, so it equals only itself and never orders.
+//
+// Arithmetic is where this departs from legacy: it needs two numbers and
+// yields null otherwise. In particular + on a string is null, where JS
+// concatenates, because the evaluator never allocates a result; a
+// condition such as `name + "x" == "bobx"` is false here. Division by
+// zero is null too, where JS gives Infinity or NaN.
+value_t expr_binary(opcode_t op, const value_t* a, const value_t* b);
+
+#endif
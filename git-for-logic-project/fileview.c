@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fileview.h"
+
+#define VIEW_READ_CHUNK (256 * 1024)
+
+static error_t read_all(file_view_t* view, int fd) {
+    size_t cap = view->st.st_size > 0 ? (size_t)view->st.st_size : VIEW_READ_CHUNK;
+    size_t len = 0;
+    char* buf = (char*)malloc(cap);
+    if (!buf) return ERR_MALLOC_FAILED;
+    for (;;) {
+        if (len == cap) {
+            char* grown = (char*)realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return ERR_MALLOC_FAILED;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t got = read(fd, buf + len, cap - len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            free(buf);
+            return ERR_IO;
+        }
+        if (got == 0) break;
+        len += (size_t)got;
+    }
+    view->heap = buf;
+    view->data = buf;
+    view->len = len;
+    return ERR_OK;
+}
+
+error_t file_view_open(file_view_t* view, const char* path) {
+    if (!view || !path) return ERR_NULL_PTR;
+    memset(view, 0, sizeof(*view));
+    view->data = "";
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ERR_FILE_NOT_FOUND;
+    if (fstat(fd, &view->st) != 0) {
+        close(fd);
+        return ERR_IO;
+    }
+
+    error_t err = ERR_OK;
+    if (S_ISREG(view->st.st_mode) && view->st.st_size == 0) {
+        // Nothing to map.
+    } else if (S_ISREG(view->st.st_mode)) {
+        size_t len = (size_t)view->st.st_size;
+        void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            // Parsers walk the file front to back exactly once.
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+            view->map = map;
+            view->data = (const char*)map;
+            view->len = len;
+        } else {
+            err = read_all(view, fd);
+        }
+    } else {
+        err = read_all(view, fd);
+    }
+    close(fd);
+    return err;
+}
+
+void file_view_close(file_view_t* view) {
+    if (!view) return;
+    if (view->map) munmap(view->map, view->len);
+    free(view->heap);
+    view->map = NULL;
+    view->heap = NULL;
+    view->data = "";
+    view->len = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef FILEVIEW_H
+#define FILEVIEW_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "git_for_logic.h"
+
+// Read-only view of a whole file as (data, len). Regular files are
+// mmap'd and advised for sequential access, so nothing is copied and the
+// pages are shared with the page cache; pipes and other files that
+// cannot be mapped are read() into a heap buffer instead. The view is not
+// NUL-terminated and may contain NUL bytes.
+
+typedef struct {
+    const char* data;
+    size_t len;
+    struct stat st;             // of the opened file
+    void* map;                  // mapping, or NULL
+    char* heap;                 // read() fallback, or NULL
+} file_view_t;
+
+// Returns ERR_FILE_NOT_FOUND if path cannot be opened, ERR_IO if it
+// cannot be read.
+error_t file_view_open(file_view_t* view, const char* path);
+void file_view_close(file_view_t* view);
+
+static inline bool file_view_mapped(const file_view_t* view) {
+    return view->map != NULL;
+}
+
+#endif
@@ -0,0 +1,478 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "gc.h"
+#include "odb.h"
+#include "pack.h"
+#include "pool.h"
+#include "buffer.h"
+#include "compress.h"
+#include "statedb.h"
+
+#define GC_CHUNK 4096
+#define GC_TMP_EXPIRE (24 * 60 * 60)    // seconds before a temporary pack counts as abandoned
+#define GC_DICT_SAMPLES 2048            // snapshots, and as many objects, to train on
+
+// Types the engine and legacy hashObject write, tried in turn on loose
+// files.
+static const char* const loose_types[] = { "commit", "blob", "tree" };
+
+typedef struct {
+    hash_t id;
+    char type[ODB_TYPE_MAX];    // empty until recognised
+    uint64_t sketch;
+    size_t size;
+    bool loose;                 // a loose file holds it
+    bool corrupt;               // a pack holds it under the wrong id
+} object_t;
+
+typedef struct {
+    const char* logicgit;
+    odb_t odb;
+    state_db_t* db;             // NULL if the repository has no state.db
+    compressor_t* compressor;   // NULL if there is no dictionary
+    object_t* objects;
+    size_t count;
+    size_t cap;
+    pack_t* pack;               // the new pack, when verifying
+} gc_t;
+
+typedef struct {
+    gc_t* gc;
+    size_t begin;
+    size_t end;
+    size_t failed;
+    error_t err;
+} chunk_t;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    return x ^ (x >> 33);
+}
+
+// Min-hash of the content's 8-byte shingles: two objects get the same
+// sketch with probability equal to the overlap of their shingle sets.
+static uint64_t sketch(const char* data, size_t len) {
+    if (len < 8) {
+        uint64_t v = 0;
+        memcpy(&v, data, len);
+        return mix64(v ^ len);
+    }
+    uint64_t min = UINT64_MAX;
+    for (size_t i = 0; i + 8 <= len; i++) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        uint64_t h = mix64(v);
+        if (h < min) min = h;
+    }
+    return min;
+}
+
+static error_t add_object(gc_t* gc, const uint8_t* id, bool loose) {
+    if (gc->count == gc->cap) {
+        size_t cap = gc->cap ? gc->cap * 2 : 1024;
+        object_t* objects = (object_t*)realloc(gc->objects, cap * sizeof(object_t));
+        if (!objects) return ERR_MALLOC_FAILED;
+        gc->objects = objects;
+        gc->cap = cap;
+    }
+    object_t* o = &gc->objects[gc->count++];
+    memset(o, 0, sizeof(*o));
+    memcpy(o->id, id, HASH_LEN);
+    o->loose = loose;
+    return ERR_OK;
+}
+
+typedef struct {
+    gc_t* gc;
+    size_t count;
+} loose_ctx_t;
+
+static error_t add_loose(void* ctx, const hash_t id) {
+    loose_ctx_t* loose = (loose_ctx_t*)ctx;
+    error_t err = add_object(loose->gc, id, true);
+    if (err == ERR_OK) loose->count++;
+    return err;
+}
+
+static error_t list_loose(gc_t* gc, size_t* nloose) {
+    loose_ctx_t loose = { gc, 0 };
+    error_t err = odb_for_each_loose(&gc->odb, add_loose, &loose);
+    *nloose = loose.count;
+    return err;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    return memcmp(((const object_t*)a)->id, ((const object_t*)b)->id, HASH_LEN);
+}
+
+// Similar objects next to each other: by type, then sketch, then largest
+// first, as git orders its delta window.
+static int compare_similar(const void* a, const void* b) {
+    const object_t* x = (const object_t*)a;
+    const object_t* y = (const object_t*)b;
+    int c = strcmp(x->type, y->type);
+    if (c) return c;
+    if (x->sketch != y->sketch) return x->sketch < y->sketch ? -1 : 1;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    return memcmp(x->id, y->id, HASH_LEN);
+}
+
+static void classify_chunk(void* arg, size_t worker) {
+    (void)worker;
+    chunk_t* chunk = (chunk_t*)arg;
+    buffer_t content;
+    buffer_init(&content);
+    for (size_t i = chunk->begin; i < chunk->end && chunk->err == ERR_OK; i++) {
+        object_t* o = &chunk->gc->objects[i];
+        char type[ODB_TYPE_MAX];
+        buffer_clear(&content);
+        error_t err = odb_read(&chunk->gc->odb, o->id, type, &content);
+        if (err == ERR_FILE_NOT_FOUND) continue;
+        if (err != ERR_OK) {
+            chunk->err = err;
+            break;
+        }
+        hash_t id;
+        if (type[0]) {
+            odb_hash(type, content.data, content.len, id);
+            if (hash_eq(id, o->id)) memcpy(o->type, type, sizeof(type));
+            else o->corrupt = true;
+        } else {
+            for (size_t t = 0; t < sizeof(loose_types) / sizeof(loose_types[0]); t++) {
+                odb_hash(loose_types[t], content.data, content.len, id);
+                if (hash_eq(id, o->id)) {
+                    strcpy(o->type, loose_types[t]);
+                    break;
+                }
+            }
+        }
+        o->size = content.len;
+        o->sketch = sketch(content.data, content.len);
+    }
+    buffer_free(&content);
+}
+
+static void verify_chunk(void* arg, size_t worker) {
+    (void)worker;
+    chunk_t* chunk = (chunk_t*)arg;
+    buffer_t content;
+    buffer_init(&content);
+    for (size_t i = chunk->begin; i < chunk->end; i++) {
+        const object_t* o = &chunk->gc->objects[i];
+        if (!o->type[0]) continue;
+        char type[ODB_TYPE_MAX];
+        hash_t id;
+        buffer_clear(&content);
+        if (pack_read(chunk->gc->pack, o->id, &chunk->gc->odb.dicts, type, &content) != ERR_OK ||
+            odb_hash(type, content.data, content.len, id) != ERR_OK || !hash_eq(id, o->id)) {
+            chunk->failed++;
+        }
+    }
+    buffer_free(&content);
+}
+
+// Runs fn over every object, GC_CHUNK at a time, on jobs threads.
+static error_t run_chunks(gc_t* gc, size_t jobs, task_fn fn, size_t* failed) {
+    size_t nchunks = (gc->count + GC_CHUNK - 1) / GC_CHUNK;
+    chunk_t* chunks = (chunk_t*)calloc(nchunks ? nchunks : 1, sizeof(chunk_t));
+    if (!chunks) return ERR_MALLOC_FAILED;
+    for (size_t c = 0; c < nchunks; c++) {
+        chunks[c].gc = gc;
+        chunks[c].begin = c * GC_CHUNK;
+        chunks[c].end = c + 1 < nchunks ? (c + 1) * GC_CHUNK : gc->count;
+    }
+
+    pool_t* pool = NULL;
+    if (jobs > 1 && nchunks > 1) {
+        error_t err = pool_create(&pool, jobs < nchunks ? jobs : nchunks);
+        if (err != ERR_OK) {
+            free(chunks);
+            return err;
+        }
+    }
+    for (size_t c = 0; c < nchunks; c++) {
+        if (!pool || pool_submit(pool, fn, &chunks[c]) != ERR_OK) fn(&chunks[c], 0);
+    }
+    pool_destroy(pool);
+
+    error_t err = ERR_OK;
+    for (size_t c = 0; c < nchunks; c++) {
+        if (err == ERR_OK) err = chunks[c].err;
+        if (failed) *failed += chunks[c].failed;
+    }
+    free(chunks);
+    return err;
+}
+
+static error_t sync_objects(const char* dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return ERR_IO;
+#ifdef SYS_syncfs
+    int rc = (int)syscall(SYS_syncfs, fd);
+#else
+    sync();
+    int rc = 0;
+#endif
+    close(fd);
+    return rc == 0 ? ERR_OK : ERR_IO;
+}
+
+static error_t pack_paths(const char* dir, const char* idx_name, char idx[ODB_PATH_MAX], char data[ODB_PATH_MAX]) {
+    int written = snprintf(idx, ODB_PATH_MAX, "%s/%s", dir, idx_name);
+    if (written < 0 || written >= ODB_PATH_MAX) return ERR_BUFFER_OVERFLOW;
+    written = snprintf(data, ODB_PATH_MAX, "%.*s.pack", written - 4, idx);
+    if (written < 0 || written >= ODB_PATH_MAX) return ERR_BUFFER_OVERFLOW;
+    return ERR_OK;
+}
+
+// Removes every pack other than the new one whose objects the new pack
+// all holds (a pack written while gc ran keeps its own), then temporary
+// files abandoned for GC_TMP_EXPIRE.
+static void remove_packs(gc_t* gc, const hash_t name, gc_stats_t* stats) {
+    char dir_path[ODB_PATH_MAX];
+    int written = snprintf(dir_path, sizeof(dir_path), "%s/%s", gc->odb.dir, PACK_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(dir_path)) return;
+    DIR* dir = opendir(dir_path);
+    if (!dir) return;
+    hash_hex_t hex;
+    hash_hex(name, hex);
+    time_t now = time(NULL);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* n = entry->d_name;
+        size_t len = strlen(n);
+        char idx[ODB_PATH_MAX], data[ODB_PATH_MAX];
+        if (strncmp(n, "tmp_", 4) == 0) {
+            struct stat st;
+            written = snprintf(idx, sizeof(idx), "%s/%s", dir_path, n);
+            if (written < 0 || (size_t)written >= sizeof(idx)) continue;
+            if (stat(idx, &st) == 0 && now - st.st_mtime > GC_TMP_EXPIRE) remove(idx);
+            continue;
+        }
+        if (strncmp(n, "pack-", 5) != 0 || len < 9 || strcmp(n + len - 4, ".idx") != 0) continue;
+        if (len == 5 + HASH_HEX_LEN + 4 && memcmp(n + 5, hex, HASH_HEX_LEN) == 0) continue;
+        if (pack_paths(dir_path, n, idx, data) != ERR_OK) continue;
+
+        pack_t* old = NULL;
+        if (pack_open(&old, idx) != ERR_OK) continue;
+        bool covered = true;
+        for (size_t i = 0; covered && i < pack_count(old); i++) covered = pack_contains(gc->pack, pack_id_at(old, i));
+        pack_close(old);
+        // Index first: a reader never finds an index without its pack.
+        if (covered && remove(idx) == 0) {
+            remove(data);
+            stats->removed_packs++;
+        }
+    }
+    closedir(dir);
+}
+
+static void remove_loose(gc_t* gc, gc_stats_t* stats) {
+    for (size_t i = 0; i < gc->count; i++) {
+        const object_t* o = &gc->objects[i];
+        if (!o->loose || !o->type[0]) continue;
+        hash_hex_t hex;
+        hash_hex(o->id, hex);
+        char path[ODB_PATH_MAX];
+        int written = snprintf(path, sizeof(path), "%s/%.2s/%s", gc->odb.dir, hex, hex + 2);
+        if (written < 0 || (size_t)written >= sizeof(path)) continue;
+        if (remove(path) == 0) stats->removed_files++;
+    }
+    // Fan-out directories that are now empty; rmdir leaves the others.
+    for (int b = 0; b < 256; b++) {
+        char path[ODB_PATH_MAX];
+        int written = snprintf(path, sizeof(path), "%s/%02x", gc->odb.dir, b);
+        if (written > 0 && (size_t)written < sizeof(path)) rmdir(path);
+    }
+}
+
+static error_t write_pack(gc_t* gc, gc_stats_t* stats) {
+    pack_writer_t* writer = NULL;
+    error_t err = pack_writer_open(&writer, gc->odb.dir);
+    if (err != ERR_OK) return err;
+    pack_writer_set_compressor(writer, gc->compressor);
+    buffer_t content;
+    buffer_init(&content);
+    char type[ODB_TYPE_MAX];
+    for (size_t i = 0; err == ERR_OK && i < gc->count; i++) {
+        const object_t* o = &gc->objects[i];
+        if (!o->type[0]) continue;
+        buffer_clear(&content);
+        err = odb_read(&gc->odb, o->id, type, &content);
+        if (err == ERR_OK) err = pack_writer_add(writer, o->type, content.data, content.len, o->id, true);
+    }
+    buffer_free(&content);
+    stats->objects = pack_writer_count(writer);
+    stats->deltas = pack_writer_deltas(writer);
+    stats->compressed = pack_writer_compressed(writer);
+    if (err != ERR_OK) {
+        pack_writer_abort(writer);
+        return err;
+    }
+    return pack_writer_finish(writer, stats->pack);
+}
+
+// Adds every step-th recognised object to samples, up to GC_DICT_SAMPLES.
+static error_t sample_objects(gc_t* gc, buffer_t* data, size_t* ends, size_t* count) {
+    size_t known = gc->count;
+    size_t step = known > GC_DICT_SAMPLES ? known / GC_DICT_SAMPLES : 1;
+    char type[ODB_TYPE_MAX];
+    error_t err = ERR_OK;
+    for (size_t i = 0, taken = 0; err == ERR_OK && i < gc->count && taken < GC_DICT_SAMPLES; i += step) {
+        if (!gc->objects[i].type[0]) continue;
+        err = odb_read(&gc->odb, gc->objects[i].id, type, data);
+        if (err == ERR_OK) {
+            ends[(*count)++] = data->len;
+            taken++;
+        }
+    }
+    return err;
+}
+
+// Trains a dictionary on the latest snapshots and a spread of objects and
+// makes it CURRENT, then opens the compressor for the new pack with the
+// CURRENT dictionary, if there is one. Too few samples keep the old one.
+static error_t train(gc_t* gc, gc_stats_t* stats) {
+    size_t* ends = (size_t*)malloc(2 * GC_DICT_SAMPLES * sizeof(size_t));
+    if (!ends) return ERR_MALLOC_FAILED;
+    buffer_t data;
+    buffer_init(&data);
+    size_t count = 0;
+    error_t err = gc->db ? state_db_samples(gc->db, GC_DICT_SAMPLES, &data, ends, &count) : ERR_OK;
+    if (err == ERR_OK) err = sample_objects(gc, &data, ends, &count);
+    str_t* samples = err == ERR_OK ? (str_t*)malloc((count ? count : 1) * sizeof(str_t)) : NULL;
+    if (err == ERR_OK && !samples) err = ERR_MALLOC_FAILED;
+    buffer_t dict;
+    buffer_init(&dict);
+    if (err == ERR_OK) {
+        for (size_t i = 0; i < count; i++) {
+            size_t start = i ? ends[i - 1] : 0;
+            samples[i].ptr = data.data + start;
+            samples[i].len = ends[i] - start;
+        }
+        stats->samples = count;
+        err = dict_train(samples, count, &dict);
+        if (err == ERR_OK) err = dict_save(gc->logicgit, dict.data, dict.len, &stats->dict);
+        if (err == ERR_OK) {
+            dict_set_free(&gc->odb.dicts);
+            err = dict_set_load(&gc->odb.dicts, gc->logicgit);
+        } else if (err == ERR_FILE_NOT_FOUND) {
+            err = ERR_OK;
+        }
+    }
+    free(ends);
+    free(samples);
+    buffer_free(&data);
+    buffer_free(&dict);
+    if (err == ERR_OK && gc->odb.dicts.current) err = compressor_open(&gc->compressor, gc->odb.dicts.current);
+    return err;
+}
+
+static error_t repack(gc_t* gc, size_t jobs, gc_stats_t* stats) {
+    error_t err = list_loose(gc, &stats->loose);
+    for (size_t p = 0; err == ERR_OK && p < gc->odb.npacks; p++) {
+        const pack_t* pack = gc->odb.packs[p];
+        for (size_t i = 0; err == ERR_OK && i < pack_count(pack); i++) {
+            err = add_object(gc, pack_id_at(pack, i), false);
+            if (err == ERR_OK) stats->packed++;
+        }
+    }
+    if (err != ERR_OK) return err;
+    // Already one pack, nothing loose and a dictionary: nothing to do.
+    if (stats->loose == 0 && gc->odb.npacks <= 1 && gc->odb.dicts.current) return ERR_OK;
+
+    // One entry per id, loose if any copy is.
+    qsort(gc->objects, gc->count, sizeof(object_t), compare_ids);
+    size_t n = 0;
+    for (size_t i = 0; i < gc->count; i++) {
+        if (n && hash_eq(gc->objects[n - 1].id, gc->objects[i].id)) {
+            gc->objects[n - 1].loose |= gc->objects[i].loose;
+            continue;
+        }
+        gc->objects[n++] = gc->objects[i];
+    }
+    gc->count = n;
+
+    err = run_chunks(gc, jobs, classify_chunk, NULL);
+    if (err != ERR_OK) return err;
+    for (size_t i = 0; i < gc->count; i++) {
+        if (gc->objects[i].corrupt) return ERR_IO;
+        if (!gc->objects[i].type[0]) stats->skipped++;
+    }
+    if (stats->skipped == gc->count) return ERR_OK;
+
+    err = train(gc, stats);
+    if (err != ERR_OK) return err;
+    qsort(gc->objects, gc->count, sizeof(object_t), compare_similar);
+    err = write_pack(gc, stats);
+    if (err == ERR_OK) err = sync_objects(gc->odb.dir);
+    if (err != ERR_OK) return err;
+
+    char dir[ODB_PATH_MAX], idx[ODB_PATH_MAX], data[ODB_PATH_MAX];
+    hash_hex_t hex;
+    int written = snprintf(dir, sizeof(dir), "%s/%s", gc->odb.dir, PACK_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(dir)) return ERR_BUFFER_OVERFLOW;
+    char name[ODB_PATH_MAX];
+    written = snprintf(name, sizeof(name), "pack-%s.idx", hash_hex(stats->pack, hex));
+    if (written < 0 || (size_t)written >= sizeof(name)) return ERR_BUFFER_OVERFLOW;
+    err = pack_paths(dir, name, idx, data);
+    if (err == ERR_OK) err = pack_open(&gc->pack, idx);
+    size_t failed = 0;
+    if (err == ERR_OK) err = run_chunks(gc, jobs, verify_chunk, &failed);
+    if (err == ERR_OK && failed) err = ERR_IO;
+    if (err != ERR_OK) {
+        // Drop the bad pack, unless it has the name (so the bytes) of one
+        // that was there before.
+        bool existed = false;
+        for (size_t p = 0; p < gc->odb.npacks; p++) {
+            hash_t old;
+            pack_name(gc->odb.packs[p], old);
+            existed |= hash_eq(old, stats->pack);
+        }
+        if (!existed) {
+            remove(idx);
+            remove(data);
+        }
+        return err;
+    }
+
+    remove_packs(gc, stats->pack, stats);
+    remove_loose(gc, stats);
+    if (gc->db && gc->compressor) return state_db_compress(gc->db, gc->compressor, &stats->snapshots);
+    return ERR_OK;
+}
+
+error_t gc_run(const char* logicgit_dir, size_t jobs, size_t cache_budget, gc_stats_t* stats) {
+    if (!logicgit_dir || !stats) return ERR_NULL_PTR;
+    memset(stats, 0, sizeof(*stats));
+    gc_t gc;
+    memset(&gc, 0, sizeof(gc));
+    gc.logicgit = logicgit_dir;
+    error_t err = odb_open(&gc.odb, logicgit_dir);
+    if (err != ERR_OK) return err;
+    err = odb_set_cache(&gc.odb, cache_budget);
+    char db_path[ODB_PATH_MAX];
+    struct stat st;
+    int written = snprintf(db_path, sizeof(db_path), "%s/state.db", logicgit_dir);
+    if (written < 0 || (size_t)written >= sizeof(db_path)) err = ERR_BUFFER_OVERFLOW;
+    if (err == ERR_OK && stat(db_path, &st) == 0) err = state_db_open(&gc.db, db_path);
+    if (err == ERR_OK) err = repack(&gc, jobs ? jobs : 1, stats);
+    cache_stats(gc.odb.cache, &stats->cache);
+    compressor_close(gc.compressor);
+    state_db_close(gc.db);
+    pack_close(gc.pack);
+    odb_close(&gc.odb);
+    free(gc.objects);
+    return err;
+}
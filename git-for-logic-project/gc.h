@@ -0,0 +1,54 @@
+#ifndef GC_H
+#define GC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "cache.h"
+
+// Repacks a repository's object store: every loose object and every
+// object in the existing packs goes into one new pack (pack.h), and the
+// files it replaces are then removed.
+//
+// Reading, typing and sketching the objects runs on a thread pool. Each
+// object gets a min-hash sketch of its 8-byte shingles, so objects that
+// share content tend to share a sketch. The pack is written in (type,
+// sketch, size) order, so that each object's delta base, the object before
+// it, is a similar one. The new pack is then read back in parallel, and
+// every object is re-hashed against its id. Only after that check and a
+// sync are loose files and old packs removed, so a crash at any point
+// loses nothing; at worst some objects are stored twice until the next gc.
+//
+// Loose files do not record their type; one that does not hash to its
+// name under any type the engine writes is left where it is.
+//
+// Before writing, gc trains a compression dictionary (compress.h) on the
+// latest state.db snapshots and a spread of the objects, and makes it
+// CURRENT. The new pack stores objects compressed with it, and once the
+// pack is in place the plain snapshot rows of state.db are compressed
+// too.
+
+typedef struct {
+    size_t loose;               // loose objects found
+    size_t packed;              // objects found in packs
+    size_t objects;             // objects in the new pack
+    size_t deltas;              // of which stored as deltas
+    size_t compressed;          // of which stored compressed
+    size_t skipped;             // unrecognised loose objects, left alone
+    size_t removed_files;       // loose files removed
+    size_t removed_packs;       // packs removed
+    size_t samples;             // dictionary training samples
+    uint32_t dict;              // id of the new dictionary, 0 if none
+    size_t snapshots;           // state.db snapshot rows compressed
+    cache_stats_t cache;        // of the object cache, at the end
+    hash_t pack;                // name of the new pack, if one was written
+} gc_stats_t;
+
+// jobs is the number of threads. Objects are read once to sort them and
+// again to write them; cache_budget bytes of them are kept in between.
+// Returns ERR_IO, removing nothing, if the new pack does not read back,
+// or if an existing pack holds a corrupt object.
+error_t gc_run(const char* logicgit_dir, size_t jobs, size_t cache_budget, gc_stats_t* stats);
+
+#endif
@@ -7,33 +7,36 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/stat.h>
-#include <openssl/sha.h>
 #include "git_for_logic.h"
+#include "hash.h"
+#include "rules.h"
+#include "json.h"
+#include "csv.h"
+#include "execute.h"
+#include "batch.h"
+#include "commit.h"
+#include "parallel.h"
+#include "index.h"
+#include "fileview.h"
+#include "stream.h"
+#include "dataset.h"
+#include "statedb.h"
+#include "writer.h"
+#include "gc.h"
+#include "compress.h"
 
 #define MAX_PATH_LEN 4096
-#define HASH_HEX_LEN 40
-
-typedef char hash_t[41];
 
 // ACTUAL STRUCT DEFINITION (matches forward declaration)
 struct repo_t {
     char repo_path[MAX_PATH_LEN];
     char db_path[MAX_PATH_LEN];
-    void* db;  // sqlite3* but we're avoiding the dependency
+    state_db_t* db;  // opened by the first execute
     char current_branch[256];
 };
 
-static error_t compute_sha1(const char* data, size_t len, hash_t out_hash) {
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1((const unsigned char*)data, len, hash);
-    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-        snprintf(&out_hash[i * 2], 3, "%02x", hash[i]);
-    }
-    out_hash[HASH_HEX_LEN] = '\0';
-    return ERR_OK;
-}
-
 static error_t ensure_directory(const char* path) {
     struct stat st;
     if (stat(path, &st) == 0) return ERR_OK;
@@ -63,6 +66,9 @@ error_t repo_init(const char* path, repo_t** out_repo) {
     snprintf(dir, sizeof(dir), "%s/.logicgit/objects", path);
     ensure_directory(dir);
     
+    snprintf(dir, sizeof(dir), "%s/.logicgit/refs", path);
+    ensure_directory(dir);
+    
     snprintf(dir, sizeof(dir), "%s/.logicgit/refs/heads", path);
     ensure_directory(dir);
     
@@ -85,51 +91,276 @@ error_t repo_init(const char* path, repo_t** out_repo) {
     return ERR_OK;
 }
 
-static char* read_file_content(const char* filepath) {
-    FILE* f = fopen(filepath, "r");
-    if (!f) return NULL;
+// Opens a file view and digests it. The digest comes from the index when
+// the file's stat data is unchanged; otherwise the view is hashed and the
+// index learns the new digest. Only regular files are cached.
+static error_t load_file(const char* filepath, index_t* index, const char* key,
+                         file_view_t* view, hash_t out_hash) {
+    error_t err = file_view_open(view, filepath);
+    if (err != ERR_OK) return err;
+    bool regular = S_ISREG(view->st.st_mode);
+    if (regular && index_lookup(index, key, &view->st, out_hash)) return ERR_OK;
+    compute_sha1(view->data, view->len, out_hash);
+    // A failed update only costs a re-hash next time.
+    if (regular) index_update(index, key, &view->st, out_hash);
+    return ERR_OK;
+}
+
+static bool has_suffix(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
 
-    if (fseek(f, 0, SEEK_END) != 0) {
-        fclose(f);
-        return NULL;
+typedef struct {
+    bool batch;                 // columnar evaluation (batch.c)
+    size_t jobs;                // worker threads; 1 runs on the main thread
+    bool stream;                // read JSON Lines and CSV in bounded memory (stream.c)
+    const char* data_dir;       // run every data file of this directory (dataset.c)
+} execute_options_t;
+
+typedef struct {
+    const ruleset_t* rules;
+    bool batched;
+    engine_t engine;
+    batch_engine_t batch;
+    parallel_t* parallel;
+    committer_t committer;
+    state_db_t* db;
+    writer_t* writer;           // stores commits and state.db rows (writer.c)
+    compressor_t* compressor;   // set if the repository has a dictionary (compress.c)
+    size_t durable;             // records the writer has synced, writer thread only
+    const char* message;
+    size_t records;
+    bool columns_shown;
+    field_t* row;               // CSV row being executed
+    size_t row_cap;
+    csv_reader_t* csv;          // streamed CSV
+    bool started;               // engines are open
+    // --data-dir runs
+    index_t* index;
+    const char* dir_key;        // the directory, relative to the repository
+    hash_ctx_t files;           // digest of every file name and file digest
+    size_t bytes;
+} run_ctx_t;
+
+static error_t print_execution(void* ctx, const execution_t* result) {
+    run_ctx_t* run = (run_ctx_t*)ctx;
+    printf("\n--- Processing Record %zu ---\n", ++run->records);
+    for (size_t i = 0; i < result->napplied; i++) {
+        str_t name = run->rules->rules[result->applied[i]].name;
+        printf("✅ Applied: %.*s\n", (int)name.len, name.ptr);
     }
+    hash_hex_t hex;
+    printf("📝 Hash: %.12s\n", hash_hex(result->execution_hash, hex));
+    hash_t parent, commit_hash;
+    bool has_parent = run->committer.has_parent;
+    if (has_parent) memcpy(parent, run->committer.parent, HASH_LEN);
+    error_t err = committer_prepare(&run->committer, result, commit_hash);
+    if (err == ERR_OK) {
+        err = writer_submit(run->writer, run->committer.content.data, run->committer.content.len, commit_hash,
+                            has_parent ? parent : NULL, result);
+    }
+    if (err != ERR_OK) return err;
+    printf("💾 [%.8s] %s\n", hash_hex(commit_hash, hex), run->message);
+    printf("🎯 Final State: %.*s\n", (int)result->output_json.len, result->output_json.ptr);
+    return ERR_OK;
+}
 
-    long size = ftell(f);
-    if (size < 0) {
-        fclose(f);
-        return NULL;
+static void count_durable(void* ctx, const hash_t commit, error_t err) {
+    (void)commit;
+    if (err == ERR_OK) ((run_ctx_t*)ctx)->durable++;
+}
+
+static error_t execute_record(void* ctx, const field_t* fields, size_t nfields) {
+    run_ctx_t* run = (run_ctx_t*)ctx;
+    if (run->parallel) return parallel_append(run->parallel, fields, nfields);
+    if (run->batched) {
+        error_t err = batch_append(&run->batch, fields, nfields);
+        if (err == ERR_OK && batch_full(&run->batch)) err = batch_flush(&run->batch, print_execution, run);
+        return err;
     }
+    execution_t result;
+    error_t err = engine_run(&run->engine, fields, nfields, &result);
+    if (err != ERR_OK) return err;
+    return print_execution(run, &result);
+}
 
-    if (fseek(f, 0, SEEK_SET) != 0) {
-        fclose(f);
-        return NULL;
+static error_t execute_batch(void* ctx, const csv_batch_t* batch) {
+    run_ctx_t* run = (run_ctx_t*)ctx;
+    if (batch->ncolumns > run->row_cap) {
+        field_t* row = (field_t*)realloc(run->row, batch->ncolumns * sizeof(field_t));
+        if (!row) return ERR_MALLOC_FAILED;
+        run->row = row;
+        run->row_cap = batch->ncolumns;
     }
+    if (!run->columns_shown) {
+        run->columns_shown = true;
+        printf("🔎 Columns:");
+        for (size_t c = 0; c < batch->ncolumns; c++) {
+            printf(" %.*s:%s", (int)batch->names[c].len, batch->names[c].ptr,
+                   column_type_name(batch->columns[c].type));
+        }
+        printf("\n");
+    }
+    for (size_t r = 0; r < batch->nrows; r++) {
+        csv_batch_row(batch, r, run->row);
+        error_t err = execute_record(run, run->row, batch->ncolumns);
+        if (err != ERR_OK) return err;
+    }
+    return ERR_OK;
+}
 
-    char* content = (char*)malloc((size_t)size + 1);
-    if (!content) {
-        fclose(f);
-        return NULL;
+static error_t execute_lines(void* ctx, const char* buf, size_t len) {
+    return json_for_each_record(buf, len, execute_record, ctx);
+}
+
+static error_t execute_rows(void* ctx, const char* buf, size_t len) {
+    return csv_reader_feed(((run_ctx_t*)ctx)->csv, buf, len);
+}
+
+static bool is_data_name(const char* name) {
+    return has_suffix(name, ".json") || has_suffix(name, ".jsonl") || has_suffix(name, ".ndjson") ||
+           has_suffix(name, ".csv");
+}
+
+// One file of a --data-dir run. Its digest (from the index while its stat
+// data is unchanged) goes into the directory digest next to its name; its
+// records then run as if it had been given alone.
+static error_t execute_file(void* ctx, const data_file_t* file) {
+    run_ctx_t* run = (run_ctx_t*)ctx;
+    char key[MAX_PATH_LEN];
+    int written = snprintf(key, sizeof(key), "%s/%s", run->dir_key, file->name);
+    if (written < 0 || (size_t)written >= sizeof(key)) return ERR_BUFFER_OVERFLOW;
+    hash_t digest;
+    bool regular = S_ISREG(file->st->st_mode);
+    if (!regular || !index_lookup(run->index, key, file->st, digest)) {
+        compute_sha1(file->data, file->len, digest);
+        if (regular) index_update(run->index, key, file->st, digest);
     }
+    hash_update(&run->files, file->name, strlen(file->name) + 1);
+    hash_update(&run->files, digest, HASH_LEN);
+    run->bytes += file->len;
 
-    size_t read_bytes = fread(content, 1, (size_t)size, f);
-    if (read_bytes != (size_t)size) {
-        fclose(f);
-        free(content);
-        return NULL;
+    printf("\n📄 File: %s (%zu bytes)\n", file->name, file->len);
+    return has_suffix(file->name, ".csv") ? csv_for_each_batch(file->data, file->len, execute_batch, run)
+                                          : json_for_each_record(file->data, file->len, execute_record, run);
+}
+
+// The run is identified by both digests, hashed as raw bytes.
+static void print_execution_hash(const hash_t rules_hash, const hash_t data_hash) {
+    uint8_t exec_data[2 * HASH_LEN];
+    hash_t exec_hash;
+    memcpy(exec_data, rules_hash, HASH_LEN);
+    memcpy(exec_data + HASH_LEN, data_hash, HASH_LEN);
+    compute_sha1((const char*)exec_data, sizeof(exec_data), exec_hash);
+    hash_hex_t hex;
+    printf("💾 Execution hash: %.12s\n", hash_hex(exec_hash, hex));
+}
+
+// Opens the committer, the state database, the writer thread and the
+// evaluation engine(s) of a run.
+static error_t run_start(run_ctx_t* run, repo_t* repo, const char* rules_file, const ruleset_t* rules,
+                         const hash_t rules_hash, const execute_options_t* options) {
+    error_t err = committer_open(&run->committer, repo->repo_path, run->message);
+    if (err == ERR_OK && !repo->db) err = state_db_open(&repo->db, repo->db_path);
+    if (err == ERR_OK) {
+        err = state_db_begin(repo->db, rules, rules_file, rules_hash, repo->current_branch, run->message);
+    }
+    if (err != ERR_OK) return err;
+    run->db = repo->db;
+    if (run->committer.odb.dicts.current) {
+        err = compressor_open(&run->compressor, run->committer.odb.dicts.current);
+        if (err != ERR_OK) return err;
     }
+    err = writer_start(&run->writer, &run->committer.odb, run->db, run->compressor, count_durable, run);
+    if (err != ERR_OK) return err;
+    if (options->jobs > 1) {
+        err = parallel_create(&run->parallel, rules, rules_hash, options->jobs, run->batched,
+                              print_execution, run);
+    } else {
+        err = run->batched ? batch_init(&run->batch, rules, rules_hash)
+                           : engine_init(&run->engine, rules, rules_hash);
+    }
+    if (err != ERR_OK) return err;
+    run->started = true;
+    if (run->batched) {
+        printf("🧮 Batch mode: %d lanes, %s kernels, %s hashing\n", BATCH_LANES,
+               batch_kernel_name(), hash_kernel_name());
+    }
+    if (run->parallel) printf("🧵 Parallel mode: %zu workers\n", options->jobs);
+    return ERR_OK;
+}
 
-    content[size] = '\0';
-    fclose(f);
-    return content;
+// Drains pending records, waits until the writer has made them durable,
+// moves the branch if everything succeeded and frees the run. Returns the
+// first error.
+static error_t run_finish(run_ctx_t* run, error_t err) {
+    writer_stats_t stats = { 0, 0, 0, 0, 0, { 0 } };
+    if (run->started) {
+        if (run->parallel) {
+            error_t finish = parallel_finish(run->parallel);
+            if (err == ERR_OK) err = finish;
+            parallel_destroy(run->parallel);
+        } else if (run->batched) {
+            if (err == ERR_OK) err = batch_flush(&run->batch, print_execution, run);
+            batch_free(&run->batch);
+        } else {
+            engine_free(&run->engine);
+        }
+    }
+    if (run->writer) {
+        error_t stop = writer_stop(run->writer, &stats);
+        if (err == ERR_OK) err = stop;
+    }
+    compressor_close(run->compressor);
+    if (run->started && err == ERR_OK) err = committer_finish(&run->committer);
+    if (run->db) {
+        error_t end = state_db_end(run->db, err == ERR_OK);
+        if (err == ERR_OK) err = end;
+    }
+    csv_reader_free(run->csv);
+    committer_close(&run->committer);
+    free(run->row);
+    if (err == ERR_OK) printf("\n🏁 Executed %zu records\n", run->records);
+    if (err == ERR_OK && run->durable) {
+        printf("🧾 Durable: %zu records in %zu group commits\n", run->durable, stats.groups);
+    }
+    size_t repeats = state_db_repeats(run->db);
+    if (err == ERR_OK && repeats) {
+        printf("🔁 %zu records repeated a stored execution: state.db keeps its first row and commit\n",
+               repeats);
+    }
+    if (err == ERR_OK && stats.packed) {
+        hash_hex_t hex;
+        printf("📦 Packed %zu objects (%zu as deltas) into pack-%.12s\n", stats.packed, stats.deltas,
+               hash_hex(stats.pack, hex));
+        if (stats.compressed) printf("🗜️  Compressed %zu objects\n", stats.compressed);
+        if (stats.nodes) printf("🌳 State trees: %zu new nodes\n", stats.nodes);
+    }
+    return err;
 }
 
+// The index is only a cache, so a failed save costs re-hashing next run;
+// a lock left behind would keep failing it, so say how to clear it.
+static void save_index(index_t* index) {
+    if (index_save(index) == ERR_OK) return;
+    if (index->locked) {
+        printf("⚠️  Could not update %s: %s.lock exists.\n", index->file, index->file);
+        printf("   Another run may be saving it; if none is, remove the lock file to continue.\n");
+    } else {
+        printf("⚠️  Could not update %s\n", index->file);
+    }
+}
 
-error_t repo_execute(repo_t* repo, const char* rules_file, const char* data_file, const char* message) {
-    if (!repo || !rules_file || !data_file) return ERR_NULL_PTR;
+// Runs rules_file over data/<data_file>, or over every data file in
+// options->data_dir (relative to the repository) when data_file is NULL.
+static error_t execute_with_options(repo_t* repo, const char* rules_file, const char* data_file,
+                                   const char* message, const execute_options_t* options) {
+    if (!repo || !rules_file || !options || (!data_file && !options->data_dir)) return ERR_NULL_PTR;
     
     printf("\n🎯 Git for Logic - Execute & Commit\n");
     printf("📋 Rules: %s\n", rules_file);
-    printf("📊 Data: %s\n", data_file);
+    printf("📊 Data: %s\n", data_file ? data_file : options->data_dir);
     
     // Build file paths
     char rules_path[MAX_PATH_LEN];
@@ -138,44 +369,323 @@ error_t repo_execute(repo_t* repo, const char* rules_file, const char* data_file
     int written = snprintf(rules_path, sizeof(rules_path), "%s/rules/%s", repo->repo_path, rules_file);
     if (written < 0 || (size_t)written >= sizeof(rules_path)) return ERR_BUFFER_OVERFLOW;
 
-    written = snprintf(data_path, sizeof(data_path), "%s/data/%s", repo->repo_path, data_file);
+    written = data_file ? snprintf(data_path, sizeof(data_path), "%s/data/%s", repo->repo_path, data_file)
+                        : snprintf(data_path, sizeof(data_path), "%s/%s", repo->repo_path, options->data_dir);
     if (written < 0 || (size_t)written >= sizeof(data_path)) return ERR_BUFFER_OVERFLOW;
+    // Index keys are relative to the repository, without a trailing slash.
+    while (!data_file && written > 1 && data_path[written - 1] == '/') data_path[--written] = '\0';
 
        
-    // Read files
-    char* rules_content = read_file_content(rules_path);
-    if (!rules_content) return ERR_FILE_NOT_FOUND;
-    
-    char* data_content = read_file_content(data_path);
-    if (!data_content) {
-        free(rules_content);
-        return ERR_FILE_NOT_FOUND;
+    char logicgit[MAX_PATH_LEN];
+    written = snprintf(logicgit, sizeof(logicgit), "%s/.logicgit", repo->repo_path);
+    if (written < 0 || (size_t)written >= sizeof(logicgit)) return ERR_BUFFER_OVERFLOW;
+    index_t index;
+    error_t err = index_load(&index, logicgit);
+    if (err != ERR_OK) return err;
+
+    // Map files; hash them unless the index already knows them. Streamed
+    // data is hashed by its reader thread instead, and a data directory
+    // file by file; their digests are only known after the run.
+    bool is_dir = data_file == NULL;
+    bool is_lines = !is_dir && (has_suffix(data_file, ".jsonl") || has_suffix(data_file, ".ndjson"));
+    bool is_json = is_lines || (!is_dir && has_suffix(data_file, ".json"));
+    bool is_csv = !is_dir && has_suffix(data_file, ".csv");
+    bool streamed = options->stream && (is_lines || is_csv);
+    bool deferred = streamed || is_dir;
+    const char* data_key = data_path + strlen(repo->repo_path) + 1;
+    hash_t rules_hash, data_hash;
+    file_view_t rules_view, data_view = { .data = "" };
+    stream_t* data_stream = NULL;
+    dataset_t* data_set = NULL;
+    bool data_cached = false;
+
+    err = load_file(rules_path, &index, rules_path + strlen(repo->repo_path) + 1, &rules_view, rules_hash);
+    if (err == ERR_OK) {
+        if (is_dir) {
+            err = dataset_open(&data_set, data_path, is_data_name);
+        } else if (streamed) {
+            err = stream_open(&data_stream, data_path);
+            if (err == ERR_OK) {
+                const struct stat* st = stream_stat(data_stream);
+                data_cached = S_ISREG(st->st_mode) && index_lookup(&index, data_key, st, data_hash);
+            }
+        } else {
+            err = load_file(data_path, &index, data_key, &data_view, data_hash);
+        }
+        if (err != ERR_OK) file_view_close(&rules_view);
     }
-    
-    // Compute hashes
-    hash_t rules_hash, data_hash, exec_hash;
-    
-    compute_sha1(rules_content, strlen(rules_content), rules_hash);
-    compute_sha1(data_content, strlen(data_content), data_hash);
-    
-    char exec_data[1024];
-    snprintf(exec_data, sizeof(exec_data), "rules:%s data:%s", rules_hash, data_hash);
-    compute_sha1(exec_data, strlen(exec_data), exec_hash);
-    
-    printf("💾 Execution hash: %.12s\n", exec_hash);
+    if (!deferred || err != ERR_OK) {
+        save_index(&index);
+        index_free(&index);
+    }
+    if (err != ERR_OK) return err;
+    size_t rules_size = rules_view.len;
+
+    if (!deferred) print_execution_hash(rules_hash, data_hash);
     printf("📝 Message: %s\n", message ? message : "(no message)");
-    printf("📏 Rules size: %zu bytes\n", strlen(rules_content));
-    printf("📏 Data size: %zu bytes\n", strlen(data_content));
-    
-    free(rules_content);
-    free(data_content);
+    printf("📏 Rules size: %zu bytes\n", rules_size);
+    if (!deferred) printf("📏 Data size: %zu bytes\n", data_view.len);
+
+    // Parse and compile the rules once; the AST points into rules_view,
+    // which stays mapped until the ruleset is freed.
+    ruleset_t rules;
+    err = ruleset_load(&rules, rules_view.data, rules_size);
+    if (err != ERR_OK) {
+        if (deferred) index_free(&index);
+        dataset_close(data_set);
+        stream_close(data_stream);
+        file_view_close(&rules_view);
+        file_view_close(&data_view);
+        return err;
+    }
+    printf("📜 Loaded %zu rules", rules.nrules);
+    if (rules.name.len || rules.version.len) {
+        printf(" (%.*s%s%.*s)", (int)rules.name.len, rules.name.ptr,
+               rules.name.len && rules.version.len ? " " : "", (int)rules.version.len, rules.version.ptr);
+    }
+    printf("\n");
+
+    run_ctx_t run = { .rules = &rules, .batched = options->batch, .message = message,
+                      .index = &index, .dir_key = data_key };
+    if (is_dir || is_json || is_csv) {
+        err = run_start(&run, repo, rules_file, &rules, rules_hash, options);
+        if (err == ERR_OK && streamed && is_csv) err = csv_reader_open(&run.csv, execute_batch, &run);
+        if (err == ERR_OK) {
+            if (is_dir) {
+                printf("🗂️  Data dir: %zu files, %s reads\n", dataset_count(data_set), dataset_backend(data_set));
+                hash_init(&run.files);
+                err = dataset_for_each(data_set, execute_file, &run);
+            } else if (streamed) {
+                printf("🌊 Streaming: %d x %d KiB buffers\n", STREAM_SLOTS, STREAM_SLOT_SIZE / 1024);
+                err = is_csv ? stream_run(data_stream, !data_cached, stream_split_csv, execute_rows, &run)
+                             : stream_run(data_stream, !data_cached, stream_split_lines, execute_lines, &run);
+                if (err == ERR_OK && is_csv) err = csv_reader_finish(run.csv);
+            } else {
+                err = is_json ? json_for_each_record(data_view.data, data_view.len, execute_record, &run)
+                              : csv_for_each_batch(data_view.data, data_view.len, execute_batch, &run);
+            }
+        }
+        err = run_finish(&run, err);
+    } else {
+        printf("⚠️  No native reader for %s yet; data hashed only\n", data_file);
+    }
+
+    if (deferred) {
+        // The data digest is only known once the last byte has been read.
+        if (err == ERR_OK) {
+            size_t data_size = run.bytes;
+            if (is_dir) {
+                hash_final(&run.files, data_hash);
+            } else {
+                if (!data_cached) {
+                    stream_digest(data_stream, data_hash);
+                    const struct stat* st = stream_stat(data_stream);
+                    if (S_ISREG(st->st_mode)) index_update(&index, data_key, st, data_hash);
+                }
+                data_size = stream_size(data_stream);
+            }
+            print_execution_hash(rules_hash, data_hash);
+            printf("📏 Data size: %zu bytes\n", data_size);
+        }
+        save_index(&index);
+        index_free(&index);
+        dataset_close(data_set);
+        stream_close(data_stream);
+    }
+
+    ruleset_free(&rules);
+    file_view_close(&rules_view);
+    file_view_close(&data_view);
     
+    return err;
+}
+
+error_t repo_execute(repo_t* repo, const char* rules_file, const char* data_file, const char* message) {
+    execute_options_t options = { .batch = false, .jobs = 1, .stream = false };
+    return execute_with_options(repo, rules_file, data_file, message, &options);
+}
+
+// Prints one object's content, from a pack or a loose file.
+static error_t cat_object(const char* repo_path, const char* id_hex) {
+    hash_t id;
+    if (!hash_from_hex(id_hex, strlen(id_hex), id)) return ERR_FILE_NOT_FOUND;
+    char logicgit[MAX_PATH_LEN];
+    int written = snprintf(logicgit, sizeof(logicgit), "%s/.logicgit", repo_path);
+    if (written < 0 || (size_t)written >= sizeof(logicgit)) return ERR_BUFFER_OVERFLOW;
+    odb_t odb;
+    error_t err = odb_open(&odb, logicgit);
+    if (err != ERR_OK) return err;
+    char type[ODB_TYPE_MAX];
+    buffer_t content;
+    buffer_init(&content);
+    err = odb_read(&odb, id, type, &content);
+    if (err == ERR_OK) fwrite(content.data, 1, content.len, stdout);
+    buffer_free(&content);
+    odb_close(&odb);
+    return err;
+}
+
+// Opens the object store and state.db of repo_path, for reading.
+static error_t open_state(const char* repo_path, odb_t* odb, state_db_t** db) {
+    char logicgit[MAX_PATH_LEN], db_path[MAX_PATH_LEN];
+    int written = snprintf(logicgit, sizeof(logicgit), "%s/.logicgit", repo_path);
+    if (written < 0 || (size_t)written >= sizeof(logicgit)) return ERR_BUFFER_OVERFLOW;
+    written = snprintf(db_path, sizeof(db_path), "%s/state.db", logicgit);
+    if (written < 0 || (size_t)written >= sizeof(db_path)) return ERR_BUFFER_OVERFLOW;
+    struct stat st;
+    if (stat(db_path, &st) != 0) return ERR_FILE_NOT_FOUND;
+    error_t err = odb_open(odb, logicgit);
+    if (err != ERR_OK) return err;
+    err = state_db_open(db, db_path);
+    if (err != ERR_OK) odb_close(odb);
+    return err;
+}
+
+// Prints the state snapshot state.db holds for an execution.
+static error_t cat_snapshot(const char* repo_path, const char* execution_hash) {
+    odb_t odb;
+    state_db_t* db = NULL;
+    error_t err = open_state(repo_path, &odb, &db);
+    if (err != ERR_OK) return err;
+    buffer_t state;
+    buffer_init(&state);
+    err = state_db_snapshot(db, &odb, execution_hash, STATE_DB_FINAL, &state);
+    if (err == ERR_OK) printf("%.*s\n", (int)state.len, state.data);
+    buffer_free(&state);
+    state_db_close(db);
+    odb_close(&odb);
+    return err;
+}
+
+// An execution's audit rows, copied out of the database.
+typedef struct {
+    arena_t arena;
+    str_t* rules;
+    str_t* changes;
+    size_t count;
+    size_t cap;
+    buffer_t replayed;          // the state after the last rule
+} audit_t;
+
+static error_t collect_audit(void* ctx, str_t rule, str_t changes) {
+    audit_t* audit = (audit_t*)ctx;
+    if (!changes.ptr) return ERR_FILE_NOT_FOUND;    // written before delta_json
+    if (audit->count == audit->cap) {
+        size_t cap = audit->cap ? audit->cap * 2 : 16;
+        str_t* rules = (str_t*)realloc(audit->rules, cap * sizeof(str_t));
+        if (!rules) return ERR_MALLOC_FAILED;
+        audit->rules = rules;
+        str_t* all = (str_t*)realloc(audit->changes, cap * sizeof(str_t));
+        if (!all) return ERR_MALLOC_FAILED;
+        audit->changes = all;
+        audit->cap = cap;
+    }
+    char* name = arena_strndup(&audit->arena, rule.ptr, rule.len);
+    char* json = arena_strndup(&audit->arena, changes.ptr, changes.len);
+    if (!name || !json) return ERR_MALLOC_FAILED;
+    audit->rules[audit->count] = (str_t){ name, rule.len };
+    audit->changes[audit->count] = (str_t){ json, changes.len };
+    audit->count++;
+    return ERR_OK;
+}
+
+static error_t print_step(void* ctx, size_t step, str_t state) {
+    audit_t* audit = (audit_t*)ctx;
+    if (step == 0) {
+        printf("📥 Input: %.*s\n", (int)state.len, state.ptr);
+    } else {
+        str_t rule = audit->rules[step - 1];
+        str_t changes = audit->changes[step - 1];
+        printf("✅ Applied: %.*s\n", (int)rule.len, rule.ptr);
+        printf("🔁 Changes: %.*s\n", (int)changes.len, changes.ptr);
+        printf("🎯 State: %.*s\n", (int)state.len, state.ptr);
+    }
+    if (step < audit->count) return ERR_OK;
+    return buffer_append(&audit->replayed, state.ptr, state.len);
+}
+
+// Prints an execution's audit trail with the state after every rule,
+// rebuilt from its input snapshot, and checks the last one against the
+// final snapshot.
+static error_t audit_execution(const char* repo_path, const char* execution_hash) {
+    odb_t odb;
+    state_db_t* db = NULL;
+    error_t err = open_state(repo_path, &odb, &db);
+    if (err != ERR_OK) return err;
+    audit_t audit = { { NULL, 0 }, NULL, NULL, 0, 0, { 0 } };
+    arena_init(&audit.arena, ARENA_DEFAULT_BLOCK);
+    buffer_init(&audit.replayed);
+    buffer_t input, final;
+    buffer_init(&input);
+    buffer_init(&final);
+    err = state_db_snapshot(db, &odb, execution_hash, STATE_DB_INPUT, &input);
+    if (err == ERR_OK) err = state_db_snapshot(db, &odb, execution_hash, STATE_DB_FINAL, &final);
+    if (err == ERR_OK) err = state_db_audit(db, execution_hash, collect_audit, &audit);
+
+    // Replaying needs no rules: the changes carry the values.
+    ruleset_t none;
+    memset(&none, 0, sizeof(none));
+    hash_t no_hash = { 0 };
+    engine_t engine;
+    bool engine_ready = false;
+    if (err == ERR_OK) err = engine_init(&engine, &none, no_hash);
+    if (err == ERR_OK) {
+        engine_ready = true;
+        printf("🔎 Execution %s\n", execution_hash);
+        err = engine_replay(&engine, (str_t){ input.data, input.len }, audit.changes, audit.count, print_step,
+                            &audit);
+    }
+    if (err == ERR_OK && (audit.replayed.len != final.len ||
+                          memcmp(audit.replayed.data, final.data, final.len) != 0)) {
+        printf("❌ Replay differs from the final snapshot\n");
+        err = ERR_IO;
+    } else if (err == ERR_OK) {
+        printf("🔐 Replay matches the final snapshot\n");
+    }
+    if (engine_ready) engine_free(&engine);
+    buffer_free(&input);
+    buffer_free(&final);
+    buffer_free(&audit.replayed);
+    free(audit.rules);
+    free(audit.changes);
+    arena_free(&audit.arena);
+    state_db_close(db);
+    odb_close(&odb);
+    return err;
+}
+
+// Repacks the object store of repo_path into one pack.
+static error_t collect_garbage(const char* repo_path, size_t jobs, size_t cache_budget) {
+    char logicgit[MAX_PATH_LEN];
+    int written = snprintf(logicgit, sizeof(logicgit), "%s/.logicgit", repo_path);
+    if (written < 0 || (size_t)written >= sizeof(logicgit)) return ERR_BUFFER_OVERFLOW;
+    printf("🧹 Repacking %s\n", logicgit);
+    printf("🧵 Threads: %zu\n", jobs);
+    gc_stats_t stats;
+    error_t err = gc_run(logicgit, jobs, cache_budget, &stats);
+    if (err != ERR_OK) return err;
+    printf("🔍 Found %zu loose and %zu packed objects\n", stats.loose, stats.packed);
+    if (stats.objects == 0) {
+        printf("✅ Nothing to repack\n");
+        return ERR_OK;
+    }
+    hash_hex_t hex;
+    if (stats.dict) printf("📚 Trained dictionary %08x on %zu samples\n", (unsigned)stats.dict, stats.samples);
+    printf("📦 Packed %zu objects (%zu as deltas) into pack-%.12s\n", stats.objects, stats.deltas,
+           hash_hex(stats.pack, hex));
+    if (stats.compressed || stats.snapshots) {
+        printf("🗜️  Compressed %zu objects and %zu snapshot rows\n", stats.compressed, stats.snapshots);
+    }
+    if (stats.skipped) printf("⚠️  Left %zu unrecognised loose objects in place\n", stats.skipped);
+    printf("🗑️  Removed %zu loose files and %zu packs\n", stats.removed_files, stats.removed_packs);
+    printf("🗃️  Cache: %llu hits, %llu misses, %llu evictions\n", (unsigned long long)stats.cache.hits,
+           (unsigned long long)stats.cache.misses, (unsigned long long)stats.cache.evictions);
     return ERR_OK;
 }
 
 void repo_close(repo_t* repo) {
     if (!repo) return;
-    // If we had a real DB: if (repo->db) sqlite3_close(repo->db);
+    state_db_close(repo->db);
     free(repo);
 }
 
@@ -188,6 +698,12 @@ const char* error_string(error_t err) {
         case ERR_INVALID_YAML: return "Invalid YAML";
         case ERR_INVALID_JSON: return "Invalid JSON";
         case ERR_DB_ERROR: return "Database error";
+        case ERR_HASH_COLLISION: return "Hash collision";
+        case ERR_BUFFER_OVERFLOW: return "Buffer overflow";
+        case ERR_DIV_ZERO: return "Division by zero";
+        case ERR_NULL_PTR: return "Null pointer";
+        case ERR_BRANCH_EXISTS: return "Branch already exists";
+        case ERR_BRANCH_NOT_FOUND: return "Branch not found";
         default: return "Unknown error";
     }
 }
@@ -198,6 +714,15 @@ int main(int argc, char** argv) {
         printf("Commands:\n");
         printf("  init                             Initialize repository\n");
         printf("  execute <rules> <data> [message] Execute rules and commit\n");
+        printf("  cat-object <id>                  Print a stored object\n");
+        printf("  cat-snapshot <execution-hash>    Print the state snapshot of an execution\n");
+        printf("  audit <execution-hash>           Replay an execution's audit trail rule by rule\n");
+        printf("  gc [--jobs N] [--cache-mb N]     Repack all objects into one pack\n");
+        printf("Execute options:\n");
+        printf("  --batch                          Evaluate records in columnar batches\n");
+        printf("  --jobs N                         Evaluate records on N worker threads\n");
+        printf("  --stream                         Read .jsonl/.ndjson/.csv data in bounded memory\n");
+        printf("  --data-dir DIR                   Execute every data file in DIR instead of <data>\n");
         return 1;
     }
     
@@ -213,14 +738,42 @@ int main(int argc, char** argv) {
     }
     
     if (strcmp(argv[1], "execute") == 0) {
-        if (argc < 4) {
-            fprintf(stderr, "Usage: %s execute <rules> <data> [message]\n", argv[0]);
+        execute_options_t options = { .batch = false, .jobs = 1, .stream = false };
+        const char* args[3] = { NULL, NULL, NULL };
+        int nargs = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--batch") == 0) {
+                options.batch = true;
+            } else if (strcmp(argv[i], "--stream") == 0) {
+                options.stream = true;
+            } else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) {
+                options.data_dir = argv[++i];
+            } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+                char* end = NULL;
+                unsigned long jobs = strtoul(argv[++i], &end, 10);
+                if (!end || *end != '\0' || jobs == 0 || jobs > 1024) {
+                    fprintf(stderr, "Invalid --jobs value: %s\n", argv[i]);
+                    return 1;
+                }
+                options.jobs = (size_t)jobs;
+            } else if (strncmp(argv[i], "--", 2) == 0) {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return 1;
+            } else if (nargs < 3) {
+                args[nargs++] = argv[i];
+            }
+        }
+        // With --data-dir the directory takes the place of <data>.
+        int ndata = options.data_dir ? 0 : 1;
+        if (nargs < 1 + ndata || nargs > 2 + ndata) {
+            fprintf(stderr, "Usage: %s execute [--batch] [--jobs N] [--stream] <rules> <data> [message]\n", argv[0]);
+            fprintf(stderr, "       %s execute [--batch] [--jobs N] <rules> --data-dir <dir> [message]\n", argv[0]);
             return 1;
         }
         
-        const char* rules_file = argv[2];
-        const char* data_file = argv[3];
-        const char* message = argc > 4 ? argv[4] : "Execute rules";
+        const char* rules_file = args[0];
+        const char* data_file = ndata ? args[1] : NULL;
+        const char* message = args[1 + ndata] ? args[1 + ndata] : "Execute rules";
         
         repo_t* repo = NULL;
         error_t err = repo_init("./logic-repo", &repo);
@@ -229,7 +782,7 @@ int main(int argc, char** argv) {
             return 1;
         }
         
-        err = repo_execute(repo, rules_file, data_file, message);
+        err = execute_with_options(repo, rules_file, data_file, message, &options);
         repo_close(repo);
         
         if (err != ERR_OK) {
@@ -239,6 +792,79 @@ int main(int argc, char** argv) {
         return 0;
     }
     
+    if (strcmp(argv[1], "gc") == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t jobs = online > 0 ? (size_t)online : 1;
+        size_t cache_budget = ODB_CACHE_BUDGET;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+                char* end = NULL;
+                unsigned long n = strtoul(argv[++i], &end, 10);
+                if (!end || *end != '\0' || n == 0 || n > 1024) {
+                    fprintf(stderr, "Invalid --jobs value: %s\n", argv[i]);
+                    return 1;
+                }
+                jobs = (size_t)n;
+            } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+                char* end = NULL;
+                unsigned long n = strtoul(argv[++i], &end, 10);
+                if (!end || *end != '\0' || n > SIZE_MAX / (1024 * 1024)) {
+                    fprintf(stderr, "Invalid --cache-mb value: %s\n", argv[i]);
+                    return 1;
+                }
+                cache_budget = (size_t)n * 1024 * 1024;
+            } else {
+                fprintf(stderr, "Usage: %s gc [--jobs N] [--cache-mb N]\n", argv[0]);
+                return 1;
+            }
+        }
+        error_t err = collect_garbage("./logic-repo", jobs, cache_budget);
+        if (err != ERR_OK) {
+            fprintf(stderr, "Error: %s\n", error_string(err));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "cat-object") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s cat-object <id>\n", argv[0]);
+            return 1;
+        }
+        error_t err = cat_object("./logic-repo", argv[2]);
+        if (err != ERR_OK) {
+            fprintf(stderr, "Error: %s\n", error_string(err));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "audit") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s audit <execution-hash>\n", argv[0]);
+            return 1;
+        }
+        error_t err = audit_execution("./logic-repo", argv[2]);
+        if (err != ERR_OK) {
+            fprintf(stderr, "Error: %s\n", error_string(err));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "cat-snapshot") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s cat-snapshot <execution-hash>\n", argv[0]);
+            return 1;
+        }
+        error_t err = cat_snapshot("./logic-repo", argv[2]);
+        if (err != ERR_OK) {
+            fprintf(stderr, "Error: %s\n", error_string(err));
+            return 1;
+        }
+        return 0;
+    }
+
     fprintf(stderr, "Unknown command: %s\n", argv[1]);
     return 1;
 }
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include "hash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_HAVE_X86 1
+#endif
+
+// Two output digits per input byte, so encoding is one load and one
+// 16-bit store per byte.
+#define HEX_PAIR(b) "0123456789abcdef"[(b) >> 4], "0123456789abcdef"[(b) & 15]
+#define HEX_ROW(r) \
+    HEX_PAIR(r + 0), HEX_PAIR(r + 1), HEX_PAIR(r + 2), HEX_PAIR(r + 3), \
+    HEX_PAIR(r + 4), HEX_PAIR(r + 5), HEX_PAIR(r + 6), HEX_PAIR(r + 7), \
+    HEX_PAIR(r + 8), HEX_PAIR(r + 9), HEX_PAIR(r + 10), HEX_PAIR(r + 11), \
+    HEX_PAIR(r + 12), HEX_PAIR(r + 13), HEX_PAIR(r + 14), HEX_PAIR(r + 15)
+
+static const char hex_pairs[512] = {
+    HEX_ROW(0x00), HEX_ROW(0x10), HEX_ROW(0x20), HEX_ROW(0x30),
+    HEX_ROW(0x40), HEX_ROW(0x50), HEX_ROW(0x60), HEX_ROW(0x70),
+    HEX_ROW(0x80), HEX_ROW(0x90), HEX_ROW(0xa0), HEX_ROW(0xb0),
+    HEX_ROW(0xc0), HEX_ROW(0xd0), HEX_ROW(0xe0), HEX_ROW(0xf0),
+};
+
+// Digit value of every byte, or X for bytes that are not hex digits.
+#define X 0xFF
+static const uint8_t hex_values[256] = {
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, X, X, X, X, X, X,
+    X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, 10, 11, 12, 13, 14, 15, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+    X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+};
+#undef X
+
+static inline uint32_t rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t load_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// FIPS 180-4 SHA-1 compression over nblocks consecutive 64-byte blocks.
+// The message schedule is kept as a rolling 16-word window.
+static void sha1_blocks_scalar(uint32_t state[5], const uint8_t* data, size_t nblocks) {
+    uint32_t w[16];
+    while (nblocks--) {
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t wi;
+            if (i < 16) {
+                wi = w[i] = load_be32(data + 4 * i);
+            } else {
+                wi = rol(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+                w[i & 15] = wi;
+            }
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + wi;
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        data += HASH_BLOCK;
+    }
+}
+
+// One block for each of HASH_MAX_LANES independent messages. Lanes whose
+// bit is clear in active keep their state.
+typedef void (*sha1_blocks_fn)(uint32_t state[5], const uint8_t* data, size_t nblocks);
+typedef void (*sha1_lanes_fn)(uint32_t state[5][HASH_MAX_LANES],
+                              const uint8_t* const blocks[HASH_MAX_LANES], unsigned active);
+
+typedef struct {
+    const char* name;
+    sha1_blocks_fn blocks;
+    sha1_lanes_fn lanes;        // NULL: hash_many runs one message at a time
+} hash_kernels_t;
+
+static const hash_kernels_t kernels_scalar = { "scalar", sha1_blocks_scalar, NULL };
+
+#ifdef HASH_HAVE_X86
+// SHA-NI: four rounds per sha1rnds4, with sha1msg1 / sha1msg2 extending
+// the schedule. QUAD is rounds 4k..4k+3 for k >= 4, with m0 = W[k % 4]
+// and the other schedule registers following it; ecur / eoth alternate.
+#define SHANI_QUAD(ecur, eoth, m0, m1, m2, m3, f)          \
+    ecur = _mm_sha1nexte_epu32(ecur, m0);                  \
+    eoth = abcd;                                           \
+    m1 = _mm_sha1msg2_epu32(m1, m0);                       \
+    abcd = _mm_sha1rnds4_epu32(abcd, ecur, f);             \
+    m3 = _mm_sha1msg1_epu32(m3, m0);                       \
+    m2 = _mm_xor_si128(m2, m0)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha1_blocks_shani(uint32_t state[5], const uint8_t* data, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+    __m128i e1;
+
+    while (nblocks--) {
+        const __m128i abcd_save = abcd;
+        const __m128i e0_save = e0;
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), bswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        // Rounds 0-15: the schedule is still the block itself.
+        e0 = _mm_add_epi32(e0, w0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        e1 = _mm_sha1nexte_epu32(e1, w1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        w0 = _mm_sha1msg1_epu32(w0, w1);
+
+        e0 = _mm_sha1nexte_epu32(e0, w2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        w1 = _mm_sha1msg1_epu32(w1, w2);
+        w0 = _mm_xor_si128(w0, w2);
+
+        SHANI_QUAD(e1, e0, w3, w0, w1, w2, 0);
+
+        SHANI_QUAD(e0, e1, w0, w1, w2, w3, 0);
+        SHANI_QUAD(e1, e0, w1, w2, w3, w0, 1);
+        SHANI_QUAD(e0, e1, w2, w3, w0, w1, 1);
+        SHANI_QUAD(e1, e0, w3, w0, w1, w2, 1);
+        SHANI_QUAD(e0, e1, w0, w1, w2, w3, 1);
+        SHANI_QUAD(e1, e0, w1, w2, w3, w0, 1);
+        SHANI_QUAD(e0, e1, w2, w3, w0, w1, 2);
+        SHANI_QUAD(e1, e0, w3, w0, w1, w2, 2);
+        SHANI_QUAD(e0, e1, w0, w1, w2, w3, 2);
+        SHANI_QUAD(e1, e0, w1, w2, w3, w0, 2);
+        SHANI_QUAD(e0, e1, w2, w3, w0, w1, 2);
+        SHANI_QUAD(e1, e0, w3, w0, w1, w2, 3);
+        SHANI_QUAD(e0, e1, w0, w1, w2, w3, 3);
+        SHANI_QUAD(e1, e0, w1, w2, w3, w0, 3);
+        SHANI_QUAD(e0, e1, w2, w3, w0, w1, 3);
+        SHANI_QUAD(e1, e0, w3, w0, w1, w2, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+        data += HASH_BLOCK;
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+// AVX2 multi-buffer: each 32-bit lane of a ymm register belongs to a
+// different message, so one pass of the scalar round function hashes
+// eight blocks. Blocks are loaded as rows and transposed 8x8 into words.
+#define MB_ROL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define MB_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+#define MB_ROUNDS(first, last, fexpr, kval)                                     \
+    for (int i = first; i < last; i++) {                                        \
+        if (i >= 16) {                                                          \
+            w[i & 15] = MB_ROL(_mm256_xor_si256(MB_XOR3(w[(i + 13) & 15], w[(i + 8) & 15], \
+                                                        w[(i + 2) & 15]), w[i & 15]), 1); \
+        }                                                                       \
+        __m256i t = _mm256_add_epi32(_mm256_add_epi32(MB_ROL(a, 5), fexpr),     \
+                                     _mm256_add_epi32(_mm256_add_epi32(e, kval), w[i & 15])); \
+        e = d;                                                                  \
+        d = c;                                                                  \
+        c = MB_ROL(b, 30);                                                      \
+        b = a;                                                                  \
+        a = t;                                                                  \
+    }
+
+__attribute__((target("avx2")))
+static void transpose8(__m256i r[8]) {
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+__attribute__((target("avx2")))
+static void sha1_x8_avx2(uint32_t state[5][HASH_MAX_LANES], size_t first,
+                         const uint8_t* const* blocks, unsigned active) {
+    const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                          12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i w[16];
+    for (int half = 0; half < 2; half++) {
+        for (int l = 0; l < 8; l++) {
+            w[8 * half + l] = _mm256_loadu_si256((const __m256i*)(blocks[l] + 32 * half));
+        }
+        transpose8(w + 8 * half);
+    }
+    for (int i = 0; i < 16; i++) w[i] = _mm256_shuffle_epi8(w[i], bswap);
+
+    __m256i s[5];
+    for (int i = 0; i < 5; i++) s[i] = _mm256_loadu_si256((const __m256i*)(state[i] + first));
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+
+    MB_ROUNDS(0, 20, _mm256_or_si256(_mm256_and_si256(b, c), _mm256_andnot_si256(b, d)),
+              _mm256_set1_epi32(0x5A827999))
+    MB_ROUNDS(20, 40, MB_XOR3(b, c, d), _mm256_set1_epi32(0x6ED9EBA1))
+    MB_ROUNDS(40, 60, _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c))),
+              _mm256_set1_epi32((int)0x8F1BBCDC))
+    MB_ROUNDS(60, 80, MB_XOR3(b, c, d), _mm256_set1_epi32((int)0xCA62C1D6))
+
+    const __m256i bits = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+    const __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)active), bits),
+                                            _mm256_setzero_si256());
+    __m256i out[5] = { a, b, c, d, e };
+    for (int i = 0; i < 5; i++) {
+        __m256i sum = _mm256_add_epi32(s[i], out[i]);
+        _mm256_storeu_si256((__m256i*)(state[i] + first), _mm256_blendv_epi8(sum, s[i], keep));
+    }
+}
+
+__attribute__((target("avx2")))
+static void sha1_lanes_avx2(uint32_t state[5][HASH_MAX_LANES],
+                            const uint8_t* const blocks[HASH_MAX_LANES], unsigned active) {
+    sha1_x8_avx2(state, 0, blocks, active & 0xFF);
+    if (active >> 8) sha1_x8_avx2(state, 8, blocks + 8, active >> 8);
+}
+
+// AVX-512: sixteen lanes, native rotates, and one vpternlogd per round
+// function. Blocks are staged contiguously and gathered into words.
+#define MB16_ROUNDS(first, last, imm, kval)                                     \
+    for (int i = first; i < last; i++) {                                        \
+        if (i >= 16) {                                                          \
+            w[i & 15] = _mm512_rol_epi32(_mm512_xor_si512(                      \
+                _mm512_ternarylogic_epi32(w[(i + 13) & 15], w[(i + 8) & 15], w[(i + 2) & 15], 0x96), \
+                w[i & 15]), 1);                                                 \
+        }                                                                       \
+        __m512i t = _mm512_add_epi32(_mm512_add_epi32(_mm512_rol_epi32(a, 5),  \
+                                                      _mm512_ternarylogic_epi32(b, c, d, imm)), \
+                                     _mm512_add_epi32(_mm512_add_epi32(e, kval), w[i & 15])); \
+        e = d;                                                                  \
+        d = c;                                                                  \
+        c = _mm512_rol_epi32(b, 30);                                            \
+        b = a;                                                                  \
+        a = t;                                                                  \
+    }
+
+__attribute__((target("avx512f,avx512bw")))
+static void sha1_lanes_avx512(uint32_t state[5][HASH_MAX_LANES],
+                              const uint8_t* const blocks[HASH_MAX_LANES], unsigned active) {
+    _Alignas(64) uint32_t staged[HASH_MAX_LANES * 16];
+    for (int l = 0; l < HASH_MAX_LANES; l++) {
+        _mm512_store_si512((void*)(staged + 16 * l), _mm512_loadu_si512((const void*)blocks[l]));
+    }
+    const __m512i bswap = _mm512_set4_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+    const __m512i rows = _mm512_mullo_epi32(_mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+                                            _mm512_set1_epi32(16));
+    __m512i w[16];
+    for (int i = 0; i < 16; i++) {
+        __m512i idx = _mm512_add_epi32(rows, _mm512_set1_epi32(i));
+        w[i] = _mm512_shuffle_epi8(_mm512_i32gather_epi32(idx, (const void*)staged, 4), bswap);
+    }
+
+    __m512i s[5];
+    for (int i = 0; i < 5; i++) s[i] = _mm512_loadu_si512((const void*)state[i]);
+    __m512i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4];
+
+    // 0xCA: b ? c : d. 0x96: b ^ c ^ d. 0xE8: majority.
+    MB16_ROUNDS(0, 20, 0xCA, _mm512_set1_epi32(0x5A827999))
+    MB16_ROUNDS(20, 40, 0x96, _mm512_set1_epi32(0x6ED9EBA1))
+    MB16_ROUNDS(40, 60, 0xE8, _mm512_set1_epi32((int)0x8F1BBCDC))
+    MB16_ROUNDS(60, 80, 0x96, _mm512_set1_epi32((int)0xCA62C1D6))
+
+    __m512i out[5] = { a, b, c, d, e };
+    for (int i = 0; i < 5; i++) {
+        __m512i sum = _mm512_mask_add_epi32(s[i], (__mmask16)active, s[i], out[i]);
+        _mm512_storeu_si512((void*)state[i], sum);
+    }
+}
+
+static const hash_kernels_t kernels_shani_avx512 = { "sha-ni+avx512", sha1_blocks_shani, sha1_lanes_avx512 };
+static const hash_kernels_t kernels_shani_avx2 = { "sha-ni+avx2", sha1_blocks_shani, sha1_lanes_avx2 };
+static const hash_kernels_t kernels_shani = { "sha-ni", sha1_blocks_shani, NULL };
+static const hash_kernels_t kernels_avx512 = { "avx512", sha1_blocks_scalar, sha1_lanes_avx512 };
+static const hash_kernels_t kernels_avx2 = { "avx2", sha1_blocks_scalar, sha1_lanes_avx2 };
+#endif
+
+static const hash_kernels_t* select_kernels(void) {
+#ifdef HASH_HAVE_X86
+    bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+        return avx512 ? &kernels_shani_avx512 : avx2 ? &kernels_shani_avx2 : &kernels_shani;
+    }
+    if (avx512) return &kernels_avx512;
+    if (avx2) return &kernels_avx2;
+#endif
+    return &kernels_scalar;
+}
+
+// select_kernels, run once. Threads that race here pick the same
+// constant table, so a relaxed store is enough.
+static const hash_kernels_t* active_kernels(void) {
+    static const hash_kernels_t* chosen;
+    const hash_kernels_t* k = __atomic_load_n(&chosen, __ATOMIC_RELAXED);
+    if (!k) {
+        k = select_kernels();
+        __atomic_store_n(&chosen, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+const char* hash_kernel_name(void) {
+    return active_kernels()->name;
+}
+
+void hash_init(hash_ctx_t* ctx) {
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->total = 0;
+    ctx->used = 0;
+}
+
+void hash_update(hash_ctx_t* ctx, const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    ctx->total += len;
+    if (ctx->used) {
+        size_t take = HASH_BLOCK - ctx->used;
+        if (take > len) take = len;
+        memcpy(ctx->block + ctx->used, p, take);
+        ctx->used += take;
+        p += take;
+        len -= take;
+        if (ctx->used < HASH_BLOCK) return;
+        active_kernels()->blocks(ctx->state, ctx->block, 1);
+        ctx->used = 0;
+    }
+    // Whole blocks are compressed straight from the caller's memory.
+    size_t nblocks = len / HASH_BLOCK;
+    if (nblocks) {
+        active_kernels()->blocks(ctx->state, p, nblocks);
+        p += nblocks * HASH_BLOCK;
+        len -= nblocks * HASH_BLOCK;
+    }
+    if (len) memcpy(ctx->block, p, len);
+    ctx->used = len;
+}
+
+void hash_final(hash_ctx_t* ctx, hash_t out) {
+    uint64_t bits = ctx->total * 8;
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > HASH_BLOCK - 8) {
+        memset(ctx->block + ctx->used, 0, HASH_BLOCK - ctx->used);
+        active_kernels()->blocks(ctx->state, ctx->block, 1);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, HASH_BLOCK - 8 - ctx->used);
+    for (int i = 0; i < 8; i++) ctx->block[HASH_BLOCK - 1 - i] = (uint8_t)(bits >> (8 * i));
+    active_kernels()->blocks(ctx->state, ctx->block, 1);
+    for (int i = 0; i < 5; i++) {
+        out[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        out[4 * i + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void hash_object_init(hash_ctx_t* ctx, const char* type, size_t len) {
+    char size[32];
+    int n = snprintf(size, sizeof(size), " %zu", len);
+    hash_init(ctx);
+    hash_update(ctx, type, strlen(type));
+    hash_update(ctx, size, (size_t)n + 1);      // includes the NUL
+}
+
+error_t compute_sha1(const char* data, size_t len, hash_t out_hash) {
+    if (!data && len) return ERR_NULL_PTR;
+    hash_ctx_t ctx;
+    hash_init(&ctx);
+    hash_update(&ctx, data, len);
+    hash_final(&ctx, out_hash);
+    return ERR_OK;
+}
+
+void hash_to_hex(const hash_t hash, char* out) {
+    for (int i = 0; i < HASH_LEN; i++) {
+        memcpy(out + 2 * i, hex_pairs + 2 * hash[i], 2);
+    }
+}
+
+bool hash_from_hex(const char* hex, size_t len, hash_t out) {
+    if (!hex || len != HASH_HEX_LEN) return false;
+    uint8_t bad = 0;
+    for (int i = 0; i < HASH_LEN; i++) {
+        uint8_t hi = hex_values[(unsigned char)hex[2 * i]];
+        uint8_t lo = hex_values[(unsigned char)hex[2 * i + 1]];
+        bad |= hi | lo;
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    // Valid digits are < 16, so any X leaves bit 4 set.
+    return (bad & 0x10) == 0;
+}
+
+// One message of a multi-buffer group: whole blocks straight from the
+// caller, then one or two padded tail blocks.
+typedef struct {
+    const uint8_t* data;
+    size_t full;                // whole blocks in data
+    size_t nblocks;             // full + tail blocks
+    uint8_t tail[2 * HASH_BLOCK];
+} lane_t;
+
+static void lane_setup(lane_t* lane, const char* data, size_t len) {
+    size_t rem = len % HASH_BLOCK;
+    lane->data = (const uint8_t*)data;
+    lane->full = len / HASH_BLOCK;
+    size_t tail_len = rem + 9 <= HASH_BLOCK ? HASH_BLOCK : 2 * HASH_BLOCK;
+    lane->nblocks = lane->full + tail_len / HASH_BLOCK;
+    memset(lane->tail, 0, tail_len);
+    if (rem) memcpy(lane->tail, data + len - rem, rem);
+    lane->tail[rem] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) lane->tail[tail_len - 1 - i] = (uint8_t)(bits >> (8 * i));
+}
+
+void hash_many(const char* const* data, const size_t* len, size_t n, hash_t* out) {
+    static const uint8_t idle[HASH_BLOCK];
+    const hash_kernels_t* kernels = active_kernels();
+    size_t i = 0;
+    if (kernels->lanes) {
+        lane_t lanes[HASH_MAX_LANES];
+        for (; i + HASH_MAX_LANES / 4 <= n; i += HASH_MAX_LANES) {
+            size_t m = n - i < HASH_MAX_LANES ? n - i : HASH_MAX_LANES;
+            uint32_t state[5][HASH_MAX_LANES];
+            static const uint32_t iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+            size_t most = 0;
+            for (size_t l = 0; l < HASH_MAX_LANES; l++) {
+                for (int k = 0; k < 5; k++) state[k][l] = iv[k];
+                if (l < m) {
+                    lane_setup(&lanes[l], data[i + l], len[i + l]);
+                    if (lanes[l].nblocks > most) most = lanes[l].nblocks;
+                } else {
+                    lanes[l].full = lanes[l].nblocks = 0;
+                }
+            }
+            // Messages of different lengths share a pass until the
+            // shorter ones run out; their lanes then idle.
+            for (size_t b = 0; b < most; b++) {
+                const uint8_t* blocks[HASH_MAX_LANES];
+                unsigned active = 0;
+                for (size_t l = 0; l < HASH_MAX_LANES; l++) {
+                    const lane_t* lane = &lanes[l];
+                    if (b < lane->full) blocks[l] = lane->data + b * HASH_BLOCK;
+                    else if (b < lane->nblocks) blocks[l] = lane->tail + (b - lane->full) * HASH_BLOCK;
+                    else blocks[l] = idle;
+                    if (b < lane->nblocks) active |= 1u << l;
+                }
+                kernels->lanes(state, blocks, active);
+            }
+            for (size_t l = 0; l < m; l++) {
+                for (int k = 0; k < 5; k++) {
+                    out[i + l][4 * k] = (uint8_t)(state[k][l] >> 24);
+                    out[i + l][4 * k + 1] = (uint8_t)(state[k][l] >> 16);
+                    out[i + l][4 * k + 2] = (uint8_t)(state[k][l] >> 8);
+                    out[i + l][4 * k + 3] = (uint8_t)state[k][l];
+                }
+            }
+        }
+    }
+    for (; i < n; i++) compute_sha1(data[i], len[i], out[i]);
+}
@@ -0,0 +1,69 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "git_for_logic.h"
+
+// Digests are kept as raw bytes everywhere inside the engine: compared,
+// copied and stored as HASH_LEN bytes. Hex only appears at the boundary,
+// in printed output and in the JSON and file names that the legacy
+// format defines in hex.
+
+#define HASH_LEN 20
+#define HASH_HEX_LEN 40
+#define HASH_BLOCK 64
+
+typedef uint8_t hash_t[HASH_LEN];
+typedef char hash_hex_t[HASH_HEX_LEN + 1];
+
+// Incremental SHA-1. Feed any number of hash_update calls between
+// hash_init and hash_final; the digest does not depend on how the input
+// was split.
+typedef struct {
+    uint32_t state[5];
+    uint64_t total;             // bytes fed so far
+    size_t used;                // bytes waiting in block
+    uint8_t block[HASH_BLOCK];
+} hash_ctx_t;
+
+void hash_init(hash_ctx_t* ctx);
+void hash_update(hash_ctx_t* ctx, const void* data, size_t len);
+void hash_final(hash_ctx_t* ctx, hash_t out);
+
+// Starts a git-style object hash: feeds the "<type> <len>\0" header, so
+// the caller only has to stream exactly len content bytes after it.
+void hash_object_init(hash_ctx_t* ctx, const char* type, size_t len);
+
+error_t compute_sha1(const char* data, size_t len, hash_t out_hash);
+
+// Hashes n independent messages, as compute_sha1 on each would. Where the
+// CPU allows, up to HASH_MAX_LANES messages are hashed side by side in
+// SIMD lanes; this pays off for many short messages of similar length.
+#define HASH_MAX_LANES 16
+void hash_many(const char* const* data, const size_t* len, size_t n, hash_t* out);
+
+// Kernels this CPU will use, single-buffer then multi-buffer:
+// "sha-ni+avx512", "sha-ni+avx2", "sha-ni", "avx512", "avx2" or "scalar".
+const char* hash_kernel_name(void);
+
+// Writes the HASH_HEX_LEN lowercase hex digits of hash, not terminated.
+void hash_to_hex(const hash_t hash, char* out);
+
+// hash_to_hex plus a terminating NUL, for printf.
+static inline const char* hash_hex(const hash_t hash, hash_hex_t out) {
+    hash_to_hex(hash, out);
+    out[HASH_HEX_LEN] = '\0';
+    return out;
+}
+
+// Parses exactly HASH_HEX_LEN hex digits (either case). Returns false on
+// any other input.
+bool hash_from_hex(const char* hex, size_t len, hash_t out);
+
+static inline bool hash_eq(const hash_t a, const hash_t b) {
+    return memcmp(a, b, HASH_LEN) == 0;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "index.h"
+#include "buffer.h"
+
+#define INDEX_MAGIC "LGIX"
+#define INDEX_VERSION 1
+#define INDEX_MAX_PATH 0xFFFF
+
+static int64_t stat_mtime_ns(const struct stat* st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+// Position of path in the sorted entries, or where it would go.
+static size_t find(const index_t* index, const char* path, bool* found) {
+    size_t lo = 0, hi = index->nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(index->entries[mid].path, path);
+        if (c == 0) {
+            *found = true;
+            return mid;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = false;
+    return lo;
+}
+
+static error_t insert(index_t* index, size_t at, const char* path, size_t len) {
+    if (index->nentries == index->cap) {
+        size_t cap = index->cap ? index->cap * 2 : 16;
+        index_entry_t* entries = (index_entry_t*)realloc(index->entries, cap * sizeof(index_entry_t));
+        if (!entries) return ERR_MALLOC_FAILED;
+        index->entries = entries;
+        index->cap = cap;
+    }
+    char* copy = (char*)malloc(len + 1);
+    if (!copy) return ERR_MALLOC_FAILED;
+    memcpy(copy, path, len);
+    copy[len] = '\0';
+    memmove(&index->entries[at + 1], &index->entries[at], (index->nentries - at) * sizeof(index_entry_t));
+    memset(&index->entries[at], 0, sizeof(index_entry_t));
+    index->entries[at].path = copy;
+    index->nentries++;
+    return ERR_OK;
+}
+
+static void clear(index_t* index) {
+    for (size_t i = 0; i < index->nentries; i++) free(index->entries[i].path);
+    index->nentries = 0;
+}
+
+// Parses an index image. Entries must arrive sorted and unique.
+static bool parse(index_t* index, const uint8_t* p, size_t len) {
+    if (len < 12 + HASH_LEN || memcmp(p, INDEX_MAGIC, 4) != 0) return false;
+    hash_t sum;
+    compute_sha1((const char*)p, len - HASH_LEN, sum);
+    if (!hash_eq(sum, p + len - HASH_LEN)) return false;
+    if (get_u32(p + 4) != INDEX_VERSION) return false;
+    uint32_t count = get_u32(p + 8);
+
+    const uint8_t* end = p + len - HASH_LEN;
+    p += 12;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((size_t)(end - p) < 32 + HASH_LEN + 2) return false;
+        size_t path_len = (size_t)p[32 + HASH_LEN] | (size_t)p[33 + HASH_LEN] << 8;
+        const char* path = (const char*)p + 34 + HASH_LEN;
+        if ((size_t)(end - p) < 34 + HASH_LEN + path_len || memchr(path, '\0', path_len)) return false;
+        if (index->nentries) {
+            const char* prev = index->entries[index->nentries - 1].path;
+            size_t n = strlen(prev) < path_len ? strlen(prev) : path_len;
+            int c = memcmp(prev, path, n);
+            if (c > 0 || (c == 0 && strlen(prev) >= path_len)) return false;
+        }
+        if (insert(index, index->nentries, path, path_len) != ERR_OK) return false;
+        index_entry_t* e = &index->entries[index->nentries - 1];
+        e->dev = get_u64(p);
+        e->ino = get_u64(p + 8);
+        e->mtime_ns = (int64_t)get_u64(p + 16);
+        e->size = get_u64(p + 24);
+        memcpy(e->hash, p + 32, HASH_LEN);
+        p += 34 + HASH_LEN + path_len;
+    }
+    return p == end;
+}
+
+error_t index_load(index_t* index, const char* logicgit_dir) {
+    if (!index || !logicgit_dir) return ERR_NULL_PTR;
+    memset(index, 0, sizeof(*index));
+    int written = snprintf(index->file, sizeof(index->file), "%s/index", logicgit_dir);
+    if (written < 0 || (size_t)written >= sizeof(index->file)) return ERR_BUFFER_OVERFLOW;
+
+    FILE* f = fopen(index->file, "rb");
+    if (!f) return ERR_OK;
+    struct stat st;
+    uint8_t* image = NULL;
+    bool ok = fstat(fileno(f), &st) == 0 && st.st_size > 0;
+    if (ok) {
+        image = (uint8_t*)malloc((size_t)st.st_size);
+        ok = image && fread(image, 1, (size_t)st.st_size, f) == (size_t)st.st_size;
+    }
+    fclose(f);
+    if (ok) {
+        index->mtime_ns = stat_mtime_ns(&st);
+        ok = parse(index, image, (size_t)st.st_size);
+    }
+    free(image);
+    if (!ok) {
+        // Start over; the next save replaces the bad file.
+        clear(index);
+        index->dirty = true;
+    }
+    return ERR_OK;
+}
+
+void index_free(index_t* index) {
+    if (!index) return;
+    clear(index);
+    free(index->entries);
+    index->entries = NULL;
+    index->cap = 0;
+}
+
+bool index_lookup(const index_t* index, const char* path, const struct stat* st, hash_t out) {
+    if (!index || !path || !st) return false;
+    bool found;
+    size_t at = find(index, path, &found);
+    if (!found) return false;
+    const index_entry_t* e = &index->entries[at];
+    int64_t mtime = stat_mtime_ns(st);
+    if (e->dev != (uint64_t)st->st_dev || e->ino != (uint64_t)st->st_ino ||
+        e->mtime_ns != mtime || e->size != (uint64_t)st->st_size) {
+        return false;
+    }
+    if (mtime >= index->mtime_ns) return false;     // racily clean
+    memcpy(out, e->hash, HASH_LEN);
+    return true;
+}
+
+error_t index_update(index_t* index, const char* path, const struct stat* st, const hash_t hash) {
+    if (!index || !path || !st || !hash) return ERR_NULL_PTR;
+    size_t len = strlen(path);
+    if (len > INDEX_MAX_PATH) return ERR_BUFFER_OVERFLOW;
+    bool found;
+    size_t at = find(index, path, &found);
+    if (!found) {
+        error_t err = insert(index, at, path, len);
+        if (err != ERR_OK) return err;
+    }
+    index_entry_t* e = &index->entries[at];
+    e->dev = (uint64_t)st->st_dev;
+    e->ino = (uint64_t)st->st_ino;
+    e->mtime_ns = stat_mtime_ns(st);
+    e->size = (uint64_t)st->st_size;
+    memcpy(e->hash, hash, HASH_LEN);
+    index->dirty = true;
+    return ERR_OK;
+}
+
+// A save takes milliseconds, so a lock this old belongs to a dead run.
+static bool lock_is_stale(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && time(NULL) - st.st_mtime >= INDEX_LOCK_STALE_SECONDS;
+}
+
+error_t index_save(index_t* index) {
+    if (!index) return ERR_NULL_PTR;
+    if (!index->dirty) return ERR_OK;
+
+    buffer_t image;
+    buffer_init(&image);
+    uint8_t head[12];
+    memcpy(head, INDEX_MAGIC, 4);
+    put_u32(head + 4, INDEX_VERSION);
+    put_u32(head + 8, (uint32_t)index->nentries);
+    error_t err = buffer_append(&image, head, sizeof(head));
+    for (size_t i = 0; i < index->nentries && err == ERR_OK; i++) {
+        const index_entry_t* e = &index->entries[i];
+        size_t path_len = strlen(e->path);
+        uint8_t fixed[34 + HASH_LEN];
+        put_u64(fixed, e->dev);
+        put_u64(fixed + 8, e->ino);
+        put_u64(fixed + 16, (uint64_t)e->mtime_ns);
+        put_u64(fixed + 24, e->size);
+        memcpy(fixed + 32, e->hash, HASH_LEN);
+        fixed[32 + HASH_LEN] = (uint8_t)path_len;
+        fixed[33 + HASH_LEN] = (uint8_t)(path_len >> 8);
+        err = buffer_append(&image, fixed, sizeof(fixed));
+        if (err == ERR_OK) err = buffer_append(&image, e->path, path_len);
+    }
+    if (err == ERR_OK) {
+        hash_t sum;
+        compute_sha1(image.data, image.len, sum);
+        err = buffer_append(&image, sum, HASH_LEN);
+    }
+
+    char tmp[ODB_PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.lock", index->file);
+    index->locked = false;
+    if (err == ERR_OK) {
+        // "x": a lock left by a concurrent run means it saves instead.
+        FILE* f = fopen(tmp, "wbx");
+        if (!f && errno == EEXIST && lock_is_stale(tmp)) {
+            remove(tmp);
+            f = fopen(tmp, "wbx");
+        }
+        if (!f) {
+            index->locked = errno == EEXIST;
+            err = ERR_IO;
+        } else {
+            size_t put = fwrite(image.data, 1, image.len, f);
+            if (fclose(f) != 0 || put != image.len || rename(tmp, index->file) != 0) {
+                remove(tmp);
+                err = ERR_IO;
+            }
+        }
+    }
+    buffer_free(&image);
+    if (err == ERR_OK) index->dirty = false;
+    return err;
+}
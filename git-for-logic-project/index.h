@@ -0,0 +1,59 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "odb.h"
+
+// Stat cache in .logicgit/index, after git's index: for every rules or
+// data file hashed before, the content digest together with the file's
+// (dev, inode, mtime_ns, size). A file whose stat data still matches is
+// not hashed again.
+//
+// Like git, an entry is only trusted if the file's mtime is older than
+// the index itself; a file rewritten within the same timestamp tick as
+// the index was saved ("racily clean") is always re-hashed.
+//
+// On disk, little-endian: "LGIX", u32 version, u32 entry count, then per
+// entry u64 dev, ino, mtime_ns and size, the digest, a u16 path length and
+// the path, sorted by path; a SHA-1 of everything before it as trailer.
+// A missing, short or corrupt index reads as empty.
+
+#define INDEX_LOCK_STALE_SECONDS 60
+
+typedef struct {
+    char* path;                 // relative to the repository
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_ns;
+    uint64_t size;
+    hash_t hash;
+} index_entry_t;
+
+typedef struct {
+    char file[ODB_PATH_MAX];
+    int64_t mtime_ns;           // of the index file when loaded
+    index_entry_t* entries;     // sorted by path
+    size_t nentries;
+    size_t cap;
+    bool dirty;
+    bool locked;                // the last save found a live index.lock
+} index_t;
+
+error_t index_load(index_t* index, const char* logicgit_dir);
+void index_free(index_t* index);
+
+// Copies the cached digest of path to out if st still matches its entry.
+bool index_lookup(const index_t* index, const char* path, const struct stat* st, hash_t out);
+
+error_t index_update(index_t* index, const char* path, const struct stat* st, const hash_t hash);
+
+// Writes the index if anything changed, through <index>.lock and a rename
+// so readers never see a partial index. A lock not touched for
+// INDEX_LOCK_STALE_SECONDS was left by a run that died while saving and is
+// removed; a newer one fails the save with ERR_IO and sets index->locked.
+error_t index_save(index_t* index);
+
+#endif
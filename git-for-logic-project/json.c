@@ -0,0 +1,671 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "json.h"
+#include "arena.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_HAVE_X86 1
+#endif
+
+#define JSON_BLOCK 64
+#define JSON_WINDOW (32 * 1024)
+#define JSON_MAX_DEPTH 64
+#define JSON_NUM_MAX 127
+#define JSON_SCRATCH_BLOCK 4096
+#define JSON_FAST_INT_DIGITS 15
+
+// Per-block classification produced by a stage-1 kernel. Bit i describes
+// byte i of the block.
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;        // { } [ ] : ,
+    uint64_t ws;        // space, tab, CR, LF
+} block_masks_t;
+
+typedef void (*classify_fn)(const uint8_t* block, block_masks_t* out);
+
+typedef struct {
+    const char* buf;
+    size_t len;
+
+    // Stage 1
+    classify_fn classify;
+    size_t next_block;          // offset of the next block to index
+    uint64_t prev_escaped;      // 1 if the next block starts escaped
+    uint64_t prev_in_string;    // all ones if the next block starts inside a string
+    uint64_t prev_scalar;       // 1 if the previous block ended inside a scalar
+    size_t window_base;
+    uint32_t index[JSON_WINDOW];
+    size_t nindex;
+    size_t cur;
+    error_t err;
+
+    // Stage 2
+    field_t* fields;
+    size_t nfields;
+    size_t fields_cap;
+    arena_t scratch;            // unescaped strings, joined key paths
+    record_fn fn;
+    void* ctx;
+} json_parser_t;
+
+// ---------------------------------------------------------------------------
+// Stage 1 kernels
+// ---------------------------------------------------------------------------
+
+static void classify_scalar(const uint8_t* in, block_masks_t* m) {
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < JSON_BLOCK; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (in[i]) {
+            case '"': m->quote |= bit; break;
+            case '\\': m->backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': m->op |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': m->ws |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#ifdef JSON_HAVE_X86
+#define CMPESTR_ANY_MASK (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK)
+
+__attribute__((target("sse4.2")))
+static void classify_sse42(const uint8_t* in, block_masks_t* m) {
+    const __m128i ops = _mm_setr_epi8('{', '}', '[', ']', ':', ',', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i ws = _mm_setr_epi8(' ', '\t', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(const void*)(in + 16 * i));
+        int shift = 16 * i;
+        m->op |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(_mm_cmpestrm(ops, 6, v, 16, CMPESTR_ANY_MASK)) << shift;
+        m->ws |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(_mm_cmpestrm(ws, 4, v, 16, CMPESTR_ANY_MASK)) << shift;
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash)) << shift;
+    }
+}
+
+__attribute__((target("avx2")))
+static uint32_t any_of4(__m256i v, char a, char b, char c, char d) {
+    __m256i r = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+    r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+    r = _mm256_or_si256(r, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(d)));
+    return (uint32_t)_mm256_movemask_epi8(r);
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const uint8_t* in, block_masks_t* m) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 2; i++) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(const void*)(in + 32 * i));
+        int shift = 32 * i;
+        uint32_t op = any_of4(v, '{', '}', '[', ']') | any_of4(v, ':', ',', ':', ',');
+        m->op |= (uint64_t)op << shift;
+        m->ws |= (uint64_t)any_of4(v, ' ', '\t', '\n', '\r') << shift;
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash)) << shift;
+    }
+}
+#endif
+
+static classify_fn select_kernel(const char** name) {
+#ifdef JSON_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        if (name) *name = "avx2";
+        return classify_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        if (name) *name = "sse4.2";
+        return classify_sse42;
+    }
+#endif
+    if (name) *name = "scalar";
+    return classify_scalar;
+}
+
+const char* json_kernel_name(void) {
+    const char* name = NULL;
+    select_kernel(&name);
+    return name;
+}
+
+// Marks the characters that follow an odd-length run of backslashes.
+static uint64_t find_escaped(uint64_t* prev_escaped, uint64_t backslash) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    backslash &= ~*prev_escaped;
+    uint64_t follows_escape = (backslash << 1) | *prev_escaped;
+    uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+    uint64_t even_series = odd_starts + backslash;
+    *prev_escaped = even_series < odd_starts;
+    uint64_t invert_mask = even_series << 1;
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Bit i of the result is the XOR of bits 0..i of x.
+static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static void index_block(json_parser_t* p, const uint8_t* block, uint32_t rel) {
+    block_masks_t m;
+    p->classify(block, &m);
+
+    uint64_t escaped = find_escaped(&p->prev_escaped, m.backslash);
+    uint64_t quote = m.quote & ~escaped;
+    uint64_t in_string = prefix_xor(quote) ^ p->prev_in_string;
+    p->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+    uint64_t op = m.op & ~in_string;
+    uint64_t scalar = ~(m.op | m.ws | m.quote) & ~in_string;
+    uint64_t scalar_start = scalar & ~((scalar << 1) | p->prev_scalar);
+    p->prev_scalar = scalar >> 63;
+
+    uint64_t structurals = op | scalar_start | (quote & in_string);
+    while (structurals) {
+        p->index[p->nindex++] = rel + (uint32_t)__builtin_ctzll(structurals);
+        structurals &= structurals - 1;
+    }
+}
+
+// Indexes the next window. Returns false at end of input.
+static bool refill(json_parser_t* p) {
+    p->nindex = 0;
+    p->cur = 0;
+    while (p->nindex == 0) {
+        if (p->next_block >= p->len) {
+            if (p->prev_in_string) p->err = ERR_INVALID_JSON;
+            return false;
+        }
+        p->window_base = p->next_block;
+        size_t end = p->len - p->window_base > JSON_WINDOW ? p->window_base + JSON_WINDOW : p->len;
+        size_t pos = p->window_base;
+        for (; pos + JSON_BLOCK <= end; pos += JSON_BLOCK) {
+            index_block(p, (const uint8_t*)p->buf + pos, (uint32_t)(pos - p->window_base));
+        }
+        if (pos < end) {
+            // Tail shorter than a block: pad with whitespace.
+            uint8_t tail[JSON_BLOCK];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p->buf + pos, end - pos);
+            index_block(p, tail, (uint32_t)(pos - p->window_base));
+            pos = end;
+        }
+        p->next_block = pos;
+    }
+    return true;
+}
+
+static inline bool next_pos(json_parser_t* p, size_t* out) {
+    if (p->cur == p->nindex && !refill(p)) return false;
+    *out = p->window_base + p->index[p->cur++];
+    return true;
+}
+
+// Position of the next structural without consuming it; len at the end.
+static inline size_t peek_pos(json_parser_t* p) {
+    if (p->cur == p->nindex && !refill(p)) return p->len;
+    return p->window_base + p->index[p->cur];
+}
+
+// ---------------------------------------------------------------------------
+// Stage 2
+// ---------------------------------------------------------------------------
+
+static bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(const char* s, size_t avail, uint32_t* out) {
+    if (avail < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hex_value(s[i]);
+        if (h < 0) return false;
+        v = (v << 4) | (uint32_t)h;
+    }
+    *out = v;
+    return true;
+}
+
+static size_t encode_utf8(uint32_t cp, char* out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Decodes the body of a string literal. Slices without backslashes are
+// returned as-is; the rest are unescaped into the record scratch arena.
+static error_t decode_string(json_parser_t* p, str_t raw, str_t* out) {
+    if (!memchr(raw.ptr, '\\', raw.len)) {
+        *out = raw;
+        return ERR_OK;
+    }
+    // Unescaping never grows the text (\uXXXX is 6 bytes for at most 4).
+    char* buf = (char*)arena_alloc(&p->scratch, raw.len + 1);
+    if (!buf) return ERR_MALLOC_FAILED;
+    size_t n = 0;
+    for (size_t i = 0; i < raw.len; i++) {
+        char c = raw.ptr[i];
+        if (c != '\\') {
+            buf[n++] = c;
+            continue;
+        }
+        if (++i >= raw.len) return ERR_INVALID_JSON;
+        switch (raw.ptr[i]) {
+            case '"': buf[n++] = '"'; break;
+            case '\\': buf[n++] = '\\'; break;
+            case '/': buf[n++] = '/'; break;
+            case 'b': buf[n++] = '\b'; break;
+            case 'f': buf[n++] = '\f'; break;
+            case 'n': buf[n++] = '\n'; break;
+            case 'r': buf[n++] = '\r'; break;
+            case 't': buf[n++] = '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!read_hex4(raw.ptr + i + 1, raw.len - i - 1, &cp)) return ERR_INVALID_JSON;
+                i += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t lo;
+                    if (i + 2 >= raw.len || raw.ptr[i + 1] != '\\' || raw.ptr[i + 2] != 'u' ||
+                        !read_hex4(raw.ptr + i + 3, raw.len - i - 3, &lo) || lo < 0xDC00 || lo > 0xDFFF) {
+                        return ERR_INVALID_JSON;
+                    }
+                    i += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    return ERR_INVALID_JSON;
+                }
+                n += encode_utf8(cp, buf + n);
+                break;
+            }
+            default:
+                return ERR_INVALID_JSON;
+        }
+    }
+    buf[n] = '\0';
+    *out = (str_t){ buf, n };
+    return ERR_OK;
+}
+
+// The closing quote of a string that opens at `open` is the last
+// non-whitespace byte before the next structural character.
+static error_t string_at(json_parser_t* p, size_t open, str_t* raw) {
+    size_t end = peek_pos(p);
+    while (end > open + 1 && is_ws(p->buf[end - 1])) end--;
+    if (end <= open + 1 || p->buf[end - 1] != '"') return ERR_INVALID_JSON;
+    *raw = (str_t){ p->buf + open + 1, end - open - 2 };
+    return ERR_OK;
+}
+
+static error_t parse_number(const char* s, size_t n, value_t* out) {
+    size_t i = 0;
+    bool neg = false;
+    if (i < n && s[i] == '-') {
+        neg = true;
+        i++;
+    }
+    size_t int_start = i;
+    if (i >= n || s[i] < '0' || s[i] > '9') return ERR_INVALID_JSON;
+    if (s[i] == '0' && i + 1 < n && s[i + 1] >= '0' && s[i + 1] <= '9') return ERR_INVALID_JSON;
+
+    uint64_t mantissa = 0;
+    while (i < n && s[i] >= '0' && s[i] <= '9') {
+        mantissa = mantissa * 10 + (uint64_t)(s[i] - '0');
+        i++;
+    }
+    size_t int_digits = i - int_start;
+
+    if (i == n && int_digits <= JSON_FAST_INT_DIGITS) {
+        // Exact in a double: no strtod needed.
+        double v = (double)mantissa;
+        *out = value_num(neg ? -v : v);
+        return ERR_OK;
+    }
+
+    if (i < n && s[i] == '.') {
+        i++;
+        size_t frac_start = i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+        if (i == frac_start) return ERR_INVALID_JSON;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) i++;
+        size_t exp_start = i;
+        while (i < n && s[i] >= '0' && s[i] <= '9') i++;
+        if (i == exp_start) return ERR_INVALID_JSON;
+    }
+    if (i != n || n > JSON_NUM_MAX) return ERR_INVALID_JSON;
+
+    char tmp[JSON_NUM_MAX + 1];
+    memcpy(tmp, s, n);
+    tmp[n] = '\0';
+    *out = value_num(strtod(tmp, NULL));
+    return ERR_OK;
+}
+
+static error_t parse_scalar(json_parser_t* p, size_t pos, value_t* out) {
+    size_t end = peek_pos(p);
+    while (end > pos && is_ws(p->buf[end - 1])) end--;
+    const char* s = p->buf + pos;
+    size_t n = end - pos;
+
+    if (n == 4 && memcmp(s, "true", 4) == 0) {
+        *out = value_bool(true);
+        return ERR_OK;
+    }
+    if (n == 5 && memcmp(s, "false", 5) == 0) {
+        *out = value_bool(false);
+        return ERR_OK;
+    }
+    if (n == 4 && memcmp(s, "null", 4) == 0) {
+        *out = value_null();
+        return ERR_OK;
+    }
+    return parse_number(s, n, out);
+}
+
+static error_t push_field(json_parser_t* p, str_t name, value_t value) {
+    if (p->nfields == p->fields_cap) {
+        size_t cap = p->fields_cap ? p->fields_cap * 2 : 32;
+        field_t* grown = (field_t*)realloc(p->fields, cap * sizeof(field_t));
+        if (!grown) return ERR_MALLOC_FAILED;
+        p->fields = grown;
+        p->fields_cap = cap;
+    }
+    p->fields[p->nfields].name = name;
+    p->fields[p->nfields].value = value;
+    p->nfields++;
+    return ERR_OK;
+}
+
+static error_t join_key(json_parser_t* p, str_t prefix, str_t key, str_t* out) {
+    if (!prefix.len) {
+        *out = key;
+        return ERR_OK;
+    }
+    char* joined = (char*)arena_alloc(&p->scratch, prefix.len + 1 + key.len);
+    if (!joined) return ERR_MALLOC_FAILED;
+    memcpy(joined, prefix.ptr, prefix.len);
+    joined[prefix.len] = '.';
+    memcpy(joined + prefix.len + 1, key.ptr, key.len);
+    *out = (str_t){ joined, prefix.len + 1 + key.len };
+    return ERR_OK;
+}
+
+#define NEXT_OR_FAIL(p, pos) \
+    do { if (!next_pos((p), &(pos))) return (p)->err != ERR_OK ? (p)->err : ERR_INVALID_JSON; } while (0)
+
+static error_t check_value(json_parser_t* p, size_t pos, int depth);
+
+// Checks the elements or members of the array or object that opens at
+// pos with the same parsers as record values, and sets *close to its
+// closing bracket.
+static error_t check_container(json_parser_t* p, size_t pos, int depth, size_t* close) {
+    if (depth > JSON_MAX_DEPTH) return ERR_INVALID_JSON;
+    char end = p->buf[pos] == '{' ? '}' : ']';
+    NEXT_OR_FAIL(p, pos);
+    for (bool first = true;; first = false) {
+        if (p->buf[pos] == end && first) break;
+        if (end == '}') {
+            str_t raw, key;
+            if (p->buf[pos] != '"') return ERR_INVALID_JSON;
+            error_t err = string_at(p, pos, &raw);
+            if (err == ERR_OK) err = decode_string(p, raw, &key);
+            if (err != ERR_OK) return err;
+            NEXT_OR_FAIL(p, pos);
+            if (p->buf[pos] != ':') return ERR_INVALID_JSON;
+            NEXT_OR_FAIL(p, pos);
+        }
+        error_t err = check_value(p, pos, depth);
+        if (err != ERR_OK) return err;
+        NEXT_OR_FAIL(p, pos);
+        if (p->buf[pos] == end) break;
+        if (p->buf[pos] != ',') return ERR_INVALID_JSON;
+        NEXT_OR_FAIL(p, pos);
+    }
+    *close = pos;
+    return ERR_OK;
+}
+
+static error_t check_value(json_parser_t* p, size_t pos, int depth) {
+    value_t value;
+    str_t raw;
+    switch (p->buf[pos]) {
+        case '{':
+        case '[':
+            return check_container(p, pos, depth + 1, &pos);
+        case '"': {
+            error_t err = string_at(p, pos, &raw);
+            return err == ERR_OK ? decode_string(p, raw, &value.as.str) : err;
+        }
+        case '}':
+        case ']':
+        case ',':
+        case ':':
+            return ERR_INVALID_JSON;
+        default:
+            return parse_scalar(p, pos, &value);
+    }
+}
+
+// A nested array is kept verbatim, once every element checks out:
+// [1,,2] or [tru] fail the record like the same mistake in an object.
+static error_t parse_raw_array(json_parser_t* p, size_t open, int depth, value_t* out) {
+    size_t close;
+    error_t err = check_container(p, open, depth, &close);
+    if (err != ERR_OK) return err;
+    out->type = VAL_RAW;
+    out->as.str = (str_t){ p->buf + open, close - open + 1 };
+    return ERR_OK;
+}
+
+// Parses the members of an object whose '{' has been consumed, appending
+// them to the record with `prefix` prepended to every key.
+static error_t parse_object(json_parser_t* p, size_t open, str_t prefix, int depth) {
+    if (depth > JSON_MAX_DEPTH) return ERR_INVALID_JSON;
+    size_t pos;
+    NEXT_OR_FAIL(p, pos);
+    if (p->buf[pos] == '}') {
+        // An empty nested object has no leaves; keep it as a value.
+        if (!prefix.len) return ERR_OK;
+        value_t empty = { .type = VAL_RAW, .as.str = { p->buf + open, pos - open + 1 } };
+        return push_field(p, prefix, empty);
+    }
+
+    for (;;) {
+        if (p->buf[pos] != '"') return ERR_INVALID_JSON;
+        str_t raw, key, name;
+        error_t err = string_at(p, pos, &raw);
+        if (err != ERR_OK) return err;
+        err = decode_string(p, raw, &key);
+        if (err != ERR_OK) return err;
+        err = join_key(p, prefix, key, &name);
+        if (err != ERR_OK) return err;
+
+        NEXT_OR_FAIL(p, pos);
+        if (p->buf[pos] != ':') return ERR_INVALID_JSON;
+        NEXT_OR_FAIL(p, pos);
+
+        value_t value;
+        switch (p->buf[pos]) {
+            case '{':
+                err = parse_object(p, pos, name, depth + 1);
+                if (err != ERR_OK) return err;
+                goto member_done;
+            case '[':
+                err = parse_raw_array(p, pos, depth + 1, &value);
+                break;
+            case '"':
+                err = string_at(p, pos, &raw);
+                if (err == ERR_OK) err = decode_string(p, raw, &value.as.str);
+                value.type = VAL_STR;
+                break;
+            case '}':
+            case ']':
+            case ',':
+            case ':':
+                return ERR_INVALID_JSON;
+            default:
+                err = parse_scalar(p, pos, &value);
+                break;
+        }
+        if (err != ERR_OK) return err;
+        err = push_field(p, name, value);
+        if (err != ERR_OK) return err;
+
+    member_done:
+        NEXT_OR_FAIL(p, pos);
+        if (p->buf[pos] == '}') return ERR_OK;
+        if (p->buf[pos] != ',') return ERR_INVALID_JSON;
+        NEXT_OR_FAIL(p, pos);
+    }
+}
+
+static error_t parse_record(json_parser_t* p, size_t open) {
+    p->nfields = 0;
+    error_t err = parse_object(p, open, (str_t){ NULL, 0 }, 1);
+    if (err == ERR_OK) err = p->fn(p->ctx, p->fields, p->nfields);
+    // Scratch allocations only happen for escaped or nested keys.
+    arena_reset(&p->scratch);
+    return err;
+}
+
+static error_t parse_document(json_parser_t* p) {
+    size_t pos;
+    bool any = false;
+    while (next_pos(p, &pos)) {
+        any = true;
+        char c = p->buf[pos];
+        if (c == '{') {
+            error_t err = parse_record(p, pos);
+            if (err != ERR_OK) return err;
+            continue;
+        }
+        if (c != '[') return ERR_INVALID_JSON;
+
+        NEXT_OR_FAIL(p, pos);
+        if (p->buf[pos] == ']') continue;
+        for (;;) {
+            if (p->buf[pos] != '{') return ERR_INVALID_JSON;
+            error_t err = parse_record(p, pos);
+            if (err != ERR_OK) return err;
+            NEXT_OR_FAIL(p, pos);
+            if (p->buf[pos] == ']') break;
+            if (p->buf[pos] != ',') return ERR_INVALID_JSON;
+            NEXT_OR_FAIL(p, pos);
+        }
+    }
+    if (p->err != ERR_OK) return p->err;
+    return any ? ERR_OK : ERR_INVALID_JSON;
+}
+
+error_t json_for_each_record(const char* buf, size_t len, record_fn fn, void* ctx) {
+    if (!buf || !fn) return ERR_NULL_PTR;
+
+    json_parser_t* p = (json_parser_t*)calloc(1, sizeof(json_parser_t));
+    if (!p) return ERR_MALLOC_FAILED;
+    p->buf = buf;
+    p->len = len;
+    p->classify = select_kernel(NULL);
+    p->fn = fn;
+    p->ctx = ctx;
+    arena_init(&p->scratch, JSON_SCRATCH_BLOCK);
+
+    error_t err = parse_document(p);
+
+    arena_free(&p->scratch);
+    free(p->fields);
+    free(p);
+    return err;
+}
+
+error_t json_write_string(buffer_t* out, str_t s) {
+    static const char hex[] = "0123456789abcdef";
+    error_t err = buffer_append_char(out, '"');
+    if (err != ERR_OK) return err;
+    size_t run = 0;
+    for (size_t i = 0; i < s.len; i++) {
+        unsigned char c = (unsigned char)s.ptr[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        err = buffer_append(out, s.ptr + run, i - run);
+        if (err != ERR_OK) return err;
+        char esc[6] = { '\\', (char)c, 0, 0, 0, 0 };
+        size_t n = 2;
+        switch (c) {
+            case '"': case '\\': break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 0xF];
+                n = 6;
+                break;
+        }
+        err = buffer_append(out, esc, n);
+        if (err != ERR_OK) return err;
+        run = i + 1;
+    }
+    err = buffer_append(out, s.ptr + run, s.len - run);
+    if (err != ERR_OK) return err;
+    return buffer_append_char(out, '"');
+}
+
+error_t json_write_hash(buffer_t* out, const hash_t hash) {
+    error_t err = buffer_reserve(out, HASH_HEX_LEN + 2);
+    if (err != ERR_OK) return err;
+    char* p = out->data + out->len;
+    p[0] = '"';
+    hash_to_hex(hash, p + 1);
+    p[HASH_HEX_LEN + 1] = '"';
+    p[HASH_HEX_LEN + 2] = '\0';
+    out->len += HASH_HEX_LEN + 2;
+    return ERR_OK;
+}
@@ -0,0 +1,39 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "git_for_logic.h"
+#include "value.h"
+#include "buffer.h"
+#include "hash.h"
+
+// Two-stage JSON reader for data files.
+//
+// Stage 1 classifies 64-byte blocks with SIMD (AVX2, SSE4.2 or scalar,
+// picked at runtime) into quote / backslash / structural / whitespace
+// bitmasks, resolves escapes and string spans with carry-propagated bit
+// tricks, and writes the offsets of structural characters to a small
+// index. It runs one window at a time so the index stays cache-sized.
+//
+// Stage 2 walks that index and emits one flat record per top-level object
+// (or per element of a top-level array) straight to a callback: keys and
+// values are slices of the input, nested objects are flattened to dotted
+// keys, arrays are passed through verbatim as VAL_RAW. No DOM is built.
+// Several top-level values in one file (JSON Lines) are accepted.
+
+// Called once per record. Field slices are valid only during the call.
+typedef error_t (*record_fn)(void* ctx, const field_t* fields, size_t nfields);
+
+// Returns ERR_INVALID_JSON on malformed input, or whatever the callback
+// returned if it stopped the walk.
+error_t json_for_each_record(const char* buf, size_t len, record_fn fn, void* ctx);
+
+// Appends s as a quoted JSON string literal.
+error_t json_write_string(buffer_t* out, str_t s);
+
+// Appends a digest as a quoted hex string, the form legacy JSON uses.
+error_t json_write_hash(buffer_t* out, const hash_t hash);
+
+// Name of the stage-1 kernel this CPU will use ("avx2", "sse4.2", "scalar").
+const char* json_kernel_name(void);
+
+#endif
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "odb.h"
+#include "pack.h"
+#include "bloom.h"
+#include "cache.h"
+
+static error_t open_packs(odb_t* odb) {
+    char path[ODB_PATH_MAX];
+    int written = snprintf(path, sizeof(path), "%s/%s", odb->dir, PACK_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(path)) return ERR_BUFFER_OVERFLOW;
+    DIR* dir = opendir(path);
+    if (!dir) return ERR_OK;
+
+    error_t err = ERR_OK;
+    size_t cap = 0;
+    struct dirent* entry;
+    while (err == ERR_OK && (entry = readdir(dir)) != NULL) {
+        size_t n = strlen(entry->d_name);
+        if (n < 4 || strncmp(entry->d_name, "pack-", 5) != 0 || strcmp(entry->d_name + n - 4, ".idx") != 0) continue;
+        written = snprintf(path, sizeof(path), "%s/%s/%s", odb->dir, PACK_SUBDIR, entry->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path)) continue;
+        pack_t* pack = NULL;
+        if (pack_open(&pack, path) != ERR_OK) continue;
+        if (odb->npacks == cap) {
+            cap = cap ? cap * 2 : 4;
+            pack_t** packs = (pack_t**)realloc(odb->packs, cap * sizeof(pack_t*));
+            if (!packs) {
+                pack_close(pack);
+                err = ERR_MALLOC_FAILED;
+                break;
+            }
+            odb->packs = packs;
+        }
+        odb->packs[odb->npacks++] = pack;
+    }
+    closedir(dir);
+    return err;
+}
+
+static bool is_hex(const char* s, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        char c = s[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+error_t odb_for_each_loose(const odb_t* odb, odb_object_fn fn, void* ctx) {
+    if (!odb || !fn) return ERR_NULL_PTR;
+    DIR* top = opendir(odb->dir);
+    if (!top) return ERR_IO;
+    error_t err = ERR_OK;
+    struct dirent* sub;
+    while (err == ERR_OK && (sub = readdir(top)) != NULL) {
+        if (strlen(sub->d_name) != 2 || !is_hex(sub->d_name, 2)) continue;
+        char path[ODB_PATH_MAX];
+        int written = snprintf(path, sizeof(path), "%s/%s", odb->dir, sub->d_name);
+        if (written < 0 || (size_t)written >= sizeof(path)) continue;
+        DIR* dir = opendir(path);
+        if (!dir) continue;
+        struct dirent* entry;
+        while (err == ERR_OK && (entry = readdir(dir)) != NULL) {
+            if (strlen(entry->d_name) != HASH_HEX_LEN - 2 || !is_hex(entry->d_name, HASH_HEX_LEN - 2)) continue;
+            char hex[HASH_HEX_LEN];
+            memcpy(hex, sub->d_name, 2);
+            memcpy(hex + 2, entry->d_name, HASH_HEX_LEN - 2);
+            hash_t id;
+            if (hash_from_hex(hex, HASH_HEX_LEN, id)) err = fn(ctx, id);
+        }
+        closedir(dir);
+    }
+    closedir(top);
+    return err;
+}
+
+typedef struct {
+    hash_t* ids;
+    size_t count;
+    size_t cap;
+} id_list_t;
+
+static error_t collect_id(void* ctx, const hash_t id) {
+    id_list_t* list = (id_list_t*)ctx;
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        hash_t* ids = (hash_t*)realloc(list->ids, cap * sizeof(hash_t));
+        if (!ids) return ERR_MALLOC_FAILED;
+        list->ids = ids;
+        list->cap = cap;
+    }
+    memcpy(list->ids[list->count++], id, sizeof(hash_t));
+    return ERR_OK;
+}
+
+// A new filter of every packed and loose id, sized for twice as many.
+static error_t build_filter(odb_t* odb, const char* dir, const char* path) {
+    id_list_t loose = { NULL, 0, 0 };
+    error_t err = odb_for_each_loose(odb, collect_id, &loose);
+    size_t total = loose.count;
+    for (size_t p = 0; p < odb->npacks; p++) total += pack_count(odb->packs[p]);
+    bloom_t* bloom = NULL;
+    if (err == ERR_OK) {
+        err = bloom_create(&bloom, dir, 2 * total > BLOOM_MIN_OBJECTS ? 2 * total : BLOOM_MIN_OBJECTS);
+    }
+    if (err == ERR_OK) {
+        for (size_t i = 0; i < loose.count; i++) bloom_add(bloom, loose.ids[i]);
+        for (size_t p = 0; p < odb->npacks; p++) {
+            for (size_t i = 0; i < pack_count(odb->packs[p]); i++) bloom_add(bloom, pack_id_at(odb->packs[p], i));
+        }
+        err = bloom_publish(bloom, path);
+    }
+    free(loose.ids);
+    if (err != ERR_OK) {
+        bloom_close(bloom);
+        return err;
+    }
+    odb->bloom = bloom;
+    return ERR_OK;
+}
+
+// The filter only saves work, so a repository where it cannot be opened
+// or built goes without.
+static void open_filter(odb_t* odb) {
+    char dir[ODB_PATH_MAX], path[ODB_PATH_MAX];
+    int written = snprintf(dir, sizeof(dir), "%s/%s", odb->dir, PACK_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(dir)) return;
+    written = snprintf(path, sizeof(path), "%s/%s", dir, BLOOM_FILE);
+    if (written < 0 || (size_t)written >= sizeof(path)) return;
+    if (bloom_open(&odb->bloom, path) == ERR_OK) {
+        if (!bloom_full(odb->bloom)) return;
+        bloom_close(odb->bloom);
+        odb->bloom = NULL;
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return;
+    build_filter(odb, dir, path);
+}
+
+error_t odb_open(odb_t* odb, const char* logicgit_dir) {
+    if (!odb || !logicgit_dir) return ERR_NULL_PTR;
+    odb->packs = NULL;
+    odb->npacks = 0;
+    odb->bloom = NULL;
+    odb->cache = NULL;
+    memset(&odb->dicts, 0, sizeof(odb->dicts));
+    int written = snprintf(odb->dir, sizeof(odb->dir), "%s/objects", logicgit_dir);
+    if (written < 0 || (size_t)written >= sizeof(odb->dir)) return ERR_BUFFER_OVERFLOW;
+    if (mkdir(odb->dir, 0755) != 0 && errno != EEXIST) return ERR_IO;
+    error_t err = dict_set_load(&odb->dicts, logicgit_dir);
+    if (err == ERR_OK) err = open_packs(odb);
+    if (err == ERR_OK) err = cache_create(&odb->cache, ODB_CACHE_BUDGET);
+    if (err != ERR_OK) {
+        odb_close(odb);
+        return err;
+    }
+    open_filter(odb);
+    return ERR_OK;
+}
+
+void odb_close(odb_t* odb) {
+    if (!odb) return;
+    for (size_t i = 0; i < odb->npacks; i++) pack_close(odb->packs[i]);
+    free(odb->packs);
+    odb->packs = NULL;
+    odb->npacks = 0;
+    dict_set_free(&odb->dicts);
+    bloom_close(odb->bloom);
+    odb->bloom = NULL;
+    cache_destroy(odb->cache);
+    odb->cache = NULL;
+}
+
+error_t odb_set_cache(odb_t* odb, size_t budget) {
+    if (!odb) return ERR_NULL_PTR;
+    cache_destroy(odb->cache);
+    odb->cache = NULL;
+    return budget ? cache_create(&odb->cache, budget) : ERR_OK;
+}
+
+error_t odb_hash(const char* type, const char* data, size_t len, hash_t out) {
+    if (!type || (!data && len)) return ERR_NULL_PTR;
+    hash_ctx_t ctx;
+    hash_object_init(&ctx, type, len);
+    hash_update(&ctx, data, len);
+    hash_final(&ctx, out);
+    return ERR_OK;
+}
+
+static error_t loose_path(const odb_t* odb, const char* hex, char path[ODB_PATH_MAX]) {
+    int written = snprintf(path, ODB_PATH_MAX, "%s/%.2s/%s", odb->dir, hex, hex + 2);
+    if (written < 0 || written >= ODB_PATH_MAX) return ERR_BUFFER_OVERFLOW;
+    return ERR_OK;
+}
+
+static bool packed(const odb_t* odb, const hash_t id) {
+    for (size_t i = 0; i < odb->npacks; i++) {
+        if (pack_contains(odb->packs[i], id)) return true;
+    }
+    return false;
+}
+
+error_t odb_write(odb_t* odb, const char* type, const char* data, size_t len, hash_t out) {
+    if (!odb) return ERR_NULL_PTR;
+    error_t err = odb_hash(type, data, len, out);
+    if (err != ERR_OK) return err;
+    if (!odb->bloom || bloom_may_contain(odb->bloom, out)) {
+        if (packed(odb, out)) return ERR_OK;
+    } else {
+        bloom_add(odb->bloom, out);
+    }
+
+    hash_hex_t hex;
+    hash_hex(out, hex);
+    char path[ODB_PATH_MAX];
+    int written = snprintf(path, sizeof(path), "%s/%.2s", odb->dir, hex);
+    if (written < 0 || (size_t)written >= sizeof(path)) return ERR_BUFFER_OVERFLOW;
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return ERR_IO;
+    err = loose_path(odb, hex, path);
+    if (err != ERR_OK) return err;
+
+    // "x": leave an existing object alone, like the legacy existsSync check.
+    FILE* f = fopen(path, "wx");
+    if (!f) return errno == EEXIST ? ERR_OK : ERR_IO;
+    size_t put = len ? fwrite(data, 1, len, f) : 0;
+    if (fclose(f) != 0 || put != len) {
+        remove(path);
+        return ERR_IO;
+    }
+    return ERR_OK;
+}
+
+bool odb_exists(const odb_t* odb, const hash_t id) {
+    if (!odb || !id) return false;
+    if (odb->bloom && !bloom_may_contain(odb->bloom, id)) return false;
+    if (packed(odb, id)) return true;
+    hash_hex_t hex;
+    char path[ODB_PATH_MAX];
+    struct stat st;
+    return loose_path(odb, hash_hex(id, hex), path) == ERR_OK && stat(path, &st) == 0;
+}
+
+void odb_mark(odb_t* odb, const hash_t id) {
+    if (odb && odb->bloom && !bloom_may_contain(odb->bloom, id)) bloom_add(odb->bloom, id);
+}
+
+static error_t read_stored(const odb_t* odb, const hash_t id, char type[ODB_TYPE_MAX], buffer_t* out) {
+    for (size_t i = 0; i < odb->npacks; i++) {
+        error_t err = pack_read(odb->packs[i], id, &odb->dicts, type, out);
+        if (err != ERR_FILE_NOT_FOUND) return err;
+    }
+
+    type[0] = '\0';
+    hash_hex_t hex;
+    char path[ODB_PATH_MAX];
+    error_t err = loose_path(odb, hash_hex(id, hex), path);
+    if (err != ERR_OK) return err;
+    FILE* f = fopen(path, "rb");
+    if (!f) return ERR_FILE_NOT_FOUND;
+    char chunk[4096];
+    size_t n;
+    while (err == ERR_OK && (n = fread(chunk, 1, sizeof(chunk), f)) > 0) err = buffer_append(out, chunk, n);
+    if (err == ERR_OK && ferror(f)) err = ERR_IO;
+    fclose(f);
+    return err;
+}
+
+error_t odb_read(const odb_t* odb, const hash_t id, char type[ODB_TYPE_MAX], buffer_t* out) {
+    if (!odb || !id || !type || !out) return ERR_NULL_PTR;
+    if (cache_get(odb->cache, id, type, out)) return ERR_OK;
+    size_t start = out->len;
+    error_t err = read_stored(odb, id, type, out);
+    // A full cache only means the next read decodes again.
+    if (err == ERR_OK && odb->cache) cache_put(odb->cache, id, type, out->data + start, out->len - start);
+    return err;
+}
@@ -0,0 +1,81 @@
+#ifndef ODB_H
+#define ODB_H
+
+#include "git_for_logic.h"
+#include "hash.h"
+#include "buffer.h"
+#include "compress.h"
+
+// Content-addressed object store under .logicgit/objects, laid out the
+// way legacy hashObject does it: an object's id is
+// sha1("<type> <len>\0" + content) and it is stored as a loose file
+// objects/xx/yyyy... holding the content. Writing an object that already
+// exists is a no-op.
+//
+// Objects may also live in packs under objects/pack (pack.h). Those are
+// opened and mapped by odb_open, and are searched before loose files.
+// Packs may hold compressed objects; odb_open loads the dictionaries
+// those need along with the packs.
+//
+// objects/pack/bloom is a Bloom filter (bloom.h) over every object id, so
+// that asking for an object that is not there, the common case when
+// storing new ones, costs one mapped cache line instead of a search of
+// every pack and a stat(). odb_open builds it from the packs and loose
+// files when it is missing or overfull. An object written behind its back
+// (by an older build, or lost from the filter in a crash) is reported
+// missing; that only ever costs storing it a second time.
+//
+// odb_read keeps what it reads in an object cache (cache.h) with a byte
+// budget of ODB_CACHE_BUDGET unless odb_set_cache says otherwise, so an
+// object read again, a snapshot or a delta chain's result, is not decoded
+// again.
+
+#define ODB_PATH_MAX 4096
+#define ODB_TYPE_MAX 16         // longest type name, with its NUL
+#define ODB_CACHE_BUDGET (64 * 1024 * 1024)
+
+struct pack;
+struct bloom;
+struct object_cache;
+
+typedef struct {
+    char dir[ODB_PATH_MAX];     // .../.logicgit/objects
+    struct pack** packs;
+    size_t npacks;
+    dict_set_t dicts;
+    struct bloom* bloom;        // NULL if the filter could not be set up
+    struct object_cache* cache; // NULL for none
+} odb_t;
+
+// Opens every readable pack; a malformed one is skipped. Also loads the
+// repository's dictionaries.
+error_t odb_open(odb_t* odb, const char* logicgit_dir);
+void odb_close(odb_t* odb);
+
+// Replaces the object cache with an empty one of budget bytes; 0 turns
+// caching off.
+error_t odb_set_cache(odb_t* odb, size_t budget);
+
+// Computes an object id without storing the object.
+error_t odb_hash(const char* type, const char* data, size_t len, hash_t out);
+
+error_t odb_write(odb_t* odb, const char* type, const char* data, size_t len, hash_t out);
+
+bool odb_exists(const odb_t* odb, const hash_t id);
+
+// Records id in the filter, for objects stored other than by odb_write,
+// e.g. into a pack. Call it before the object is stored.
+void odb_mark(odb_t* odb, const hash_t id);
+
+typedef error_t (*odb_object_fn)(void* ctx, const hash_t id);
+
+// Calls fn for every loose object file, stopping at the first error.
+error_t odb_for_each_loose(const odb_t* odb, odb_object_fn fn, void* ctx);
+
+// Appends the object's content to out. type receives the type of a packed
+// object; loose files do not record theirs, so it is left empty for them.
+// Returns ERR_FILE_NOT_FOUND for an unknown id. Safe to call from several
+// threads at once.
+error_t odb_read(const odb_t* odb, const hash_t id, char type[ODB_TYPE_MAX], buffer_t* out);
+
+#endif
@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pack.h"
+#include "delta.h"
+#include "compress.h"
+#include "fileview.h"
+
+#define PACK_MAGIC "LGPK"
+#define PACK_IDX_MAGIC "LGPI"
+#define PACK_VERSION 1
+#define PACK_HEADER 8
+#define PACK_IDX_HEADER 12
+#define PACK_FANOUT 256
+
+enum { PACK_WHOLE = 1, PACK_DELTA = 2, PACK_DEFLATE = 3 };
+
+// Types whose last object the writer keeps as a delta base.
+#define PACK_BASES 4
+#define PACK_MIN_SLOTS 2048
+#define PACK_RECENT (64 * 1024)         // ids remembered across packs; a power of two
+#define PACK_COPY_CHUNK (16 * 1024)     // bytes copied at a time by a merge
+
+// Raw deflate never expands data by more than this factor.
+#define PACK_DEFLATE_RATIO 1032
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_u64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+struct pack {
+    file_view_t data;
+    file_view_t idx;
+    size_t count;
+    const uint8_t* fanout;
+    const uint8_t* ids;
+    const uint8_t* offsets;
+    size_t entries_end;         // where the pack's entries stop
+};
+
+// Lookups touch a few scattered pages; don't read ahead around them.
+static void advise_random(const file_view_t* view) {
+    if (file_view_mapped(view)) posix_madvise(view->map, view->len, POSIX_MADV_RANDOM);
+}
+
+static bool parse_idx(pack_t* pack) {
+    const uint8_t* p = (const uint8_t*)pack->idx.data;
+    size_t len = pack->idx.len;
+    if (len < PACK_IDX_HEADER + PACK_FANOUT * 4 + 2 * HASH_LEN) return false;
+    if (memcmp(p, PACK_IDX_MAGIC, 4) != 0 || get_u32(p + 4) != PACK_VERSION) return false;
+    size_t count = get_u32(p + 8);
+    if (len != PACK_IDX_HEADER + PACK_FANOUT * 4 + count * (HASH_LEN + 8) + 2 * HASH_LEN) return false;
+    pack->count = count;
+    pack->fanout = p + PACK_IDX_HEADER;
+    pack->ids = pack->fanout + PACK_FANOUT * 4;
+    pack->offsets = pack->ids + count * HASH_LEN;
+    uint32_t prev = 0;
+    for (size_t i = 0; i < PACK_FANOUT; i++) {
+        uint32_t n = get_u32(pack->fanout + 4 * i);
+        if (n < prev) return false;
+        prev = n;
+    }
+    return prev == count;
+}
+
+static bool parse_pack(pack_t* pack) {
+    const uint8_t* p = (const uint8_t*)pack->data.data;
+    size_t len = pack->data.len;
+    if (len < PACK_HEADER + 4 + HASH_LEN) return false;
+    if (memcmp(p, PACK_MAGIC, 4) != 0 || get_u32(p + 4) != PACK_VERSION) return false;
+    pack->entries_end = len - 4 - HASH_LEN;
+    if (get_u32(p + pack->entries_end) != pack->count) return false;
+    // The index names the pack it was built for.
+    return memcmp(p + len - HASH_LEN, pack->offsets + pack->count * 8, HASH_LEN) == 0;
+}
+
+error_t pack_open(pack_t** out, const char* idx_path) {
+    if (!out || !idx_path) return ERR_NULL_PTR;
+    size_t n = strlen(idx_path);
+    if (n < 4 || strcmp(idx_path + n - 4, ".idx") != 0 || n + 2 > ODB_PATH_MAX) return ERR_FILE_NOT_FOUND;
+    char data_path[ODB_PATH_MAX];
+    memcpy(data_path, idx_path, n - 4);
+    memcpy(data_path + n - 4, ".pack", 6);
+
+    pack_t* pack = (pack_t*)calloc(1, sizeof(pack_t));
+    if (!pack) return ERR_MALLOC_FAILED;
+    error_t err = file_view_open(&pack->idx, idx_path);
+    if (err == ERR_OK) {
+        err = file_view_open(&pack->data, data_path);
+        if (err != ERR_OK) file_view_close(&pack->idx);
+    }
+    if (err != ERR_OK) {
+        free(pack);
+        return err;
+    }
+    if (!parse_idx(pack) || !parse_pack(pack)) {
+        pack_close(pack);
+        return ERR_IO;
+    }
+    advise_random(&pack->idx);
+    advise_random(&pack->data);
+    *out = pack;
+    return ERR_OK;
+}
+
+void pack_close(pack_t* pack) {
+    if (!pack) return;
+    file_view_close(&pack->data);
+    file_view_close(&pack->idx);
+    free(pack);
+}
+
+size_t pack_count(const pack_t* pack) {
+    return pack ? pack->count : 0;
+}
+
+void pack_name(const pack_t* pack, hash_t out) {
+    memcpy(out, pack->offsets + pack->count * 8, HASH_LEN);
+}
+
+const uint8_t* pack_id_at(const pack_t* pack, size_t i) {
+    return pack->ids + i * HASH_LEN;
+}
+
+static bool find(const pack_t* pack, const hash_t id, uint64_t* offset) {
+    size_t lo = id[0] ? get_u32(pack->fanout + 4 * (id[0] - 1)) : 0;
+    size_t hi = get_u32(pack->fanout + 4 * id[0]);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = memcmp(pack->ids + mid * HASH_LEN, id, HASH_LEN);
+        if (c == 0) {
+            if (offset) *offset = get_u64(pack->offsets + mid * 8);
+            return true;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return false;
+}
+
+bool pack_contains(const pack_t* pack, const hash_t id) {
+    return pack && id && find(pack, id, NULL);
+}
+
+typedef struct {
+    int kind;
+    const char* type;
+    uint64_t size;              // of the object
+    uint64_t base;              // offset of the base entry (PACK_DELTA)
+    uint32_t dict;              // dictionary id (PACK_DEFLATE)
+    const char* data;           // content, delta or compressed content
+    size_t len;
+} entry_t;
+
+static bool parse_entry(const pack_t* pack, uint64_t offset, entry_t* e) {
+    const uint8_t* p = (const uint8_t*)pack->data.data;
+    size_t end = pack->entries_end;
+    if (offset < PACK_HEADER || offset >= end) return false;
+    size_t pos = (size_t)offset;
+    e->kind = p[pos++];
+    if (e->kind != PACK_WHOLE && e->kind != PACK_DELTA && e->kind != PACK_DEFLATE) return false;
+    const uint8_t* nul = (const uint8_t*)memchr(p + pos, '\0', end - pos < ODB_TYPE_MAX ? end - pos : ODB_TYPE_MAX);
+    if (!nul) return false;
+    e->type = (const char*)p + pos;
+    pos = (size_t)(nul - p) + 1;
+    size_t n = delta_get_varint(p + pos, end - pos, &e->size);
+    if (!n) return false;
+    pos += n;
+    uint64_t len = e->size;
+    if (e->kind == PACK_DELTA) {
+        uint64_t distance;
+        n = delta_get_varint(p + pos, end - pos, &distance);
+        if (!n || distance == 0 || distance > offset) return false;
+        e->base = offset - distance;
+        pos += n;
+        n = delta_get_varint(p + pos, end - pos, &len);
+        if (!n) return false;
+        pos += n;
+    } else if (e->kind == PACK_DEFLATE) {
+        uint64_t dict;
+        n = delta_get_varint(p + pos, end - pos, &dict);
+        if (!n || dict > UINT32_MAX) return false;
+        e->dict = (uint32_t)dict;
+        pos += n;
+        n = delta_get_varint(p + pos, end - pos, &len);
+        if (!n || e->size / PACK_DEFLATE_RATIO > len) return false;
+        pos += n;
+    }
+    if (len > end - pos) return false;
+    e->data = (const char*)p + pos;
+    e->len = (size_t)len;
+    return true;
+}
+
+// Appends the content of a whole entry to out.
+static error_t read_whole(const entry_t* e, const dict_set_t* dicts, buffer_t* out) {
+    if (e->kind == PACK_WHOLE) return buffer_append(out, e->data, e->len);
+    const dict_t* dict = NULL;
+    if (e->dict && !(dict = dict_set_find(dicts, e->dict))) return ERR_IO;
+    return decompress(dict, e->data, e->len, (size_t)e->size, out);
+}
+
+error_t pack_read(const pack_t* pack, const hash_t id, const dict_set_t* dicts, char type[ODB_TYPE_MAX],
+                  buffer_t* out) {
+    if (!pack || !id || !type || !out) return ERR_NULL_PTR;
+    uint64_t offset;
+    if (!find(pack, id, &offset)) return ERR_FILE_NOT_FOUND;
+
+    // Walk down to the whole object at the bottom of the chain.
+    entry_t chain[PACK_DELTA_DEPTH + 1];
+    size_t depth = 0;
+    if (!parse_entry(pack, offset, &chain[0])) return ERR_IO;
+    while (chain[depth].kind == PACK_DELTA) {
+        if (depth == PACK_DELTA_DEPTH || !parse_entry(pack, chain[depth].base, &chain[depth + 1])) return ERR_IO;
+        depth++;
+    }
+    strcpy(type, chain[0].type);
+    if (depth == 0) return read_whole(&chain[0], dicts, out);
+
+    // Then apply the deltas back up, alternating between two scratch
+    // buffers; the last one lands in out.
+    buffer_t scratch[3];
+    buffer_init(&scratch[0]);
+    buffer_init(&scratch[1]);
+    buffer_init(&scratch[2]);
+    error_t err = ERR_OK;
+    const char* base = chain[depth].data;
+    size_t base_len = chain[depth].len;
+    if (chain[depth].kind == PACK_DEFLATE) {
+        err = read_whole(&chain[depth], dicts, &scratch[2]);
+        base = scratch[2].data;
+        base_len = scratch[2].len;
+    }
+    size_t begin = out->len;
+    for (size_t k = depth; err == ERR_OK && k-- > 0;) {
+        buffer_t* target = k ? &scratch[k & 1] : out;
+        if (k) buffer_clear(target);
+        err = delta_apply(base, base_len, chain[k].data, chain[k].len, target);
+        base = target->data + (k ? 0 : begin);
+        base_len = target->len - (k ? 0 : begin);
+    }
+    buffer_free(&scratch[0]);
+    buffer_free(&scratch[1]);
+    buffer_free(&scratch[2]);
+    if (err == ERR_OK && base_len != chain[0].size) err = ERR_IO;
+    return err;
+}
+
+typedef struct {
+    hash_t id;
+    uint64_t offset;
+} pack_entry_t;
+
+typedef struct {
+    hash_t name;
+    uint64_t size;              // bytes of entries
+} pack_part_t;
+
+typedef struct {
+    buffer_t data;
+    char type[ODB_TYPE_MAX];
+    uint64_t offset;
+    size_t depth;
+    bool used;
+} pack_base_t;
+
+struct pack_writer {
+    char dir[ODB_PATH_MAX];     // objects/pack
+    char tmp[ODB_PATH_MAX];
+    FILE* f;
+    hash_ctx_t sum;
+    uint64_t offset;
+    pack_entry_t* entries;      // the current pack's objects, in order
+    size_t count;
+    size_t cap;
+    size_t added;               // objects added to every pack
+    // Published packs, oldest first, each more than twice the size of
+    // the next
+    pack_part_t* parts;
+    size_t nparts;
+    size_t parts_cap;
+    size_t deltas;
+    size_t compressed;
+    compressor_t* compressor;   // not owned
+    // Open addressing over entries: index + 1, 0 for empty
+    uint32_t* slots;
+    size_t slot_mask;
+    // The last id added to each of PACK_RECENT slots, so that objects
+    // repeated across packs are mostly still added once
+    hash_t* recent;
+    // The last object of each recent type, delta base candidates
+    pack_base_t bases[PACK_BASES];
+    size_t next_base;
+    buffer_t delta;
+};
+
+static error_t put(pack_writer_t* w, const void* data, size_t len) {
+    if (len && fwrite(data, 1, len, w->f) != len) return ERR_IO;
+    hash_update(&w->sum, data, len);
+    w->offset += len;
+    return ERR_OK;
+}
+
+static error_t put_varint(pack_writer_t* w, uint64_t v) {
+    uint8_t tmp[10];
+    return put(w, tmp, delta_put_varint(tmp, v));
+}
+
+// mkstemp() into dir, for a read-only file that is renamed into place
+// when done.
+static FILE* create_temp(const char* dir, const char* prefix, char path[ODB_PATH_MAX]) {
+    int written = snprintf(path, ODB_PATH_MAX, "%s/%sXXXXXX", dir, prefix);
+    if (written < 0 || written >= ODB_PATH_MAX) return NULL;
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    if (fchmod(fd, 0444) != 0) {
+        close(fd);
+        remove(path);
+        return NULL;
+    }
+    FILE* f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        remove(path);
+    }
+    return f;
+}
+
+// Starts the next pack in a new temporary file. Deltas never reach back
+// into an earlier pack.
+static error_t begin_pack(pack_writer_t* w) {
+    if (!(w->f = create_temp(w->dir, "tmp_pack_", w->tmp))) return ERR_IO;
+    hash_init(&w->sum);
+    w->offset = 0;
+    w->count = 0;
+    if (w->slots) memset(w->slots, 0, (w->slot_mask + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < PACK_BASES; i++) w->bases[i].used = false;
+
+    uint8_t head[PACK_HEADER];
+    memcpy(head, PACK_MAGIC, 4);
+    put_u32(head + 4, PACK_VERSION);
+    return put(w, head, sizeof(head));
+}
+
+error_t pack_writer_open(pack_writer_t** out, const char* objects_dir) {
+    if (!out || !objects_dir) return ERR_NULL_PTR;
+    pack_writer_t* w = (pack_writer_t*)calloc(1, sizeof(pack_writer_t));
+    if (!w) return ERR_MALLOC_FAILED;
+    int written = snprintf(w->dir, sizeof(w->dir), "%s/%s", objects_dir, PACK_SUBDIR);
+    if (written < 0 || (size_t)written >= sizeof(w->dir)) {
+        free(w);
+        return ERR_BUFFER_OVERFLOW;
+    }
+    if (mkdir(w->dir, 0755) != 0 && errno != EEXIST) {
+        free(w);
+        return ERR_IO;
+    }
+    for (size_t i = 0; i < PACK_BASES; i++) buffer_init(&w->bases[i].data);
+    buffer_init(&w->delta);
+    w->recent = (hash_t*)calloc(PACK_RECENT, sizeof(hash_t));
+    error_t err = w->recent ? begin_pack(w) : ERR_MALLOC_FAILED;
+    if (err != ERR_OK) {
+        pack_writer_abort(w);
+        return err;
+    }
+    *out = w;
+    return ERR_OK;
+}
+
+static hash_t* recent_of(const pack_writer_t* w, const hash_t id) {
+    uint32_t v = (uint32_t)id[8] | (uint32_t)id[9] << 8 | (uint32_t)id[10] << 16 | (uint32_t)id[11] << 24;
+    return &w->recent[v & (PACK_RECENT - 1)];
+}
+
+static size_t slot_of(const pack_writer_t* w, const hash_t id) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)id[i] << (8 * i);
+    size_t i = (size_t)(v & w->slot_mask);
+    while (w->slots[i] && !hash_eq(w->entries[w->slots[i] - 1].id, id)) i = (i + 1) & w->slot_mask;
+    return i;
+}
+
+// Keeps the table at most half full.
+static error_t grow_slots(pack_writer_t* w) {
+    size_t n = w->slots ? (w->slot_mask + 1) * 2 : PACK_MIN_SLOTS;
+    uint32_t* slots = (uint32_t*)calloc(n, sizeof(uint32_t));
+    if (!slots) return ERR_MALLOC_FAILED;
+    free(w->slots);
+    w->slots = slots;
+    w->slot_mask = n - 1;
+    for (size_t i = 0; i < w->count; i++) {
+        size_t s = slot_of(w, w->entries[i].id);
+        if (!w->slots[s]) w->slots[s] = (uint32_t)(i + 1);
+    }
+    return ERR_OK;
+}
+
+static pack_base_t* base_for(pack_writer_t* w, const char* type) {
+    for (size_t i = 0; i < PACK_BASES; i++) {
+        if (w->bases[i].used && strcmp(w->bases[i].type, type) == 0) return &w->bases[i];
+    }
+    return NULL;
+}
+
+error_t pack_writer_add(pack_writer_t* w, const char* type, const char* data, size_t len,
+                        const hash_t id, bool delta) {
+    if (!w || !type || (!data && len) || !id) return ERR_NULL_PTR;
+    size_t type_len = strlen(type);
+    if (type_len >= ODB_TYPE_MAX) return ERR_BUFFER_OVERFLOW;
+    if (!w->f) return ERR_IO;
+    if (w->count >= UINT32_MAX - 1) return ERR_BUFFER_OVERFLOW;
+    if (w->count == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 1024;
+        pack_entry_t* entries = (pack_entry_t*)realloc(w->entries, cap * sizeof(pack_entry_t));
+        if (!entries) return ERR_MALLOC_FAILED;
+        w->entries = entries;
+        w->cap = cap;
+    }
+    if (!w->slots || (w->count + 1) * 2 > w->slot_mask + 1) {
+        error_t err = grow_slots(w);
+        if (err != ERR_OK) return err;
+    }
+
+    // A delta only pays if it saves a quarter of the object.
+    pack_base_t* base = base_for(w, type);
+    error_t err = ERR_BUFFER_OVERFLOW;
+    if (delta && base && base->depth < PACK_DELTA_DEPTH) {
+        buffer_clear(&w->delta);
+        err = delta_create(base->data.data, base->data.len, data, len, len - len / 4, &w->delta);
+        if (err != ERR_OK && err != ERR_BUFFER_OVERFLOW) return err;
+    }
+    bool as_delta = err == ERR_OK;
+
+    // Otherwise the object is compressed, when that pays.
+    err = ERR_BUFFER_OVERFLOW;
+    if (!as_delta && w->compressor) {
+        buffer_clear(&w->delta);
+        err = compressor_run(w->compressor, data, len, &w->delta);
+        if (err != ERR_OK && err != ERR_BUFFER_OVERFLOW) return err;
+    }
+    bool as_deflate = err == ERR_OK;
+
+    uint64_t offset = w->offset;
+    uint8_t kind = as_delta ? PACK_DELTA : as_deflate ? PACK_DEFLATE : PACK_WHOLE;
+    err = put(w, &kind, 1);
+    if (err == ERR_OK) err = put(w, type, type_len + 1);
+    if (err == ERR_OK) err = put_varint(w, len);
+    if (err == ERR_OK && as_delta) err = put_varint(w, offset - base->offset);
+    if (err == ERR_OK && as_deflate) err = put_varint(w, compressor_dict_id(w->compressor));
+    if (err == ERR_OK && (as_delta || as_deflate)) {
+        err = put_varint(w, w->delta.len);
+        if (err == ERR_OK) err = put(w, w->delta.data, w->delta.len);
+    } else if (err == ERR_OK) {
+        err = put(w, data, len);
+    }
+    if (err != ERR_OK) return err;
+
+    size_t slot = slot_of(w, id);
+    if (!w->slots[slot]) w->slots[slot] = (uint32_t)(w->count + 1);
+    memcpy(w->entries[w->count].id, id, sizeof(hash_t));
+    w->entries[w->count].offset = offset;
+    w->count++;
+    w->added++;
+    memcpy(*recent_of(w, id), id, sizeof(hash_t));
+    w->deltas += as_delta;
+    w->compressed += as_deflate;
+
+    // A type without a base takes the next slot in turn.
+    size_t depth = as_delta ? base->depth + 1 : 0;
+    if (!base) {
+        base = &w->bases[w->next_base];
+        w->next_base = (w->next_base + 1) % PACK_BASES;
+        memcpy(base->type, type, type_len + 1);
+    }
+    base->depth = depth;
+    base->offset = offset;
+    buffer_clear(&base->data);
+    base->used = buffer_append(&base->data, data, len) == ERR_OK;
+    return ERR_OK;
+}
+
+bool pack_writer_contains(const pack_writer_t* w, const hash_t id) {
+    if (!w || !id) return false;
+    return (w->slots && w->slots[slot_of(w, id)] != 0) || hash_eq(*recent_of(w, id), id);
+}
+
+void pack_writer_set_compressor(pack_writer_t* w, compressor_t* compressor) {
+    if (w) w->compressor = compressor;
+}
+
+size_t pack_writer_count(const pack_writer_t* w) {
+    return w ? w->added : 0;
+}
+
+size_t pack_writer_deltas(const pack_writer_t* w) {
+    return w ? w->deltas : 0;
+}
+
+size_t pack_writer_compressed(const pack_writer_t* w) {
+    return w ? w->compressed : 0;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    return memcmp(((const pack_entry_t*)a)->id, ((const pack_entry_t*)b)->id, HASH_LEN);
+}
+
+static void free_writer(pack_writer_t* w) {
+    for (size_t i = 0; i < PACK_BASES; i++) buffer_free(&w->bases[i].data);
+    buffer_free(&w->delta);
+    free(w->entries);
+    free(w->slots);
+    free(w->recent);
+    free(w->parts);
+    free(w);
+}
+
+// Writes the file, syncs it and only then renames it into place.
+static error_t write_synced(FILE* f, const char* tmp, const char* path) {
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return ERR_IO;
+    }
+    return ERR_OK;
+}
+
+static error_t sync_dir(const char* dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return ERR_IO;
+    int rc = fsync(fd);
+    close(fd);
+    return rc == 0 ? ERR_OK : ERR_IO;
+}
+
+// Indexes the current pack's entries. The writer's own entries stay in
+// the order its lookup table expects.
+static error_t write_idx(pack_writer_t* w, const hash_t name, const char* path) {
+    size_t total = w->count;
+    pack_entry_t* sorted = (pack_entry_t*)malloc((total ? total : 1) * sizeof(pack_entry_t));
+    if (!sorted) return ERR_MALLOC_FAILED;
+    if (total) memcpy(sorted, w->entries, total * sizeof(pack_entry_t));
+    // Sorted and unique; a repeated id keeps its first entry.
+    qsort(sorted, total, sizeof(pack_entry_t), compare_entries);
+    size_t n = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (n && hash_eq(sorted[n - 1].id, sorted[i].id)) continue;
+        sorted[n++] = sorted[i];
+    }
+
+    size_t len = PACK_IDX_HEADER + PACK_FANOUT * 4 + n * (HASH_LEN + 8) + 2 * HASH_LEN;
+    uint8_t* p = (uint8_t*)malloc(len);
+    if (!p) {
+        free(sorted);
+        return ERR_MALLOC_FAILED;
+    }
+    memcpy(p, PACK_IDX_MAGIC, 4);
+    put_u32(p + 4, PACK_VERSION);
+    put_u32(p + 8, (uint32_t)n);
+    uint8_t* fanout = p + PACK_IDX_HEADER;
+    uint8_t* ids = fanout + PACK_FANOUT * 4;
+    uint8_t* offsets = ids + n * HASH_LEN;
+    size_t i = 0;
+    for (size_t b = 0; b < PACK_FANOUT; b++) {
+        while (i < n && sorted[i].id[0] == b) i++;
+        put_u32(fanout + 4 * b, (uint32_t)i);
+    }
+    for (i = 0; i < n; i++) {
+        memcpy(ids + i * HASH_LEN, sorted[i].id, HASH_LEN);
+        put_u64(offsets + i * 8, sorted[i].offset);
+    }
+    free(sorted);
+    memcpy(offsets + n * 8, name, HASH_LEN);
+    compute_sha1((const char*)p, len - HASH_LEN, p + len - HASH_LEN);
+
+    char tmp[ODB_PATH_MAX];
+    FILE* f = create_temp(w->dir, "tmp_idx_", tmp);
+    error_t err = f ? ERR_OK : ERR_IO;
+    if (f && fwrite(p, 1, len, f) != len) {
+        fclose(f);
+        remove(tmp);
+        err = ERR_IO;
+    } else if (f) {
+        err = write_synced(f, tmp, path);
+    }
+    free(p);
+    return err;
+}
+
+static error_t pack_file(const char* dir, const char* hex, const char* ext, char path[ODB_PATH_MAX]) {
+    int written = snprintf(path, ODB_PATH_MAX, "%s/pack-%s.%s", dir, hex, ext);
+    if (written < 0 || written >= ODB_PATH_MAX) return ERR_BUFFER_OVERFLOW;
+    return ERR_OK;
+}
+
+// Finishes the current pack: trailer, sync, rename, then its index and
+// the directory entries, so that an index only ever names a complete
+// pack and both survive a crash once this returns.
+static error_t end_pack(pack_writer_t* w, hash_t name) {
+    size_t n = w->count;
+    if (n > UINT32_MAX) return ERR_BUFFER_OVERFLOW;
+    if (w->nparts == w->parts_cap) {
+        size_t cap = w->parts_cap ? w->parts_cap * 2 : 8;
+        pack_part_t* parts = (pack_part_t*)realloc(w->parts, cap * sizeof(pack_part_t));
+        if (!parts) return ERR_MALLOC_FAILED;
+        w->parts = parts;
+        w->parts_cap = cap;
+    }
+    uint64_t size = w->offset;
+    uint8_t count[4];
+    put_u32(count, (uint32_t)n);
+    error_t err = put(w, count, sizeof(count));
+    hash_final(&w->sum, name);
+    if (err == ERR_OK && fwrite(name, 1, HASH_LEN, w->f) != HASH_LEN) err = ERR_IO;
+
+    hash_hex_t hex;
+    hash_hex(name, hex);
+    char pack_path[ODB_PATH_MAX], idx_path[ODB_PATH_MAX];
+    if (err == ERR_OK) err = pack_file(w->dir, hex, "pack", pack_path);
+    if (err == ERR_OK) err = pack_file(w->dir, hex, "idx", idx_path);
+    if (err == ERR_OK) {
+        err = write_synced(w->f, w->tmp, pack_path);
+    } else {
+        fclose(w->f);
+        remove(w->tmp);
+    }
+    w->f = NULL;
+    if (err == ERR_OK) err = write_idx(w, name, idx_path);
+    if (err == ERR_OK) err = sync_dir(w->dir);
+    if (err == ERR_OK) {
+        memcpy(w->parts[w->nparts].name, name, sizeof(hash_t));
+        w->parts[w->nparts].size = size;
+        w->nparts++;
+    }
+    return err;
+}
+
+// One pack being merged. Its index and entries are read front to back
+// through stdio rather than the mapping, so that a merge takes the same
+// memory however big the packs are.
+typedef struct {
+    pack_t* pack;
+    FILE* ids;                  // the idx, at the id after id
+    FILE* offsets;              // the idx, at the offset after offset
+    FILE* data;                 // the .pack
+    size_t next;                // index entries read
+    bool head;                  // id and offset hold an entry not merged yet
+    hash_t id;
+    uint64_t offset;            // in the merged pack
+    uint64_t shift;             // from its offsets to the merged pack's
+} merge_src_t;
+
+static error_t read_head(merge_src_t* src) {
+    src->head = src->next < pack_count(src->pack);
+    if (!src->head) return ERR_OK;
+    uint8_t offset[8];
+    if (fread(src->id, 1, HASH_LEN, src->ids) != HASH_LEN || fread(offset, 1, 8, src->offsets) != 8) return ERR_IO;
+    src->offset = get_u64(offset) + src->shift;
+    src->next++;
+    return ERR_OK;
+}
+
+static error_t rewind_src(merge_src_t* src) {
+    off_t ids = PACK_IDX_HEADER + PACK_FANOUT * 4;
+    off_t offsets = ids + (off_t)(pack_count(src->pack) * HASH_LEN);
+    if (fseeko(src->ids, ids, SEEK_SET) != 0 || fseeko(src->offsets, offsets, SEEK_SET) != 0) return ERR_IO;
+    src->next = 0;
+    return read_head(src);
+}
+
+// Takes the smallest id at the heads of the sources into id and offset.
+// An id several packs hold keeps its entry in the oldest. *more is false
+// once every source is used up.
+static error_t merge_next(merge_src_t* srcs, size_t n, bool* more, hash_t id, uint64_t* offset) {
+    merge_src_t* min = NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (srcs[i].head && (!min || memcmp(srcs[i].id, min->id, HASH_LEN) < 0)) min = &srcs[i];
+    }
+    *more = min != NULL;
+    if (!min) return ERR_OK;
+    memcpy(id, min->id, sizeof(hash_t));
+    *offset = min->offset;
+    error_t err = ERR_OK;
+    for (size_t i = 0; i < n && err == ERR_OK; i++) {
+        if (srcs[i].head && hash_eq(srcs[i].id, id)) err = read_head(&srcs[i]);
+    }
+    return err;
+}
+
+static error_t open_src(pack_writer_t* w, const hash_t name, merge_src_t* src) {
+    hash_hex_t hex;
+    hash_hex(name, hex);
+    char idx_path[ODB_PATH_MAX], pack_path[ODB_PATH_MAX];
+    error_t err = pack_file(w->dir, hex, "idx", idx_path);
+    if (err == ERR_OK) err = pack_file(w->dir, hex, "pack", pack_path);
+    if (err == ERR_OK) err = pack_open(&src->pack, idx_path);
+    if (err != ERR_OK) return err;
+    src->ids = fopen(idx_path, "rb");
+    src->offsets = fopen(idx_path, "rb");
+    src->data = fopen(pack_path, "rb");
+    return src->ids && src->offsets && src->data ? ERR_OK : ERR_IO;
+}
+
+static void close_src(merge_src_t* src) {
+    if (src->ids) fclose(src->ids);
+    if (src->offsets) fclose(src->offsets);
+    if (src->data) fclose(src->data);
+    pack_close(src->pack);
+}
+
+// Copies the entries of src to the merged pack. Deltas name their base by
+// distance, so entries copied whole and in order stay valid.
+static error_t copy_entries(pack_writer_t* w, merge_src_t* src) {
+    char chunk[PACK_COPY_CHUNK];
+    uint64_t left = src->pack->entries_end - PACK_HEADER;
+    if (fseek(src->data, PACK_HEADER, SEEK_SET) != 0) return ERR_IO;
+    while (left) {
+        size_t n = left < sizeof(chunk) ? (size_t)left : sizeof(chunk);
+        if (fread(chunk, 1, n, src->data) != n) return ERR_IO;
+        error_t err = put(w, chunk, n);
+        if (err != ERR_OK) return err;
+        left -= n;
+    }
+    return ERR_OK;
+}
+
+// Writes the merged pack: header, every source's entries in turn, then
+// the trailer with the count of distinct ids.
+static error_t write_merged_pack(pack_writer_t* w, merge_src_t* srcs, size_t n, size_t count, hash_t name) {
+    if (!(w->f = create_temp(w->dir, "tmp_pack_", w->tmp))) return ERR_IO;
+    hash_init(&w->sum);
+    w->offset = 0;
+    uint8_t head[PACK_HEADER];
+    memcpy(head, PACK_MAGIC, 4);
+    put_u32(head + 4, PACK_VERSION);
+    error_t err = put(w, head, sizeof(head));
+    for (size_t i = 0; i < n && err == ERR_OK; i++) err = copy_entries(w, &srcs[i]);
+    uint8_t trailer[4];
+    put_u32(trailer, (uint32_t)count);
+    if (err == ERR_OK) err = put(w, trailer, sizeof(trailer));
+    hash_final(&w->sum, name);
+    if (err == ERR_OK && fwrite(name, 1, HASH_LEN, w->f) != HASH_LEN) err = ERR_IO;
+
+    hash_hex_t hex;
+    char path[ODB_PATH_MAX];
+    if (err == ERR_OK) err = pack_file(w->dir, hash_hex(name, hex), "pack", path);
+    if (err == ERR_OK) {
+        err = write_synced(w->f, w->tmp, path);
+    } else {
+        fclose(w->f);
+        remove(w->tmp);
+    }
+    w->f = NULL;
+    return err;
+}
+
+// Writes the merged index in the layout write_idx uses, one merge pass for
+// the ids and one for their offsets.
+static error_t write_merged_idx(pack_writer_t* w, merge_src_t* srcs, size_t n, const uint32_t fanout[PACK_FANOUT],
+                                size_t count, const hash_t name) {
+    if (!(w->f = create_temp(w->dir, "tmp_idx_", w->tmp))) return ERR_IO;
+    hash_init(&w->sum);
+    uint8_t head[PACK_IDX_HEADER + PACK_FANOUT * 4];
+    memcpy(head, PACK_IDX_MAGIC, 4);
+    put_u32(head + 4, PACK_VERSION);
+    put_u32(head + 8, (uint32_t)count);
+    for (size_t b = 0; b < PACK_FANOUT; b++) put_u32(head + PACK_IDX_HEADER + 4 * b, fanout[b]);
+    error_t err = put(w, head, sizeof(head));
+
+    hash_t id;
+    uint64_t offset;
+    bool more = true;
+    for (size_t i = 0; i < n && err == ERR_OK; i++) err = rewind_src(&srcs[i]);
+    while (err == ERR_OK && (err = merge_next(srcs, n, &more, id, &offset)) == ERR_OK && more) {
+        err = put(w, id, HASH_LEN);
+    }
+    for (size_t i = 0; i < n && err == ERR_OK; i++) err = rewind_src(&srcs[i]);
+    while (err == ERR_OK && (err = merge_next(srcs, n, &more, id, &offset)) == ERR_OK && more) {
+        uint8_t bytes[8];
+        put_u64(bytes, offset);
+        err = put(w, bytes, sizeof(bytes));
+    }
+    if (err == ERR_OK) err = put(w, name, HASH_LEN);
+    hash_t sum;
+    hash_final(&w->sum, sum);
+    if (err == ERR_OK && fwrite(sum, 1, HASH_LEN, w->f) != HASH_LEN) err = ERR_IO;
+
+    hash_hex_t hex;
+    char path[ODB_PATH_MAX];
+    if (err == ERR_OK) err = pack_file(w->dir, hash_hex(name, hex), "idx", path);
+    if (err == ERR_OK) {
+        err = write_synced(w->f, w->tmp, path);
+    } else {
+        fclose(w->f);
+        remove(w->tmp);
+    }
+    w->f = NULL;
+    return err;
+}
+
+// Replaces the published packs from parts[from] on with one pack holding
+// all of their objects. The merged pack and its index are synced and in
+// place before the packs they replace are removed, index first, so that
+// a crash at any point leaves every object readable.
+static error_t merge_parts(pack_writer_t* w, size_t from) {
+    size_t n = w->nparts - from;
+    merge_src_t* srcs = (merge_src_t*)calloc(n, sizeof(merge_src_t));
+    if (!srcs) return ERR_MALLOC_FAILED;
+    error_t err = ERR_OK;
+    uint64_t size = 0;
+    for (size_t i = 0; i < n && err == ERR_OK; i++) {
+        err = open_src(w, w->parts[from + i].name, &srcs[i]);
+        if (err == ERR_OK) {
+            srcs[i].shift = size;
+            size += srcs[i].pack->entries_end - PACK_HEADER;
+        }
+    }
+
+    // First pass: how many distinct ids, by first byte.
+    uint32_t fanout[PACK_FANOUT] = { 0 };
+    size_t count = 0;
+    hash_t id;
+    uint64_t offset;
+    bool more = true;
+    for (size_t i = 0; i < n && err == ERR_OK; i++) err = rewind_src(&srcs[i]);
+    while (err == ERR_OK && (err = merge_next(srcs, n, &more, id, &offset)) == ERR_OK && more) {
+        fanout[id[0]]++;
+        if (++count > UINT32_MAX) err = ERR_BUFFER_OVERFLOW;
+    }
+    for (size_t b = 1; b < PACK_FANOUT; b++) fanout[b] += fanout[b - 1];
+
+    hash_t name;
+    if (err == ERR_OK) err = write_merged_pack(w, srcs, n, count, name);
+    if (err == ERR_OK) err = write_merged_idx(w, srcs, n, fanout, count, name);
+    if (err == ERR_OK) err = sync_dir(w->dir);
+    for (size_t i = 0; i < n; i++) close_src(&srcs[i]);
+    free(srcs);
+    if (err != ERR_OK) return err;
+
+    for (size_t i = from; i < w->nparts; i++) {
+        if (hash_eq(w->parts[i].name, name)) continue;
+        hash_hex_t hex;
+        char idx_path[ODB_PATH_MAX], pack_path[ODB_PATH_MAX];
+        hash_hex(w->parts[i].name, hex);
+        if (pack_file(w->dir, hex, "idx", idx_path) != ERR_OK || pack_file(w->dir, hex, "pack", pack_path) != ERR_OK) {
+            continue;
+        }
+        if (remove(idx_path) == 0) remove(pack_path);
+    }
+    memcpy(w->parts[from].name, name, sizeof(hash_t));
+    w->parts[from].size = size + PACK_HEADER;
+    w->nparts = from + 1;
+    return ERR_OK;
+}
+
+// Merges the newest packs until each pack is more than twice the size of
+// all that follow it, as git's geometric repack does: a run of n groups
+// keeps O(log n) packs and copies each entry O(log n) times.
+static error_t settle(pack_writer_t* w) {
+    size_t from = w->nparts - 1;
+    uint64_t size = w->parts[from].size;
+    while (from > 0 && w->parts[from - 1].size <= 2 * size) size += w->parts[--from].size;
+    return from + 1 < w->nparts ? merge_parts(w, from) : ERR_OK;
+}
+
+error_t pack_writer_publish(pack_writer_t* w, hash_t name) {
+    if (!w || !name) return ERR_NULL_PTR;
+    if (!w->f) return ERR_IO;
+    if (w->count == 0) return ERR_OK;
+    error_t err = end_pack(w, name);
+    if (err == ERR_OK) err = settle(w);
+    if (err == ERR_OK) err = begin_pack(w);
+    if (err == ERR_OK) memcpy(name, w->parts[w->nparts - 1].name, sizeof(hash_t));
+    return err;
+}
+
+error_t pack_writer_finish(pack_writer_t* w, hash_t name) {
+    if (!w || !name) return ERR_NULL_PTR;
+    error_t err = ERR_OK;
+    if (!w->f) {
+        err = ERR_IO;
+    } else if (w->count > 0 || !w->nparts) {
+        err = end_pack(w, name);
+    } else {
+        fclose(w->f);
+        remove(w->tmp);
+        w->f = NULL;
+    }
+    if (err == ERR_OK && w->nparts > 1) err = merge_parts(w, 0);
+    if (err == ERR_OK) memcpy(name, w->parts[0].name, sizeof(hash_t));
+    free_writer(w);
+    return err;
+}
+
+void pack_writer_abort(pack_writer_t* w) {
+    if (!w) return;
+    if (w->f) {
+        fclose(w->f);
+        remove(w->tmp);
+    }
+    free_writer(w);
+}
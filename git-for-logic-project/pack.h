@@ -0,0 +1,110 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "buffer.h"
+#include "odb.h"
+#include "compress.h"
+
+// Packs keep many objects in one file, after git's packfiles: objects/pack
+// holds pack-<name>.pack and pack-<name>.idx pairs, <name> being the
+// pack's checksum. All integers are little-endian.
+//
+// .pack: "LGPK", u32 version, the entries, u32 entry count, then a SHA-1
+// of everything before it. An entry is a kind byte, the object type and a
+// NUL, and the varint object length. A PACK_WHOLE entry is followed by
+// the content. A PACK_DELTA entry is followed by the varint distance back
+// to its base entry, the varint delta length and a delta (delta.h)
+// against the base's content. Chains are at most PACK_DELTA_DEPTH deep.
+// A PACK_DEFLATE entry is a whole object compressed (compress.h): the
+// varint dictionary id (0 for none), the varint compressed length and the
+// compressed content.
+//
+// .idx: "LGPI", u32 version, u32 count, a 256-entry fanout table (u32
+// count of ids whose first byte is <= i), the sorted ids, their u64 entry
+// offsets, the pack checksum, then a SHA-1 of everything before it.
+//
+// Both files are mmap'd. Finding an object is a fanout lookup and a
+// binary search over the mapped ids, with no system calls.
+
+#define PACK_SUBDIR "pack"
+#define PACK_DELTA_DEPTH 16
+
+typedef struct pack pack_t;
+
+// Opens idx_path and the .pack next to it. Returns ERR_FILE_NOT_FOUND if
+// either is missing and ERR_IO if either is malformed.
+error_t pack_open(pack_t** out, const char* idx_path);
+void pack_close(pack_t* pack);
+
+size_t pack_count(const pack_t* pack);
+
+// The pack's checksum, which names its files.
+void pack_name(const pack_t* pack, hash_t out);
+
+// The i-th id in sorted order.
+const uint8_t* pack_id_at(const pack_t* pack, size_t i);
+
+bool pack_contains(const pack_t* pack, const hash_t id);
+
+// Appends the object's content to out and copies its type to type.
+// Compressed entries are read with their dictionary from dicts. Returns
+// ERR_FILE_NOT_FOUND if the pack does not hold id, ERR_IO if the entry is
+// corrupt or its dictionary is missing.
+error_t pack_read(const pack_t* pack, const hash_t id, const dict_set_t* dicts, char type[ODB_TYPE_MAX],
+                  buffer_t* out);
+
+// Writes new packs as objects arrive. Nothing is visible to readers
+// until pack_writer_publish or pack_writer_finish renames the finished
+// files into place. One writer can publish any number of packs. It
+// merges the packs it published as it goes, so that it leaves O(log n)
+// of them after n publishes and one once it finishes. Its memory depends
+// on the size of the pack being written, not on what it published: it
+// keeps the current pack's entries and PACK_RECENT ids of earlier ones.
+typedef struct pack_writer pack_writer_t;
+
+error_t pack_writer_open(pack_writer_t** out, const char* objects_dir);
+
+// Adds an object whose id is id. With delta set, the object may be stored
+// as a delta against the last object of the same type added before it,
+// when that is smaller; callers put similar objects next to each other.
+error_t pack_writer_add(pack_writer_t* writer, const char* type, const char* data, size_t len,
+                        const hash_t id, bool delta);
+
+// Whether an object with this id was added to the current pack, or
+// recently to an earlier one. An id added long before may be missed;
+// adding it again stores a second copy, which merges leave out of the
+// index and gc drops.
+bool pack_writer_contains(const pack_writer_t* writer, const hash_t id);
+
+// Whole objects added from now on are compressed with compressor, which
+// must outlive the writer, wherever that pays.
+void pack_writer_set_compressor(pack_writer_t* writer, compressor_t* compressor);
+
+// Publishes the objects added since the last pack as a pack of their own
+// and starts the next one. The pack, its index and their directory
+// entries are synced before this returns, so the objects survive a crash
+// from then on. The newest packs are then merged while the one before
+// them is not more than twice their size; a merge copies their entries
+// and merges their indexes in constant memory, and removes them once the
+// merged pack is synced. name receives the name of the pack holding the
+// objects. Does nothing if no object was added; name is then left alone.
+error_t pack_writer_publish(pack_writer_t* writer, hash_t name);
+
+size_t pack_writer_count(const pack_writer_t* writer);
+size_t pack_writer_deltas(const pack_writer_t* writer);
+size_t pack_writer_compressed(const pack_writer_t* writer);
+
+// Publishes the last pack, merges every pack the writer published into
+// one and frees the writer; name receives its name. Only a writer that
+// has published nothing yet writes an empty pack.
+error_t pack_writer_finish(pack_writer_t* writer, hash_t name);
+
+// Frees the writer and removes its temporary file.
+void pack_writer_abort(pack_writer_t* writer);
+
+#endif
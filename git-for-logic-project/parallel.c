@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parallel.h"
+#include "pool.h"
+#include "arena.h"
+
+typedef struct {
+    field_t* fields;
+    size_t nfields;
+} record_t;
+
+typedef struct {
+    hash_t input_hash;
+    hash_t output_hash;
+    hash_t execution_hash;
+    uint32_t* applied;
+    size_t napplied;
+    str_t output_json;
+    str_t input_json;
+    str_t changes;
+    size_t* changes_end;
+} result_t;
+
+typedef struct {
+    parallel_t* par;
+    arena_t arena;              // records, then results; reset on reuse
+    record_t records[PARALLEL_CHUNK];
+    result_t results[PARALLEL_CHUNK];
+    size_t nrecords;
+    size_t nresults;
+    bool done;                  // guarded by par->lock
+    error_t err;
+} chunk_t;
+
+typedef struct {
+    engine_t engine;
+    batch_engine_t batch;
+} worker_state_t;
+
+struct parallel {
+    const ruleset_t* rules;
+    bool batched;
+    execution_fn fn;
+    void* ctx;
+
+    pool_t* pool;
+    worker_state_t* workers;
+    size_t nworkers;
+    size_t ninit;
+
+    // Chunks in flight form a ring: oldest is reported first, the one
+    // after the newest is being filled.
+    chunk_t* chunks;
+    size_t nchunks;
+    size_t oldest;
+    size_t inflight;
+    chunk_t* filling;
+
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+};
+
+static error_t store_result(void* ctx, const execution_t* result) {
+    chunk_t* chunk = (chunk_t*)ctx;
+    result_t* r = &chunk->results[chunk->nresults];
+    memcpy(r->input_hash, result->input_hash, sizeof(hash_t));
+    memcpy(r->output_hash, result->output_hash, sizeof(hash_t));
+    memcpy(r->execution_hash, result->execution_hash, sizeof(hash_t));
+    r->napplied = result->napplied;
+    r->applied = NULL;
+    r->changes_end = NULL;
+    if (result->napplied) {
+        r->applied = (uint32_t*)arena_alloc(&chunk->arena, result->napplied * sizeof(uint32_t));
+        r->changes_end = (size_t*)arena_alloc(&chunk->arena, result->napplied * sizeof(size_t));
+        if (!r->applied || !r->changes_end) return ERR_MALLOC_FAILED;
+        memcpy(r->applied, result->applied, result->napplied * sizeof(uint32_t));
+        memcpy(r->changes_end, result->changes_end, result->napplied * sizeof(size_t));
+    }
+    char* json = arena_strndup(&chunk->arena, result->output_json.ptr, result->output_json.len);
+    char* input = arena_strndup(&chunk->arena, result->input_json.ptr, result->input_json.len);
+    char* changes = arena_strndup(&chunk->arena, result->changes.ptr, result->changes.len);
+    if (!json || !input || !changes) return ERR_MALLOC_FAILED;
+    r->output_json = (str_t){ json, result->output_json.len };
+    r->input_json = (str_t){ input, result->input_json.len };
+    r->changes = (str_t){ changes, result->changes.len };
+    chunk->nresults++;
+    return ERR_OK;
+}
+
+static error_t run_chunk(chunk_t* chunk, worker_state_t* state, bool batched) {
+    error_t err = ERR_OK;
+    for (size_t i = 0; i < chunk->nrecords && err == ERR_OK; i++) {
+        const record_t* rec = &chunk->records[i];
+        if (batched) {
+            err = batch_append(&state->batch, rec->fields, rec->nfields);
+        } else {
+            execution_t result;
+            err = engine_run(&state->engine, rec->fields, rec->nfields, &result);
+            if (err == ERR_OK) err = store_result(chunk, &result);
+        }
+    }
+    if (batched && err == ERR_OK) err = batch_flush(&state->batch, store_result, chunk);
+    return err;
+}
+
+static void chunk_task(void* arg, size_t worker) {
+    chunk_t* chunk = (chunk_t*)arg;
+    parallel_t* par = chunk->par;
+    error_t err = run_chunk(chunk, &par->workers[worker], par->batched);
+
+    pthread_mutex_lock(&par->lock);
+    chunk->err = err;
+    chunk->done = true;
+    pthread_cond_broadcast(&par->done);
+    pthread_mutex_unlock(&par->lock);
+}
+
+// Waits for the oldest chunk in flight, reports it and recycles it.
+static error_t report_oldest(parallel_t* par) {
+    chunk_t* chunk = &par->chunks[par->oldest];
+    pthread_mutex_lock(&par->lock);
+    while (!chunk->done) pthread_cond_wait(&par->done, &par->lock);
+    pthread_mutex_unlock(&par->lock);
+
+    error_t err = chunk->err;
+    for (size_t i = 0; i < chunk->nresults && err == ERR_OK; i++) {
+        const result_t* r = &chunk->results[i];
+        execution_t result;
+        memcpy(result.input_hash, r->input_hash, sizeof(hash_t));
+        memcpy(result.output_hash, r->output_hash, sizeof(hash_t));
+        memcpy(result.execution_hash, r->execution_hash, sizeof(hash_t));
+        result.applied = r->applied;
+        result.napplied = r->napplied;
+        result.state = NULL;
+        result.nstate = 0;
+        result.output_json = r->output_json;
+        result.input_json = r->input_json;
+        result.changes = r->changes;
+        result.changes_end = r->changes_end;
+        err = par->fn(par->ctx, &result);
+    }
+
+    arena_reset(&chunk->arena);
+    chunk->nrecords = 0;
+    chunk->nresults = 0;
+    chunk->done = false;
+    par->oldest = (par->oldest + 1) % par->nchunks;
+    par->inflight--;
+    return err;
+}
+
+static error_t submit_filling(parallel_t* par) {
+    chunk_t* chunk = par->filling;
+    par->filling = NULL;
+    par->inflight++;
+    error_t err = pool_submit(par->pool, chunk_task, chunk);
+    if (err != ERR_OK) {
+        // Still counts as in flight; report_oldest hands back the error.
+        pthread_mutex_lock(&par->lock);
+        chunk->err = err;
+        chunk->done = true;
+        pthread_mutex_unlock(&par->lock);
+    }
+    return err;
+}
+
+error_t parallel_create(parallel_t** out, const ruleset_t* rules, const hash_t rules_hash,
+                        size_t jobs, bool batch, execution_fn fn, void* ctx) {
+    if (!out || !rules || !rules_hash || !fn) return ERR_NULL_PTR;
+    if (jobs == 0) jobs = 1;
+    parallel_t* par = (parallel_t*)calloc(1, sizeof(parallel_t));
+    if (!par) return ERR_MALLOC_FAILED;
+    par->rules = rules;
+    par->batched = batch;
+    par->fn = fn;
+    par->ctx = ctx;
+    par->nworkers = jobs;
+    // Enough chunks to keep every worker busy while the oldest is being
+    // reported and the next one filled.
+    par->nchunks = 2 * jobs + 2;
+    pthread_mutex_init(&par->lock, NULL);
+    pthread_cond_init(&par->done, NULL);
+
+    error_t err = ERR_OK;
+    par->workers = (worker_state_t*)calloc(jobs, sizeof(worker_state_t));
+    par->chunks = (chunk_t*)calloc(par->nchunks, sizeof(chunk_t));
+    if (!par->workers || !par->chunks) err = ERR_MALLOC_FAILED;
+    for (size_t i = 0; err == ERR_OK && i < par->nchunks; i++) {
+        par->chunks[i].par = par;
+        arena_init(&par->chunks[i].arena, 0);
+    }
+    for (; err == ERR_OK && par->ninit < jobs; par->ninit++) {
+        worker_state_t* w = &par->workers[par->ninit];
+        err = batch ? batch_init(&w->batch, rules, rules_hash)
+                    : engine_init(&w->engine, rules, rules_hash);
+        if (err != ERR_OK) break;
+    }
+    if (err == ERR_OK) err = pool_create(&par->pool, jobs);
+    if (err != ERR_OK) {
+        parallel_destroy(par);
+        return err;
+    }
+    *out = par;
+    return ERR_OK;
+}
+
+error_t parallel_append(parallel_t* par, const field_t* fields, size_t nfields) {
+    if (!par || (!fields && nfields)) return ERR_NULL_PTR;
+    if (!par->filling) {
+        if (par->inflight == par->nchunks) {
+            error_t err = report_oldest(par);
+            if (err != ERR_OK) return err;
+        }
+        par->filling = &par->chunks[(par->oldest + par->inflight) % par->nchunks];
+    }
+
+    chunk_t* chunk = par->filling;
+    record_t* rec = &chunk->records[chunk->nrecords];
+    rec->nfields = nfields;
+    rec->fields = (field_t*)arena_alloc(&chunk->arena, (nfields ? nfields : 1) * sizeof(field_t));
+    if (!rec->fields) return ERR_MALLOC_FAILED;
+    for (size_t i = 0; i < nfields; i++) {
+        field_t f = fields[i];
+        f.name.ptr = arena_strndup(&chunk->arena, f.name.ptr, f.name.len);
+        if (!f.name.ptr) return ERR_MALLOC_FAILED;
+        if (f.value.type == VAL_STR || f.value.type == VAL_RAW) {
+            f.value.as.str.ptr = arena_strndup(&chunk->arena, f.value.as.str.ptr, f.value.as.str.len);
+            if (!f.value.as.str.ptr) return ERR_MALLOC_FAILED;
+        }
+        rec->fields[i] = f;
+    }
+    chunk->nrecords++;
+    if (chunk->nrecords == PARALLEL_CHUNK) return submit_filling(par);
+    return ERR_OK;
+}
+
+error_t parallel_finish(parallel_t* par) {
+    if (!par) return ERR_NULL_PTR;
+    error_t err = ERR_OK;
+    if (par->filling && par->filling->nrecords) err = submit_filling(par);
+    while (par->inflight) {
+        error_t e = report_oldest(par);
+        if (err == ERR_OK) err = e;
+    }
+    return err;
+}
+
+void parallel_destroy(parallel_t* par) {
+    if (!par) return;
+    // Let queued chunks finish before their engines and arenas go away.
+    pool_destroy(par->pool);
+    for (size_t i = 0; i < par->ninit; i++) {
+        if (par->batched) batch_free(&par->workers[i].batch);
+        else engine_free(&par->workers[i].engine);
+    }
+    if (par->chunks) {
+        for (size_t i = 0; i < par->nchunks; i++) arena_free(&par->chunks[i].arena);
+    }
+    pthread_mutex_destroy(&par->lock);
+    pthread_cond_destroy(&par->done);
+    free(par->workers);
+    free(par->chunks);
+    free(par);
+}
@@ -0,0 +1,35 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "git_for_logic.h"
+#include "rules.h"
+#include "batch.h"
+
+// Parallel record executor. Appended records are copied into chunks of
+// PARALLEL_CHUNK records; full chunks go to a work-stealing pool
+// (pool.c) where each worker runs them through its own engine_t, or its
+// own batch_engine_t in batch mode. The calling thread reports finished
+// chunks to fn strictly in append order, so anything fn chains (commit
+// parents, record numbers, output) is identical to a serial run.
+//
+// The execution_t passed to fn carries the hashes, applied rules, input
+// and output JSON and the changes; state is not kept (state is NULL,
+// nstate is 0).
+
+#define PARALLEL_CHUNK BATCH_LANES
+
+typedef struct parallel parallel_t;
+
+error_t parallel_create(parallel_t** out, const ruleset_t* rules, const hash_t rules_hash,
+                        size_t jobs, bool batch, execution_fn fn, void* ctx);
+
+// Copies one record into the current chunk. May block until the oldest
+// chunk in flight is done, and report it, to bound memory.
+error_t parallel_append(parallel_t* par, const field_t* fields, size_t nfields);
+
+// Runs the remaining records and reports every result still pending.
+error_t parallel_finish(parallel_t* par);
+
+void parallel_destroy(parallel_t* par);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "pool.h"
+
+typedef struct {
+    task_fn fn;
+    void* arg;
+} task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    task_t* ring;
+    size_t cap;                 // power of two
+    size_t head;
+    size_t count;
+} deque_t;
+
+typedef struct {
+    pool_t* pool;
+    size_t id;
+} worker_t;
+
+struct pool {
+    pthread_t* threads;
+    worker_t* workers;
+    deque_t* deques;
+    size_t nworkers;
+    size_t started;
+    size_t next;                // deque the next submit goes to
+
+    pthread_mutex_t lock;       // guards queued and stop
+    pthread_cond_t wake;
+    size_t queued;
+    bool stop;
+};
+
+static bool deque_push_back(deque_t* d, task_t task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 16;
+        task_t* ring = (task_t*)malloc(cap * sizeof(task_t));
+        if (!ring) {
+            pthread_mutex_unlock(&d->lock);
+            return false;
+        }
+        for (size_t i = 0; i < d->count; i++) ring[i] = d->ring[(d->head + i) & (d->cap - 1)];
+        free(d->ring);
+        d->ring = ring;
+        d->cap = cap;
+        d->head = 0;
+    }
+    d->ring[(d->head + d->count) & (d->cap - 1)] = task;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return true;
+}
+
+static bool deque_pop_front(deque_t* d, task_t* out) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->count > 0;
+    if (ok) {
+        *out = d->ring[d->head];
+        d->head = (d->head + 1) & (d->cap - 1);
+        d->count--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static bool deque_steal_back(deque_t* d, task_t* out) {
+    pthread_mutex_lock(&d->lock);
+    bool ok = d->count > 0;
+    if (ok) {
+        d->count--;
+        *out = d->ring[(d->head + d->count) & (d->cap - 1)];
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static bool take_task(pool_t* pool, size_t id, task_t* out) {
+    if (deque_pop_front(&pool->deques[id], out)) return true;
+    for (size_t i = 1; i < pool->nworkers; i++) {
+        if (deque_steal_back(&pool->deques[(id + i) % pool->nworkers], out)) return true;
+    }
+    return false;
+}
+
+static void* worker_main(void* arg) {
+    worker_t* worker = (worker_t*)arg;
+    pool_t* pool = worker->pool;
+    for (;;) {
+        task_t task;
+        if (take_task(pool, worker->id, &task)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->queued--;
+            pthread_mutex_unlock(&pool->lock);
+            task.fn(task.arg, worker->id);
+            continue;
+        }
+        // Nothing visible. A task counted in queued may still be in the
+        // middle of being pushed or taken, so only sleep once it is gone.
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->stop) pthread_cond_wait(&pool->wake, &pool->lock);
+        bool done = pool->stop && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (done) return NULL;
+    }
+}
+
+error_t pool_create(pool_t** out, size_t nworkers) {
+    if (!out) return ERR_NULL_PTR;
+    if (nworkers == 0) nworkers = 1;
+    pool_t* pool = (pool_t*)calloc(1, sizeof(pool_t));
+    if (!pool) return ERR_MALLOC_FAILED;
+    pool->nworkers = nworkers;
+    pool->threads = (pthread_t*)calloc(nworkers, sizeof(pthread_t));
+    pool->workers = (worker_t*)calloc(nworkers, sizeof(worker_t));
+    pool->deques = (deque_t*)calloc(nworkers, sizeof(deque_t));
+    if (!pool->threads || !pool->workers || !pool->deques) {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool->deques);
+        free(pool);
+        return ERR_MALLOC_FAILED;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for (size_t i = 0; i < nworkers; i++) pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    for (size_t i = 0; i < nworkers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->workers[i]) != 0) break;
+        pool->started++;
+    }
+    *out = pool;
+    if (pool->started == 0) {
+        pool_destroy(pool);
+        *out = NULL;
+        return ERR_MALLOC_FAILED;
+    }
+    return ERR_OK;
+}
+
+error_t pool_submit(pool_t* pool, task_fn fn, void* arg) {
+    if (!pool || !fn) return ERR_NULL_PTR;
+    // Only started workers own a deque that someone will drain.
+    deque_t* d = &pool->deques[pool->next++ % pool->started];
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pthread_mutex_unlock(&pool->lock);
+    if (!deque_push_back(d, (task_t){ fn, arg })) {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+        return ERR_MALLOC_FAILED;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    return ERR_OK;
+}
+
+void pool_destroy(pool_t* pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < pool->started; i++) pthread_join(pool->threads[i], NULL);
+
+    for (size_t i = 0; i < pool->nworkers; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].ring);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
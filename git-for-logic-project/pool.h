@@ -0,0 +1,24 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include "git_for_logic.h"
+
+// Fixed-size thread pool with one deque per worker. Submitted tasks are
+// dealt round-robin onto the deques; a worker takes the oldest task from
+// the front of its own deque and, when that is empty, steals the newest
+// task from the back of another worker's. Tasks run in no particular
+// order; callers that need ordered results sequence them themselves.
+
+typedef void (*task_fn)(void* arg, size_t worker);
+
+typedef struct pool pool_t;
+
+error_t pool_create(pool_t** out, size_t nworkers);
+
+error_t pool_submit(pool_t* pool, task_fn fn, void* arg);
+
+// Runs every queued task, then stops and joins the workers.
+void pool_destroy(pool_t* pool);
+
+#endif
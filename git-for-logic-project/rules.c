@@ -0,0 +1,608 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rules.h"
+
+#define NAME_SORT_RUN 16
+
+// Block-style YAML reader for the rules schema. Supports nested block
+// mappings and sequences, plain / single-quoted / double-quoted scalars,
+// `|` and `>` block scalars and comments. Flow collections, anchors and
+// multi-document files are rejected.
+
+typedef struct {
+    const char* src;
+    size_t len;
+    size_t next;        // offset of the first unread physical line
+    size_t line_no;     // physical line number of `next - 1`
+    arena_t* arena;
+
+    bool has_line;      // current logical line loaded and not consumed
+    size_t indent;
+    str_t text;         // line content after indentation, trimmed
+    size_t line;        // line number of the current logical line
+} yaml_t;
+
+typedef struct list_node {
+    struct list_node* next;
+    void* item;
+} list_node_t;
+
+typedef struct {
+    list_node_t* head;
+    list_node_t* tail;
+    size_t count;
+} list_t;
+
+static error_t yaml_error(size_t line, const char* msg) {
+    fprintf(stderr, "❌ Invalid rules (line %zu): %s\n", line, msg);
+    return ERR_INVALID_YAML;
+}
+
+static error_t list_push(arena_t* arena, list_t* list, void* item) {
+    list_node_t* node = (list_node_t*)arena_alloc(arena, sizeof(list_node_t));
+    if (!node) return ERR_MALLOC_FAILED;
+    node->next = NULL;
+    node->item = item;
+    if (list->tail) list->tail->next = node;
+    else list->head = node;
+    list->tail = node;
+    list->count++;
+    return ERR_OK;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static str_t trim(str_t s) {
+    while (s.len && is_space(s.ptr[0])) {
+        s.ptr++;
+        s.len--;
+    }
+    while (s.len && is_space(s.ptr[s.len - 1])) s.len--;
+    return s;
+}
+
+// Loads the next non-blank, non-comment line into the cursor.
+static bool peek(yaml_t* y) {
+    while (!y->has_line && y->next < y->len) {
+        size_t start = y->next;
+        const char* eol = (const char*)memchr(y->src + start, '\n', y->len - start);
+        size_t end = eol ? (size_t)(eol - y->src) : y->len;
+        y->next = eol ? end + 1 : y->len;
+        y->line_no++;
+
+        size_t i = start;
+        while (i < end && y->src[i] == ' ') i++;
+        size_t stop = end;
+        while (stop > i && (y->src[stop - 1] == '\r' || is_space(y->src[stop - 1]))) stop--;
+        if (i == stop || y->src[i] == '#') continue;
+        if (i == start && stop - i == 3 && memcmp(y->src + i, "---", 3) == 0) continue;
+
+        y->has_line = true;
+        y->indent = i - start;
+        y->text = (str_t){ y->src + i, stop - i };
+        y->line = y->line_no;
+    }
+    return y->has_line;
+}
+
+static void consume(yaml_t* y) {
+    y->has_line = false;
+}
+
+static bool is_seq_item(str_t text) {
+    return text.len && text.ptr[0] == '-' && (text.len == 1 || text.ptr[1] == ' ');
+}
+
+// Turns a `- key: value` line into the first line of a mapping that starts
+// after the dash, so sequences of mappings reuse the mapping parser.
+static bool enter_seq_item(yaml_t* y) {
+    size_t skip = 1;
+    while (skip < y->text.len && y->text.ptr[skip] == ' ') skip++;
+    if (skip >= y->text.len) {
+        consume(y);
+        return false;
+    }
+    y->indent += skip;
+    y->text.ptr += skip;
+    y->text.len -= skip;
+    return true;
+}
+
+static error_t split_key(const yaml_t* y, str_t* key, str_t* rest) {
+    str_t text = y->text;
+    if (text.ptr[0] == '\t') return yaml_error(y->line, "tabs are not allowed for indentation");
+
+    size_t colon = 0;
+    if (text.ptr[0] == '"' || text.ptr[0] == '\'') {
+        const char* close = (const char*)memchr(text.ptr + 1, text.ptr[0], text.len - 1);
+        if (!close) return yaml_error(y->line, "unterminated quoted key");
+        *key = (str_t){ text.ptr + 1, (size_t)(close - text.ptr - 1) };
+        colon = (size_t)(close - text.ptr) + 1;
+        if (colon >= text.len || text.ptr[colon] != ':') return yaml_error(y->line, "expected ':' after key");
+    } else {
+        for (colon = 0; colon < text.len; colon++) {
+            if (text.ptr[colon] == ':' && (colon + 1 == text.len || is_space(text.ptr[colon + 1]))) break;
+        }
+        if (colon == text.len) return yaml_error(y->line, "expected 'key: value'");
+        *key = trim((str_t){ text.ptr, colon });
+    }
+    *rest = trim((str_t){ text.ptr + colon + 1, text.len - colon - 1 });
+    return ERR_OK;
+}
+
+static error_t parse_quoted(yaml_t* y, str_t rest, size_t line, scalar_t* out) {
+    char quote = rest.ptr[0];
+    bool escaped = false;
+    size_t i = 1;
+    for (; i < rest.len; i++) {
+        if (quote == '"' && rest.ptr[i] == '\\') {
+            escaped = true;
+            i++;
+        } else if (rest.ptr[i] == quote) {
+            if (quote == '\'' && i + 1 < rest.len && rest.ptr[i + 1] == '\'') {
+                escaped = true;
+                i++;
+            } else {
+                break;
+            }
+        }
+    }
+    if (i >= rest.len) return yaml_error(line, "unterminated quoted string");
+
+    str_t after = trim((str_t){ rest.ptr + i + 1, rest.len - i - 1 });
+    if (after.len && after.ptr[0] != '#') return yaml_error(line, "unexpected text after quoted string");
+
+    str_t inner = { rest.ptr + 1, i - 1 };
+    out->style = quote == '"' ? SCALAR_DOUBLE_QUOTED : SCALAR_SINGLE_QUOTED;
+    out->line = line;
+    if (!escaped) {
+        out->text = inner;
+        return ERR_OK;
+    }
+
+    char* buf = (char*)arena_alloc(y->arena, inner.len + 1);
+    if (!buf) return ERR_MALLOC_FAILED;
+    size_t n = 0;
+    for (size_t j = 0; j < inner.len; j++) {
+        char c = inner.ptr[j];
+        if (quote == '\'' && c == '\'') {
+            j++;
+        } else if (quote == '"' && c == '\\' && j + 1 < inner.len) {
+            c = inner.ptr[++j];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                default: break;
+            }
+        }
+        buf[n++] = c;
+    }
+    buf[n] = '\0';
+    out->text = (str_t){ buf, n };
+    return ERR_OK;
+}
+
+// `|` keeps line breaks, `>` folds them into spaces. Chomping: `-` strips
+// the final newline, `+` keeps trailing blank lines, default keeps one.
+static error_t parse_block_scalar(yaml_t* y, str_t rest, size_t parent_indent, size_t line, scalar_t* out) {
+    bool folded = rest.ptr[0] == '>';
+    char chomp = rest.len > 1 ? rest.ptr[1] : ' ';
+
+    // First pass: find the extent and the content indentation.
+    size_t content_indent = 0;
+    size_t pos = y->next;
+    size_t end_pos = pos;
+    size_t bytes = 0;
+    while (pos < y->len) {
+        const char* eol = (const char*)memchr(y->src + pos, '\n', y->len - pos);
+        size_t end = eol ? (size_t)(eol - y->src) : y->len;
+        size_t i = pos;
+        while (i < end && y->src[i] == ' ') i++;
+        bool blank = i == end || (i + 1 == end && y->src[i] == '\r');
+        if (!blank) {
+            if (i - pos <= parent_indent) break;
+            if (!content_indent) content_indent = i - pos;
+            if (i - pos < content_indent) break;
+        }
+        bytes += end - pos + 1;
+        pos = eol ? end + 1 : y->len;
+        if (!blank) end_pos = pos;
+    }
+    if (chomp == '+') end_pos = pos;
+
+    char* buf = (char*)arena_alloc(y->arena, bytes + 1);
+    if (!buf) return ERR_MALLOC_FAILED;
+    size_t n = 0;
+    size_t cur = y->next;
+    while (cur < end_pos) {
+        const char* eol = (const char*)memchr(y->src + cur, '\n', end_pos - cur);
+        size_t end = eol ? (size_t)(eol - y->src) : end_pos;
+        size_t stop = end;
+        if (stop > cur && y->src[stop - 1] == '\r') stop--;
+        size_t start = cur + content_indent < stop ? cur + content_indent : stop;
+        if (n && folded && start < stop && buf[n - 1] == '\n' && (n < 2 || buf[n - 2] != '\n')) {
+            buf[n - 1] = ' ';
+        }
+        memcpy(buf + n, y->src + start, stop - start);
+        n += stop - start;
+        buf[n++] = '\n';
+        cur = eol ? end + 1 : end_pos;
+    }
+    if (chomp == '-') {
+        while (n && buf[n - 1] == '\n') n--;
+    } else if (chomp != '+') {
+        while (n > 1 && buf[n - 1] == '\n' && buf[n - 2] == '\n') n--;
+    }
+    buf[n] = '\0';
+
+    // Skip the consumed physical lines.
+    for (size_t i = y->next; i < end_pos; i++) {
+        if (y->src[i] == '\n') y->line_no++;
+    }
+    if (end_pos > y->next && y->src[end_pos - 1] != '\n') y->line_no++;
+    y->next = end_pos;
+
+    out->text = (str_t){ buf, n };
+    out->style = SCALAR_BLOCK;
+    out->line = line;
+    return ERR_OK;
+}
+
+// Parses the value part of a `key: value` line whose line has already been
+// consumed.
+static error_t parse_scalar(yaml_t* y, str_t rest, size_t parent_indent, size_t line, scalar_t* out) {
+    switch (rest.ptr[0]) {
+        case '"':
+        case '\'':
+            return parse_quoted(y, rest, line, out);
+        case '|':
+        case '>':
+            return parse_block_scalar(y, rest, parent_indent, line, out);
+        case '[':
+        case '{':
+            return yaml_error(line, "flow collections are not supported");
+        case '&':
+        case '*':
+            return yaml_error(line, "anchors and aliases are not supported");
+        default:
+            break;
+    }
+
+    size_t n = rest.len;
+    for (size_t i = 1; i < rest.len; i++) {
+        if (rest.ptr[i] == '#' && is_space(rest.ptr[i - 1])) {
+            n = i;
+            break;
+        }
+    }
+    out->text = trim((str_t){ rest.ptr, n });
+    out->style = SCALAR_PLAIN;
+    out->line = line;
+    return ERR_OK;
+}
+
+// Consumes every line nested deeper than `indent` (plus sequence items at
+// `indent`, which YAML allows under a mapping key).
+static void skip_block(yaml_t* y, size_t indent) {
+    while (peek(y) && (y->indent > indent || (y->indent == indent && is_seq_item(y->text)))) {
+        consume(y);
+    }
+}
+
+static error_t parse_int(const scalar_t* s, int64_t* out) {
+    str_t t = s->text;
+    bool neg = false;
+    size_t i = 0;
+    if (s->style != SCALAR_PLAIN || t.len == 0) return yaml_error(s->line, "priority must be an integer");
+    if (t.ptr[0] == '-' || t.ptr[0] == '+') {
+        neg = t.ptr[0] == '-';
+        i++;
+    }
+    if (i == t.len) return yaml_error(s->line, "priority must be an integer");
+    int64_t v = 0;
+    for (; i < t.len; i++) {
+        char c = t.ptr[i];
+        if (c < '0' || c > '9') return yaml_error(s->line, "priority must be an integer");
+        if (v > (INT64_MAX - (c - '0')) / 10) return yaml_error(s->line, "priority out of range");
+        v = v * 10 + (c - '0');
+    }
+    *out = neg ? -v : v;
+    return ERR_OK;
+}
+
+static error_t parse_metadata(yaml_t* y, ruleset_t* rules, size_t parent_indent) {
+    if (!peek(y) || y->indent <= parent_indent) return ERR_OK;
+    size_t map_indent = y->indent;
+
+    while (peek(y) && y->indent > parent_indent) {
+        if (y->indent != map_indent) return yaml_error(y->line, "bad indentation in metadata");
+        str_t key, rest;
+        error_t err = split_key(y, &key, &rest);
+        if (err != ERR_OK) return err;
+        size_t line = y->line;
+        consume(y);
+
+        if (rest.len == 0) {
+            skip_block(y, map_indent);
+            continue;
+        }
+        scalar_t value;
+        err = parse_scalar(y, rest, map_indent, line, &value);
+        if (err != ERR_OK) return err;
+        if (str_eq(key, STR_LIT("name"))) rules->name = value.text;
+        else if (str_eq(key, STR_LIT("version"))) rules->version = value.text;
+        else if (str_eq(key, STR_LIT("description"))) rules->description = value.text;
+    }
+    return ERR_OK;
+}
+
+// `then` mappings may nest; nested keys are flattened to dotted paths the
+// same way legacy setNestedValue splits them.
+static error_t parse_then(yaml_t* y, list_t* out, size_t parent_indent, str_t prefix) {
+    if (!peek(y) || y->indent <= parent_indent) return ERR_OK;
+    size_t map_indent = y->indent;
+
+    while (peek(y) && y->indent > parent_indent) {
+        if (y->indent != map_indent) return yaml_error(y->line, "bad indentation in then");
+        str_t key, rest;
+        error_t err = split_key(y, &key, &rest);
+        if (err != ERR_OK) return err;
+        size_t line = y->line;
+        consume(y);
+
+        if (prefix.len) {
+            char* joined = (char*)arena_alloc(y->arena, prefix.len + 1 + key.len);
+            if (!joined) return ERR_MALLOC_FAILED;
+            memcpy(joined, prefix.ptr, prefix.len);
+            joined[prefix.len] = '.';
+            memcpy(joined + prefix.len + 1, key.ptr, key.len);
+            key = (str_t){ joined, prefix.len + 1 + key.len };
+        }
+
+        if (rest.len == 0) {
+            err = parse_then(y, out, map_indent, key);
+            if (err != ERR_OK) return err;
+            continue;
+        }
+
+        assignment_t* a = (assignment_t*)arena_alloc(y->arena, sizeof(assignment_t));
+        if (!a) return ERR_MALLOC_FAILED;
+        memset(a, 0, sizeof(*a));
+        a->field = key;
+        err = parse_scalar(y, rest, map_indent, line, &a->value);
+        if (err != ERR_OK) return err;
+        err = list_push(y->arena, out, a);
+        if (err != ERR_OK) return err;
+    }
+    return ERR_OK;
+}
+
+static error_t parse_rule(yaml_t* y, rule_t* rule, size_t seq_indent) {
+    if (!peek(y) || y->indent <= seq_indent) return yaml_error(y->line, "empty rule");
+    size_t map_indent = y->indent;
+    bool has_when = false;
+    list_t then = { 0 };
+
+    rule->priority = RULE_DEFAULT_PRIORITY;
+    rule->line = y->line;
+
+    while (peek(y) && y->indent > seq_indent) {
+        if (y->indent != map_indent) return yaml_error(y->line, "bad indentation in rule");
+        str_t key, rest;
+        error_t err = split_key(y, &key, &rest);
+        if (err != ERR_OK) return err;
+        size_t line = y->line;
+        consume(y);
+
+        if (str_eq(key, STR_LIT("then"))) {
+            if (rest.len) return yaml_error(line, "then must be a mapping");
+            err = parse_then(y, &then, map_indent, (str_t){ NULL, 0 });
+            if (err != ERR_OK) return err;
+            continue;
+        }
+        if (rest.len == 0) {
+            skip_block(y, map_indent);
+            continue;
+        }
+
+        scalar_t value;
+        err = parse_scalar(y, rest, map_indent, line, &value);
+        if (err != ERR_OK) return err;
+        if (str_eq(key, STR_LIT("name"))) {
+            rule->name = value.text;
+        } else if (str_eq(key, STR_LIT("priority"))) {
+            err = parse_int(&value, &rule->priority);
+            if (err != ERR_OK) return err;
+            // Legacy sorts by `priority || 999`, so 0 is the default too.
+            if (rule->priority == 0) rule->priority = RULE_DEFAULT_PRIORITY;
+        } else if (str_eq(key, STR_LIT("when"))) {
+            rule->when = value;
+            has_when = true;
+        }
+    }
+
+    if (!rule->name.len) return yaml_error(rule->line, "rule has no name");
+    if (!has_when) return yaml_error(rule->line, "rule has no when condition");
+
+    rule->nthen = then.count;
+    if (then.count) {
+        rule->then = (assignment_t*)arena_alloc(y->arena, then.count * sizeof(assignment_t));
+        if (!rule->then) return ERR_MALLOC_FAILED;
+        size_t i = 0;
+        for (list_node_t* n = then.head; n; n = n->next) {
+            rule->then[i++] = *(assignment_t*)n->item;
+        }
+    }
+    return ERR_OK;
+}
+
+static error_t parse_rules(yaml_t* y, list_t* out, size_t parent_indent) {
+    if (!peek(y) || y->indent < parent_indent) return ERR_OK;
+    size_t seq_indent = y->indent;
+
+    while (peek(y) && y->indent == seq_indent && is_seq_item(y->text)) {
+        bool inline_map = enter_seq_item(y);
+        if (!inline_map && (!peek(y) || y->indent <= seq_indent)) {
+            return yaml_error(y->line_no, "empty rule");
+        }
+
+        rule_t* rule = (rule_t*)arena_alloc(y->arena, sizeof(rule_t));
+        if (!rule) return ERR_MALLOC_FAILED;
+        memset(rule, 0, sizeof(*rule));
+        error_t err = parse_rule(y, rule, seq_indent);
+        if (err != ERR_OK) return err;
+        err = list_push(y->arena, out, rule);
+        if (err != ERR_OK) return err;
+    }
+    if (peek(y) && y->indent > parent_indent) {
+        return yaml_error(y->line, "expected '- ' rule entry");
+    }
+    return ERR_OK;
+}
+
+static int compare_rules(const void* a, const void* b) {
+    const rule_t* ra = (const rule_t*)a;
+    const rule_t* rb = (const rule_t*)b;
+    if (ra->priority != rb->priority) return ra->priority < rb->priority ? -1 : 1;
+    // Source order breaks ties so the sort is stable.
+    return (ra->line > rb->line) - (ra->line < rb->line);
+}
+
+static error_t parse_document(yaml_t* y, ruleset_t* rules) {
+    list_t list = { 0 };
+    bool has_rules = false;
+
+    while (peek(y)) {
+        if (y->indent != 0) return yaml_error(y->line, "unexpected indentation");
+        if (y->text.len == 3 && memcmp(y->text.ptr, "...", 3) == 0) break;
+        str_t key, rest;
+        error_t err = split_key(y, &key, &rest);
+        if (err != ERR_OK) return err;
+        size_t line = y->line;
+        consume(y);
+
+        if (str_eq(key, STR_LIT("metadata"))) {
+            if (rest.len) return yaml_error(line, "metadata must be a mapping");
+            err = parse_metadata(y, rules, 0);
+        } else if (str_eq(key, STR_LIT("rules"))) {
+            if (rest.len) return yaml_error(line, "rules must be a sequence");
+            has_rules = true;
+            err = parse_rules(y, &list, 0);
+        } else {
+            skip_block(y, 0);
+        }
+        if (err != ERR_OK) return err;
+    }
+    if (!has_rules) return yaml_error(y->line_no, "missing top-level 'rules' sequence");
+
+    rules->nrules = list.count;
+    if (list.count) {
+        rules->rules = (rule_t*)arena_alloc(&rules->arena, list.count * sizeof(rule_t));
+        if (!rules->rules) return ERR_MALLOC_FAILED;
+        size_t i = 0;
+        for (list_node_t* n = list.head; n; n = n->next) {
+            rules->rules[i++] = *(rule_t*)n->item;
+        }
+        qsort(rules->rules, rules->nrules, sizeof(rule_t), compare_rules);
+    }
+    return ERR_OK;
+}
+
+// Conditions and assignment targets first: together they are the fields
+// a plain `then` value may name (expr_compile_value).
+static error_t compile_rules(ruleset_t* rules) {
+    program_t* prog = &rules->program;
+    for (size_t i = 0; i < rules->nrules; i++) {
+        rule_t* rule = &rules->rules[i];
+        error_t err = expr_compile(prog, rule->when.text, &rule->cond);
+        if (err != ERR_OK) {
+            fprintf(stderr, "❌ Invalid rules (line %zu): bad condition in rule \"%.*s\"\n",
+                    rule->when.line, (int)rule->name.len, rule->name.ptr);
+            return err;
+        }
+        for (size_t j = 0; j < rule->nthen; j++) {
+            err = program_intern_field(prog, rule->then[j].field, &rule->then[j].symbol);
+            if (err != ERR_OK) return err;
+        }
+    }
+    for (size_t i = 0; i < rules->nrules; i++) {
+        rule_t* rule = &rules->rules[i];
+        for (size_t j = 0; j < rule->nthen; j++) {
+            assignment_t* a = &rule->then[j];
+            error_t err = a->value.style == SCALAR_PLAIN ? expr_compile_value(prog, a->value.text, &a->expr)
+                                                         : expr_compile_literal(prog, a->value.text, &a->expr);
+            if (err != ERR_OK) return err;
+        }
+    }
+    return ERR_OK;
+}
+
+error_t ruleset_load(ruleset_t* rules, const char* source, size_t len) {
+    if (!rules) return ERR_NULL_PTR;
+    memset(rules, 0, sizeof(*rules));
+    arena_init(&rules->arena, 0);
+    program_init(&rules->program);
+    rules->source = source;
+    rules->source_len = len;
+    if (!source) return ERR_NULL_PTR;
+
+    yaml_t y = { .src = source, .len = len, .arena = &rules->arena };
+    error_t err = parse_document(&y, rules);
+    if (err == ERR_OK) err = compile_rules(rules);
+    if (err != ERR_OK) {
+        ruleset_free(rules);
+        return err;
+    }
+    return ERR_OK;
+}
+
+void ruleset_free(ruleset_t* rules) {
+    if (!rules) return;
+    program_free(&rules->program);
+    arena_free(&rules->arena);
+    rules->source = NULL;
+    rules->rules = NULL;
+    rules->nrules = 0;
+}
+
+static int name_cmp(str_t a, str_t b) {
+    size_t n = a.len < b.len ? a.len : b.len;
+    int c = n ? memcmp(a.ptr, b.ptr, n) : 0;
+    if (c != 0) return c;
+    return (a.len > b.len) - (a.len < b.len);
+}
+
+// Merge sort like execute.c's sort_paths: runs of NAME_SORT_RUN are
+// insertion sorted, then merged back and forth between names and tmp.
+void sort_rule_names(str_t* names, str_t* tmp, size_t n) {
+    for (size_t lo = 0; lo < n; lo += NAME_SORT_RUN) {
+        size_t hi = lo + NAME_SORT_RUN < n ? lo + NAME_SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            str_t s = names[i];
+            size_t j = i;
+            for (; j > lo && name_cmp(names[j - 1], s) > 0; j--) names[j] = names[j - 1];
+            names[j] = s;
+        }
+    }
+    str_t* src = names;
+    str_t* dst = tmp;
+    for (size_t width = NAME_SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) dst[k++] = name_cmp(src[j], src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid) dst[k++] = src[i++];
+            while (j < hi) dst[k++] = src[j++];
+        }
+        str_t* swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != names) memcpy(names, src, n * sizeof(*names));
+}
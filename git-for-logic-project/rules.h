@@ -0,0 +1,81 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include "git_for_logic.h"
+#include "value.h"
+#include "arena.h"
+#include "expr.h"
+
+// Typed AST for the rules schema:
+//
+//   metadata: { name, version, description }
+//   rules:
+//     - name: ...
+//       priority: <int>     (default 999, also for 0)
+//       when: <expression>
+//       then: { <field>: <value expression>, ... }
+//
+// All nodes live in the ruleset's arena and all strings are slices of the
+// source buffer, except quoted scalars with escapes and block scalars,
+// which are unescaped into the arena.
+
+#define RULE_DEFAULT_PRIORITY 999
+
+typedef enum {
+    SCALAR_PLAIN = 0,
+    SCALAR_SINGLE_QUOTED,
+    SCALAR_DOUBLE_QUOTED,
+    SCALAR_BLOCK,
+} scalar_style_t;
+
+typedef struct {
+    str_t text;
+    scalar_style_t style;
+    size_t line;
+} scalar_t;
+
+typedef struct {
+    str_t field;
+    uint32_t symbol;            // field's index in program.fields
+    scalar_t value;
+    expr_t expr;
+} assignment_t;
+
+typedef struct {
+    str_t name;
+    int64_t priority;
+    scalar_t when;
+    expr_t cond;
+    assignment_t* then;
+    size_t nthen;
+    size_t line;
+} rule_t;
+
+typedef struct {
+    arena_t arena;
+    const char* source;    // not owned; every slice points into it
+    size_t source_len;
+
+    str_t name;
+    str_t version;
+    str_t description;
+
+    rule_t* rules;         // sorted by priority, stable
+    size_t nrules;
+
+    program_t program;
+} ruleset_t;
+
+// Parses source[0..len) and compiles every expression. source is not
+// copied and must outlive the ruleset; it need not be NUL-terminated.
+// Returns ERR_INVALID_YAML for malformed documents or expressions.
+error_t ruleset_load(ruleset_t* rules, const char* source, size_t len);
+
+void ruleset_free(ruleset_t* rules);
+
+// Sorts n rule names bytewise, as legacy sorts applied_rules, with tmp (n
+// entries) as scratch. Unlike qsort it never allocates, so callers can
+// sort per record with scratch sized once for the ruleset.
+void sort_rule_names(str_t* names, str_t* tmp, size_t n);
+
+#endif
@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite3.h"
+#include "statedb.h"
+#include "buffer.h"
+#include "json.h"
+#include "compress.h"
+#include "tree.h"
+
+// Legacy createTables(): tables first, then indexes.
+static const char* const SCHEMA =
+    "CREATE TABLE IF NOT EXISTS objects ("
+    " hash TEXT PRIMARY KEY,"
+    " type TEXT NOT NULL,"
+    " content TEXT NOT NULL,"
+    " size INTEGER,"
+    " created_at DATETIME DEFAULT CURRENT_TIMESTAMP);"
+    "CREATE TABLE IF NOT EXISTS executions ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " execution_hash TEXT UNIQUE NOT NULL,"
+    " commit_hash TEXT,"
+    " parent_hash TEXT,"
+    " rules_file TEXT NOT NULL,"
+    " rules_hash TEXT NOT NULL,"
+    " input_hash TEXT NOT NULL,"
+    " output_hash TEXT NOT NULL,"
+    " applied_rules TEXT NOT NULL,"
+    " execution_time_ms INTEGER,"
+    " branch TEXT DEFAULT 'main',"
+    " message TEXT,"
+    " author TEXT DEFAULT 'logic-git',"
+    " timestamp DATETIME DEFAULT CURRENT_TIMESTAMP);"
+    "CREATE TABLE IF NOT EXISTS audit_trail ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " execution_hash TEXT REFERENCES executions(execution_hash),"
+    " rule_name TEXT NOT NULL,"
+    " condition_text TEXT NOT NULL,"
+    " changes_json TEXT NOT NULL,"
+    " state_before TEXT,"
+    " state_after TEXT,"
+    " timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    " delta_json TEXT);"
+    "CREATE TABLE IF NOT EXISTS state_snapshots ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " execution_hash TEXT REFERENCES executions(execution_hash),"
+    " snapshot_type TEXT DEFAULT 'final',"
+    " state_data TEXT NOT NULL,"
+    " state_hash TEXT NOT NULL,"
+    " timestamp DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    " dict_id INTEGER,"
+    " state_size INTEGER,"
+    " state_tree TEXT,"
+    " state_blob BLOB);"
+    "CREATE INDEX IF NOT EXISTS idx_executions_hash ON executions(execution_hash);"
+    "CREATE INDEX IF NOT EXISTS idx_executions_time ON executions(timestamp);"
+    "CREATE INDEX IF NOT EXISTS idx_executions_branch ON executions(branch);"
+    "CREATE INDEX IF NOT EXISTS idx_audit_execution ON audit_trail(execution_hash);";
+
+// The database is a query cache next to the object store, which stays the
+// source of truth; a power loss may drop the last transactions but cannot
+// corrupt the file.
+static const char* const PRAGMAS =
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=NORMAL;";
+
+enum {
+    STMT_BEGIN,
+    STMT_COMMIT,
+    STMT_ROLLBACK,
+    STMT_EXECUTION,
+    STMT_AUDIT,
+    STMT_SNAPSHOT,
+    STMT_SNAPSHOT_READ,
+    STMT_AUDIT_READ,
+    STMT_SAMPLES,
+    STMT_PLAIN,
+    STMT_COMPRESS,
+    STMT_COUNT
+};
+
+static const char* const STATEMENTS[STMT_COUNT] = {
+    "BEGIN",
+    "COMMIT",
+    "ROLLBACK",
+    "INSERT OR IGNORE INTO executions"
+    " (execution_hash, commit_hash, parent_hash, rules_file, rules_hash,"
+    "  input_hash, output_hash, applied_rules, branch, message)"
+    " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    "INSERT INTO audit_trail"
+    " (execution_hash, rule_name, condition_text, changes_json, delta_json)"
+    " VALUES (?, ?, ?, ?, ?)",
+    "INSERT INTO state_snapshots"
+    " (execution_hash, snapshot_type, state_data, state_hash, dict_id, state_size, state_tree, state_blob)"
+    " VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+    "SELECT state_data, dict_id, state_size, state_tree, state_blob FROM state_snapshots"
+    " WHERE execution_hash = ? AND snapshot_type = ? ORDER BY id LIMIT 1",
+    "SELECT rule_name, delta_json FROM audit_trail WHERE execution_hash = ? ORDER BY id",
+    "SELECT state_data FROM state_snapshots"
+    " WHERE dict_id IS NULL AND state_tree IS NULL ORDER BY id DESC LIMIT ?",
+    "SELECT id, state_data FROM state_snapshots"
+    " WHERE dict_id IS NULL AND state_tree IS NULL AND id > ? ORDER BY id LIMIT ?",
+    "UPDATE state_snapshots SET state_data = ?, state_blob = ?, dict_id = ?, state_size = ? WHERE id = ?",
+};
+
+// Snapshot rows compressed (compress.h) hold the payload in state_blob,
+// the dictionary id (0 for none) in dict_id, the plain length in
+// state_size and NO_JSON in state_data. Plain rows have a NULL dict_id.
+// Rows of a state stored as a tree (tree.h) hold its root in state_tree,
+// NO_JSON in state_data and the JSON's length in state_size. Each
+// execution has a STATE_DB_INPUT and a STATE_DB_FINAL row.
+//
+// Audit rows keep the legacy changes_json, the rule's `then` clause, and
+// add delta_json, the changes the rule made to this record (execute.h).
+// state_before and state_after are left NULL: engine_replay rebuilds them
+// from the input row.
+
+// state_data of a row whose state is stored elsewhere. Legacy readers
+// JSON.parse every state_data (NOT NULL in its schema); this parses to
+// null, as for an execution without a snapshot.
+static const char* const NO_JSON = "null";
+
+struct state_db {
+    sqlite3* db;
+    sqlite3_stmt* stmt[STMT_COUNT];
+    bool in_txn;
+    size_t txn_records;
+    size_t repeats;             // records of this run already stored
+
+    // Current run
+    const ruleset_t* rules;
+    const char* rules_file;
+    hash_hex_t rules_hex;
+    const char* branch;
+    const char* message;
+    buffer_t changes;           // changes_json of every rule, back to back
+    size_t* changes_end;        // per rule: where its JSON ends in changes
+    buffer_t applied;
+    str_t* names;               // applied rule names, for sorting
+    compressor_t* compressor;   // for snapshot rows, if set
+    buffer_t packed;
+};
+
+static error_t step(state_db_t* db, int which) {
+    sqlite3_stmt* stmt = db->stmt[which];
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc == SQLITE_DONE ? ERR_OK : ERR_DB_ERROR;
+}
+
+static void bind_str(sqlite3_stmt* stmt, int index, str_t s) {
+    sqlite3_bind_text(stmt, index, s.ptr, (int)s.len, SQLITE_STATIC);
+}
+
+static void bind_cstr(sqlite3_stmt* stmt, int index, const char* s) {
+    if (s) {
+        sqlite3_bind_text(stmt, index, s, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+// Columns added after the legacy schema; files from before them get them
+// on open.
+static const char* const ADDED_COLUMNS[][3] = {
+    { "state_snapshots", "dict_id", "INTEGER" },
+    { "state_snapshots", "state_size", "INTEGER" },
+    { "state_snapshots", "state_tree", "TEXT" },
+    { "state_snapshots", "state_blob", "BLOB" },
+    { "audit_trail", "delta_json", "TEXT" },
+};
+
+static bool add_column(sqlite3* db, const char* table, const char* name, const char* type) {
+    char sql[128];
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int written = snprintf(sql, sizeof(sql), "SELECT %s FROM %s LIMIT 0", name, table);
+        if (written < 0 || (size_t)written >= sizeof(sql)) return false;
+        sqlite3_stmt* probe = NULL;
+        if (sqlite3_prepare_v2(db, sql, -1, &probe, NULL) == SQLITE_OK) {
+            sqlite3_finalize(probe);
+            return true;
+        }
+        // Another process may have added it first; probe again either way.
+        written = snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD COLUMN %s %s", table, name, type);
+        if (written < 0 || (size_t)written >= sizeof(sql)) return false;
+        sqlite3_exec(db, sql, NULL, NULL, NULL);
+    }
+    return false;
+}
+
+static bool migrate(sqlite3* db) {
+    size_t n = sizeof(ADDED_COLUMNS) / sizeof(ADDED_COLUMNS[0]);
+    for (size_t i = 0; i < n; i++) {
+        if (!add_column(db, ADDED_COLUMNS[i][0], ADDED_COLUMNS[i][1], ADDED_COLUMNS[i][2])) return false;
+    }
+    return true;
+}
+
+error_t state_db_open(state_db_t** out, const char* path) {
+    if (!out || !path) return ERR_NULL_PTR;
+    state_db_t* db = (state_db_t*)calloc(1, sizeof(state_db_t));
+    if (!db) return ERR_MALLOC_FAILED;
+    buffer_init(&db->changes);
+    buffer_init(&db->applied);
+    buffer_init(&db->packed);
+
+    bool ok = sqlite3_open(path, &db->db) == SQLITE_OK;
+    // WAL readers never wait on the writer; a busy writer is retried briefly.
+    ok = ok && sqlite3_busy_timeout(db->db, 5000) == SQLITE_OK;
+    ok = ok && sqlite3_exec(db->db, PRAGMAS, NULL, NULL, NULL) == SQLITE_OK;
+    ok = ok && sqlite3_exec(db->db, SCHEMA, NULL, NULL, NULL) == SQLITE_OK;
+    ok = ok && migrate(db->db);
+    for (int i = 0; ok && i < STMT_COUNT; i++) {
+        ok = sqlite3_prepare_v2(db->db, STATEMENTS[i], -1, &db->stmt[i], NULL) == SQLITE_OK;
+    }
+    if (!ok) {
+        state_db_close(db);
+        return ERR_DB_ERROR;
+    }
+    *out = db;
+    return ERR_OK;
+}
+
+void state_db_close(state_db_t* db) {
+    if (!db) return;
+    if (db->in_txn) step(db, STMT_ROLLBACK);
+    for (int i = 0; i < STMT_COUNT; i++) sqlite3_finalize(db->stmt[i]);
+    sqlite3_close(db->db);
+    buffer_free(&db->changes);
+    buffer_free(&db->applied);
+    buffer_free(&db->packed);
+    free(db->changes_end);
+    free(db->names);
+    free(db);
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// JSON number grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool is_json_number(str_t s) {
+    size_t i = 0, n = s.len;
+    if (i < n && s.ptr[i] == '-') i++;
+    if (i < n && s.ptr[i] == '0') {
+        i++;
+    } else {
+        if (i == n || !is_digit(s.ptr[i])) return false;
+        while (i < n && is_digit(s.ptr[i])) i++;
+    }
+    if (i < n && s.ptr[i] == '.') {
+        if (++i == n || !is_digit(s.ptr[i])) return false;
+        while (i < n && is_digit(s.ptr[i])) i++;
+    }
+    if (i < n && (s.ptr[i] == 'e' || s.ptr[i] == 'E')) {
+        i++;
+        if (i < n && (s.ptr[i] == '+' || s.ptr[i] == '-')) i++;
+        if (i == n || !is_digit(s.ptr[i])) return false;
+        while (i < n && is_digit(s.ptr[i])) i++;
+    }
+    return i == n;
+}
+
+// Plain YAML scalars that are JSON literals keep their type, as they do
+// in legacy JSON.stringify(rule.then); everything else is a string.
+static bool is_json_literal(const scalar_t* value) {
+    static const str_t words[] = { { "true", 4 }, { "false", 5 }, { "null", 4 } };
+    if (value->style != SCALAR_PLAIN) return false;
+    for (size_t i = 0; i < 3; i++) {
+        if (str_eq(value->text, words[i])) return true;
+    }
+    return is_json_number(value->text);
+}
+
+static error_t write_changes(buffer_t* out, const rule_t* rule) {
+    error_t err = buffer_append_char(out, '{');
+    for (size_t i = 0; err == ERR_OK && i < rule->nthen; i++) {
+        const assignment_t* a = &rule->then[i];
+        if (i) err = buffer_append_char(out, ',');
+        if (err == ERR_OK) err = json_write_string(out, a->field);
+        if (err == ERR_OK) err = buffer_append_char(out, ':');
+        if (err != ERR_OK) break;
+        err = is_json_literal(&a->value) ? buffer_append(out, a->value.text.ptr, a->value.text.len)
+                                         : json_write_string(out, a->value.text);
+    }
+    if (err == ERR_OK) err = buffer_append_char(out, '}');
+    return err;
+}
+
+error_t state_db_begin(state_db_t* db, const ruleset_t* rules, const char* rules_file,
+                       const hash_t rules_hash, const char* branch, const char* message) {
+    if (!db || !rules || !rules_file) return ERR_NULL_PTR;
+    db->rules = rules;
+    db->rules_file = rules_file;
+    hash_hex(rules_hash, db->rules_hex);
+    db->branch = branch;
+    db->message = message;
+    db->repeats = 0;
+
+    // A rule's changes_json is the same for every record; build it once.
+    size_t* ends = (size_t*)realloc(db->changes_end, (rules->nrules + 1) * sizeof(size_t));
+    // The upper half is sort_rule_names' scratch.
+    str_t* names = (str_t*)realloc(db->names, 2 * (rules->nrules + 1) * sizeof(str_t));
+    if (ends) db->changes_end = ends;
+    if (names) db->names = names;
+    if (!ends || !names) return ERR_MALLOC_FAILED;
+    buffer_clear(&db->changes);
+    for (size_t r = 0; r < rules->nrules; r++) {
+        error_t err = write_changes(&db->changes, &rules->rules[r]);
+        if (err != ERR_OK) return err;
+        db->changes_end[r] = db->changes.len;
+    }
+    return ERR_OK;
+}
+
+// applied_rules as legacy stores it: the names, sorted, as a JSON array.
+static error_t write_applied(state_db_t* db, const execution_t* result) {
+    for (size_t i = 0; i < result->napplied; i++) db->names[i] = db->rules->rules[result->applied[i]].name;
+    sort_rule_names(db->names, db->names + db->rules->nrules + 1, result->napplied);
+    buffer_clear(&db->applied);
+    error_t err = buffer_append_char(&db->applied, '[');
+    for (size_t i = 0; err == ERR_OK && i < result->napplied; i++) {
+        if (i) err = buffer_append_char(&db->applied, ',');
+        if (err == ERR_OK) err = json_write_string(&db->applied, db->names[i]);
+    }
+    if (err == ERR_OK) err = buffer_append_char(&db->applied, ']');
+    return err;
+}
+
+// Adds one snapshot row: the tree's root if there is one, else the JSON,
+// compressed where that pays.
+static error_t insert_snapshot(state_db_t* db, const char* exec_hex, const char* type, str_t json,
+                               const char* state_hex, const uint8_t* tree) {
+    sqlite3_stmt* stmt = db->stmt[STMT_SNAPSHOT];
+    hash_hex_t tree_hex;
+    bind_cstr(stmt, 1, exec_hex);
+    bind_cstr(stmt, 2, type);
+    bind_cstr(stmt, 4, state_hex);
+    error_t packed = ERR_BUFFER_OVERFLOW;
+    if (!tree && db->compressor) {
+        buffer_clear(&db->packed);
+        packed = compressor_run(db->compressor, json.ptr, json.len, &db->packed);
+    }
+    if (tree) {
+        bind_cstr(stmt, 3, NO_JSON);
+        sqlite3_bind_int64(stmt, 6, (sqlite3_int64)json.len);
+        bind_cstr(stmt, 7, hash_hex(tree, tree_hex));
+    } else if (packed == ERR_OK) {
+        bind_cstr(stmt, 3, NO_JSON);
+        sqlite3_bind_blob(stmt, 8, db->packed.data, (int)db->packed.len, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 5, compressor_dict_id(db->compressor));
+        sqlite3_bind_int64(stmt, 6, (sqlite3_int64)json.len);
+    } else {
+        bind_str(stmt, 3, json);
+    }
+    return step(db, STMT_SNAPSHOT);
+}
+
+error_t state_db_record(state_db_t* db, const execution_t* result, const hash_t commit,
+                        const uint8_t* parent, const uint8_t* input_tree, const uint8_t* output_tree) {
+    if (!db || !result || !db->rules) return ERR_NULL_PTR;
+    if (!db->in_txn) {
+        error_t err = step(db, STMT_BEGIN);
+        if (err != ERR_OK) return err;
+        db->in_txn = true;
+        db->txn_records = 0;
+    }
+
+    hash_hex_t exec_hex, commit_hex, parent_hex, input_hex, output_hex;
+    hash_hex(result->execution_hash, exec_hex);
+    hash_hex(commit, commit_hex);
+    if (parent) hash_hex(parent, parent_hex);
+    hash_hex(result->input_hash, input_hex);
+    hash_hex(result->output_hash, output_hex);
+    error_t err = write_applied(db, result);
+    if (err != ERR_OK) return err;
+
+    sqlite3_stmt* stmt = db->stmt[STMT_EXECUTION];
+    bind_cstr(stmt, 1, exec_hex);
+    bind_cstr(stmt, 2, commit_hex);
+    bind_cstr(stmt, 3, parent ? parent_hex : NULL);
+    bind_cstr(stmt, 4, db->rules_file);
+    bind_cstr(stmt, 5, db->rules_hex);
+    bind_cstr(stmt, 6, input_hex);
+    bind_cstr(stmt, 7, output_hex);
+    sqlite3_bind_text(stmt, 8, db->applied.data, (int)db->applied.len, SQLITE_STATIC);
+    bind_cstr(stmt, 9, db->branch);
+    bind_cstr(stmt, 10, db->message);
+    err = step(db, STMT_EXECUTION);
+    if (err != ERR_OK) return err;
+
+    if (sqlite3_changes(db->db) > 0) {
+        stmt = db->stmt[STMT_AUDIT];
+        for (size_t i = 0; err == ERR_OK && i < result->napplied; i++) {
+            uint32_t r = result->applied[i];
+            const rule_t* rule = &db->rules->rules[r];
+            size_t start = r ? db->changes_end[r - 1] : 0;
+            bind_cstr(stmt, 1, exec_hex);
+            bind_str(stmt, 2, rule->name);
+            bind_str(stmt, 3, rule->when.text);
+            sqlite3_bind_text(stmt, 4, db->changes.data + start, (int)(db->changes_end[r] - start),
+                              SQLITE_STATIC);
+            size_t delta = i ? result->changes_end[i - 1] : 0;
+            sqlite3_bind_text(stmt, 5, result->changes.ptr + delta, (int)(result->changes_end[i] - delta),
+                              SQLITE_STATIC);
+            err = step(db, STMT_AUDIT);
+        }
+        if (err == ERR_OK) {
+            err = insert_snapshot(db, exec_hex, STATE_DB_INPUT, result->input_json, input_hex, input_tree);
+        }
+        if (err == ERR_OK) {
+            err = insert_snapshot(db, exec_hex, STATE_DB_FINAL, result->output_json, output_hex, output_tree);
+        }
+        if (err != ERR_OK) return err;
+    } else {
+        db->repeats++;
+    }
+
+    if (++db->txn_records == STATE_DB_TXN_RECORDS) {
+        db->in_txn = false;
+        return step(db, STMT_COMMIT);
+    }
+    return ERR_OK;
+}
+
+size_t state_db_repeats(const state_db_t* db) {
+    return db ? db->repeats : 0;
+}
+
+error_t state_db_flush(state_db_t* db) {
+    if (!db) return ERR_NULL_PTR;
+    if (!db->in_txn) return ERR_OK;
+    db->in_txn = false;
+    return step(db, STMT_COMMIT);
+}
+
+error_t state_db_end(state_db_t* db, bool ok) {
+    if (!db) return ERR_NULL_PTR;
+    db->rules = NULL;
+    if (!db->in_txn) return ERR_OK;
+    db->in_txn = false;
+    return step(db, ok ? STMT_COMMIT : STMT_ROLLBACK);
+}
+
+void state_db_set_compressor(state_db_t* db, compressor_t* compressor) {
+    if (db) db->compressor = compressor;
+}
+
+error_t state_db_snapshot(state_db_t* db, const odb_t* odb, const char* execution_hash, const char* type,
+                          buffer_t* out) {
+    if (!db || !odb || !execution_hash || !type || !out) return ERR_NULL_PTR;
+    sqlite3_stmt* stmt = db->stmt[STMT_SNAPSHOT_READ];
+    bind_cstr(stmt, 1, execution_hash);
+    bind_cstr(stmt, 2, type);
+    int rc = sqlite3_step(stmt);
+    error_t err = rc == SQLITE_ROW ? ERR_OK : rc == SQLITE_DONE ? ERR_FILE_NOT_FOUND : ERR_DB_ERROR;
+    if (err == ERR_OK) {
+        const char* data = (const char*)sqlite3_column_blob(stmt, 0);
+        size_t len = (size_t)sqlite3_column_bytes(stmt, 0);
+        const char* tree = (const char*)sqlite3_column_text(stmt, 3);
+        hash_t root;
+        if (tree) {
+            err = hash_from_hex(tree, strlen(tree), root) ? tree_read(odb, root, out) : ERR_IO;
+        } else if (sqlite3_column_type(stmt, 1) == SQLITE_NULL) {
+            err = buffer_append(out, data, len);
+        } else {
+            data = (const char*)sqlite3_column_blob(stmt, 4);
+            len = (size_t)sqlite3_column_bytes(stmt, 4);
+            sqlite3_int64 id = sqlite3_column_int64(stmt, 1);
+            sqlite3_int64 size = sqlite3_column_int64(stmt, 2);
+            const dict_t* dict = NULL;
+            if (!data || size < 0 || (id && !(dict = dict_set_find(&odb->dicts, (uint32_t)id)))) {
+                err = ERR_IO;
+            } else {
+                err = decompress(dict, data, len, (size_t)size, out);
+            }
+        }
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return err;
+}
+
+error_t state_db_audit(state_db_t* db, const char* execution_hash, audit_fn fn, void* ctx) {
+    if (!db || !execution_hash || !fn) return ERR_NULL_PTR;
+    sqlite3_stmt* stmt = db->stmt[STMT_AUDIT_READ];
+    bind_cstr(stmt, 1, execution_hash);
+    error_t err = ERR_OK;
+    int rc = SQLITE_DONE;
+    while (err == ERR_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        str_t rule = { (const char*)sqlite3_column_text(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0) };
+        str_t changes = { (const char*)sqlite3_column_text(stmt, 1), (size_t)sqlite3_column_bytes(stmt, 1) };
+        err = fn(ctx, rule, changes);
+    }
+    if (err == ERR_OK && rc != SQLITE_DONE) err = ERR_DB_ERROR;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return err;
+}
+
+error_t state_db_samples(state_db_t* db, size_t max, buffer_t* data, size_t* ends, size_t* count) {
+    if (!db || !data || (!ends && max) || !count) return ERR_NULL_PTR;
+    *count = 0;
+    sqlite3_stmt* stmt = db->stmt[STMT_SAMPLES];
+    sqlite3_bind_int64(stmt, 1, (sqlite3_int64)max);
+    error_t err = ERR_OK;
+    int rc = SQLITE_DONE;
+    while (err == ERR_OK && *count < max && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        err = buffer_append(data, (const char*)sqlite3_column_blob(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0));
+        ends[(*count)++] = data->len;
+    }
+    if (err == ERR_OK && rc != SQLITE_ROW && rc != SQLITE_DONE) err = ERR_DB_ERROR;
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return err;
+}
+
+// One batch of plain rows after *last, in its own transaction.
+static error_t compress_batch(state_db_t* db, compressor_t* compressor, sqlite3_int64* last, size_t* seen,
+                              size_t* rows) {
+    sqlite3_stmt* select = db->stmt[STMT_PLAIN];
+    sqlite3_stmt* update = db->stmt[STMT_COMPRESS];
+    error_t err = step(db, STMT_BEGIN);
+    if (err != ERR_OK) return err;
+    sqlite3_bind_int64(select, 1, *last);
+    sqlite3_bind_int(select, 2, STATE_DB_TXN_RECORDS);
+    *seen = 0;
+    int rc = SQLITE_DONE;
+    while (err == ERR_OK && (rc = sqlite3_step(select)) == SQLITE_ROW) {
+        *last = sqlite3_column_int64(select, 0);
+        (*seen)++;
+        buffer_clear(&db->packed);
+        const char* data = (const char*)sqlite3_column_blob(select, 1);
+        size_t len = (size_t)sqlite3_column_bytes(select, 1);
+        error_t packed = compressor_run(compressor, data, len, &db->packed);
+        if (packed == ERR_BUFFER_OVERFLOW) continue;     // stays plain
+        if (packed != ERR_OK) {
+            err = packed;
+            break;
+        }
+        bind_cstr(update, 1, NO_JSON);
+        sqlite3_bind_blob(update, 2, db->packed.data, (int)db->packed.len, SQLITE_STATIC);
+        sqlite3_bind_int64(update, 3, compressor_dict_id(compressor));
+        sqlite3_bind_int64(update, 4, (sqlite3_int64)len);
+        sqlite3_bind_int64(update, 5, *last);
+        err = step(db, STMT_COMPRESS);
+        if (err == ERR_OK) (*rows)++;
+    }
+    if (err == ERR_OK && rc != SQLITE_DONE && rc != SQLITE_ROW) err = ERR_DB_ERROR;
+    sqlite3_reset(select);
+    sqlite3_clear_bindings(select);
+    error_t end = step(db, err == ERR_OK ? STMT_COMMIT : STMT_ROLLBACK);
+    return err != ERR_OK ? err : end;
+}
+
+error_t state_db_compress(state_db_t* db, compressor_t* compressor, size_t* rows) {
+    if (!db || !compressor || !rows) return ERR_NULL_PTR;
+    if (db->in_txn) return ERR_DB_ERROR;
+    *rows = 0;
+    sqlite3_int64 last = 0;
+    size_t seen;
+    error_t err;
+    do {
+        err = compress_batch(db, compressor, &last, &seen, rows);
+    } while (err == ERR_OK && seen == STATE_DB_TXN_RECORDS);
+    return err;
+}
@@ -0,0 +1,89 @@
+#ifndef STATEDB_H
+#define STATEDB_H
+
+#include "git_for_logic.h"
+#include "rules.h"
+#include "execute.h"
+#include "compress.h"
+#include "odb.h"
+
+// The queryable side of a repository: .logicgit/state.db, with the legacy
+// schema (objects, executions, audit_trail, state_snapshots). The database
+// runs in WAL mode with synchronous=NORMAL, every INSERT is prepared once
+// per process, and rows are written in transactions of up to
+// STATE_DB_TXN_RECORDS executions instead of one autocommit per row.
+//
+// Executions are content-addressed: a record whose execution hash is
+// already stored (same rules, input and output) adds no rows, so running
+// the same data twice does not duplicate its audit trail or snapshot. Its
+// commit is still made; the stored row names the first commit with that
+// execution. state_db_repeats counts these records so the caller can say so.
+//
+// Snapshot rows may be stored compressed (compress.h), or hold only the
+// root of the state's tree in the object store (tree.h); state_db_snapshot
+// reads every kind. Compressed payloads live in their own state_blob
+// column; the state_data of a compressed or tree row is the JSON null, so
+// legacy readers still parse it.
+
+#define STATE_DB_TXN_RECORDS 1024
+
+// snapshot_type of the two snapshots of an execution
+#define STATE_DB_INPUT "input"
+#define STATE_DB_FINAL "final"
+
+typedef struct state_db state_db_t;
+
+// Creates the file and schema if needed. Returns ERR_DB_ERROR on failure.
+error_t state_db_open(state_db_t** out, const char* path);
+
+// Rolls back an unfinished run.
+void state_db_close(state_db_t* db);
+
+// Starts a run of rules (loaded from rules_file) on branch. The rules and
+// message must outlive the run.
+error_t state_db_begin(state_db_t* db, const ruleset_t* rules, const char* rules_file,
+                       const hash_t rules_hash, const char* branch, const char* message);
+
+// Adds the execution, audit and snapshot rows of one committed record.
+// parent is NULL for a root commit. input_tree and output_tree are the
+// roots of the states' trees, stored in place of their JSON; NULL stores
+// the JSON.
+error_t state_db_record(state_db_t* db, const execution_t* result, const hash_t commit,
+                        const uint8_t* parent, const uint8_t* input_tree, const uint8_t* output_tree);
+
+// Snapshot rows added from now on are compressed with compressor, where
+// that pays; NULL stores them as plain text. Not owned.
+void state_db_set_compressor(state_db_t* db, compressor_t* compressor);
+
+// Records of the current or last run that added no rows because their
+// execution hash was already stored.
+size_t state_db_repeats(const state_db_t* db);
+
+// Commits the open transaction and keeps the run going.
+error_t state_db_flush(state_db_t* db);
+
+// Commits the open transaction, or rolls it back if ok is false.
+error_t state_db_end(state_db_t* db, bool ok);
+
+// Appends the snapshot of type (STATE_DB_INPUT or STATE_DB_FINAL) of an
+// execution (by hex hash) to out. Returns ERR_FILE_NOT_FOUND if there is
+// none and ERR_IO if it is corrupt or its dictionary is not among odb's.
+// A tree's nodes are read from odb.
+error_t state_db_snapshot(state_db_t* db, const odb_t* odb, const char* execution_hash, const char* type,
+                          buffer_t* out);
+
+// Called for each audit row of an execution, in the order the rules
+// applied. changes.ptr is NULL for rows written before delta_json.
+typedef error_t (*audit_fn)(void* ctx, str_t rule, str_t changes);
+
+error_t state_db_audit(state_db_t* db, const char* execution_hash, audit_fn fn, void* ctx);
+
+// Appends up to max of the latest plain JSON snapshots to data, back to back;
+// ends[i] is where the i-th stops. For training dictionaries.
+error_t state_db_samples(state_db_t* db, size_t max, buffer_t* data, size_t* ends, size_t* count);
+
+// Compresses every plain JSON snapshot row that shrinks, STATE_DB_TXN_RECORDS
+// rows to a transaction. Not during a run.
+error_t state_db_compress(state_db_t* db, compressor_t* compressor, size_t* rows);
+
+#endif
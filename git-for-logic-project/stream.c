@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "stream.h"
+
+#define SLOT_STRIDE (STREAM_RECORD_MAX + STREAM_SLOT_SIZE)
+
+typedef struct {
+    size_t len;                 // bytes read into the slot
+    bool full;                  // filled and not yet released by the consumer
+    bool eof;                   // last slot of the file
+    error_t err;
+} slot_t;
+
+struct stream {
+    int fd;
+    struct stat st;
+    char* memory;               // STREAM_SLOTS slots of SLOT_STRIDE bytes
+    slot_t slots[STREAM_SLOTS];
+    size_t size;
+
+    bool hash;
+    hash_ctx_t digest;
+
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool stop;                  // consumer gave up; reader exits
+};
+
+// Read area of slot i; the STREAM_RECORD_MAX bytes before it hold the
+// carried-over partial record.
+static char* slot_data(stream_t* s, size_t i) {
+    return s->memory + i * SLOT_STRIDE + STREAM_RECORD_MAX;
+}
+
+static error_t fill_slot(stream_t* s, char* data, size_t* len, bool* eof) {
+    *len = 0;
+    *eof = false;
+    while (*len < STREAM_SLOT_SIZE) {
+        ssize_t got = read(s->fd, data + *len, STREAM_SLOT_SIZE - *len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return ERR_IO;
+        if (got == 0) {
+            *eof = true;
+            break;
+        }
+        *len += (size_t)got;
+    }
+    return ERR_OK;
+}
+
+static void* reader_main(void* arg) {
+    stream_t* s = (stream_t*)arg;
+    for (size_t i = 0;; i = (i + 1) % STREAM_SLOTS) {
+        slot_t* slot = &s->slots[i];
+        pthread_mutex_lock(&s->lock);
+        while (slot->full && !s->stop) pthread_cond_wait(&s->changed, &s->lock);
+        bool stop = s->stop;
+        pthread_mutex_unlock(&s->lock);
+        if (stop) break;
+
+        size_t len;
+        bool eof;
+        error_t err = fill_slot(s, slot_data(s, i), &len, &eof);
+        if (err == ERR_OK && s->hash) hash_update(&s->digest, slot_data(s, i), len);
+
+        pthread_mutex_lock(&s->lock);
+        slot->len = len;
+        slot->eof = eof || err != ERR_OK;
+        slot->err = err;
+        slot->full = true;
+        pthread_cond_broadcast(&s->changed);
+        pthread_mutex_unlock(&s->lock);
+        if (slot->eof) break;
+    }
+    return NULL;
+}
+
+static slot_t* wait_full(stream_t* s, size_t i) {
+    slot_t* slot = &s->slots[i];
+    pthread_mutex_lock(&s->lock);
+    while (!slot->full) pthread_cond_wait(&s->changed, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+    return slot;
+}
+
+static void release(stream_t* s, size_t i) {
+    pthread_mutex_lock(&s->lock);
+    s->slots[i].full = false;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+}
+
+error_t stream_open(stream_t** out, const char* path) {
+    if (!out || !path) return ERR_NULL_PTR;
+    stream_t* s = (stream_t*)calloc(1, sizeof(stream_t));
+    if (!s) return ERR_MALLOC_FAILED;
+    s->fd = open(path, O_RDONLY);
+    if (s->fd < 0) {
+        free(s);
+        return ERR_FILE_NOT_FOUND;
+    }
+    if (fstat(s->fd, &s->st) != 0) {
+        close(s->fd);
+        free(s);
+        return ERR_IO;
+    }
+    s->memory = (char*)malloc((size_t)STREAM_SLOTS * SLOT_STRIDE);
+    if (!s->memory) {
+        close(s->fd);
+        free(s);
+        return ERR_MALLOC_FAILED;
+    }
+    // The file is read front to back exactly once.
+    if (S_ISREG(s->st.st_mode)) posix_fadvise(s->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->changed, NULL);
+    *out = s;
+    return ERR_OK;
+}
+
+void stream_close(stream_t* s) {
+    if (!s) return;
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->changed);
+    close(s->fd);
+    free(s->memory);
+    free(s);
+}
+
+const struct stat* stream_stat(const stream_t* s) {
+    return &s->st;
+}
+
+error_t stream_run(stream_t* s, bool hash, split_fn split, piece_fn fn, void* ctx) {
+    if (!s || !split || !fn) return ERR_NULL_PTR;
+    s->hash = hash;
+    if (hash) hash_init(&s->digest);
+    if (pthread_create(&s->reader, NULL, reader_main, s) != 0) return ERR_MALLOC_FAILED;
+
+    error_t err = ERR_OK;
+    size_t carry = 0;
+    slot_t* slot = wait_full(s, 0);
+    for (size_t i = 0;;) {
+        // The carried bytes sit right in front of this slot's data.
+        char* start = slot_data(s, i) - carry;
+        size_t len = carry + slot->len;
+        bool last = slot->eof;
+        s->size += slot->len;
+        err = slot->err;
+        if (err != ERR_OK) break;
+
+        size_t whole = last ? len : split(start, len);
+        if (whole) err = fn(ctx, start, whole);
+        carry = len - whole;
+        if (err != ERR_OK || last) break;
+        if (carry > STREAM_RECORD_MAX) {
+            err = ERR_BUFFER_OVERFLOW;
+            break;
+        }
+
+        // Keep this slot until the tail is in front of the next one.
+        size_t next = (i + 1) % STREAM_SLOTS;
+        slot_t* next_slot = wait_full(s, next);
+        memcpy(slot_data(s, next) - carry, start + whole, carry);
+        release(s, i);
+        i = next;
+        slot = next_slot;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+    return err;
+}
+
+void stream_digest(const stream_t* s, hash_t out) {
+    hash_ctx_t digest = s->digest;
+    hash_final(&digest, out);
+}
+
+size_t stream_size(const stream_t* s) {
+    return s->size;
+}
+
+size_t stream_split_lines(const char* buf, size_t len) {
+    while (len && buf[len - 1] != '\n') len--;
+    return len;
+}
+
+size_t stream_split_csv(const char* buf, size_t len) {
+    // A newline ends a row when an even number of quotes precede it.
+    size_t quotes = 0;
+    for (const char* q = buf; (q = (const char*)memchr(q, '"', (size_t)(buf + len - q))); q++) quotes++;
+    for (size_t i = len; i > 0; i--) {
+        char c = buf[i - 1];
+        if (c == '"') {
+            quotes--;
+        } else if (c == '\n' && quotes % 2 == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
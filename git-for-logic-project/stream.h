@@ -0,0 +1,58 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include "git_for_logic.h"
+#include "hash.h"
+
+// Bounded-memory reader for data files too large to map. A reader thread
+// read()s the file into a fixed ring of STREAM_SLOTS buffers and, if
+// asked, hashes every byte as it lands; the calling thread cuts each
+// buffer at its last record boundary and hands the whole records to a
+// callback. The partial record at the end of a buffer is copied into the
+// headroom in front of the next one, so records are always contiguous and
+// nothing else is copied. Peak memory is STREAM_SLOTS * (STREAM_SLOT_SIZE
+// + STREAM_RECORD_MAX) whatever the file size; a record longer than
+// STREAM_RECORD_MAX fails with ERR_BUFFER_OVERFLOW.
+
+#define STREAM_SLOTS 4
+#define STREAM_SLOT_SIZE (1024 * 1024)
+#define STREAM_RECORD_MAX (256 * 1024)
+
+// Returns how many leading bytes of buf are whole records.
+typedef size_t (*split_fn)(const char* buf, size_t len);
+
+// Called with whole records, in file order. buf is valid only during the
+// call.
+typedef error_t (*piece_fn)(void* ctx, const char* buf, size_t len);
+
+typedef struct stream stream_t;
+
+// Returns ERR_FILE_NOT_FOUND if path cannot be opened.
+error_t stream_open(stream_t** out, const char* path);
+void stream_close(stream_t* stream);
+
+// Stat data of the opened file, for the index.
+const struct stat* stream_stat(const stream_t* stream);
+
+// Reads to the end of the file. With hash set, stream_digest afterwards
+// gives the SHA-1 of the whole file. Returns ERR_IO on a read error, or
+// whatever fn returned if it stopped the walk.
+error_t stream_run(stream_t* stream, bool hash, split_fn split, piece_fn fn, void* ctx);
+
+void stream_digest(const stream_t* stream, hash_t out);
+
+// Bytes read so far.
+size_t stream_size(const stream_t* stream);
+
+// Record boundaries of JSON Lines: the last newline. Each value sits on
+// one line (strings cannot hold a raw newline), so a newline ends a record.
+size_t stream_split_lines(const char* buf, size_t len);
+
+// Record boundaries of CSV: the last newline outside quotes. buf must
+// start on a row boundary.
+size_t stream_split_csv(const char* buf, size_t len);
+
+#endif
@@ -1,29 +1,233 @@
 #!/bin/bash
 # test.sh
+#
+# Builds the tool and checks its behaviour against the fixtures in
+# logic-repo/rules and logic-repo/data. Pass --no-build to reuse the binary
+# (make test does).
 
 set -e
 
-echo "🔨 Compiling..."
-make clean
-make
+BIN=./git-for-logic
+REPO=logic-repo
+STORE=$REPO/.logicgit
+OUT=$(mktemp)
+LARGE=$REPO/rules/large.yaml
+MANY=$REPO/data/many.jsonl
+SMALL=$REPO/data/small.jsonl
+BIG=$REPO/data/big.jsonl
+SEMANTICS=$REPO/rules/semantics.yaml
+DEEP=$REPO/rules/deep.yaml
+ARRAYS=$REPO/data/arrays.json
+PRIORITY=$REPO/rules/priority.yaml
+trap 'rm -f "$OUT" "$LARGE" "$MANY" "$SMALL" "$BIG" "$SEMANTICS" "$DEEP" "$ARRAYS" "$PRIORITY"' EXIT
+
+fail() {
+  echo "❌ $1"
+  cat "$OUT"
+  exit 1
+}
+
+# Runs execute on a fresh store and prints the resulting HEAD commit.
+fresh_execute() {
+  rm -rf "$STORE"
+  $BIN execute "$@" > "$OUT" 2>&1 || fail "execute $* failed"
+  cat "$STORE/refs/heads/main"
+}
+
+# Writes count applicant records as JSON Lines to file.
+write_records() {
+  awk -v n="$1" 'BEGIN {
+    for (i = 0; i < n; i++)
+      printf "{\"name\": \"a%d\", \"income\": %d, \"credit_score\": %d, \"employment_years\": %d, \"note\": \"\"}\n", i, 20000 + i * 7, 500 + i % 350, i % 12
+  }' > "$2"
+}
+
+# Runs execute on a fresh store and sets PEAK to its peak RSS in kB, the
+# last VmHWM read before it exits.
+peak_execute() {
+  rm -rf "$STORE"
+  $BIN execute "$@" > "$OUT" 2>&1 &
+  local pid=$! hwm
+  PEAK=0
+  while kill -0 "$pid" 2> /dev/null; do
+    # The process may exit between kill -0 and the read.
+    hwm=$(sed -n 's/^VmHWM:[[:space:]]*\([0-9]*\) kB/\1/p' "/proc/$pid/status" 2> /dev/null || true)
+    [ -n "$hwm" ] && PEAK=$hwm
+    sleep 0.05
+  done
+  wait "$pid" || fail "execute $* failed"
+}
+
+# Prints the execution hash of the HEAD commit.
+head_execution() {
+  $BIN cat-object "$(cat "$STORE/refs/heads/main")" | sed 's/.*"execution":"\([0-9a-f]*\)".*/\1/'
+}
+
+if [ "$1" != "--no-build" ]; then
+  echo "🔨 Compiling..."
+  make clean
+  make
+fi
 
 echo ""
 echo "🧪 Testing initialization..."
-./git-for-logic init
+$BIN init
 
 echo ""
 echo "📁 Checking directory structure..."
-if [ -d "logic-repo" ]; then
-  echo "✅ logic-repo created"
-  ls -la logic-repo/
+if [ -d ".logicgit/objects" ] && [ -d ".logicgit/refs/heads" ]; then
+  echo "✅ .logicgit created"
 else
-  echo "❌ logic-repo not created"
+  echo "❌ .logicgit not created"
   exit 1
 fi
 
 echo ""
-echo "📋 Testing execution..."
-./git-for-logic execute loan.yaml test.json "CALYX test run"
+echo "📋 Testing execution modes..."
+for data in applicants.csv applicants.json; do
+  modes=("" "--batch" "--jobs 2")
+  [ "$data" = applicants.csv ] && modes+=("--stream")
+  expected=""
+  for mode in "${modes[@]}"; do
+    head=$(fresh_execute $mode loan.yaml "$data" "CALYX test run")
+    [ -n "$expected" ] || expected=$head
+    [ "$head" = "$expected" ] || fail "$data ${mode:-serial}: HEAD $head, expected $expected"
+  done
+  echo "✅ $data: ${#modes[@]} modes agree on HEAD ${expected:0:12}"
+done
+
+echo ""
+echo "🧾 Testing quoted CSV fields..."
+fresh_execute loan.yaml applicants.csv > /dev/null
+for field in '"name":"Smith, Jane"' '"zip":42}' '"zip":2139}' '"note":"said \"call me\""' '"note":"line one, line two"'; do
+  grep -qF "$field" "$OUT" || fail "no $field in the final states"
+done
+# The first batch is the sample: zip reads "00042" as 42, so it is an int.
+grep -qF "Columns: name:string income:int credit_score:int employment_years:int zip:int note:string" "$OUT" \
+  || fail "unexpected column types"
+echo "✅ Quoted commas and doubled quotes survive, \"00042\" reads as 42"
+
+echo ""
+echo "🧮 Testing expression semantics..."
+cat > "$SEMANTICS" << 'EOF'
+rules:
+  - name: "Loose Equality"
+    when: "employment_years == '5' && note == 0"
+  - name: "Numeric String Order"
+    when: "'70000' < income"
+  - name: "Concatenation"
+    when: "name + '!' == 'Bob Jones!'"
+  - name: "Missing Equals Null"
+    when: "missing == null"
+  - name: "Missing Orders"
+    when: "missing < 1 || missing >= 1"
+EOF
+fresh_execute semantics.yaml applicants.json > /dev/null
+# Comparisons are loose as in JS; + on a string is null, where JS
+# concatenates (see expr.h).
+for expect in "Loose Equality:1" "Numeric String Order:2" "Concatenation:0" "Missing Equals Null:4" "Missing Orders:0"; do
+  applied=$(grep -c "Applied: ${expect%:*}$" "$OUT" || true)
+  [ "$applied" = "${expect##*:}" ] || fail "${expect%:*} applied to $applied records, expected ${expect##*:}"
+done
+{
+  echo "rules:"
+  printf '  - name: "Deep"\n    when: "%s income > 0"\n' "$(printf '!%.0s' $(seq 300))"
+} > "$DEEP"
+rm -rf "$STORE"
+$BIN execute deep.yaml applicants.json > "$OUT" 2>&1 && fail "300 nested '!' compiled"
+grep -q "nested too deeply" "$OUT" || fail "300 nested '!' failed for another reason"
+echo "✅ Loose comparisons match legacy, deep nesting is a compile error"
+
+echo ""
+echo "🔢 Testing rule priorities..."
+cat > "$PRIORITY" << 'EOF'
+rules:
+  - name: "Zero"
+    priority: 0
+    when: "income > 0"
+  - name: "Default"
+    when: "income > 0"
+  - name: "Thousand"
+    priority: 1000
+    when: "income > 0"
+  - name: "Five"
+    priority: 5
+    when: "income > 0"
+EOF
+fresh_execute priority.yaml applicants.json > /dev/null
+# Legacy sorts by priority || 999, so 0 ties with the default.
+order=$(grep -m 4 "Applied" "$OUT" | sed 's/.*Applied: //' | tr '\n' ' ')
+[ "$order" = "Five Zero Default Thousand " ] || fail "rules ran as $order"
+grep -q "Loaded 4 rules$" "$OUT" || fail "no metadata should print no name or version"
+echo "✅ Priority 0 runs as the default 999"
+
+echo ""
+echo "🧱 Testing nested arrays..."
+echo '[{"income": 5, "tags": [1, [2, {"a": "x"}], "s", true, null, -1.5e3, []]}]' > "$ARRAYS"
+fresh_execute loan.yaml arrays.json > /dev/null
+grep -qF '"tags":[1, [2, {"a": "x"}], "s", true, null, -1.5e3, []]' "$OUT" || fail "nested array not kept verbatim"
+for tags in '[1,,2]' '[tru]' '[1,]' '[{"a" 1}]' '["\q"]'; do
+  echo "[{\"income\": 5, \"tags\": $tags}]" > "$ARRAYS"
+  rm -rf "$STORE"
+  $BIN execute loan.yaml arrays.json > "$OUT" 2>&1 && fail "tags $tags was accepted"
+  grep -q "Invalid JSON" "$OUT" || fail "tags $tags failed for another reason"
+done
+echo "✅ Valid arrays kept verbatim, malformed elements rejected"
+
+echo ""
+echo "🔐 Testing audit replay..."
+fresh_execute loan.yaml applicants.json > /dev/null
+execution=$(head_execution)
+$BIN audit "$execution" > "$OUT" 2>&1 || fail "audit $execution failed"
+grep -q "Replay matches the final snapshot" "$OUT" || fail "audit replay of $execution diverged"
+echo "✅ Replay matches for ${execution:0:12}"
+
+echo ""
+echo "🗑️  Testing gc and cat-snapshot..."
+before=$($BIN cat-snapshot "$execution") || fail "cat-snapshot $execution failed"
+$BIN gc > "$OUT" 2>&1 || fail "gc failed"
+after=$($BIN cat-snapshot "$execution") || fail "cat-snapshot $execution failed after gc"
+[ "$before" = "$after" ] || fail "snapshot changed across gc: $before vs $after"
+echo "✅ Snapshot unchanged across gc"
+
+echo ""
+echo "📦 Testing the pack count of a multi-group run..."
+write_records 5000 "$MANY"
+fresh_execute --stream loan.yaml many.jsonl > /dev/null
+groups=$(sed -n 's/.*records in \([0-9]*\) group commits.*/\1/p' "$OUT")
+packs=$(ls "$STORE"/objects/pack/pack-*.idx | wc -l)
+[ "${groups:-0}" -gt 1 ] || fail "many.jsonl ran in ${groups:-no} group commits, expected several"
+[ "$packs" = 1 ] || fail "$groups group commits left $packs packs, expected 1"
+echo "✅ $groups group commits left 1 pack"
+
+echo ""
+echo "📈 Testing --stream memory..."
+if [ -r /proc/self/status ]; then
+  write_records 20000 "$SMALL"
+  write_records 60000 "$BIG"
+  peak_execute --stream loan.yaml small.jsonl
+  small=$PEAK
+  peak_execute --stream loan.yaml big.jsonl
+  big=$PEAK
+  # Per-run state that grew with the input made this about 2.4x.
+  [ "$big" -le $((small * 3 / 2)) ] || fail "peak RSS went from $small kB to $big kB for 3x the records"
+  echo "✅ Peak RSS $small kB for 20000 records, $big kB for 60000"
+else
+  echo "⏭️  No /proc: skipped"
+fi
+
+echo ""
+echo "📚 Testing a large ruleset..."
+awk 'BEGIN {
+  print "rules:"
+  for (i = 0; i < 20000; i++)
+    printf "  - name: \"r%d\"\n    priority: %d\n    when: \"income > %d\"\n    then:\n      o%d: income * 2 + %d\n", i, i, i * 10, i, i
+}' > "$LARGE"
+fresh_execute large.yaml applicants.json > /dev/null
+# income / 10 rules fire per record: 12000 + 6500 + 4500 + 9800.
+applied=$(grep -c "Applied" "$OUT")
+[ "$applied" = 32800 ] || fail "large.yaml applied $applied rules, expected 32800"
+echo "✅ 20000 rules loaded, $applied applied"
 
 echo ""
 echo "✅ All tests passed!"
@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tree.h"
+#include "json.h"
+
+#define TREE_MASK (TREE_FANOUT - 1)
+#define TREE_BITS 4             // log2 of TREE_FANOUT
+#define TREE_NODE_MAX (4 * TREE_FANOUT)
+#define TREE_LEVELS_MAX 8       // index levels over one object
+#define TREE_REF "{\"tree\":"
+#define TREE_REF_LEN (sizeof(TREE_REF) - 1)
+
+typedef struct {
+    uint64_t key;               // hash of the chunk's first key
+    hash_t id;
+} chunk_t;
+
+// Scratch for the objects being cut at one nesting depth.
+typedef struct {
+    buffer_t node;
+    size_t members;             // in node
+    uint64_t first_key;
+    chunk_t* chunks;
+    size_t nchunks;
+    size_t cap;
+} level_t;
+
+struct tree_builder {
+    level_t levels[TREE_DEPTH_MAX];
+    tree_node_fn fn;
+    void* ctx;
+};
+
+error_t tree_builder_create(tree_builder_t** out) {
+    if (!out) return ERR_NULL_PTR;
+    tree_builder_t* b = (tree_builder_t*)calloc(1, sizeof(tree_builder_t));
+    if (!b) return ERR_MALLOC_FAILED;
+    for (size_t i = 0; i < TREE_DEPTH_MAX; i++) buffer_init(&b->levels[i].node);
+    *out = b;
+    return ERR_OK;
+}
+
+void tree_builder_free(tree_builder_t* b) {
+    if (!b) return;
+    for (size_t i = 0; i < TREE_DEPTH_MAX; i++) {
+        buffer_free(&b->levels[i].node);
+        free(b->levels[i].chunks);
+    }
+    free(b);
+}
+
+// FNV-1a over the key as written, quotes and escapes included.
+static uint64_t key_hash(const char* p, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void skip_ws(const char* p, size_t len, size_t* i) {
+    while (*i < len && (p[*i] == ' ' || p[*i] == '\t' || p[*i] == '\n' || p[*i] == '\r')) (*i)++;
+}
+
+// Steps over the string starting at p[*i], quotes included.
+static bool skip_string(const char* p, size_t len, size_t* i) {
+    for (size_t j = *i + 1; j < len; j++) {
+        if (p[j] == '\\') {
+            j++;
+        } else if (p[j] == '"') {
+            *i = j + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Steps over any value starting at p[*i]. Arrays and objects are only
+// matched up; the engine wrote them.
+static bool skip_value(const char* p, size_t len, size_t* i) {
+    if (*i >= len) return false;
+    if (p[*i] == '"') return skip_string(p, len, i);
+    if (p[*i] == '[' || p[*i] == '{') {
+        size_t depth = 0;
+        for (size_t j = *i; j < len; j++) {
+            if (p[j] == '"') {
+                if (!skip_string(p, len, &j)) return false;
+                j--;
+            } else if (p[j] == '[' || p[j] == '{') {
+                depth++;
+            } else if ((p[j] == ']' || p[j] == '}') && --depth == 0) {
+                *i = j + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+    size_t start = *i;
+    while (*i < len && p[*i] != ',' && p[*i] != '}' && p[*i] != ']' && p[*i] != ' ' && p[*i] != '\t' &&
+           p[*i] != '\n' && p[*i] != '\r') {
+        (*i)++;
+    }
+    return *i > start;
+}
+
+static error_t emit(tree_builder_t* b, const buffer_t* node, hash_t id) {
+    error_t err = odb_hash(TREE_TYPE, node->data, node->len, id);
+    if (err == ERR_OK) err = b->fn(b->ctx, id, node->data, node->len);
+    return err;
+}
+
+static error_t push_chunk(level_t* lv, uint64_t key, const hash_t id) {
+    if (lv->nchunks == lv->cap) {
+        size_t cap = lv->cap ? lv->cap * 2 : TREE_FANOUT;
+        chunk_t* chunks = (chunk_t*)realloc(lv->chunks, cap * sizeof(chunk_t));
+        if (!chunks) return ERR_MALLOC_FAILED;
+        lv->chunks = chunks;
+        lv->cap = cap;
+    }
+    lv->chunks[lv->nchunks].key = key;
+    memcpy(lv->chunks[lv->nchunks].id, id, sizeof(hash_t));
+    lv->nchunks++;
+    return ERR_OK;
+}
+
+static error_t end_chunk(tree_builder_t* b, level_t* lv) {
+    hash_t id;
+    error_t err = buffer_append_char(&lv->node, '}');
+    if (err == ERR_OK) err = emit(b, &lv->node, id);
+    if (err == ERR_OK) err = push_chunk(lv, lv->first_key, id);
+    buffer_clear(&lv->node);
+    lv->members = 0;
+    if (err == ERR_OK) err = buffer_append_char(&lv->node, '{');
+    return err;
+}
+
+// Puts index nodes over the chunks, a level at a time, until one is left.
+// Level n cuts on the n-th TREE_BITS of the chunks' first keys; past
+// TREE_LEVELS_MAX everything left goes under one node.
+static error_t index_chunks(tree_builder_t* b, level_t* lv, hash_t root) {
+    error_t err = ERR_OK;
+    for (size_t level = 1; lv->nchunks > 1 && err == ERR_OK; level++) {
+        size_t n = 0, start = 0;
+        for (size_t c = 0; c < lv->nchunks && err == ERR_OK; c++) {
+            bool cut = c + 1 == lv->nchunks;
+            if (!cut && level < TREE_LEVELS_MAX) {
+                cut = c + 1 - start == TREE_NODE_MAX ||
+                      ((lv->chunks[c].key >> (TREE_BITS * level)) & TREE_MASK) == TREE_MASK;
+            }
+            if (!cut) continue;
+            buffer_clear(&lv->node);
+            err = buffer_append_char(&lv->node, '[');
+            for (size_t i = start; i <= c && err == ERR_OK; i++) {
+                if (i > start) err = buffer_append_char(&lv->node, ',');
+                if (err == ERR_OK) err = json_write_hash(&lv->node, lv->chunks[i].id);
+            }
+            if (err == ERR_OK) err = buffer_append_char(&lv->node, ']');
+            hash_t id;
+            if (err == ERR_OK) err = emit(b, &lv->node, id);
+            // n <= start: the entries read above are not overwritten.
+            lv->chunks[n].key = lv->chunks[start].key;
+            memcpy(lv->chunks[n].id, id, sizeof(hash_t));
+            n++;
+            start = c + 1;
+        }
+        lv->nchunks = n;
+    }
+    if (err == ERR_OK) memcpy(root, lv->chunks[0].id, sizeof(hash_t));
+    return err;
+}
+
+// Cuts the object at json[*pos], its nested objects first, and leaves
+// *pos after it.
+static error_t build_object(tree_builder_t* b, size_t depth, const char* p, size_t len, size_t* pos,
+                            hash_t root) {
+    if (depth >= TREE_DEPTH_MAX) return ERR_INVALID_JSON;
+    level_t* lv = &b->levels[depth];
+    buffer_clear(&lv->node);
+    lv->members = 0;
+    lv->nchunks = 0;
+    error_t err = buffer_append_char(&lv->node, '{');
+
+    size_t i = *pos + 1;
+    skip_ws(p, len, &i);
+    bool done = i < len && p[i] == '}';
+    if (done) i++;
+    while (!done && err == ERR_OK) {
+        size_t key = i;
+        if (i >= len || p[i] != '"' || !skip_string(p, len, &i)) return ERR_INVALID_JSON;
+        size_t key_len = i - key;
+        skip_ws(p, len, &i);
+        if (i >= len || p[i] != ':') return ERR_INVALID_JSON;
+        i++;
+        skip_ws(p, len, &i);
+
+        uint64_t h = key_hash(p + key, key_len);
+        if (lv->members == 0) lv->first_key = h;
+        if (lv->members > 0) err = buffer_append_char(&lv->node, ',');
+        if (err == ERR_OK) err = buffer_append(&lv->node, p + key, key_len);
+        if (err == ERR_OK) err = buffer_append_char(&lv->node, ':');
+        if (err == ERR_OK && i < len && p[i] == '{') {
+            hash_t child;
+            err = build_object(b, depth + 1, p, len, &i, child);
+            if (err == ERR_OK) err = buffer_append(&lv->node, TREE_REF, TREE_REF_LEN);
+            if (err == ERR_OK) err = json_write_hash(&lv->node, child);
+            if (err == ERR_OK) err = buffer_append_char(&lv->node, '}');
+        } else if (err == ERR_OK) {
+            size_t value = i;
+            if (!skip_value(p, len, &i)) return ERR_INVALID_JSON;
+            err = buffer_append(&lv->node, p + value, i - value);
+        }
+        if (err != ERR_OK) return err;
+        lv->members++;
+        if ((h & TREE_MASK) == TREE_MASK || lv->members == TREE_NODE_MAX) err = end_chunk(b, lv);
+
+        skip_ws(p, len, &i);
+        if (i < len && p[i] == ',') {
+            i++;
+            skip_ws(p, len, &i);
+        } else if (i < len && p[i] == '}') {
+            i++;
+            done = true;
+        } else {
+            return ERR_INVALID_JSON;
+        }
+    }
+    if (err == ERR_OK && (lv->members > 0 || lv->nchunks == 0)) err = end_chunk(b, lv);
+    if (err == ERR_OK) err = index_chunks(b, lv, root);
+    *pos = i;
+    return err;
+}
+
+error_t tree_build(tree_builder_t* b, const char* json, size_t len, tree_node_fn fn, void* ctx, hash_t root) {
+    if (!b || (!json && len) || !fn || !root) return ERR_NULL_PTR;
+    b->fn = fn;
+    b->ctx = ctx;
+    size_t i = 0;
+    skip_ws(json, len, &i);
+    if (i >= len || json[i] != '{') return ERR_INVALID_JSON;
+    error_t err = build_object(b, 0, json, len, &i, root);
+    if (err != ERR_OK) return err;
+    skip_ws(json, len, &i);
+    return i == len ? ERR_OK : ERR_INVALID_JSON;
+}
+
+// ---------------------------------------------------------------------------
+// Reading
+// ---------------------------------------------------------------------------
+
+// A node's id within it, as json_write_hash wrote it.
+static bool parse_id(const char* p, size_t len, size_t* i, hash_t id) {
+    if (*i + HASH_HEX_LEN + 2 > len || p[*i] != '"' || p[*i + HASH_HEX_LEN + 1] != '"') return false;
+    if (!hash_from_hex(p + *i + 1, HASH_HEX_LEN, id)) return false;
+    *i += HASH_HEX_LEN + 2;
+    return true;
+}
+
+// Appends the members under node id to out, a comma before each but the
+// first of the object. depth bounds nodes nested in nodes.
+static error_t read_members(const odb_t* odb, const hash_t id, size_t depth, bool* first, buffer_t* out) {
+    if (depth >= TREE_DEPTH_MAX * (TREE_LEVELS_MAX + 1)) return ERR_IO;
+    buffer_t node;
+    buffer_init(&node);
+    char type[ODB_TYPE_MAX];
+    error_t err = odb_read(odb, id, type, &node);
+    if (err == ERR_OK && type[0] && strcmp(type, TREE_TYPE) != 0) err = ERR_IO;
+    const char* p = node.data;
+    size_t len = node.len;
+    size_t i = 1;
+    if (err == ERR_OK && len >= 2 && p[0] == '[' && p[len - 1] == ']') {
+        while (err == ERR_OK && i < len - 1) {
+            hash_t child;
+            if (!parse_id(p, len, &i, child) || i >= len || (i != len - 1 && p[i] != ',')) {
+                err = ERR_IO;
+                break;
+            }
+            if (p[i] == ',') i++;
+            err = read_members(odb, child, depth + 1, first, out);
+        }
+    } else if (err == ERR_OK && len >= 2 && p[0] == '{' && p[len - 1] == '}') {
+        while (err == ERR_OK && i < len - 1) {
+            size_t start = i;
+            if (p[i] != '"' || !skip_string(p, len, &i) || i >= len || p[i] != ':') {
+                err = ERR_IO;
+                break;
+            }
+            i++;
+            if (!*first) err = buffer_append_char(out, ',');
+            *first = false;
+            if (err == ERR_OK) err = buffer_append(out, p + start, i - start);
+            if (err != ERR_OK) break;
+            if (len - i > TREE_REF_LEN && memcmp(p + i, TREE_REF, TREE_REF_LEN) == 0) {
+                hash_t child;
+                i += TREE_REF_LEN;
+                if (!parse_id(p, len, &i, child) || i >= len || p[i] != '}') {
+                    err = ERR_IO;
+                    break;
+                }
+                i++;
+                bool child_first = true;
+                err = buffer_append_char(out, '{');
+                if (err == ERR_OK) err = read_members(odb, child, depth + 1, &child_first, out);
+                if (err == ERR_OK) err = buffer_append_char(out, '}');
+            } else {
+                start = i;
+                if (!skip_value(p, len, &i)) {
+                    err = ERR_IO;
+                    break;
+                }
+                err = buffer_append(out, p + start, i - start);
+            }
+            if (err == ERR_OK && i < len - 1 && p[i] == ',') i++;
+            else if (err == ERR_OK && i != len - 1) err = ERR_IO;
+        }
+    } else if (err == ERR_OK) {
+        err = ERR_IO;
+    }
+    buffer_free(&node);
+    return err;
+}
+
+error_t tree_read(const odb_t* odb, const hash_t root, buffer_t* out) {
+    if (!odb || !root || !out) return ERR_NULL_PTR;
+    bool first = true;
+    error_t err = buffer_append_char(out, '{');
+    if (err == ERR_OK) err = read_members(odb, root, 0, &first, out);
+    if (err == ERR_OK) err = buffer_append_char(out, '}');
+    return err;
+}
@@ -0,0 +1,58 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <stddef.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "buffer.h"
+#include "odb.h"
+
+// A record's output state stored as a tree of "tree" objects in the odb,
+// so that the parts of a state that did not change between two snapshots
+// are the same objects and are stored once.
+//
+// Every JSON object of the state is cut into chunks of members. A chunk
+// ends after a member whose key hashes to a boundary (one key in
+// TREE_FANOUT on average), so where the cuts fall depends only on the
+// keys around them: changing a value rewrites its chunk and nothing
+// else, and adding or dropping a field disturbs at most its neighbours.
+// A chunk is stored as a JSON object of its members, a nested object
+// being replaced by a reference {"tree":"<id>"} to its own tree. An
+// object of one chunk is that chunk; several chunks hang under index
+// nodes, JSON arrays of chunk ids, cut the same way one level up, until
+// one node remains. That node's id is the object's.
+//
+// An object member can never be stored inline in a chunk, so a reference
+// is never confused with data, and the first character of a node tells a
+// chunk ('{') from an index node ('[').
+
+#define TREE_TYPE "tree"
+#define TREE_FANOUT 16
+#define TREE_DEPTH_MAX 64       // nested objects
+
+// States shorter than this are not worth cutting: they span a chunk or
+// two, so a tree would share little and cost an object or more each.
+#define TREE_MIN_STATE 1024
+
+typedef struct tree_builder tree_builder_t;
+
+error_t tree_builder_create(tree_builder_t** out);
+void tree_builder_free(tree_builder_t* builder);
+
+// Called for every node of a tree, children before their parents. Nodes
+// shared with other trees, or repeated within one, are passed every time.
+typedef error_t (*tree_node_fn)(void* ctx, const hash_t id, const char* data, size_t len);
+
+// Cuts a JSON object, as engine_write_json writes it, into nodes and
+// sets root to the id of its top node. Returns ERR_INVALID_JSON if json
+// is not an object, or whatever fn returned if it stopped the walk.
+error_t tree_build(tree_builder_t* builder, const char* json, size_t len, tree_node_fn fn, void* ctx,
+                   hash_t root);
+
+// Appends the JSON object whose tree root is root to out, without
+// whitespace: for engine_write_json output, byte for byte what tree_build
+// was given. Returns ERR_FILE_NOT_FOUND if a node is
+// missing and ERR_IO if one is malformed.
+error_t tree_read(const odb_t* odb, const hash_t root, buffer_t* out);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// Non-owning byte slice. Used for names and strings that live in a
+// buffer owned by someone else (rules file, data file, program).
+typedef struct {
+    const char* ptr;
+    size_t len;
+} str_t;
+
+#define STR_LIT(s) ((str_t){ (s), sizeof(s) - 1 })
+
+typedef enum {
+    VAL_NULL = 0,
+    VAL_BOOL = 1,
+    VAL_NUM = 2,
+    VAL_STR = 3,
+    VAL_RAW = 4,   // verbatim JSON (arrays); opaque to expressions
+} value_type_t;
+
+// Dynamically typed rule value. Numbers are doubles to match the
+// legacy engine's JavaScript semantics. VAL_STR and VAL_RAW use `str`.
+typedef struct {
+    value_type_t type;
+    union {
+        bool b;
+        double num;
+        str_t str;
+    } as;
+} value_t;
+
+static inline value_t value_null(void) {
+    value_t v;
+    v.type = VAL_NULL;
+    v.as.num = 0.0;
+    return v;
+}
+
+static inline value_t value_bool(bool b) {
+    value_t v;
+    v.type = VAL_BOOL;
+    v.as.b = b;
+    return v;
+}
+
+static inline value_t value_num(double num) {
+    value_t v;
+    v.type = VAL_NUM;
+    v.as.num = num;
+    return v;
+}
+
+static inline value_t value_str(str_t str) {
+    value_t v;
+    v.type = VAL_STR;
+    v.as.str = str;
+    return v;
+}
+
+// One named field of a flat record. Nested objects are flattened to
+// dotted paths (`applicant.income`).
+typedef struct {
+    str_t name;
+    value_t value;
+} field_t;
+
+static inline bool str_eq(str_t a, str_t b) {
+    return a.len == b.len && (a.len == 0 || memcmp(a.ptr, b.ptr, a.len) == 0);
+}
+
+#endif
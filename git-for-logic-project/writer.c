@@ -0,0 +1,428 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "writer.h"
+#include "tree.h"
+
+// Queue links are intrusive: a record or a flush barrier starts with a
+// node_t. The queue is Vyukov's MPSC list: a producer swaps itself in as
+// the head with one atomic exchange, then links the old head to itself;
+// the writer walks from the tail. A producer preempted between the two
+// steps leaves the list briefly unlinked, which the writer sees as
+// "nothing yet" and retries.
+
+#define WRITER_MIN_RECORD 256
+#define WRITER_SPARE_MAX WRITER_GROUP_MAX
+
+enum { NODE_STUB, NODE_RECORD, NODE_BARRIER };
+
+typedef struct node {
+    struct node* next;          // atomic
+    int kind;
+} node_t;
+
+typedef struct record {
+    node_t node;
+    struct record* next_in_group;
+    hash_t commit;
+    hash_t parent;
+    bool has_parent;
+    execution_t result;         // its arrays and JSON point into data
+    const char* content;        // commit object, also in data
+    size_t len;
+    size_t cap;                 // bytes of data
+    // Changes ends, applied indices, output JSON, input JSON, changes,
+    // commit object
+    _Alignas(max_align_t) uint8_t data[];
+} record_t;
+
+typedef struct {
+    node_t node;
+    bool done;                  // guarded by writer->lock
+} barrier_t;
+
+struct writer {
+    odb_t* odb;
+    state_db_t* db;
+    pack_writer_t* pack;        // opened by the first new object
+    hash_t last_pack;           // the last pack published
+    compressor_t* compressor;
+    tree_builder_t* trees;
+    size_t nodes;               // new tree nodes
+    int sync_fd;
+    durable_fn on_durable;
+    void* ctx;
+
+    node_t* head;               // atomic, swapped by producers
+    node_t* tail;               // writer only
+    node_t stub;
+    size_t pushed;              // atomic: pushes that have linked their node
+    size_t popped;              // writer only
+    int sleeping;               // atomic: writer is (about to be) waiting
+
+    record_t* group;            // persisted, waiting for the group's sync
+    record_t** group_end;
+    size_t ngroup;
+    error_t group_err;
+
+    // Records of durable groups, for writer_submit to reuse instead of
+    // allocating one per record on the submitting thread and freeing it
+    // on this one.
+    pthread_mutex_t spare_lock;
+    record_t* spare;            // linked by next_in_group
+    size_t nspare;
+
+    pthread_t thread;
+    pthread_mutex_t lock;       // guards stop, err and barrier done flags
+    pthread_cond_t wake;        // writer: work or stop
+    pthread_cond_t acked;       // producers: records made durable
+    bool stop;
+    size_t durable;             // atomic: records acknowledged
+    error_t err;
+    size_t groups;
+};
+
+static void link_node(writer_t* w, node_t* n) {
+    __atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+    node_t* prev = __atomic_exchange_n(&w->head, n, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+static void push(writer_t* w, node_t* n) {
+    link_node(w, n);
+    __atomic_add_fetch(&w->pushed, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static node_t* pop(writer_t* w) {
+    node_t* tail = w->tail;
+    node_t* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &w->stub) {
+        if (!next) return NULL;
+        w->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (!next) {
+        if (tail != __atomic_load_n(&w->head, __ATOMIC_ACQUIRE)) return NULL;
+        // tail is the last node: queue the stub behind it so tail can go.
+        link_node(w, &w->stub);
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+        if (!next) return NULL;
+    }
+    w->tail = next;
+    w->popped++;
+    return tail;
+}
+
+static error_t sync_repo(writer_t* w) {
+#ifdef SYS_syncfs
+    if (syscall(SYS_syncfs, w->sync_fd) != 0) return ERR_IO;
+#else
+    sync();
+#endif
+    return ERR_OK;
+}
+
+// Adds an object to the run's pack unless it is stored already.
+static error_t pack_object(writer_t* w, const char* type, const char* data, size_t len, const hash_t id,
+                           bool* added) {
+    *added = false;
+    if (pack_writer_contains(w->pack, id) || odb_exists(w->odb, id)) return ERR_OK;
+    odb_mark(w->odb, id);
+    if (!w->pack) {
+        error_t err = pack_writer_open(&w->pack, w->odb->dir);
+        if (err != ERR_OK) return err;
+        pack_writer_set_compressor(w->pack, w->compressor);
+    }
+    *added = true;
+    return pack_writer_add(w->pack, type, data, len, id, true);
+}
+
+static error_t store_node(void* ctx, const hash_t id, const char* data, size_t len) {
+    writer_t* w = (writer_t*)ctx;
+    bool added;
+    error_t err = pack_object(w, TREE_TYPE, data, len, id, &added);
+    w->nodes += added;
+    return err;
+}
+
+// Stores a state as a tree if it is big enough; *tree is then set to root.
+static error_t state_tree(writer_t* w, str_t json, hash_t root, const uint8_t** tree) {
+    if (json.len < TREE_MIN_STATE) return ERR_OK;
+    *tree = root;
+    return tree_build(w->trees, json.ptr, json.len, store_node, w, root);
+}
+
+static void persist(writer_t* w, record_t* r) {
+    *w->group_end = r;
+    w->group_end = &r->next_in_group;
+    w->ngroup++;
+    if (w->group_err != ERR_OK || w->err != ERR_OK) return;
+
+    // Commits carry no timestamp, so rerunning the same data yields
+    // commits that are already stored. Of a state's tree only the nodes
+    // that changed since any earlier snapshot, the record's input
+    // included, are new.
+    bool added;
+    hash_t input, output;
+    const uint8_t* input_tree = NULL;
+    const uint8_t* output_tree = NULL;
+    error_t err = pack_object(w, "commit", r->content, r->len, r->commit, &added);
+    if (err == ERR_OK && w->db) err = state_tree(w, r->result.input_json, input, &input_tree);
+    if (err == ERR_OK && w->db) err = state_tree(w, r->result.output_json, output, &output_tree);
+    if (err == ERR_OK && w->db) err = state_db_record(w->db, &r->result, r->commit,
+                                                      r->has_parent ? r->parent : NULL, input_tree, output_tree);
+    w->group_err = err;
+}
+
+static void free_records(record_t* r) {
+    while (r) {
+        record_t* next = r->next_in_group;
+        free(r);
+        r = next;
+    }
+}
+
+// Publishes the group's objects as a pack, commits the group's
+// transaction, syncs once, then acknowledges every record of the group
+// and keeps their memory for reuse. The pack is in place and synced
+// before any row naming its objects is committed, so a crash never
+// leaves a committed row whose objects are in an unindexed file.
+static void end_group(writer_t* w) {
+    if (w->ngroup == 0) return;
+    error_t err = w->err != ERR_OK ? w->err : w->group_err;
+    if (err == ERR_OK && w->pack) err = pack_writer_publish(w->pack, w->last_pack);
+    if (err == ERR_OK && w->db) err = state_db_flush(w->db);
+    if (err == ERR_OK) err = sync_repo(w);
+
+    size_t n = w->ngroup;
+    for (record_t* r = w->group; r; r = r->next_in_group) {
+        if (w->on_durable) w->on_durable(w->ctx, r->commit, err);
+    }
+    pthread_mutex_lock(&w->spare_lock);
+    if (w->nspare < WRITER_SPARE_MAX) {
+        *w->group_end = w->spare;
+        w->spare = w->group;
+        w->nspare += n;
+        w->group = NULL;
+    }
+    pthread_mutex_unlock(&w->spare_lock);
+    free_records(w->group);
+    w->group = NULL;
+    w->group_end = &w->group;
+    w->ngroup = 0;
+    w->group_err = ERR_OK;
+
+    pthread_mutex_lock(&w->lock);
+    if (err != ERR_OK && w->err == ERR_OK) w->err = err;
+    w->groups++;
+    __atomic_add_fetch(&w->durable, n, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&w->acked);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void* writer_main(void* arg) {
+    writer_t* w = (writer_t*)arg;
+    for (;;) {
+        node_t* node = pop(w);
+        if (node && node->kind == NODE_RECORD) {
+            persist(w, (record_t*)node);
+            if (w->ngroup == WRITER_GROUP_MAX) end_group(w);
+            continue;
+        }
+        if (node) {
+            end_group(w);
+            pthread_mutex_lock(&w->lock);
+            ((barrier_t*)node)->done = true;
+            pthread_cond_broadcast(&w->acked);
+            pthread_mutex_unlock(&w->lock);
+            continue;
+        }
+        if (w->popped != __atomic_load_n(&w->pushed, __ATOMIC_SEQ_CST)) continue;   // mid-push
+
+        // Drained: whatever arrived while the last group synced is the
+        // next group.
+        end_group(w);
+        pthread_mutex_lock(&w->lock);
+        __atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (!w->stop && w->popped == __atomic_load_n(&w->pushed, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&w->wake, &w->lock);
+        }
+        __atomic_store_n(&w->sleeping, 0, __ATOMIC_SEQ_CST);
+        bool done = w->stop && w->popped == __atomic_load_n(&w->pushed, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&w->lock);
+        if (done) break;
+    }
+    return NULL;
+}
+
+error_t writer_start(writer_t** out, odb_t* odb, state_db_t* db, compressor_t* compressor,
+                     durable_fn on_durable, void* ctx) {
+    if (!out || !odb) return ERR_NULL_PTR;
+    writer_t* w = (writer_t*)calloc(1, sizeof(writer_t));
+    if (!w) return ERR_MALLOC_FAILED;
+    if (tree_builder_create(&w->trees) != ERR_OK) {
+        free(w);
+        return ERR_MALLOC_FAILED;
+    }
+    w->sync_fd = open(odb->dir, O_RDONLY | O_DIRECTORY);
+    if (w->sync_fd < 0) {
+        tree_builder_free(w->trees);
+        free(w);
+        return ERR_IO;
+    }
+    w->odb = odb;
+    w->db = db;
+    w->compressor = compressor;
+    w->on_durable = on_durable;
+    w->ctx = ctx;
+    w->stub.kind = NODE_STUB;
+    w->head = &w->stub;
+    w->tail = &w->stub;
+    w->group_end = &w->group;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_mutex_init(&w->spare_lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->acked, NULL);
+    if (db) state_db_set_compressor(db, compressor);
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        if (db) state_db_set_compressor(db, NULL);
+        pthread_cond_destroy(&w->acked);
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->spare_lock);
+        pthread_mutex_destroy(&w->lock);
+        close(w->sync_fd);
+        tree_builder_free(w->trees);
+        free(w);
+        return ERR_MALLOC_FAILED;
+    }
+    *out = w;
+    return ERR_OK;
+}
+
+// Copies s to *p and advances *p past it.
+static uint8_t* copy_str(uint8_t** p, str_t s) {
+    uint8_t* start = *p;
+    if (s.len) memcpy(start, s.ptr, s.len);
+    *p += s.len;
+    return start;
+}
+
+// Reuses a spare record if it is big enough. New ones get a power of two
+// of room, so that spares soon fit records of any usual size.
+static record_t* take_record(writer_t* w, size_t size) {
+    pthread_mutex_lock(&w->spare_lock);
+    record_t* r = w->spare;
+    if (r) {
+        w->spare = r->next_in_group;
+        w->nspare--;
+    }
+    pthread_mutex_unlock(&w->spare_lock);
+    if (r && r->cap >= size) return r;
+    free(r);
+    size_t cap = WRITER_MIN_RECORD;
+    while (cap < size && cap <= SIZE_MAX / 2) cap *= 2;
+    if (cap < size || cap > SIZE_MAX - sizeof(record_t)) return NULL;
+    r = (record_t*)malloc(sizeof(record_t) + cap);
+    if (r) r->cap = cap;
+    return r;
+}
+
+error_t writer_submit(writer_t* w, const char* content, size_t len, const hash_t commit,
+                      const uint8_t* parent, const execution_t* result) {
+    if (!w || !content || !result) return ERR_NULL_PTR;
+
+    // Backpressure: wait for the disk rather than queueing without bound.
+    if (__atomic_load_n(&w->pushed, __ATOMIC_RELAXED) - __atomic_load_n(&w->durable, __ATOMIC_ACQUIRE) >=
+        WRITER_MAX_PENDING) {
+        pthread_mutex_lock(&w->lock);
+        while (w->err == ERR_OK && __atomic_load_n(&w->pushed, __ATOMIC_RELAXED) -
+               __atomic_load_n(&w->durable, __ATOMIC_ACQUIRE) >= WRITER_MAX_PENDING) {
+            pthread_cond_wait(&w->acked, &w->lock);
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    size_t ends = result->napplied * sizeof(size_t);
+    size_t applied = result->napplied * sizeof(uint32_t);
+    size_t json = result->output_json.len + result->input_json.len + result->changes.len;
+    record_t* r = take_record(w, ends + applied + json + len);
+    if (!r) return ERR_MALLOC_FAILED;
+    r->node.kind = NODE_RECORD;
+    r->next_in_group = NULL;
+    memcpy(r->commit, commit, sizeof(hash_t));
+    r->has_parent = parent != NULL;
+    if (parent) memcpy(r->parent, parent, sizeof(hash_t));
+    r->result = *result;
+    r->result.state = NULL;
+    r->result.nstate = 0;
+    uint8_t* p = r->data;
+    if (ends) memcpy(p, result->changes_end, ends);
+    r->result.changes_end = (const size_t*)p;
+    p += ends;
+    if (applied) memcpy(p, result->applied, applied);
+    r->result.applied = (const uint32_t*)p;
+    p += applied;
+    r->result.output_json.ptr = (const char*)copy_str(&p, result->output_json);
+    r->result.input_json.ptr = (const char*)copy_str(&p, result->input_json);
+    r->result.changes.ptr = (const char*)copy_str(&p, result->changes);
+    memcpy(p, content, len);
+    r->content = (const char*)p;
+    r->len = len;
+    push(w, &r->node);
+    return ERR_OK;
+}
+
+error_t writer_flush(writer_t* w) {
+    if (!w) return ERR_NULL_PTR;
+    barrier_t barrier = { { NULL, NODE_BARRIER }, false };
+    push(w, &barrier.node);
+    pthread_mutex_lock(&w->lock);
+    while (!barrier.done) pthread_cond_wait(&w->acked, &w->lock);
+    error_t err = w->err;
+    pthread_mutex_unlock(&w->lock);
+    return err;
+}
+
+error_t writer_stop(writer_t* w, writer_stats_t* stats) {
+    if (!w) return ERR_NULL_PTR;
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    if (w->db) state_db_set_compressor(w->db, NULL);
+
+    error_t err = w->err;
+    writer_stats_t done = { w->groups, pack_writer_count(w->pack), pack_writer_deltas(w->pack),
+                            pack_writer_compressed(w->pack), w->nodes, { 0 } };
+    memcpy(done.pack, w->last_pack, sizeof(hash_t));
+    // Every group has published its pack; this merges them into one and
+    // drops the empty pack started after the last.
+    if (w->pack && err == ERR_OK) {
+        err = pack_writer_finish(w->pack, done.pack);
+    } else {
+        pack_writer_abort(w->pack);
+    }
+    if (stats) *stats = done;
+    pthread_cond_destroy(&w->acked);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->spare_lock);
+    pthread_mutex_destroy(&w->lock);
+    close(w->sync_fd);
+    tree_builder_free(w->trees);
+    free_records(w->spare);
+    free(w);
+    return err;
+}
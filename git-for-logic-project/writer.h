@@ -0,0 +1,81 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include "git_for_logic.h"
+#include "hash.h"
+#include "odb.h"
+#include "pack.h"
+#include "statedb.h"
+#include "execute.h"
+
+// Persistence thread for committed records. Evaluating threads hand each
+// record (its commit object and its state.db rows) to writer_submit, which
+// copies it onto a lock-free multi-producer / single-consumer queue and
+// returns without touching the disk. The writer thread drains the queue in
+// groups: it writes the group's new commit objects into a pack (pack.h),
+// each a delta against the commit before it where that is smaller, and
+// publishes that pack, synced and indexed, before it commits the group's
+// rows in one state.db transaction. A single syncfs() of the
+// repository's filesystem then makes the whole group durable. Only then
+// is each record acknowledged through the durable_fn callback, and its
+// copy kept for a later writer_submit to reuse, so that a steady run
+// stops allocating. The pack writer merges the group packs as they pile
+// up and into one when the writer stops, so a run leaves a single pack
+// whatever its number of groups.
+//
+// With a state.db, the writer thread also stores each record's input and
+// output states of TREE_MIN_STATE bytes or more as trees (tree.h): only
+// the nodes no earlier snapshot shares go into the pack, and the snapshot
+// rows hold the trees' roots. Smaller states go into their rows whole.
+//
+// Given a compressor, the writer thread compresses the objects it does
+// not store as deltas with it.
+//
+// Submitters block only if WRITER_MAX_PENDING records are waiting to be
+// made durable, so a slow disk applies backpressure instead of growing
+// the queue without bound. Nothing else the writer keeps grows with the
+// run either: the pack writer holds the current group's entries and a
+// fixed table of recent ids, and the tree builder the state being cut. A
+// --stream run's peak memory therefore levels off after a few groups,
+// whatever the size of its input.
+
+#define WRITER_GROUP_MAX 1024
+#define WRITER_MAX_PENDING (4 * WRITER_GROUP_MAX)
+
+// Runs on the writer thread once per record, in submission order, after
+// the record's group has been synced (err is ERR_OK) or has failed.
+typedef void (*durable_fn)(void* ctx, const hash_t commit, error_t err);
+
+typedef struct writer writer_t;
+
+typedef struct {
+    size_t groups;              // group commits
+    size_t packed;              // objects written to the run's packs
+    size_t deltas;              // of which stored as deltas
+    size_t compressed;          // of which stored compressed
+    size_t nodes;               // of which state tree nodes
+    hash_t pack;                // the run's pack, if anything was packed
+} writer_stats_t;
+
+// db, compressor and on_durable may be NULL. The compressor is used until
+// writer_stop returns.
+error_t writer_start(writer_t** out, odb_t* odb, state_db_t* db, compressor_t* compressor,
+                     durable_fn on_durable, void* ctx);
+
+// Queues one committed record. content is the commit object; parent is
+// NULL for a root commit. Safe to call from any number of threads.
+error_t writer_submit(writer_t* writer, const char* content, size_t len, const hash_t commit,
+                      const uint8_t* parent, const execution_t* result);
+
+// Blocks until everything this thread submitted before the call is
+// durable. Returns the first write error so far.
+error_t writer_flush(writer_t* writer);
+
+// Makes everything durable, joins the writer thread and frees the writer.
+// stats may be NULL. Returns the first write error; the pack of the group
+// that failed is discarded, and the packs of the groups before it are
+// left unmerged.
+error_t writer_stop(writer_t* writer, writer_stats_t* stats);
+
+#endif